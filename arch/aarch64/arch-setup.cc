@@ -249,21 +249,21 @@ void arch_init_drivers()
     drvman->register_driver(virtio::balloon::probe);
 #endif
 #if CONF_drivers_virtio_blk
-    drvman->register_driver(virtio::blk::probe);
+    drvman->register_driver(virtio::blk::probe, hw::probe_chain_virtio_disk);
 #endif
 #if CONF_drivers_virtio_scsi
-    drvman->register_driver(virtio::scsi::probe);
+    drvman->register_driver(virtio::scsi::probe, hw::probe_chain_virtio_disk);
 #endif
 #if CONF_networking_stack
 #if CONF_drivers_virtio_net
-    drvman->register_driver(virtio::net::probe);
+    drvman->register_driver(virtio::net::probe, hw::probe_chain_virtio_net);
 #endif
 #endif
 #if CONF_drivers_virtio_fs
-    drvman->register_driver(virtio::fs::probe);
+    drvman->register_driver(virtio::fs::probe, hw::probe_chain_virtio_fs);
 #endif
 #if CONF_drivers_nvme
-    drvman->register_driver(nvme::driver::probe);
+    drvman->register_driver(nvme::driver::probe, hw::probe_chain_nvme);
 #endif
     boot_time.event("drivers probe");
     drvman->load_all();
@@ -123,6 +123,44 @@ void flush_tlb_local() {
     asm volatile("dsb sy; tlbi vmalle1; dsb sy; isb;");
 }
 
+// The operand of TLBI by address is bits 55:12 of the address
+static inline u64 tlbi_va(uintptr_t addr)
+{
+    return (addr >> page_size_shift) & ((1ull << 44) - 1);
+}
+
+// The inner shareable TLBI variants are broadcast to all cpus by the
+// hardware, so there is no shootdown to batch here beyond issuing a single
+// barrier for the whole batch.
+void flush_tlb(const tlb_batch& batch)
+{
+    if (batch.empty()) {
+        return;
+    }
+    if (batch.all) {
+        flush_tlb_all();
+        return;
+    }
+    asm volatile("dsb ishst" ::: "memory");
+    for (unsigned i = 0; i < batch.nr; i++) {
+        asm volatile("tlbi vaae1is, %0" :: "r"(tlbi_va(batch.addrs[i])) : "memory");
+    }
+    asm volatile("dsb ish; isb" ::: "memory");
+}
+
+void flush_tlb_local(const tlb_batch& batch)
+{
+    if (batch.all) {
+        flush_tlb_local();
+        return;
+    }
+    asm volatile("dsb nshst" ::: "memory");
+    for (unsigned i = 0; i < batch.nr; i++) {
+        asm volatile("tlbi vaae1, %0" :: "r"(tlbi_va(batch.addrs[i])) : "memory");
+    }
+    asm volatile("dsb nsh; isb" ::: "memory");
+}
+
 static pt_element<4> page_table_root[2] __attribute__((init_priority((int)init_prio::pt_root)));
 u64 mem_addr;
 
@@ -9,43 +9,105 @@
 #include "drivers/clock.hh"
 #include "exceptions.hh"
 #include "apic.hh"
+#include "msr.hh"
+#include "cpuid.hh"
+#include <osv/percpu.hh>
+#include <osv/sched.hh>
+#include <atomic>
 
 using namespace processor;
 
+// The timer is first armed in one-shot mode, through the initial count
+// register. When the cpu supports it, each cpu then moves to TSC-deadline
+// mode, where arming the timer is a single write of the absolute TSC value
+// to fire at, as soon as the TSC frequency is known. That is only after
+// the clock is fully set up, well after the timer is first needed.
 class apic_clock_events : public clock_event_driver {
 public:
     explicit apic_clock_events();
     ~apic_clock_events();
     virtual void setup_on_cpu();
     virtual void set(std::chrono::nanoseconds nanos);
+private:
+    void find_tsc_frequency();
+    void enter_tsc_deadline_mode();
 private:
     unsigned _vector;
+    // TSC ticks per nanosecond, as a 32.32 fixed point number, 0 while
+    // it is not known
+    std::atomic<u64> _tsc_mult;
+    static percpu<bool> _tsc_deadline_mode;
 };
 
+PERCPU(bool, apic_clock_events::_tsc_deadline_mode);
+
+constexpr u32 lvtt_tsc_deadline = 2 << 17;
+
 apic_clock_events::apic_clock_events()
     : _vector(idt.register_handler([this] { _callback->fired(); }))
+    , _tsc_mult(0)
 {
+    if (processor::features().tsc_deadline) {
+        auto t = sched::thread::make([this] { find_tsc_frequency(); },
+            sched::thread::attr().name("tsc_deadline_init"));
+        t->start();
+    }
 }
 
 apic_clock_events::~apic_clock_events()
 {
 }
 
+// The clock knows how to convert TSC ticks to nanoseconds once it is set
+// up: directly for kvmclock, and after calibration for the TSC clock.
+// Without any of them, the timer stays in one-shot mode.
+void apic_clock_events::find_tsc_frequency()
+{
+    for (int i = 0; i < 500; i++) {
+        u64 ns = ::clock::get()->processor_to_nano(1ull << 32);
+        if (ns) {
+            _tsc_mult.store(((unsigned __int128)1 << 64) / ns, std::memory_order_release);
+            return;
+        }
+        sched::thread::sleep(std::chrono::milliseconds(10));
+    }
+}
+
 void apic_clock_events::setup_on_cpu()
 {
+    *_tsc_deadline_mode = false;
     processor::apic->write(apicreg::TMDCR, 0xb); // divide by 1
     processor::apic->write(apicreg::TMICT, 0);
     processor::apic->write(apicreg::LVTT, _vector); // one-shot
 }
 
+void apic_clock_events::enter_tsc_deadline_mode()
+{
+    processor::apic->write(apicreg::TMICT, 0);
+    processor::apic->write(apicreg::LVTT, _vector | lvtt_tsc_deadline);
+    // In xAPIC mode, the LVTT write must be globally visible before the
+    // deadline is written, or the timer may not fire
+    asm volatile ("mfence" : : : "memory");
+    *_tsc_deadline_mode = true;
+}
+
 void apic_clock_events::set(std::chrono::nanoseconds nanos)
 {
     if (nanos.count() <= 0) {
         _callback->fired();
-    } else {
-        // FIXME: handle overflow
-        apic->write(apicreg::TMICT, nanos.count());
+        return;
+    }
+    if (!*_tsc_deadline_mode) {
+        if (!_tsc_mult.load(std::memory_order_relaxed)) {
+            // FIXME: handle overflow
+            apic->write(apicreg::TMICT, nanos.count());
+            return;
+        }
+        enter_tsc_deadline_mode();
     }
+    u64 ticks = ((unsigned __int128)nanos.count() *
+                 _tsc_mult.load(std::memory_order_relaxed)) >> 32;
+    processor::wrmsr(msr::IA32_TSC_DEADLINE, processor::rdtsc() + ticks);
 }
 
 void __attribute__((constructor)) init_apic_clock()
@@ -143,6 +143,12 @@ void arch_setup_free_memory()
         }
     }
 
+    // Let the linear map (and MAP_HUGE_1GB mappings) use 1GB pages when
+    // the cpu, or what the hypervisor exposes of it, supports them
+    if (processor::features().gbpage) {
+        mmu::set_nr_page_sizes(3);
+    }
+
     setup_temporary_phys_map();
 
     // setup all memory up to 1GB.  We can't free any more, because no
@@ -354,14 +360,14 @@ void arch_init_drivers()
     // Initialize all drivers
     hw::driver_manager* drvman = hw::driver_manager::instance();
 #if CONF_drivers_virtio_blk
-    drvman->register_driver(virtio::blk::probe);
+    drvman->register_driver(virtio::blk::probe, hw::probe_chain_virtio_disk);
 #endif
 #if CONF_drivers_virtio_scsi
-    drvman->register_driver(virtio::scsi::probe);
+    drvman->register_driver(virtio::scsi::probe, hw::probe_chain_virtio_disk);
 #endif
 #if CONF_networking_stack
 #if CONF_drivers_virtio_net
-    drvman->register_driver(virtio::net::probe);
+    drvman->register_driver(virtio::net::probe, hw::probe_chain_virtio_net);
 #endif
 #endif
 #if CONF_drivers_virtio_rng
@@ -371,7 +377,7 @@ void arch_init_drivers()
     drvman->register_driver(virtio::balloon::probe);
 #endif
 #if CONF_drivers_virtio_fs
-    drvman->register_driver(virtio::fs::probe);
+    drvman->register_driver(virtio::fs::probe, hw::probe_chain_virtio_fs);
 #endif
 #if CONF_drivers_xen
     drvman->register_driver(xenfront::xenplatform_pci::probe);
@@ -396,7 +402,7 @@ void arch_init_drivers()
 #endif
 #endif
 #if CONF_drivers_nvme
-    drvman->register_driver(nvme::driver::probe);
+    drvman->register_driver(nvme::driver::probe, hw::probe_chain_nvme);
 #endif
     boot_time.event("drivers probe");
     drvman->load_all();
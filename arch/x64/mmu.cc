@@ -54,68 +54,116 @@ void flush_tlb_local() {
     processor::write_cr3(processor::read_cr3());
 }
 
-// tlb_flush() does TLB flush on *all* processors, not returning before all
-// processors confirm flushing their TLB. This is slow, but necessary for
-// correctness so that, for example, after mprotect() returns, no thread on
-// no cpu can write to the protected page.
-mutex tlb_flush_mutex;
-sched::thread_handle tlb_flush_waiter;
-std::atomic<int> tlb_flush_pendingconfirms;
+void flush_tlb_local(const tlb_batch& batch)
+{
+    if (batch.all) {
+        flush_tlb_local();
+        return;
+    }
+    for (unsigned i = 0; i < batch.nr; i++) {
+        processor::invlpg(reinterpret_cast<void*>(batch.addrs[i]));
+    }
+}
+
+// flush_tlb() invalidates a batch of translations on *all* processors, not
+// returning before all processors confirm it. This is slow, but necessary
+// for correctness so that, for example, after mprotect() returns, no thread
+// on no cpu can write to the protected page.
+//
+// Concurrent flushes do not wait for each other: every flush is a request,
+// living on its caller's stack, which gets pushed on the queue of each cpu
+// it targets. The IPI handler runs all the requests queued on its cpu, and
+// the last cpu to get to a request wakes its caller up. A cpu is only sent
+// an IPI when its queue was empty, otherwise one is already on its way.
+struct tlb_flush_request {
+    const tlb_batch* batch;
+    std::atomic<int> pending;
+    sched::thread_handle waiter;
+    // next request in each target cpu's queue
+    tlb_flush_request* next[sched::max_cpus];
+};
+
+static std::atomic<tlb_flush_request*> tlb_flush_queue[sched::max_cpus];
 
 inter_processor_interrupt tlb_flush_ipi{IPI_TLB_FLUSH, [] {
-        mmu::flush_tlb_local();
-        if (tlb_flush_pendingconfirms.fetch_add(-1) == 1) {
-            tlb_flush_waiter.wake_from_kernel_or_with_irq_disabled();
+        auto id = sched::cpu::current()->id;
+        auto req = tlb_flush_queue[id].exchange(nullptr, std::memory_order_acquire);
+        while (req) {
+            // Once pending drops to zero, the request may be gone, so get
+            // everything we need from it first.
+            auto next = req->next[id];
+            flush_tlb_local(*req->batch);
+            sched::thread_handle waiter(req->waiter);
+            if (req->pending.fetch_add(-1, std::memory_order_release) == 1) {
+                waiter.wake_from_kernel_or_with_irq_disabled();
+            }
+            req = next;
         }
 }};
 
-void flush_tlb_all()
+void flush_tlb(const tlb_batch& batch)
 {
-    static std::vector<sched::cpu*> ipis(sched::max_cpus);
-
+    if (batch.empty()) {
+        return;
+    }
     if (sched::cpus.size() <= 1) {
-        mmu::flush_tlb_local();
+        flush_tlb_local(batch);
         return;
     }
 
     SCOPE_LOCK(migration_lock);
-    mmu::flush_tlb_local();
-    std::lock_guard<mutex> guard(tlb_flush_mutex);
-    tlb_flush_waiter.reset(*sched::thread::current());
-    int count;
-    if (sched::thread::current()->is_app()) {
-        ipis.clear();
-        std::copy_if(sched::cpus.begin(), sched::cpus.end(), std::back_inserter(ipis),
-                [](sched::cpu* c) {
-            if (c == sched::cpu::current()) {
-                return false;
-            }
-
+    flush_tlb_local(batch);
+    auto current = sched::cpu::current();
+    bool app = sched::thread::current()->is_app();
+    sched::cpu* targets[sched::max_cpus];
+    int count = 0;
+    for (auto c : sched::cpus) {
+        if (c == current) {
+            continue;
+        }
+        if (app) {
+            // A cpu running a kernel thread cannot touch application
+            // memory, so let it do a full flush when it switches back to an
+            // application thread rather than interrupting it now.
             c->lazy_flush_tlb.store(true, std::memory_order_relaxed);
             if (!c->app_thread.load(std::memory_order_seq_cst)) {
-                return false;
+                continue;
             }
             if (!c->lazy_flush_tlb.exchange(false, std::memory_order_relaxed)) {
-                return false;
+                continue;
             }
-            return true;
-        });
-        count = ipis.size();
-    } else {
-        count = sched::cpus.size() - 1;
+        }
+        targets[count++] = c;
+    }
+    if (!count) {
+        return;
     }
-    tlb_flush_pendingconfirms.store(count);
-    if (count == (int)sched::cpus.size() - 1) {
-        tlb_flush_ipi.send_allbutself();
-    } else {
-        for (auto&& c: ipis) {
-            tlb_flush_ipi.send(c);
+
+    tlb_flush_request req;
+    req.batch = &batch;
+    req.pending.store(count, std::memory_order_relaxed);
+    req.waiter.reset(*sched::thread::current());
+    for (int i = 0; i < count; i++) {
+        auto id = targets[i]->id;
+        auto head = tlb_flush_queue[id].load(std::memory_order_relaxed);
+        do {
+            req.next[id] = head;
+        } while (!tlb_flush_queue[id].compare_exchange_weak(head, &req,
+                    std::memory_order_release, std::memory_order_relaxed));
+        if (!head) {
+            tlb_flush_ipi.send(targets[i]);
         }
     }
-    sched::thread::wait_until([] {
-            return tlb_flush_pendingconfirms.load() == 0;
+    sched::thread::wait_until([&req] {
+            return req.pending.load(std::memory_order_acquire) == 0;
     });
-    tlb_flush_waiter.clear();
+}
+
+void flush_tlb_all()
+{
+    tlb_batch all;
+    all.add_all();
+    flush_tlb(all);
 }
 
 static pt_element<4> page_table_root __attribute__((init_priority((int)init_prio::pt_root)));
@@ -180,6 +228,8 @@ bool fast_sigsegv_check(uintptr_t addr, exception_frame* ef)
         void pte(pt_element<1> pte) override {
             // large ptes are never cow yet
         }
+        void pte(pt_element<2> pte) override {
+        }
     } visitor;
 
     // if page is present, but write protected without cow bit set
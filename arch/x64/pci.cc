@@ -8,6 +8,8 @@
 #include <osv/debug.hh>
 #include <osv/pci.hh>
 #include "drivers/pci-function.hh"
+#include <osv/spinlock.h>
+#include <osv/irqlock.hh>
 
 namespace pci {
 
@@ -30,6 +32,19 @@ static inline u32 build_config_address(u8 bus, u8 slot, u8 func, u8 offset) {
         func << PCI_FUNC_OFFSET | (offset & ~0x03);
 }
 
+// The address and the data port form a pair that must not be interleaved
+// with another access, and drivers may be probed concurrently (see
+// hw::driver_manager::load_all()).
+static np_spinlock_t config_lock;
+
+class config_access_guard {
+public:
+    config_access_guard() { _irq.lock(); config_lock.lock(); }
+    ~config_access_guard() { config_lock.unlock(); _irq.unlock(); }
+private:
+    irq_save_lock_type _irq;
+};
+
 static inline void prepare_pci_config_access(u8 bus, u8 slot, u8 func, u8 offset)
 {
     u32 address = build_config_address(bus, slot, func, offset);
@@ -38,36 +53,42 @@ static inline void prepare_pci_config_access(u8 bus, u8 slot, u8 func, u8 offset
 
 u32 read_pci_config(u8 bus, u8 slot, u8 func, u8 offset)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     return inl(PCI_CONFIG_DATA);
 }
 
 u16 read_pci_config_word(u8 bus, u8 slot, u8 func, u8 offset)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     return inw(PCI_CONFIG_DATA + (offset & 0x02));
 }
 
 u8 read_pci_config_byte(u8 bus, u8 slot, u8 func, u8 offset)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     return inb(PCI_CONFIG_DATA + (offset & 0x03));
 }
 
 void write_pci_config(u8 bus, u8 slot, u8 func, u8 offset, u32 val)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     outl(val, PCI_CONFIG_DATA);
 }
 
 void write_pci_config_word(u8 bus, u8 slot, u8 func, u8 offset, u16 val)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     outw(val, PCI_CONFIG_DATA + (offset & 0x02));
 }
 
 void write_pci_config_byte(u8 bus, u8 slot, u8 func, u8 offset, u8 val)
 {
+    config_access_guard guard;
     prepare_pci_config_access(bus, slot, func, offset);
     outb(val, PCI_CONFIG_DATA + (offset & 0x03));
 }
@@ -98,6 +98,10 @@ inline void write_cr3(ulong r) {
     asm volatile ("mov %0, %%cr3" : : "r"(r));
 }
 
+inline void invlpg(const void* addr) {
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
 inline ulong read_cr4() {
     ulong r;
     asm volatile ("mov %%cr4, %0" : "=r"(r));
@@ -6,6 +6,7 @@
  */
 
 #include <errno.h>
+#include <vector>
 #include <osv/ioctl.h>
 
 #include <bsd/porting/netport.h>
@@ -17,6 +18,8 @@
 #include <bsd/sys/net/route.h>
 #include <bsd/sys/netinet/in.h>
 #include <bsd/sys/netinet/in_var.h>
+#include <bsd/sys/netinet/if_ether.h>
+#include <bsd/sys/net/if_types.h>
 #include <bsd/sys/sys/socket.h>
 #include <bsd/sys/sys/socketvar.h>
 
@@ -194,4 +197,42 @@ std::string if_ip(std::string if_name) {
     }
     return inet_ntoa(((bsd_sockaddr_in*)&(addr.ifr_addr))->sin_addr);
 }
+
+void if_announce()
+{
+    struct bsd_sockaddr_in any;
+    bzero(&any, sizeof(any));
+    any.sin_len = sizeof(any);
+    any.sin_family = AF_INET;
+    lltable_prefix_free(AF_INET, (struct bsd_sockaddr *)&any,
+        (struct bsd_sockaddr *)&any, 0);
+
+    // arp_ifinit() transmits, so collect the addresses first rather than
+    // call it with the interface locks held
+    std::vector<std::pair<struct ifnet*, struct bsd_ifaddr*>> addrs;
+    struct ifnet *ifp;
+    IFNET_RLOCK_NOSLEEP();
+    TAILQ_FOREACH(ifp, &V_ifnet, if_link) {
+        if (ifp->if_type != IFT_ETHER || !(ifp->if_flags & IFF_UP)) {
+            continue;
+        }
+        struct bsd_ifaddr *ifa;
+        IF_ADDR_RLOCK(ifp);
+        TAILQ_FOREACH(ifa, &ifp->if_addrhead, ifa_link) {
+            if (ifa->ifa_addr->sa_family == AF_INET) {
+                if_ref(ifp);
+                ifa_ref(ifa);
+                addrs.emplace_back(ifp, ifa);
+            }
+        }
+        IF_ADDR_RUNLOCK(ifp);
+    }
+    IFNET_RUNLOCK_NOSLEEP();
+
+    for (auto& a : addrs) {
+        arp_ifinit(a.first, a.second);
+        ifa_free(a.second);
+        if_rele(a.first);
+    }
+}
 }
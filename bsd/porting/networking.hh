@@ -22,6 +22,10 @@ namespace osv {
     int stop_if(std::string if_name, std::string ip_addr);
     int ifup(std::string if_name);
     std::string if_ip(std::string if_name);
+    /* Forget the link-layer addresses learnt so far and announce ours with
+     * a gratuitous ARP on every Ethernet interface, e.g. after the VM was
+     * restored from a snapshot on another host */
+    void if_announce();
 }
 
 #endif /* __NETWORKING_H__ */
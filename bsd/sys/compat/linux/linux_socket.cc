@@ -29,6 +29,7 @@
 #include <sys/cdefs.h>
 
 #include <unistd.h> /* for close() */
+#include <time.h>
 
 /* XXX we use functions that might not exist. */
 
@@ -49,6 +50,8 @@
 #include <bsd/sys/netinet/in.h>
 #include <bsd/sys/netinet/in_systm.h>
 #include <bsd/sys/netinet/ip.h>
+#include <bsd/sys/netinet/tcp.h>
+#include <bsd/sys/netinet/udp.h>
 #ifdef INET6
 #include <bsd/sys/netinet/ip6.h>
 #include <bsd/sys/netinet6/ip6_var.h>
@@ -359,6 +362,8 @@ linux_to_bsd_so_sockopt(int opt)
 		return (SO_TIMESTAMP);
 	case LINUX_SO_ACCEPTCONN:
 		return (SO_ACCEPTCONN);
+	case LINUX_SO_MAX_PACING_RATE:
+		return (SO_MAX_PACING_RATE);
 	}
 	return (-1);
 }
@@ -386,6 +391,8 @@ linux_to_bsd_msg_flags(int flags)
 		ret_flags |= MSG_WAITALL;
 	if (flags & LINUX_MSG_NOSIGNAL)
 		ret_flags |= MSG_NOSIGNAL;
+	if (flags & LINUX_MSG_FASTOPEN)
+		ret_flags |= MSG_FASTOPEN;
 #if 0 /* not handled */
 	if (flags & LINUX_MSG_PROXY)
 		;
@@ -523,8 +530,10 @@ linux_sendit(int s, struct msghdr *mp, int flags,
 
 	if (mp->msg_name != NULL) {
 		error = linux_getsockaddr(&to, (const bsd_osockaddr*)mp->msg_name, mp->msg_namelen);
-		if (error)
+		if (error) {
+			m_freem(control);
 			return (error);
+		}
 		mp->msg_name = to;
 	} else
 		to = NULL;
@@ -912,6 +921,66 @@ linux_recvfrom(int s, void* buf, size_t len, int flags,
 	return (0);
 }
 
+/*
+ * Build the BSD control mbuf for the UDP_SEGMENT message in 'msg', if any.
+ * On error, *controlp is freed and set to NULL.
+ */
+static int
+linux_to_bsd_udp_cmsg(const struct msghdr *msg, struct mbuf **controlp)
+{
+	struct cmsghdr *cm;
+	struct mbuf *control = NULL;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL;
+	    cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level != IPPROTO_UDP ||
+		    cm->cmsg_type != UDP_SEGMENT)
+			continue;
+		if (cm->cmsg_len != CMSG_LEN(sizeof(u_short))) {
+			m_freem(control);
+			*controlp = NULL;
+			return (EINVAL);
+		}
+		m_freem(control);
+		control = sbcreatecontrol((caddr_t)CMSG_DATA(cm),
+		    sizeof(u_short), UDP_SEGMENT, IPPROTO_UDP);
+		if (control == NULL) {
+			*controlp = NULL;
+			return (ENOBUFS);
+		}
+	}
+	*controlp = control;
+	return (0);
+}
+
+/*
+ * Copy the UDP_GRO control messages in 'control' out to the caller's control
+ * buffer, and set msg_controllen to the length copied.
+ */
+static void
+bsd_to_linux_udp_cmsg(struct msghdr *msg, void *ctlbuf, socklen_t ctllen,
+    struct mbuf *control)
+{
+	struct cmsghdr *cm;
+	socklen_t outlen = 0;
+	struct mbuf *m;
+
+	for (m = control; m != NULL; m = m->m_hdr.mh_next) {
+		cm = mtod(m, struct cmsghdr *);
+		if (m->m_hdr.mh_len < sizeof(*cm) ||
+		    cm->cmsg_level != IPPROTO_UDP || cm->cmsg_type != UDP_GRO)
+			continue;
+		if (outlen + CMSG_SPACE(sizeof(int)) > ctllen) {
+			msg->msg_flags |= MSG_CTRUNC;
+			break;
+		}
+		memcpy((caddr_t)ctlbuf + outlen, cm, CMSG_LEN(sizeof(int)));
+		outlen += CMSG_SPACE(sizeof(int));
+	}
+	msg->msg_control = ctlbuf;
+	msg->msg_controllen = outlen;
+}
+
 int
 linux_sendmsg(int s, struct msghdr* msg, int flags, ssize_t* bytes)
 {
@@ -925,6 +994,7 @@ linux_sendmsg(int s, struct msghdr* msg, int flags, ssize_t* bytes)
 	void *data;
 #endif
 
+	struct mbuf *control = NULL;
 	int error;
 
 	/*
@@ -937,12 +1007,21 @@ linux_sendmsg(int s, struct msghdr* msg, int flags, ssize_t* bytes)
 	if (msg->msg_control != NULL && msg->msg_controllen == 0)
 		msg->msg_control = NULL;
 
-	/* FIXME: Translate msg control */
-	assert(msg->msg_control == NULL);
+	/*
+	 * The only control message passed on is UDP_SEGMENT, whose layout
+	 * is the same for Linux and BSD; others are ignored.
+	 */
+	if (msg->msg_control != NULL) {
+		error = linux_to_bsd_udp_cmsg(msg, &control);
+		if (error)
+			return (error);
+	}
 
 	error = linux_to_bsd_msghdr(msg);
-	if (error)
+	if (error) {
+		m_freem(control);
 		return (error);
+	}
 
 	/* FIXME: OSv - cmsgs translation is done credentials and rights,
 	   we ignore those in OSv. */
@@ -1026,7 +1105,7 @@ linux_sendmsg(int s, struct msghdr* msg, int flags, ssize_t* bytes)
 	}
 #endif
 
-	error = linux_sendit(s, msg, flags, NULL, bytes);
+	error = linux_sendit(s, msg, flags, control, bytes);
 
 #if 0
 bad:
@@ -1056,10 +1135,14 @@ linux_recvmsg(int s, struct msghdr *msg, int flags, ssize_t* bytes)
 	void *data;
 	int error, i, fd, fds, *fdp;
 #endif
+	struct mbuf *control = NULL;
+	void *ctlbuf = msg->msg_control;
+	socklen_t ctllen = ctlbuf != NULL ? msg->msg_controllen : 0;
 	int error;
 	error = linux_to_bsd_msghdr(msg);
 	if (error)
 		return (error);
+	msg->msg_controllen = 0;
 
 	if (msg->msg_name) {
 		error = linux_to_bsd_sockaddr((struct bsd_sockaddr *)msg->msg_name,
@@ -1070,7 +1153,7 @@ linux_recvmsg(int s, struct msghdr *msg, int flags, ssize_t* bytes)
 
 	assert(msg->msg_control == NULL);
 
-	error = kern_recvit(s, msg, NULL, bytes);
+	error = kern_recvit(s, msg, ctllen ? &control : NULL, bytes);
 	if (error)
 		goto bad;
 
@@ -1089,11 +1172,9 @@ linux_recvmsg(int s, struct msghdr *msg, int flags, ssize_t* bytes)
 			goto bad;
 	}
 
-	//TODO: Implement handling of ancillary data - see http://www.masterraghu.com/subjects/np/introduction/unix_network_programming_v1.3/ch14lev1sec6.html
-	if (msg->msg_controllen != 0) {
-		WARN_ONCE("linux_recvmsg: ignoring ancillary data (control message)!\n");
-	}
-	assert(msg->msg_control == NULL);
+	//TODO: Implement handling of other ancillary data - see http://www.masterraghu.com/subjects/np/introduction/unix_network_programming_v1.3/ch14lev1sec6.html
+	if (ctllen != 0)
+		bsd_to_linux_udp_cmsg(msg, ctlbuf, ctllen, control);
 
 #if 0
 	if (control) {
@@ -1196,10 +1277,93 @@ bad:
 #endif
 
 bad:
+	if (control != NULL)
+		m_freem(control);
+	if (error && ctlbuf != NULL) {
+		msg->msg_control = ctlbuf;
+		msg->msg_controllen = ctllen;
+	}
 
 	return (error);
 }
 
+/*
+ * OSv has no system call boundary to amortize, so the batch calls loop over
+ * sendmsg and recvmsg; what a batch saves is in the protocols, e.g. with
+ * UDP_SEGMENT and UDP_GRO.
+ */
+int
+linux_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+    int *count)
+{
+	struct msghdr msg;
+	ssize_t bytes;
+	unsigned int i;
+	int error = 0;
+
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+	for (i = 0; i < vlen; i++) {
+		msg = msgvec[i].msg_hdr;
+		error = linux_sendmsg(s, &msg, flags, &bytes);
+		if (error)
+			break;
+		msgvec[i].msg_len = bytes;
+	}
+	*count = i;
+	return (i > 0 ? 0 : error);
+}
+
+int
+linux_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+    struct timespec *timeout, int *count)
+{
+	struct msghdr msg;
+	struct timespec now, end;
+	ssize_t bytes;
+	unsigned int i;
+	int error = 0;
+
+	if (timeout != NULL) {
+		if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+		    timeout->tv_nsec >= 1000000000L)
+			return (EINVAL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		end.tv_sec += timeout->tv_sec;
+		end.tv_nsec += timeout->tv_nsec;
+		if (end.tv_nsec >= 1000000000L) {
+			end.tv_sec++;
+			end.tv_nsec -= 1000000000L;
+		}
+	}
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+	for (i = 0; i < vlen; i++) {
+		msg = msgvec[i].msg_hdr;
+		msg.msg_flags = flags & ~LINUX_MSG_WAITFORONE;
+		if (i > 0 && (flags & LINUX_MSG_WAITFORONE))
+			msg.msg_flags |= LINUX_MSG_DONTWAIT;
+		error = linux_recvmsg(s, &msg, msg.msg_flags, &bytes);
+		if (error)
+			break;
+		msgvec[i].msg_hdr.msg_namelen = msg.msg_namelen;
+		msgvec[i].msg_hdr.msg_controllen = msg.msg_controllen;
+		msgvec[i].msg_hdr.msg_flags = msg.msg_flags;
+		msgvec[i].msg_len = bytes;
+		/* The timeout is only checked after each datagram, as on Linux */
+		if (timeout != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > end.tv_sec || (now.tv_sec == end.tv_sec &&
+			    now.tv_nsec >= end.tv_nsec)) {
+				i++;
+				break;
+			}
+		}
+	}
+	*count = i;
+	return (i > 0 ? 0 : error);
+}
+
 int
 linux_shutdown(int s, int how)
 {
@@ -1221,8 +1385,12 @@ int linux_to_bsd_tcp_sockopt(int name)
 		return 0x200;
 	case 6:  // TCP_KEEPCNT
 		return 0x400;
+	case 11: // TCP_INFO
+		return 0x20;
 	case 13: // TCP_CONGESTION
 		return 0x40;
+	case 23: // TCP_FASTOPEN
+		return 0x800;
 	}
 	// The BSD and Linux constants here are so different, that anything
 	// not explicitly supported is not supported. We return -1, which
@@ -1230,6 +1398,17 @@ int linux_to_bsd_tcp_sockopt(int name)
 	return -1;
 }
 
+static int
+linux_to_bsd_udp_sockopt(int name)
+{
+	switch (name) {
+	case UDP_SEGMENT:
+	case UDP_GRO:
+		return (name);
+	}
+	return (-1);
+}
+
 int
 linux_setsockopt(int s, int level, int name, caddr_t val, int valsize)
 {
@@ -1245,6 +1424,9 @@ linux_setsockopt(int s, int level, int name, caddr_t val, int valsize)
 	case IPPROTO_TCP:
 		name = linux_to_bsd_tcp_sockopt(name);
 		break;
+	case IPPROTO_UDP:
+		name = linux_to_bsd_udp_sockopt(name);
+		break;
 	default:
 		name = -1;
 		break;
@@ -1281,6 +1463,9 @@ linux_getsockopt(int s, int level, int name, void *val, socklen_t *valsize)
 	case IPPROTO_TCP:
 		name = linux_to_bsd_tcp_sockopt(name);
 		break;
+	case IPPROTO_UDP:
+		name = linux_to_bsd_udp_sockopt(name);
+		break;
 	default:
 		name = -1;
 		break;
@@ -1288,6 +1473,23 @@ linux_getsockopt(int s, int level, int name, void *val, socklen_t *valsize)
 	if (name == -1)
 		return (EINVAL);
 
+	/*
+	 * struct tcp_info is laid out as on Linux up to tcpi_rcv_space, the
+	 * FreeBSD extensions that follow are not Linux's fields.
+	 */
+	if (level == IPPROTO_TCP && name == TCP_INFO) {
+		struct tcp_info ti;
+		socklen_t len = sizeof(ti);
+
+		error = sys_getsockopt(s, level, name, &ti, &len);
+		if (error == 0) {
+			len = MIN(*valsize, offsetof(struct tcp_info, tcpi_snd_wnd));
+			memcpy(val, &ti, len);
+			*valsize = len;
+		}
+		return (error);
+	}
+
 	/* FIXME: OSv - enable when we have IPv6 */
 #if 0
 	if (name == IPV6_NEXTHOP) {
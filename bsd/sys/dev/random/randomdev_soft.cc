@@ -277,8 +277,15 @@ randomdev_flush_reseed(void)
 {
 	/* Command a entropy queue flush and wait for it to finish */
 	random_kthread_control = 1;
+#ifdef __OSV__
+	/* Don't wait for the thread's next round, this is on the resume path */
+	wakeup(&random_kthread_control);
+	while (random_kthread_control)
+		bsd_pause("-", 1);
+#else
 	while (random_kthread_control)
 		bsd_pause("-", hz / 10);
+#endif
 
 #if defined(RANDOM_YARROW)
 	/* This ultimately calls randomdev_unblock() */
@@ -390,6 +390,7 @@ sonewconn(struct socket *head, int connstatus)
 	so->so_linger = head->so_linger;
 	so->so_state = head->so_state | SS_NOFDREF;
 	so->so_fibnum = head->so_fibnum;
+	so->so_max_pacing_rate = head->so_max_pacing_rate;
 	so->so_proto = head->so_proto;
 	VNET_SO_ASSERT(head);
 	if (soreserve_internal(so, head->so_snd.sb_hiwat, head->so_rcv.sb_hiwat) ||
@@ -1073,7 +1074,8 @@ restart:
 			VNET_SO_ASSERT(so);
 			SOCK_UNLOCK(so);
 			error = (*so->so_proto->pr_usrreqs->pru_send)(so,
-			    (flags & MSG_OOB) ? PRUS_OOB :
+			    ((flags & MSG_FASTOPEN) ? PRUS_FASTOPEN : 0) |
+			    ((flags & MSG_OOB) ? PRUS_OOB :
 			/*
 			 * If the user set MSG_EOF, the protocol understands
 			 * this flag and nothing left to send then use
@@ -1084,7 +1086,7 @@ restart:
 			     (resid <= 0)) ?
 				PRUS_EOF :
 			/* If there is more to send set PRUS_MORETOCOME. */
-			    (resid > 0 && space > 0) ? PRUS_MORETOCOME : 0,
+			    (resid > 0 && space > 0) ? PRUS_MORETOCOME : 0),
 			    top, addr, control, td);
 			SOCK_LOCK(so);
 			if (dontroute) {
@@ -2535,6 +2537,53 @@ soreceive_dgram(struct socket *so, struct bsd_sockaddr **psa, struct uio *uio,
 	return (0);
 }
 
+/*
+ * Dequeue the datagram at the head of the receive buffer if it was sent from
+ * 'from', carries no control data and has no more than 'maxlen' bytes, for
+ * protocols coalescing datagrams on receive.  Returns its data, with the
+ * length in *lenp, or NULL without waiting if there is no such datagram.
+ */
+struct mbuf *
+sodequeue_dgram(struct socket *so, const struct bsd_sockaddr *from,
+    ssize_t maxlen, ssize_t *lenp)
+{
+	struct mbuf *m, *m2, *nextrecord;
+	ssize_t len = 0;
+
+	SOCK_LOCK(so);
+	m = so->so_rcv.sb_mb;
+	if (m == NULL || m->m_hdr.mh_type != MT_SONAME ||
+	    m->m_hdr.mh_len != from->sa_len ||
+	    bcmp(mtod(m, caddr_t), from, from->sa_len) != 0) {
+		SOCK_UNLOCK(so);
+		return (NULL);
+	}
+	for (m2 = m->m_hdr.mh_next; m2 != NULL; m2 = m2->m_hdr.mh_next) {
+		if (m2->m_hdr.mh_type != MT_DATA) {
+			SOCK_UNLOCK(so);
+			return (NULL);
+		}
+		len += m2->m_hdr.mh_len;
+	}
+	if (len == 0 || len > maxlen) {
+		SOCK_UNLOCK(so);
+		return (NULL);
+	}
+	SBLASTRECORDCHK(&so->so_rcv);
+	SBLASTMBUFCHK(&so->so_rcv);
+	nextrecord = m->m_hdr.mh_nextpkt;
+	so->so_rcv.sb_mb = NULL;
+	sockbuf_pushsync(so, &so->so_rcv, nextrecord);
+	for (m2 = m; m2 != NULL; m2 = m2->m_hdr.mh_next)
+		sbfree(&so->so_rcv, m2);
+	SBLASTRECORDCHK(&so->so_rcv);
+	SBLASTMBUFCHK(&so->so_rcv);
+	SOCK_UNLOCK(so);
+
+	*lenp = len;
+	return (m_free(m));
+}
+
 int
 soreceive(struct socket *so, struct bsd_sockaddr **psa, struct uio *uio,
     struct mbuf **mp0, struct mbuf **controlp, int *flagsp)
@@ -2677,6 +2726,7 @@ sosetopt(struct socket *so, struct sockopt *sopt)
 	struct	timeval tv;
 	u_long  val;
 	uint32_t val32;
+	uint64_t val64;
 
 	CURVNET_SET(so->so_vnet);
 	error = 0;
@@ -2764,6 +2814,24 @@ sosetopt(struct socket *so, struct sockopt *sopt)
 			so->so_user_cookie = val32;
 			break;
 
+		case SO_MAX_PACING_RATE:
+			/*
+			 * Like Linux, take either a 32 or a 64 bit rate in
+			 * bytes per second, with all ones meaning no limit.
+			 */
+			if (sopt->sopt_valsize >= sizeof(uint64_t)) {
+				error = sooptcopyin(sopt, &val64, sizeof val64,
+						    sizeof val64);
+			} else {
+				error = sooptcopyin(sopt, &val32, sizeof val32,
+						    sizeof val32);
+				val64 = val32 == ~0u ? ~0ull : val32;
+			}
+			if (error)
+				goto bad;
+			so->so_max_pacing_rate = val64;
+			break;
+
 		case SO_SNDBUF:
 		case SO_RCVBUF:
 		case SO_SNDLOWAT:
@@ -3006,6 +3074,16 @@ integer:
 			optval = so->so_incqlen;
 			goto integer;
 
+		case SO_MAX_PACING_RATE:
+			if (sopt->sopt_valsize >= sizeof(uint64_t)) {
+				error = sooptcopyout(sopt, &so->so_max_pacing_rate,
+				    sizeof so->so_max_pacing_rate);
+			} else {
+				uint32_t rate32 = bsd_min(so->so_max_pacing_rate, ~0u);
+				error = sooptcopyout(sopt, &rate32, sizeof rate32);
+			}
+			break;
+
 		default:
 			error = ENOPROTOOPT;
 			break;
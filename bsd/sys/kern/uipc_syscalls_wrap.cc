@@ -264,6 +264,44 @@ ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
 	return bytes;
 }
 
+extern "C" OSV_LIBC_API
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen,
+    unsigned int flags)
+{
+	int error, count;
+
+	sock_d("sendmmsg(fd=%d, msgvec=..., vlen=%u, flags=0x%x)", fd, vlen,
+		flags);
+
+	error = linux_sendmmsg(fd, msgvec, vlen, flags, &count);
+	if (error) {
+		sock_d("sendmmsg() failed, errno=%d", error);
+		errno = error;
+		return -1;
+	}
+
+	return count;
+}
+
+extern "C" OSV_LIBC_API
+int recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen,
+    unsigned int flags, struct timespec *timeout)
+{
+	int error, count;
+
+	sock_d("recvmmsg(fd=%d, msgvec=..., vlen=%u, flags=0x%x)", fd, vlen,
+		flags);
+
+	error = linux_recvmmsg(fd, msgvec, vlen, flags, timeout, &count);
+	if (error) {
+		sock_d("recvmmsg() failed, errno=%d", error);
+		errno = error;
+		return -1;
+	}
+
+	return count;
+}
+
 extern "C" OSV_LIBC_API
 int getsockopt(int fd, int level, int optname, void *__restrict optval,
 		socklen_t *__restrict optlen)
@@ -62,6 +62,9 @@ struct if_data {
                                 * be sent due to a lack of free space
                                 * on a HW ring
                                 */
+    u_long  ifi_okicks_avoided;/* Tx packets posted without their own kick */
+    u_long  ifi_obatch_kicks;/* Tx kicks issued at the end of a batch */
+    u_long  ifi_obatch_packets;/* Tx packets covered by the batch kicks */
     wakeup_stats ifi_iwakeup_stats; /* Rx BH wakeup statistics */
     wakeup_stats ifi_owakeup_stats; /* Tx BH wakeup statistics */
 };
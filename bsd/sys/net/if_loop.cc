@@ -43,6 +43,7 @@
 #include <bsd/sys/sys/socket.h>
 
 #include <bsd/sys/net/if.h>
+#include <bsd/sys/net/ethernet.h>
 #include <bsd/sys/net/if_clone.h>
 #include <bsd/sys/net/if_types.h>
 #include <bsd/sys/net/netisr.h>
@@ -82,6 +83,7 @@ static void	lortrequest(int, struct rtentry *, struct rt_addrinfo *);
 int		looutput(struct ifnet *ifp, struct mbuf *m,
 		    struct bsd_sockaddr *dst, struct route *ro);
 static int	lo_clone_create(struct if_clone *, int, caddr_t);
+static bool	lo_post_channel(struct ifnet *ifp, struct mbuf *m);
 static void	lo_clone_destroy(struct ifnet *);
 
 VNET_DEFINE(struct ifnet *, loif);	/* Used externally */
@@ -187,9 +189,55 @@ looutput(struct ifnet *ifp, struct mbuf *m, struct bsd_sockaddr *dst,
 		return (EAFNOSUPPORT);
 	}
 #endif
+	if (dst->sa_family == AF_INET && lo_post_channel(ifp, m))
+		return (0);
 	return (if_simloop(ifp, m, dst->sa_family, 0));
 }
 
+/*
+ * Established TCP connections register a net channel with the interface
+ * they receive on, which for local connections is this one.  Hand their
+ * segments straight to the peer's channel, to be processed by tcp in the
+ * context of the receiving thread, instead of going through the netisr
+ * queue and thread, ip_input() and the pcb lookup.  Segments that open or
+ * close a connection, or find the channel full, still take the slow path,
+ * which flushes the channel first so that ordering is kept.
+ *
+ * The channel consumer expects an Ethernet frame, so a dummy header is put
+ * in the link header space tcp_output() reserves in front of the IP header.
+ */
+static bool
+lo_post_channel(struct ifnet *ifp, struct mbuf *m)
+{
+	struct ether_header *eh;
+	int len;
+
+#if CONF_lazy_stack_invariant
+	/* Waking the channel's thread must not run on an application stack */
+	if (sched::thread::current()->is_app())
+		return (false);
+#endif
+	if (M_LEADINGSPACE(m) < ETHER_HDR_LEN)
+		return (false);
+	len = m->M_dat.MH.MH_pkthdr.len;
+	m->m_hdr.mh_data -= ETHER_HDR_LEN;
+	m->m_hdr.mh_len += ETHER_HDR_LEN;
+	m->M_dat.MH.MH_pkthdr.len += ETHER_HDR_LEN;
+	m->M_dat.MH.MH_pkthdr.rcvif = ifp;
+	eh = mtod(m, struct ether_header *);
+	bzero(eh, ETHER_ADDR_LEN * 2);
+	eh->ether_type = htons(ETHERTYPE_IP);
+	if (!ifp->if_classifier.post_packet(m)) {
+		m->m_hdr.mh_data += ETHER_HDR_LEN;
+		m->m_hdr.mh_len -= ETHER_HDR_LEN;
+		m->M_dat.MH.MH_pkthdr.len -= ETHER_HDR_LEN;
+		return (false);
+	}
+	ifp->if_ipackets++;
+	ifp->if_ibytes += len;
+	return (true);
+}
+
 /*
  * if_simloop()
  *
@@ -57,6 +57,7 @@
 
 __BEGIN_DECLS
 
+extern struct cc_algo bbr_cc_algo;
 extern struct cc_algo htcp_cc_algo;
 extern struct cc_algo cubic_cc_algo;
 extern struct cc_algo newreno_cc_algo;
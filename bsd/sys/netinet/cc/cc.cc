@@ -201,6 +201,8 @@ cc_init(void)
 
 	/* OSv: Initalize cubic CC which is the default in Linux */
 	cc_modevent(MOD_LOAD, &cubic_cc_algo);
+	/* and BBR, selectable per socket with TCP_CONGESTION */
+	cc_modevent(MOD_LOAD, &bbr_cc_algo);
 }
 
 /*
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+/*
+ * A BBR congestion control module, after "BBR: Congestion-Based Congestion
+ * Control" by Cardwell et al.
+ *
+ * Rather than reacting to loss, BBR models the path by its bottleneck
+ * bandwidth (the maximum delivery rate seen over the last rounds) and its
+ * propagation delay (the minimum round trip seen over the last seconds),
+ * paces data at about the bottleneck bandwidth and keeps about one
+ * bandwidth-delay product in flight.
+ *
+ * The model is sampled once per packet-timed round trip: a round starts
+ * on an ACK, ends on the first ACK covering everything that was in flight
+ * when it started, and yields one delivery rate and one round trip sample.
+ * Pacing itself is done by tcp_output(), at the rate left in t_pacing_rate.
+ */
+
+#include <sys/cdefs.h>
+
+#include <osv/initialize.hh>
+#include <osv/clock.hh>
+#include <bsd/porting/netport.h>
+
+#include <bsd/sys/sys/param.h>
+#include <bsd/sys/sys/socket.h>
+#include <bsd/sys/sys/socketvar.h>
+
+#include <bsd/sys/net/vnet.h>
+
+#include <bsd/sys/netinet/cc.h>
+#include <bsd/sys/netinet/tcp_seq.h>
+#include <bsd/sys/netinet/tcp_var.h>
+
+#include <bsd/sys/netinet/cc/cc_module.h>
+
+/* Gains are fixed point, in units of 1/BBR_UNIT. */
+#define	BBR_UNIT		256
+#define	BBR_HIGH_GAIN		739	/* 2/ln(2), doubles each round */
+#define	BBR_DRAIN_GAIN		88	/* 1/high gain */
+#define	BBR_CWND_GAIN		512
+
+#define	BBR_BW_ROUNDS		10	/* bandwidth filter length, rounds */
+#define	BBR_MIN_RTT_WIN		10000000000ull	/* min rtt filter length, ns */
+#define	BBR_PROBE_RTT_TIME	200000000ull	/* time spent in PROBE_RTT, ns */
+#define	BBR_FULL_BW_ROUNDS	3	/* rounds without growth to leave STARTUP */
+#define	BBR_MIN_CWND_SEGS	4
+
+enum bbr_state {
+	BBR_STARTUP,
+	BBR_DRAIN,
+	BBR_PROBE_BW,
+	BBR_PROBE_RTT,
+};
+
+static const u_int bbr_cycle_gain[] = {
+	BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4,
+	BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT,
+};
+#define	BBR_CYCLE_LEN	(sizeof(bbr_cycle_gain) / sizeof(bbr_cycle_gain[0]))
+
+struct bbr {
+	enum bbr_state	state;
+	u_int		pacing_gain;
+	u_int		cwnd_gain;
+	bool		full_pipe;	/* STARTUP found the bottleneck */
+
+	/* Round being timed */
+	bool		round_started;
+	tcp_seq		round_end;	/* ends when this is acked */
+	u64		round_start;	/* uptime, ns */
+	u64		round_delivered;
+	u64		round_count;
+
+	/* Model */
+	u64		bw[BBR_BW_ROUNDS];	/* delivery rate per round, B/s */
+	u64		max_bw;
+	u64		min_rtt;	/* ns, ~0 until sampled */
+	u64		min_rtt_stamp;
+
+	u64		full_bw;
+	int		full_bw_rounds;
+	u_int		cycle_idx;
+	u64		cycle_stamp;
+	u64		probe_rtt_done;
+};
+
+static void	bbr_ack_received(struct cc_var *ccv, uint16_t type);
+static void	bbr_after_idle(struct cc_var *ccv);
+static void	bbr_cb_destroy(struct cc_var *ccv);
+static int	bbr_cb_init(struct cc_var *ccv);
+static void	bbr_cong_signal(struct cc_var *ccv, uint32_t type);
+static void	bbr_conn_init(struct cc_var *ccv);
+static void	bbr_post_recovery(struct cc_var *ccv);
+
+struct cc_algo bbr_cc_algo = initialize_with([] (cc_algo& x) {
+	strcpy(x.name, "bbr");
+	x.ack_received = bbr_ack_received;
+	x.after_idle = bbr_after_idle;
+	x.cb_destroy = bbr_cb_destroy;
+	x.cb_init = bbr_cb_init;
+	x.cong_signal = bbr_cong_signal;
+	x.conn_init = bbr_conn_init;
+	x.post_recovery = bbr_post_recovery;
+});
+
+static inline u64
+bbr_now(void)
+{
+	return osv::clock::uptime::now().time_since_epoch().count();
+}
+
+static inline bool
+bbr_has_model(struct bbr *bbr)
+{
+	return bbr->max_bw != 0 && bbr->min_rtt != ~0ull;
+}
+
+/*
+ * Window needed to keep gain times the bandwidth-delay product in flight,
+ * plus a few segments for TSO bursts and delayed ACKs at the receiver.
+ */
+static u_long
+bbr_target_cwnd(struct cc_var *ccv, struct bbr *bbr, u_int gain)
+{
+	u_int mss = CCV(ccv, t_maxseg);
+	u64 bdp = bbr->max_bw * (bbr->min_rtt / 1000) / 1000000;
+	u64 cwnd = bdp * gain / BBR_UNIT + 3 * mss;
+
+	return bsd_max(cwnd, (u64)BBR_MIN_CWND_SEGS * mss);
+}
+
+static void
+bbr_set_pacing_rate(struct cc_var *ccv, struct bbr *bbr)
+{
+	if (bbr->max_bw)
+		CCV(ccv, t_pacing_rate) = bsd_max(1,
+		    bbr->max_bw * bbr->pacing_gain / BBR_UNIT);
+}
+
+static void
+bbr_set_cwnd(struct cc_var *ccv, struct bbr *bbr)
+{
+	u_int mss = CCV(ccv, t_maxseg);
+	u_long cwnd = CCV(ccv, snd_cwnd);
+
+	if (IN_RECOVERY(CCV(ccv, t_flags)))
+		return;
+	if (bbr->state == BBR_PROBE_RTT) {
+		cwnd = bsd_min(cwnd, BBR_MIN_CWND_SEGS * mss);
+	} else if (!bbr_has_model(bbr)) {
+		cwnd += ccv->bytes_this_ack;
+	} else {
+		u_long target = bbr_target_cwnd(ccv, bbr, bbr->cwnd_gain);
+		/*
+		 * Grow towards the target by what was acked, like slow
+		 * start, but once the pipe is known to be full do not
+		 * stay above it.
+		 */
+		if (bbr->full_pipe)
+			cwnd = bsd_min(cwnd + ccv->bytes_this_ack, target);
+		else if (cwnd < target)
+			cwnd += ccv->bytes_this_ack;
+	}
+	cwnd = bsd_max(cwnd, BBR_MIN_CWND_SEGS * mss);
+	CCV(ccv, snd_cwnd) = bsd_min(cwnd, TCP_MAXWIN << CCV(ccv, snd_scale));
+}
+
+static void
+bbr_enter_probe_bw(struct bbr *bbr, u64 now)
+{
+	bbr->state = BBR_PROBE_BW;
+	bbr->cwnd_gain = BBR_CWND_GAIN;
+	/* Start on a cruising phase so a new flow does not probe at once. */
+	bbr->cycle_idx = 2;
+	bbr->pacing_gain = bbr_cycle_gain[bbr->cycle_idx];
+	bbr->cycle_stamp = now;
+}
+
+static void
+bbr_enter_startup(struct bbr *bbr)
+{
+	bbr->state = BBR_STARTUP;
+	bbr->pacing_gain = BBR_HIGH_GAIN;
+	bbr->cwnd_gain = BBR_HIGH_GAIN;
+}
+
+/*
+ * The round ended: fold its delivery rate and duration into the model and
+ * move through the states which advance per round.
+ */
+static void
+bbr_round_end(struct cc_var *ccv, struct bbr *bbr, u64 now)
+{
+	u64 elapsed = now - bbr->round_start;
+	u64 max_bw = 0;
+
+	if (elapsed == 0)
+		return;
+
+	bbr->bw[bbr->round_count % BBR_BW_ROUNDS] =
+	    bbr->round_delivered * 1000000000ull / elapsed;
+	bbr->round_count++;
+	for (auto bw : bbr->bw)
+		max_bw = bsd_max(max_bw, bw);
+	bbr->max_bw = max_bw;
+
+	bool expired = now - bbr->min_rtt_stamp > BBR_MIN_RTT_WIN;
+	if (elapsed <= bbr->min_rtt || expired) {
+		bbr->min_rtt = elapsed;
+		bbr->min_rtt_stamp = now;
+	}
+	if (expired && bbr->state != BBR_PROBE_RTT) {
+		/*
+		 * No lower round trip for a while: drain the queue for a
+		 * moment to see the path's own delay again.
+		 */
+		bbr->state = BBR_PROBE_RTT;
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->probe_rtt_done = now + bsd_max(BBR_PROBE_RTT_TIME,
+		    bbr->min_rtt);
+	}
+
+	if (bbr->state == BBR_STARTUP) {
+		if (bbr->max_bw >= bbr->full_bw * 5 / 4) {
+			bbr->full_bw = bbr->max_bw;
+			bbr->full_bw_rounds = 0;
+		} else if (++bbr->full_bw_rounds >= BBR_FULL_BW_ROUNDS) {
+			bbr->full_pipe = true;
+			bbr->state = BBR_DRAIN;
+			bbr->pacing_gain = BBR_DRAIN_GAIN;
+		}
+	}
+}
+
+static void
+bbr_update_state(struct cc_var *ccv, struct bbr *bbr, u64 now)
+{
+	switch (bbr->state) {
+	case BBR_DRAIN:
+		/* Drain what STARTUP queued, down to one BDP in flight. */
+		if (CCV(ccv, snd_max) - ccv->curack <=
+		    bbr_target_cwnd(ccv, bbr, BBR_UNIT))
+			bbr_enter_probe_bw(bbr, now);
+		break;
+	case BBR_PROBE_BW:
+		if (now - bbr->cycle_stamp > bbr->min_rtt) {
+			bbr->cycle_idx = (bbr->cycle_idx + 1) % BBR_CYCLE_LEN;
+			bbr->pacing_gain = bbr_cycle_gain[bbr->cycle_idx];
+			bbr->cycle_stamp = now;
+		}
+		break;
+	case BBR_PROBE_RTT:
+		if (now >= bbr->probe_rtt_done) {
+			bbr->min_rtt_stamp = now;
+			if (bbr->full_pipe)
+				bbr_enter_probe_bw(bbr, now);
+			else
+				bbr_enter_startup(bbr);
+		}
+		break;
+	case BBR_STARTUP:
+		break;
+	}
+}
+
+static void
+bbr_ack_received(struct cc_var *ccv, uint16_t type)
+{
+	struct bbr *bbr = (struct bbr *)ccv->cc_data;
+	u64 now = bbr_now();
+
+	if (type != CC_ACK)
+		return;
+
+	bbr->round_delivered += ccv->bytes_this_ack;
+	if (bbr->round_started && SEQ_GEQ(ccv->curack, bbr->round_end)) {
+		bbr_round_end(ccv, bbr, now);
+		bbr->round_started = false;
+	}
+	/*
+	 * Only time rounds with data in flight, or the next ACK would end
+	 * one at once and report a meaningless rate.
+	 */
+	if (!bbr->round_started && SEQ_GT(CCV(ccv, snd_max), ccv->curack)) {
+		bbr->round_started = true;
+		bbr->round_end = CCV(ccv, snd_max);
+		bbr->round_start = now;
+		bbr->round_delivered = 0;
+	}
+
+	if (bbr_has_model(bbr))
+		bbr_update_state(ccv, bbr, now);
+	bbr_set_pacing_rate(ccv, bbr);
+	bbr_set_cwnd(ccv, bbr);
+}
+
+static void
+bbr_after_idle(struct cc_var *ccv)
+{
+	struct bbr *bbr = (struct bbr *)ccv->cc_data;
+
+	/*
+	 * Restarting from idle there is no queue to drain or probe: send
+	 * at the estimated bandwidth.  Pacing keeps the old window from
+	 * leaving as one burst.
+	 */
+	if (bbr->state == BBR_PROBE_BW) {
+		bbr->pacing_gain = BBR_UNIT;
+		bbr_set_pacing_rate(ccv, bbr);
+	}
+	bbr->round_started = false;
+}
+
+static void
+bbr_cb_destroy(struct cc_var *ccv)
+{
+	if (ccv->cc_data != NULL)
+		free(ccv->cc_data);
+	/* Whatever comes next paces on its own terms, if at all. */
+	CCV(ccv, t_pacing_rate) = 0;
+}
+
+static int
+bbr_cb_init(struct cc_var *ccv)
+{
+	struct bbr *bbr;
+
+	bbr = (struct bbr *)malloc(sizeof(struct bbr));
+	if (bbr == NULL)
+		return (ENOMEM);
+	bzero(bbr, sizeof(*bbr));
+	bbr_enter_startup(bbr);
+	bbr->min_rtt = ~0ull;
+	bbr->min_rtt_stamp = bbr_now();
+	ccv->cc_data = bbr;
+
+	return (0);
+}
+
+static void
+bbr_conn_init(struct cc_var *ccv)
+{
+	struct bbr *bbr = (struct bbr *)ccv->cc_data;
+
+	bbr->round_started = false;
+	bbr->min_rtt_stamp = bbr_now();
+}
+
+static void
+bbr_cong_signal(struct cc_var *ccv, uint32_t type)
+{
+	struct bbr *bbr = (struct bbr *)ccv->cc_data;
+	u_int mss = CCV(ccv, t_maxseg);
+	u_long win;
+
+	/* Catch algos which mistakenly leak private signal types. */
+	KASSERT((type & CC_SIGPRIVMASK) == 0,
+	    ("%s: congestion signal type 0x%08x is private\n", __func__, type));
+
+	switch (type) {
+	case CC_NDUPACK:
+		/*
+		 * Loss is not taken as a sign of congestion, so recovery
+		 * only brings the window down to the path's BDP rather than
+		 * halving it.
+		 */
+		if (!IN_FASTRECOVERY(CCV(ccv, t_flags))) {
+			if (bbr_has_model(bbr))
+				win = bbr_target_cwnd(ccv, bbr, BBR_UNIT);
+			else
+				win = bsd_max(CCV(ccv, snd_cwnd) / 2 / mss, 2) *
+				    mss;
+			if (!IN_CONGRECOVERY(CCV(ccv, t_flags)))
+				CCV(ccv, snd_ssthresh) = win;
+			ENTER_RECOVERY(CCV(ccv, t_flags));
+		}
+		break;
+	case CC_RTO:
+		/*
+		 * The window was cut to one segment; the model stays, and
+		 * bbr_set_cwnd() grows the window back to it.
+		 */
+		bbr->round_started = false;
+		break;
+	}
+}
+
+static void
+bbr_post_recovery(struct cc_var *ccv)
+{
+	struct bbr *bbr = (struct bbr *)ccv->cc_data;
+
+	if (IN_FASTRECOVERY(CCV(ccv, t_flags))) {
+		if (bbr_has_model(bbr))
+			CCV(ccv, snd_cwnd) = bbr_target_cwnd(ccv, bbr,
+			    bbr->cwnd_gain);
+		else
+			CCV(ccv, snd_cwnd) = CCV(ccv, snd_ssthresh);
+	}
+}
@@ -57,6 +57,7 @@
 #include <bsd/sys/netinet/in_var.h>
 #include <bsd/sys/netinet/ip_var.h>
 #include <bsd/sys/netinet/ip_options.h>
+#include <bsd/sys/netinet/udp.h>
 
 #include <bsd/sys/net/routecache.hh>
 
@@ -115,6 +116,7 @@ ip_output(struct mbuf *m, struct mbuf *opt, struct route *ro, int flags,
 	struct m_tag *fwd_tag = NULL;
 	struct rtentry rte_one;
 	int have_ia_ref;
+	int segmented = 0;
 #ifdef IPSEC
 	int no_route_but_check_spd = 0;
 #endif
@@ -569,6 +571,23 @@ passout:
 	}
 
 	m->M_dat.MH.MH_pkthdr.csum_flags |= CSUM_IP;
+	/*
+	 * A UDP_SEGMENT super-packet the interface can't split is split here,
+	 * once the route is known, and its datagrams sent like fragments.
+	 */
+	if ((m->M_dat.MH.MH_pkthdr.csum_flags & CSUM_UDP_SEG) &&
+	    (ifp->if_hwassist & CSUM_UDP_SEG) == 0) {
+		if (m->M_dat.MH.MH_pkthdr.tso_segsz + hlen +
+		    sizeof(struct udphdr) > (u_int)mtu) {
+			error = EMSGSIZE;
+			goto bad;
+		}
+		error = ip_udp_segment(ip, &m, ifp->if_hwassist);
+		if (error)
+			goto bad;
+		segmented = 1;
+		goto sendchain;
+	}
 	sw_csum = m->M_dat.MH.MH_pkthdr.csum_flags & ~ifp->if_hwassist;
 	if (sw_csum & CSUM_DELAY_DATA) {
 		in_delayed_cksum(m);
@@ -587,7 +606,8 @@ passout:
 	 * care of the fragmentation for us, we can just send directly.
 	 */
 	if (ip->ip_len <= mtu ||
-	    (m->M_dat.MH.MH_pkthdr.csum_flags & ifp->if_hwassist & CSUM_TSO) != 0 ||
+	    (m->M_dat.MH.MH_pkthdr.csum_flags & ifp->if_hwassist &
+	     (CSUM_TSO | CSUM_UDP_SEG)) != 0 ||
 	    ((ip->ip_off & IP_DF) == 0 && (ifp->if_hwassist & CSUM_FRAGMENT))) {
 		ip->ip_len = htons(ip->ip_len);
 		ip->ip_off = htons(ip->ip_off);
@@ -602,7 +622,8 @@ passout:
 		 * once instead of for every generated packet.
 		 */
 		if (!(flags & IP_FORWARDING) && ia) {
-			if (m->M_dat.MH.MH_pkthdr.csum_flags & CSUM_TSO)
+			if (m->M_dat.MH.MH_pkthdr.csum_flags &
+			    (CSUM_TSO | CSUM_UDP_SEG))
 				ia->ia_ifa.if_opackets +=
 				    m->M_dat.MH.MH_pkthdr.len / m->M_dat.MH.MH_pkthdr.tso_segsz;
 			else
@@ -637,6 +658,7 @@ passout:
 	error = ip_fragment(ip, &m, mtu, ifp->if_hwassist, sw_csum);
 	if (error)
 		goto bad;
+sendchain:
 	for (; m; m = m0) {
 		m0 = m->m_hdr.mh_nextpkt;
 		m->m_hdr.mh_nextpkt = 0;
@@ -658,7 +680,7 @@ passout:
 			m_freem(m);
 	}
 
-	if (error == 0)
+	if (error == 0 && !segmented)
 		IPSTAT_INC(ips_fragmented);
 
 done:
@@ -670,6 +692,92 @@ bad:
 	goto done;
 }
 
+/*
+ * Split a UDP_SEGMENT super-packet, whose UDP payload is a run of datagrams
+ * of tso_segsz bytes each but the last, into a chain of UDP datagrams.
+ * m_seg points to the packet, with ip_len and ip_off still in host order;
+ * on return it points to the chain, with complete headers and checksums.
+ * Return 0 if no error. If error, m_seg is set to NULL and the original
+ * packet as well as any datagrams built so far are freed.
+ *
+ * if_hwassist_flags is the hw offload capabilities (see if_data.ifi_hwassist)
+ */
+int
+ip_udp_segment(struct ip *ip, struct mbuf **m_seg, u_long if_hwassist_flags)
+{
+	struct mbuf *m0 = *m_seg;	/* the original packet */
+	struct mbuf *chain = NULL, **mnext = &chain;
+	int hlen = ip->ip_hl << 2;
+	int hdrlen = hlen + sizeof(struct udphdr);
+	int segsz = m0->M_dat.MH.MH_pkthdr.tso_segsz;
+	int csum_flags = m0->M_dat.MH.MH_pkthdr.csum_flags & ~CSUM_UDP_SEG;
+	int off, len, nsegs = 0;
+	int error = 0;
+
+	for (off = hdrlen; off < ip->ip_len; off += len, nsegs++) {
+		struct ip *mip;
+		struct udphdr *uh;
+		struct mbuf *m;
+
+		len = imin(segsz, ip->ip_len - off);
+		MGETHDR(m, M_DONTWAIT, MT_DATA);
+		if (m == NULL) {
+			error = ENOBUFS;
+			break;
+		}
+		*mnext = m;
+		mnext = &m->m_hdr.mh_nextpkt;
+		m->m_hdr.mh_flags |= m0->m_hdr.mh_flags & (M_MCAST | M_FLOWID);
+		/*
+		 * In the first mbuf, leave room for the link header, then copy
+		 * the IP and UDP headers. The payload goes into an additional
+		 * mbuf chain returned by m_copym().
+		 */
+		m->m_hdr.mh_data += max_linkhdr;
+		m_copydata(m0, 0, hdrlen, mtod(m, caddr_t));
+		m->m_hdr.mh_len = hdrlen;
+		m->m_hdr.mh_next = m_copym(m0, off, len, M_DONTWAIT);
+		if (m->m_hdr.mh_next == NULL) {
+			error = ENOBUFS;
+			break;
+		}
+		m->M_dat.MH.MH_pkthdr.len = hdrlen + len;
+		m->M_dat.MH.MH_pkthdr.rcvif = NULL;
+		m->M_dat.MH.MH_pkthdr.flowid = m0->M_dat.MH.MH_pkthdr.flowid;
+		m->M_dat.MH.MH_pkthdr.csum_flags = csum_flags;
+		m->M_dat.MH.MH_pkthdr.csum_data = m0->M_dat.MH.MH_pkthdr.csum_data;
+
+		mip = mtod(m, struct ip *);
+		mip->ip_len = hdrlen + len;
+		if (nsegs > 0)
+			mip->ip_id = ip_newid();
+		uh = (struct udphdr *)((caddr_t)mip + hlen);
+		uh->uh_ulen = htons(sizeof(struct udphdr) + len);
+		if (csum_flags & CSUM_UDP) {
+			uh->uh_sum = in_pseudo(mip->ip_src.s_addr,
+			    mip->ip_dst.s_addr,
+			    htons(sizeof(struct udphdr) + len + IPPROTO_UDP));
+			if ((if_hwassist_flags & CSUM_UDP) == 0)
+				in_delayed_cksum(m);
+		}
+		m->M_dat.MH.MH_pkthdr.csum_flags &= if_hwassist_flags;
+		mip->ip_len = htons(mip->ip_len);
+		mip->ip_off = htons(mip->ip_off);
+		mip->ip_sum = 0;
+		if ((if_hwassist_flags & CSUM_IP) == 0)
+			mip->ip_sum = in_cksum(m, hlen);
+	}
+	m_freem(m0);
+	if (error) {
+		for (; chain; chain = m0) {
+			m0 = chain->m_hdr.mh_nextpkt;
+			m_freem(chain);
+		}
+	}
+	*m_seg = chain;
+	return (error);
+}
+
 /*
  * Create a chain of fragments which fit the given mtu. m_frag points to the
  * mbuf to be fragmented; on return it points to the chain with the fragments.
@@ -131,6 +131,12 @@ struct tcphdr {
 #define    TCPOLEN_TSTAMP_APPA		(TCPOLEN_TIMESTAMP+2) /* appendix A */
 #define	TCPOPT_SIGNATURE	19		/* Keyed MD5: RFC 2385 */
 #define	   TCPOLEN_SIGNATURE		18
+#define	TCPOPT_FASTOPEN		34		/* TCP Fast Open: RFC 7413 */
+#define	   TCPOLEN_FASTOPEN_REQ		2	/* cookie request, no cookie */
+
+#define	TCP_FASTOPEN_MIN_COOKIE_LEN	4
+#define	TCP_FASTOPEN_MAX_COOKIE_LEN	16
+#define	TCP_FASTOPEN_COOKIE_LEN		8	/* length of the cookies we issue */
 
 /* Miscellaneous constants */
 #define	MAX_SACK_BLKS	6	/* Max # SACK blocks stored at receiver side */
@@ -197,6 +203,7 @@ struct tcphdr {
 #define	TCP_KEEPIDLE	0x100	/* L,N,X start keeplives after this period */
 #define	TCP_KEEPINTVL	0x200	/* L,N interval between keepalives */
 #define	TCP_KEEPCNT	0x400	/* L,N number of keepalives before close */
+#define	TCP_FASTOPEN	0x800	/* L max pending TCP Fast Open connections */
 
 #define	TCP_CA_NAME_MAX	16	/* max congestion control name length */
 
@@ -205,6 +212,7 @@ struct tcphdr {
 #define	TCPI_OPT_WSCALE		0x04
 #define	TCPI_OPT_ECN		0x08
 #define	TCPI_OPT_TOE		0x10
+#define	TCPI_OPT_SYN_DATA	0x20	/* As on Linux: TFO data in SYN taken */
 
 /*
  * The TCP_INFO socket option comes from the Linux 2.6 TCP API, and permits
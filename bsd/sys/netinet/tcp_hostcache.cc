@@ -502,6 +502,58 @@ tcp_hc_updatemtu(struct in_conninfo *inc, u_long mtu)
 	THC_UNLOCK(&hc_entry->rmx_head->hch_mtx);
 }
 
+/*
+ * External function: copy out the TCP Fast Open cookie the host gave us
+ * and return its length, or 0 if we have none.
+ */
+int
+tcp_hc_gettfo(struct in_conninfo *inc, u_char *cookie)
+{
+	struct hc_metrics *hc_entry;
+	int len;
+
+	hc_entry = tcp_hc_lookup(inc);
+	if (hc_entry == NULL) {
+		return 0;
+	}
+	hc_entry->rmx_hits++;
+	hc_entry->rmx_expire = V_tcp_hostcache.expire; /* start over again */
+
+	len = hc_entry->rmx_tfo_len;
+	bcopy(hc_entry->rmx_tfo_cookie, cookie, len);
+	THC_UNLOCK(&hc_entry->rmx_head->hch_mtx);
+	return len;
+}
+
+/*
+ * External function: remember the TCP Fast Open cookie a host gave us.
+ * Creates a new entry if none was found.
+ */
+void
+tcp_hc_updatetfo(struct in_conninfo *inc, const u_char *cookie, int len)
+{
+	struct hc_metrics *hc_entry;
+
+	KASSERT(len <= TCP_FASTOPEN_MAX_COOKIE_LEN,
+	    ("%s: cookie too long", __func__));
+
+	hc_entry = tcp_hc_lookup(inc);
+	if (hc_entry == NULL) {
+		hc_entry = tcp_hc_insert(inc);
+		if (hc_entry == NULL)
+			return;
+	}
+	hc_entry->rmx_updates++;
+	hc_entry->rmx_expire = V_tcp_hostcache.expire; /* start over again */
+
+	bcopy(cookie, hc_entry->rmx_tfo_cookie, len);
+	hc_entry->rmx_tfo_len = len;
+
+	TAILQ_REMOVE(&hc_entry->rmx_head->hch_bucket, hc_entry, rmx_q);
+	TAILQ_INSERT_HEAD(&hc_entry->rmx_head->hch_bucket, hc_entry, rmx_q);
+	THC_UNLOCK(&hc_entry->rmx_head->hch_mtx);
+}
+
 /*
  * External function: update the TCP metrics of an entry in the hostcache.
  * Creates a new entry if none was found.
@@ -60,6 +60,9 @@ struct hc_metrics {
 	u_long	rmx_cwnd;	/* congestion window */
 	u_long	rmx_sendpipe;	/* outbound delay-bandwidth product */
 	u_long	rmx_recvpipe;	/* inbound delay-bandwidth product */
+	u_char	rmx_tfo_cookie[TCP_FASTOPEN_MAX_COOKIE_LEN];
+				/* TCP Fast Open cookie the host gave us */
+	u_char	rmx_tfo_len;	/* its length, 0 if none */
 	/* TCP hostcache internal data */
 	int	rmx_expire;	/* lifetime for object */
 	u_long	rmx_hits;	/* number of hits */
@@ -156,6 +156,11 @@ SYSCTL_VNET_INT(_net_inet_tcp_ecn, OID_AUTO, maxretries, CTLFLAG_RW,
     &VNET_NAME(tcp_ecn_maxretries), 0,
     "Max retries before giving up on ECN");
 
+VNET_DEFINE(int, tcp_do_fastopen) = 1;
+SYSCTL_VNET_INT(_net_inet_tcp, OID_AUTO, fastopen, CTLFLAG_RW,
+    &VNET_NAME(tcp_do_fastopen), 0,
+    "TCP Fast Open (RFC 7413) support");
+
 VNET_DEFINE(int, tcp_insecure_rst) = 0;
 #define	V_tcp_insecure_rst	VNET(tcp_insecure_rst)
 SYSCTL_VNET_INT(_net_inet_tcp, OID_AUTO, insecure_rst, CTLFLAG_RW,
@@ -204,6 +209,8 @@ static void inline	cc_ack_received(struct tcpcb *tp, struct tcphdr *th,
 			    uint16_t type);
 static void inline	cc_conn_init(struct tcpcb *tp);
 static void inline	cc_post_recovery(struct tcpcb *tp, struct tcphdr *th);
+static void	 tcp_fastopen_synack(struct tcpcb *, struct tcpopt *,
+		     struct tcphdr *);
 
 /*
  * Kernel module interface for updating tcpstat.  The argument is an index
@@ -398,6 +405,30 @@ cc_post_recovery(struct tcpcb *tp, struct tcphdr *th)
 	tp->t_bytes_acked = 0;
 }
 
+/*
+ * Our SYN went out under TCP Fast Open and the SYN|ACK is in.  Remember
+ * the cookie the peer handed us for the next connection, and if it did
+ * not take the data our SYN carried, have tcp_output() send it again
+ * right away rather than wait for the retransmit timer.
+ */
+static void
+tcp_fastopen_synack(struct tcpcb *tp, struct tcpopt *to, struct tcphdr *th)
+{
+	INP_LOCK_ASSERT(tp->t_inpcb);
+
+	if ((to->to_flags & TOF_FASTOPEN) && to->to_tfo_len)
+		tcp_hc_updatetfo(&tp->t_inpcb->inp_inc, to->to_tfo_cookie,
+		    to->to_tfo_len);
+	if (tp->snd_max > tp->iss + 1) {
+		if (th->th_ack < tp->snd_max) {
+			TCPSTAT_INC(tcps_tfo_active_fail);
+			tp->snd_nxt = th->th_ack;
+		} else
+			tp->t_flags2 |= TF2_SYN_DATA;
+	}
+	tp->t_flags &= ~TF_FASTOPEN;
+}
+
 static inline void
 tcp_fields_to_host(struct tcphdr *th)
 {
@@ -938,7 +969,33 @@ relocked:
 			    (void *)tcp_saveipgen, &tcp_savetcp, 0);
 #endif
 		tcp_dooptions(&to, optp, optlen, TO_SYN);
-		syncache_add(&inc, &to, th, inp, &so, m);
+		if (syncache_add(&inc, &to, th, inp, &so, m)) {
+			/*
+			 * The SYN carried a valid TCP Fast Open cookie
+			 * and a socket was created for it in SYN_RECEIVED.
+			 * Hand it to accept() right away, then let
+			 * tcp_do_segment() queue the data the SYN carries
+			 * and answer with our SYN|ACK.
+			 */
+			INP_UNLOCK(inp);	/* listen socket */
+			inp = sotoinpcb(so);
+			INP_LOCK(inp);		/* new connection */
+			tp = intotcpcb(inp);
+			if (tlen > 0)
+				tp->t_flags2 |= TF2_SYN_DATA;
+			SOCK_LOCK(so);
+			soisconnected(so);
+
+			bool want_close;
+			tcp_do_segment(m, th, so, tp, drop_hdrlen, tlen,
+			    iptos, ti_locked, want_close);
+			INP_INFO_UNLOCK_ASSERT(&V_tcbinfo);
+			// if tcp_close() indeed closes, it also unlocks
+			if (!want_close || tcp_close(tp)) {
+				INP_UNLOCK(inp);
+			}
+			return;
+		}
 		/*
 		 * Entry added to syncache and mbuf consumed.
 		 * Everything already unlocked by syncache_add().
@@ -1497,6 +1554,8 @@ tcp_do_segment(struct mbuf *m, struct tcphdr *th, struct socket *so,
 			tp->rcv_adv += imin(tp->rcv_wnd,
 			    TCP_MAXWIN << tp->rcv_scale);
 			tp->snd_una++;		/* SYN is acked */
+			if (tp->t_flags & TF_FASTOPEN)
+				tcp_fastopen_synack(tp, &to, th);
 			/*
 			 * If there's data, delay ACK; if there's also a FIN
 			 * ACKNOW will be turned on later.
@@ -1542,6 +1601,7 @@ tcp_do_segment(struct mbuf *m, struct tcphdr *th, struct socket *so,
 			 * If there was no CC option, clear cached CC value.
 			 */
 			tp->t_flags |= (TF_ACKNOW | TF_NEEDSYN);
+			tp->t_flags &= ~TF_FASTOPEN;
 			tcp_timer_activate(tp, TT_REXMT, 0);
 			tp->set_state(TCPS_SYN_RECEIVED);
 		}
@@ -1914,8 +1974,13 @@ tcp_do_segment(struct mbuf *m, struct tcphdr *th, struct socket *so,
 	case TCPS_SYN_RECEIVED:
 
 		TCPSTAT_INC(tcps_connects);
-		SOCK_LOCK(so);
-		soisconnected(so);
+		if (tp->t_flags & TF_FASTOPEN) {
+			/* Already handed to accept() when the SYN came */
+			tp->t_flags &= ~TF_FASTOPEN;
+		} else {
+			SOCK_LOCK(so);
+			soisconnected(so);
+		}
 		/* Do window scaling? */
 		if ((tp->t_flags & (TF_RCVD_SCALE|TF_REQ_SCALE)) ==
 			(TF_RCVD_SCALE|TF_REQ_SCALE)) {
@@ -2423,7 +2488,8 @@ dodata:							/* XXX */
 		 */
 		if (th->th_seq == tp->rcv_nxt &&
 		    LIST_EMPTY(&tp->t_segq) &&
-		    TCPS_HAVEESTABLISHED(tp->get_state())) {
+		    (TCPS_HAVEESTABLISHED(tp->get_state()) ||
+		     (tp->t_flags & TF_FASTOPEN))) {
 			if (DELAY_ACK(tp))
 				tp->t_flags |= TF_DELACK;
 			else
@@ -2724,6 +2790,23 @@ tcp_dooptions(struct tcpopt *to, u_char *cp, int cnt, int flags)
 			to->to_sacks = cp + 2;
 			TCPSTAT_INC(tcps_sack_rcv_blocks);
 			break;
+		case TCPOPT_FASTOPEN:
+			/* Empty (a cookie request) or a whole cookie */
+			if (optlen != TCPOLEN_FASTOPEN_REQ &&
+			    (optlen < TCPOLEN_FASTOPEN_REQ +
+				TCP_FASTOPEN_MIN_COOKIE_LEN ||
+			     optlen > TCPOLEN_FASTOPEN_REQ +
+				TCP_FASTOPEN_MAX_COOKIE_LEN ||
+			     (optlen & 1)))
+				continue;
+			if (!(flags & TO_SYN))
+				continue;
+			if (!V_tcp_do_fastopen)
+				continue;
+			to->to_flags |= TOF_FASTOPEN;
+			to->to_tfo_len = optlen - TCPOLEN_FASTOPEN_REQ;
+			to->to_tfo_cookie = to->to_tfo_len ? cp + 2 : NULL;
+			break;
 		default:
 			continue;
 		}
@@ -75,6 +75,8 @@
 
 #include <machine/in_cksum.h>
 
+#include <osv/xmit_batch.hh>
+
 TRACEPOINT(trace_tso_flush_sched, "");
 TRACEPOINT(trace_tso_flush_cancel, "");
 TRACEPOINT(trace_tso_flush_fire, "Going to send %d bytes", int);
@@ -88,6 +90,7 @@ TRACEPOINT(trace_tcp_output_ret, "tcp_output() returning: %d", int);
 TRACEPOINT(trace_tcp_output_just_ret, "tcp_output() just returning: len %d off %d sendwin(snd_wnd: %d snd_cwnd %d) %d sb_cc %d", int, int, int, int, int, int);
 
 TRACEPOINT(trace_tcp_output_cant_take_inp_lock, "Can't take inp lock");
+TRACEPOINT(trace_tcp_output_paced, "%p: held back for %lu ns", void*, u64);
 
 VNET_DEFINE(int, path_mtu_discovery) = 1;
 SYSCTL_VNET_INT(_net_inet_tcp, OID_AUTO, path_mtu_discovery, CTLFLAG_RW,
@@ -216,6 +219,39 @@ static inline bool tcp_tso_send_now(struct tcpcb *tp, long len,
 	return false;
 }
 
+/*
+ * Rate, in bytes per second, to pace the connection's segments at: the
+ * lower of what the congestion control asks for and the socket's
+ * SO_MAX_PACING_RATE.  0 means the connection is not paced.
+ */
+static inline u64 tcp_pacing_rate(struct tcpcb *tp, struct socket *so)
+{
+	u64 rate = tp->t_pacing_rate;
+	u64 max = so->so_max_pacing_rate;
+
+	if (max != ~0ull && max != 0 && (rate == 0 || max < rate))
+		rate = max;
+	return rate;
+}
+
+static inline u64 tcp_pace_now()
+{
+	return osv::clock::uptime::now().time_since_epoch().count();
+}
+
+/*
+ * Account for a segment of len bytes (headers included) leaving at the
+ * pacing rate.  A connection which was idle does not earn credit for it:
+ * the next departure is computed from now, not from the last one.
+ */
+static inline void tcp_pace_sent(struct tcpcb *tp, u64 rate, long len)
+{
+	u64 now = tcp_pace_now();
+
+	tp->t_pace_next = bsd_max(tp->t_pace_next, now) +
+	    (u64)len * 1000000000ull / rate;
+}
+
 /*
  * Tcp output routine: figure out what should be sent and send it.
  */
@@ -239,6 +275,14 @@ tcp_output(struct tcpcb *tp)
 	struct sackhole *p;
 	int tso, mtu;
 	struct tcpopt to;
+	u64 pacing_rate;
+	u_char tfo_cookie[TCP_FASTOPEN_MAX_COOKIE_LEN];
+	int tfo_len;
+	/*
+	 * We may send several segments in one go; let the driver notify
+	 * the device once, after the last of them.
+	 */
+	osv::xmit_batch tx_batch;
 #if 0
 	int maxburst = TCP_MAXBURST;
 #endif
@@ -448,6 +492,23 @@ after_sack_rexmit:
 		off--, len++;
 	}
 
+	/*
+	 * Before the handshake completes, data only goes out in our SYN,
+	 * and only under TCP Fast Open with a cookie the peer handed us
+	 * earlier: a segment's worth of it goes with the cookie.  Without
+	 * a cookie the SYN asks for one and the data waits for the SYN,ACK.
+	 */
+	tfo_len = 0;
+	if (tp->get_state() == TCPS_SYN_SENT) {
+		if ((flags & TH_SYN) && (tp->t_flags & TF_FASTOPEN))
+			tfo_len = tcp_hc_gettfo(&tp->t_inpcb->inp_inc,
+			    tfo_cookie);
+		if (tfo_len == 0)
+			len = 0;
+		else if (len > tp->t_maxseg)
+			len = tp->t_maxseg;
+	}
+
 	/*
 	 * Be careful not to send data and/or FIN on SYN segments.
 	 * This measure is needed to prevent interoperability problems
@@ -771,6 +832,24 @@ just_return:
 
 send:
 	SOCK_LOCK_ASSERT(so);
+	/*
+	 * Pacing: data leaves no earlier than t_pace_next, and whatever
+	 * is held back goes out when the TT_PACE timer fires.  SYNs,
+	 * window probes and segments carrying an ACK the peer is waiting
+	 * for are not held back.
+	 */
+	pacing_rate = tcp_pacing_rate(tp, so);
+	if (pacing_rate && len && !(flags & (TH_SYN | TH_RST)) &&
+	    !(tp->t_flags & (TF_FORCEDATA | TF_ACKNOW))) {
+		u64 now = tcp_pace_now();
+		if (now < tp->t_pace_next) {
+			trace_tcp_output_paced(tp, tp->t_pace_next - now);
+			if (!tcp_timer_active(tp, TT_PACE))
+				tcp_timer_activate_ns(tp, TT_PACE,
+				    tp->t_pace_next - now);
+			return (0);
+		}
+	}
 	/*
 	 * Before ESTABLISHED, force sending of initial options
 	 * unless TCP set not to do any options.
@@ -834,9 +913,22 @@ send:
 		if (tp->t_flags & TF_SIGNATURE)
 			to.to_flags |= TOF_SIGNATURE;
 #endif /* TCP_SIGNATURE */
+		/* TCP Fast Open cookie, or a request for one. */
+		if ((flags & TH_SYN) && (tp->t_flags & TF_FASTOPEN) &&
+		    tp->get_state() == TCPS_SYN_SENT) {
+			to.to_tfo_len = tfo_len;
+			to.to_tfo_cookie = tfo_cookie;
+			to.to_flags |= TOF_FASTOPEN;
+		}
 
 		/* Processing the options. */
 		hdrlen += optlen = tcp_addoptions(&to, opt);
+
+		/* No room left for the cookie: the data waits, too. */
+		if (tfo_len && !(to.to_flags & TOF_FASTOPEN))
+			len = 0;
+		else if (tfo_len && len)
+			TCPSTAT_INC(tcps_tfo_active);
 	}
 
 #ifdef INET6
@@ -903,6 +995,21 @@ send:
 	} else
 		tso = 0;
 
+	/*
+	 * A paced TSO burst holds about a millisecond's worth of data, so
+	 * it does not leave as a line rate train.
+	 */
+	if (tso && pacing_rate) {
+		u_int seg = tp->t_maxopd - optlen;
+		long quantum = bsd_max(pacing_rate / 1000, 2 * (u64)seg);
+
+		if (len > quantum) {
+			len = quantum - quantum % seg;
+			flags &= ~TH_FIN;
+			sendalot = 1;
+		}
+	}
+
 	KASSERT(len + hdrlen + ipoptlen <= IP_MAXSEGMENT,
 	    ("%s: len > IP_MAXPACKET", __func__));
 
@@ -1467,6 +1574,9 @@ out:
 	}
 	TCPSTAT_INC(tcps_sndtotal);
 
+	if (pacing_rate && len)
+		tcp_pace_sent(tp, pacing_rate, len + hdrlen);
+
 	/*
 	 * Data sent (as far as we can tell).
 	 * If this advertises a larger window than any other segment,
@@ -1643,6 +1753,21 @@ tcp_addoptions(struct tcpopt *to, u_char *optp)
 			TCPSTAT_INC(tcps_sack_send_blocks);
 			break;
 			}
+		case TOF_FASTOPEN:
+			{
+			int tfolen = TCPOLEN_FASTOPEN_REQ + to->to_tfo_len;
+
+			if (TCP_MAXOLEN - optlen < tfolen) {
+				to->to_flags &= ~TOF_FASTOPEN;
+				continue;
+			}
+			optlen += tfolen;
+			*optp++ = TCPOPT_FASTOPEN;
+			*optp++ = tfolen;
+			bcopy(to->to_tfo_cookie, optp, to->to_tfo_len);
+			optp += to->to_tfo_len;
+			break;
+			}
 		default:
 			panic("%s: unknown TCP option type", __func__);
 			break;
@@ -108,6 +108,9 @@ struct syncache *syncache_lookup(struct in_conninfo *, struct syncache_head **);
 static int syncache_respond(struct syncache *);
 static struct socket *syncache_socket(struct syncache *, struct socket *,
 	struct mbuf *m);
+static struct socket *syncache_tfo_socket(struct syncache *, struct socket *,
+	struct mbuf *m);
+static void syncache_tfo_cookie(struct in_conninfo *, u_int8_t *);
 static void syncache_timeout(struct syncache *sc, struct syncache_head *sch,
 	int docallout);
 static void syncache_timer(struct syncache_head *sch, serial_timer_task& timer);
@@ -216,6 +219,8 @@ void syncache_init(void)
 	V_tcp_syncache.bucket_limit = TCP_SYNCACHE_BUCKETLIMIT;
 	V_tcp_syncache.rexmt_limit = SYNCACHE_MAXREXMTS;
 	V_tcp_syncache.hash_secret = arc4random();
+	for (int i = 0; i < TCP_FASTOPEN_SECRET_SIZE; i++)
+		V_tcp_syncache.tfo_secret[i] = arc4random();
 
 	TUNABLE_INT_FETCH("net.inet.tcp.syncache.hashsize",
 		&V_tcp_syncache.hashsize); TUNABLE_INT_FETCH("net.inet.tcp.syncache.bucketlimit",
@@ -819,6 +824,52 @@ syncache_socket(struct syncache *sc, struct socket *lso, struct mbuf *m)
 	return (NULL );
 }
 
+/*
+ * Build the socket for a SYN carrying a valid TCP Fast Open cookie.  It
+ * sends its SYN,ACK itself once the data in the SYN has been queued to
+ * it, so that data is acknowledged along with the SYN.
+ */
+static struct socket *
+syncache_tfo_socket(struct syncache *sc, struct socket *lso, struct mbuf *m)
+{
+	struct socket *so;
+	struct tcpcb *tp;
+
+	so = syncache_socket(sc, lso, m);
+	if (so == NULL)
+		return (NULL);
+	tp = sototcpcb(so);
+	INP_LOCK(tp->t_inpcb);
+	tp->t_flags |= TF_FASTOPEN | TF_ACKNOW;
+	tp->snd_max = tp->iss;
+	tp->snd_nxt = tp->iss;
+	INP_UNLOCK(tp->t_inpcb);
+	return (so);
+}
+
+/*
+ * The TCP Fast Open cookie for a peer: a MAC of its address, so it holds
+ * whichever port the peer connects from.
+ */
+static void
+syncache_tfo_cookie(struct in_conninfo *inc, u_int8_t *cookie)
+{
+	MD5_CTX ctx;
+	u_int8_t digest[MD5_DIGEST_LENGTH];
+
+	MD5Init(&ctx);
+	MD5Update(&ctx, V_tcp_syncache.tfo_secret,
+		sizeof(V_tcp_syncache.tfo_secret));
+#ifdef INET6
+	if (inc->inc_flags & INC_ISIPV6)
+		MD5Update(&ctx, &inc->inc6_faddr, sizeof(inc->inc6_faddr));
+	else
+#endif
+	MD5Update(&ctx, &inc->inc_faddr, sizeof(inc->inc_faddr));
+	MD5Final(digest, &ctx);
+	bcopy(digest, cookie, TCP_FASTOPEN_COOKIE_LEN);
+}
+
 static void
 syncache_remove_and_free(struct syncache_head *sch, struct syncache *sc)
 {
@@ -961,8 +1012,13 @@ failed:
  * DoS attack, an attacker could send data which would eventually
  * consume all available buffer space if it were ACKed.  By not ACKing
  * the data, we avoid this DoS scenario.
+ *
+ * The exception is a SYN carrying a valid TCP Fast Open cookie, which
+ * proves the peer is at the address it claims: the connection is then
+ * created right away and returned in *lsop, and we return 1 with the
+ * locks still held, for tcp_input() to process the SYN and its data on it.
  */
-static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
+static int _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	struct tcphdr *th, struct inpcb *inp, struct socket **lsop, struct mbuf *m,
 	struct toe_usrreqs *tu, void *toepcb)
 {
@@ -974,6 +1030,8 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	u_int32_t flowtmp;
 	u_int ltflags;
 	int win, sb_hiwat, ip_ttl, ip_tos;
+	int tfo_open = 0, tfo_respond = 0;
+	u_int8_t tfo_cookie[TCP_FASTOPEN_COOKIE_LEN];
 	char *s;
 #ifdef INET6
 	int autoflowlabel = 0;
@@ -1006,6 +1064,29 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	sb_hiwat = so->so_rcv.sb_hiwat;
 	ltflags = (tp->t_flags & (TF_NOOPT | TF_SIGNATURE));
 
+	/*
+	 * TCP Fast Open, if the listener enabled it.  A SYN asking for a
+	 * cookie, or carrying a stale one, gets a cookie with the SYN,ACK.
+	 * A SYN carrying a valid one opens the connection at once, unless
+	 * the listener already has its TCP_FASTOPEN queue length of
+	 * connections waiting to be accepted.
+	 */
+	if (tp->t_tfo_qlen && (to->to_flags & TOF_FASTOPEN)) {
+		syncache_tfo_cookie(inc, tfo_cookie);
+		if (to->to_tfo_len == 0) {
+			TCPSTAT_INC(tcps_tfo_cookie_req);
+			tfo_respond = 1;
+		} else if (to->to_tfo_len != TCP_FASTOPEN_COOKIE_LEN ||
+		    bcmp(to->to_tfo_cookie, tfo_cookie,
+			TCP_FASTOPEN_COOKIE_LEN) != 0) {
+			TCPSTAT_INC(tcps_tfo_bad_cookie);
+			tfo_respond = 1;
+		} else if (so->so_qlen >= tp->t_tfo_qlen)
+			TCPSTAT_INC(tcps_tfo_qoverflow);
+		else
+			tfo_open = 1;
+	}
+
 	/* By the time we drop the lock these should no longer be used. */
 	so = NULL;
 	tp = NULL;
@@ -1018,8 +1099,11 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	} else
 	mac_syncache_create(maclabel, inp);
 #endif
-	INP_UNLOCK(inp);
-	INP_INFO_WUNLOCK(&V_tcbinfo);
+	/* A Fast Open connection is created under the locks. */
+	if (!tfo_open) {
+		INP_UNLOCK(inp);
+		INP_INFO_WUNLOCK(&V_tcbinfo);
+	}
 
 	/*
 	 * Remember the IP options, if any.
@@ -1049,6 +1133,12 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	SCH_LOCK_ASSERT(sch);
 	if (sc != NULL ) {
 		TCPSTAT_INC(tcps_sc_dupsyn);
+		if (tfo_open) {
+			/* Let the handshake under way complete instead. */
+			INP_UNLOCK(inp);
+			INP_INFO_WUNLOCK(&V_tcbinfo);
+			tfo_open = 0;
+		}
 		if (ipopts) {
 			/*
 			 * If we were remembering a previous source route,
@@ -1089,7 +1179,12 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 		goto done;
 	}
 
-	sc = (syncache *)uma_zalloc(V_tcp_syncache.zone, M_NOWAIT | M_ZERO);
+	if (tfo_open) {
+		/* The connection exists at once, so it needs no entry. */
+		bzero(&scs, sizeof(scs));
+		sc = &scs;
+	} else
+		sc = (syncache *)uma_zalloc(V_tcp_syncache.zone, M_NOWAIT | M_ZERO);
 	if (sc == NULL ) {
 		/*
 		 * The zone allocator couldn't provide more entries.
@@ -1205,6 +1300,8 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 		sc->sc_flags |= SCF_NOOPT;
 	if ((th->th_flags & (TH_ECE | TH_CWR)) && V_tcp_do_ecn)
 		sc->sc_flags |= SCF_ECN;
+	if (tfo_respond)
+		sc->sc_flags |= SCF_TFO;
 
 	if (V_tcp_syncookies) {
 		syncookie_generate(sch, sc, &flowtmp);
@@ -1221,6 +1318,21 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 	}
 	SCH_UNLOCK(sch);
 
+	if (tfo_open) {
+		*lsop = syncache_tfo_socket(sc, *lsop, m);
+		if (*lsop != NULL) {
+			TCPSTAT_INC(tcps_tfo_passive);
+			return (1);
+		}
+		/* Drop the SYN; the peer will retransmit it. */
+		TCPSTAT_INC(tcps_sc_aborted);
+		if (sc->sc_ipopts)
+			(void)m_free(sc->sc_ipopts);
+		INP_UNLOCK(inp);
+		INP_INFO_WUNLOCK(&V_tcbinfo);
+		goto done;
+	}
+
 	/*
 	 * Do a standard 3-way handshake.
 	 */
@@ -1247,6 +1359,7 @@ static void _syncache_add(struct in_conninfo *inc, struct tcpopt *to,
 		*lsop = NULL;
 		m_freem(m);
 	}
+	return (0);
 }
 
 static int syncache_respond(struct syncache *sc)
@@ -1257,6 +1370,7 @@ static int syncache_respond(struct syncache *sc)
 	int optlen, error = 0; /* Make compiler happy */
 	u_int16_t hlen, tlen, mssopt;
 	struct tcpopt to;
+	u_int8_t tfo_cookie[TCP_FASTOPEN_COOKIE_LEN];
 #ifdef INET6
 	struct ip6_hdr *ip6 = NULL;
 #endif
@@ -1373,6 +1487,12 @@ static int syncache_respond(struct syncache *sc)
 		if (sc->sc_flags & SCF_SIGNATURE)
 		to.to_flags |= TOF_SIGNATURE;
 #endif
+		if (sc->sc_flags & SCF_TFO) {
+			syncache_tfo_cookie(&sc->sc_inc, tfo_cookie);
+			to.to_tfo_len = TCP_FASTOPEN_COOKIE_LEN;
+			to.to_tfo_cookie = tfo_cookie;
+			to.to_flags |= TOF_FASTOPEN;
+		}
 		optlen = tcp_addoptions(&to, (u_char *)(th + 1));
 
 		/* Adjust headers by option size. */
@@ -1419,10 +1539,10 @@ static int syncache_respond(struct syncache *sc)
 	return (error);
 }
 
-void syncache_add(struct in_conninfo *inc, struct tcpopt *to, struct tcphdr *th,
+int syncache_add(struct in_conninfo *inc, struct tcpopt *to, struct tcphdr *th,
 	struct inpcb *inp, struct socket **lsop, struct mbuf *m)
 {
-	_syncache_add(inc, to, th, inp, lsop, m, NULL, NULL );
+	return _syncache_add(inc, to, th, inp, lsop, m, NULL, NULL );
 }
 
 /*
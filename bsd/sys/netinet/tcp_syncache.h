@@ -49,7 +49,7 @@ void	syncache_destroy(void);
 void	 syncache_unreach(struct in_conninfo *, struct tcphdr *);
 int	 syncache_expand(struct in_conninfo *, struct tcpopt *,
 	     struct tcphdr *, struct socket **, struct mbuf *);
-void	 syncache_add(struct in_conninfo *, struct tcpopt *,
+int	 syncache_add(struct in_conninfo *, struct tcpopt *,
 	     struct tcphdr *, struct inpcb *, struct socket **, struct mbuf *);
 
 void	 syncache_chkrst(struct in_conninfo *, struct tcphdr *);
@@ -97,10 +97,13 @@ struct syncache {
 #define SCF_SIGNATURE	0x20			/* send MD5 digests */
 #define SCF_SACK	0x80			/* send SACK option */
 #define SCF_ECN		0x100			/* send ECN setup packet */
+#define SCF_TFO		0x200			/* send a TCP Fast Open cookie */
 
 #define	SYNCOOKIE_SECRET_SIZE	8	/* dwords */
 #define	SYNCOOKIE_LIFETIME	16	/* seconds */
 
+#define	TCP_FASTOPEN_SECRET_SIZE	4	/* dwords */
+
 TAILQ_HEAD(sch_head, syncache);
 
 struct syncache_head {
@@ -128,6 +131,7 @@ struct tcp_syncache {
 	u_int	cache_limit;
 	u_int	rexmt_limit;
 	u_int	hash_secret;
+	u_int32_t tfo_secret[TCP_FASTOPEN_SECRET_SIZE];
 };
 
 #endif /* _KERNEL */
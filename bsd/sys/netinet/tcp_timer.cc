@@ -65,6 +65,7 @@
 TRACEPOINT(trace_tcp_timer_tso_flush, "");
 TRACEPOINT(trace_tcp_timer_tso_flush_ret, "");
 TRACEPOINT(trace_tcp_timer_tso_flush_err, "");
+TRACEPOINT(trace_tcp_timer_pace, "tp=%p", void*);
 
 int	tcp_keepinit;
 SYSCTL_PROC(_net_inet_tcp, TCPCTL_KEEPINIT, keepinit, CTLTYPE_INT|CTLFLAG_RW,
@@ -455,6 +456,31 @@ tcp_timer_tso_flush(serial_timer_task& timer, struct tcpcb *tp)
 	trace_tcp_timer_tso_flush_ret();
 }
 
+/*
+ * A paced connection held back a segment; its time has come.
+ */
+static void
+tcp_timer_pace(serial_timer_task& timer, struct tcpcb *tp)
+{
+	trace_tcp_timer_pace(tp);
+
+	CURVNET_SET(tp->t_vnet);
+	struct inpcb *inp = tp->t_inpcb;
+
+	KASSERT(inp != NULL, ("tcp_timer_pace: inp == NULL"));
+	INP_LOCK(inp);
+	if (!timer.try_fire()) {
+		INP_UNLOCK(inp);
+		CURVNET_RESTORE();
+		return;
+	}
+
+	(void) tcp_output(tp);
+
+	INP_UNLOCK(inp);
+	CURVNET_RESTORE();
+}
+
 static void
 tcp_timer_rexmt(serial_timer_task& timer, struct tcpcb *tp)
 {
@@ -619,6 +645,12 @@ tcp_timer_activate(struct tcpcb *tp, tcp_timer_type timer_type, ticks_t delta)
 	}
 }
 
+void
+tcp_timer_activate_ns(struct tcpcb *tp, tcp_timer_type timer_type, u64 ns)
+{
+	tp->t_timers->get(timer_type).reschedule(ns * 1_ns);
+}
+
 int
 tcp_timer_active(struct tcpcb *tp, tcp_timer_type timer_type)
 {
@@ -648,6 +680,9 @@ init_timers(struct tcp_timer* timers, struct tcpcb *tp, struct inpcb *inp)
 
 	timers->timers[tcp_timer_type::TT_TSO_FLUSH] =
 		new serial_timer_task(inp->inp_lock, std::bind(tcp_timer_tso_flush, _1, tp));
+
+	timers->timers[tcp_timer_type::TT_PACE] =
+		new serial_timer_task(inp->inp_lock, std::bind(tcp_timer_pace, _1, tp));
 }
 
 serial_timer_task&
@@ -816,6 +816,8 @@ tcp_usr_send(struct socket *so, int flags, struct mbuf *m,
 				goto out;
 			tp->snd_wnd = TTCP_CLIENT_SND_WND;
 			tcp_mss(tp, -1);
+			if ((flags & PRUS_FASTOPEN) && V_tcp_do_fastopen)
+				tp->t_flags |= TF_FASTOPEN;
 		}
 		if (flags & PRUS_EOF) {
 			/*
@@ -1240,6 +1242,8 @@ tcp_fill_info(struct tcpcb *tp, struct tcp_info *ti)
 	ti->tcpi_rcv_mss = tp->t_maxseg;
 	if (tp->t_flags & TF_TOE)
 		ti->tcpi_options |= TCPI_OPT_TOE;
+	if (tp->t_flags2 & TF2_SYN_DATA)
+		ti->tcpi_options |= TCPI_OPT_SYN_DATA;
 	ti->tcpi_snd_rexmitpack = tp->t_sndrexmitpack;
 	ti->tcpi_rcv_ooopack = tp->t_rcvoopack;
 	ti->tcpi_snd_zerowin = tp->t_sndzerowin;
@@ -1492,6 +1496,23 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 			INP_UNLOCK(inp);
 			break;
 
+		case TCP_FASTOPEN:
+			INP_UNLOCK(inp);
+			error = sooptcopyin(sopt, &optval, sizeof optval,
+			    sizeof optval);
+			if (error)
+				return (error);
+
+			INP_LOCK_RECHECK(inp);
+			/* Only meaningful on a (future) listen socket */
+			if (optval < 0 || (tp->get_state() != TCPS_CLOSED &&
+			    tp->get_state() != TCPS_LISTEN))
+				error = EINVAL;
+			else
+				tp->t_tfo_qlen = optval;
+			INP_UNLOCK(inp);
+			break;
+
 		default:
 			INP_UNLOCK(inp);
 			error = ENOPROTOOPT;
@@ -1556,6 +1577,11 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 			INP_UNLOCK(inp);
 			error = sooptcopyout(sopt, &optval, sizeof optval);
 			break;
+		case TCP_FASTOPEN:
+			optval = tp->t_tfo_qlen;
+			INP_UNLOCK(inp);
+			error = sooptcopyout(sopt, &optval, sizeof optval);
+			break;
 		default:
 			INP_UNLOCK(inp);
 			error = ENOPROTOOPT;
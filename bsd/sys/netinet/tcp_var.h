@@ -224,9 +224,15 @@ public:
 	net_channel* nc;
 	struct ifnet* nc_intf;
 
-	uint32_t t_ispare[8];		/* 5 UTO, 3 TBD */
+	uint64_t t_pacing_rate;		/* cc's pacing rate (bytes/s), 0 if none */
+	uint64_t t_pace_next;		/* uptime (ns) the next paced send is due */
+
+	u_int	t_tfo_qlen;		/* listener's TCP_FASTOPEN queue length */
+	u_int	t_flags2;		/* TF2_* flags, t_flags is full */
+
+	uint32_t t_ispare[7];		/* 5 UTO, 2 TBD */
 	void	*t_pspare2[4];		/* 4 TBD */
-	uint64_t _pad[6];		/* 6 TBD (1-2 CC/RTT?) */
+	uint64_t _pad[4];		/* 4 TBD (1-2 CC/RTT?) */
 public:
 	__attribute__((always_inline)) // Necessary because of issue #1029
 	inline void set_state(int state) {
@@ -273,6 +279,9 @@ public:
 #define	TF_ECN_SND_ECE	0x10000000	/* ECN ECE in queue */
 #define	TF_CONGRECOVERY	0x20000000	/* congestion recovery mode */
 #define	TF_WASCRECOVERY	0x40000000	/* was in congestion recovery */
+#define	TF_FASTOPEN	0x80000000	/* TCP Fast Open handshake in progress */
+
+#define	TF2_SYN_DATA	0x00000001	/* TFO: data in the SYN was taken */
 
 #define	IN_FASTRECOVERY(t_flags)	(t_flags & TF_FASTRECOVERY)
 #define	ENTER_FASTRECOVERY(t_flags)	t_flags |= TF_FASTRECOVERY
@@ -325,7 +334,8 @@ struct tcpopt {
 #define	TOF_TS		0x0010		/* timestamp */
 #define	TOF_SIGNATURE	0x0040		/* TCP-MD5 signature option (RFC2385) */
 #define	TOF_SACK	0x0080		/* Peer sent SACK option */
-#define	TOF_MAXOPT	0x0100
+#define	TOF_FASTOPEN	0x0100		/* TCP Fast Open (RFC 7413) */
+#define	TOF_MAXOPT	0x0200
 	u_int32_t	to_tsval;	/* new timestamp */
 	u_int32_t	to_tsecr;	/* reflected timestamp */
 	u_char		*to_sacks;	/* pointer to the first SACK blocks */
@@ -333,6 +343,8 @@ struct tcpopt {
 	u_int16_t	to_mss;		/* maximum segment size */
 	u_int8_t	to_wscale;	/* window scaling */
 	u_int8_t	to_nsacks;	/* number of SACK blocks */
+	u_int8_t	to_tfo_len;	/* TFO cookie length, 0 for a request */
+	u_char		*to_tfo_cookie;	/* pointer to the TFO cookie */
 	u_int32_t	to_spare;	/* UTO */
 };
 
@@ -526,7 +538,15 @@ struct	tcpstat {
 	u_long	tcps_sig_err_sigopt;	/* No signature expected by socket */
 	u_long	tcps_sig_err_nosigopt;	/* No signature provided by segment */
 
-	u_long	_pad[12];		/* 6 UTO, 6 TBD */
+	/* TCP Fast Open */
+	u_long	tcps_tfo_active;	/* SYNs sent with a cookie and data */
+	u_long	tcps_tfo_active_fail;	/* ... whose data the peer did not take */
+	u_long	tcps_tfo_cookie_req;	/* cookie requests answered */
+	u_long	tcps_tfo_passive;	/* connections opened by a valid cookie */
+	u_long	tcps_tfo_bad_cookie;	/* invalid cookies received */
+	u_long	tcps_tfo_qoverflow;	/* valid cookies over the listener's limit */
+
+	u_long	_pad[6];		/* 6 UTO */
 };
 
 #ifdef _KERNEL
@@ -666,6 +686,9 @@ VNET_DECLARE(int, tcp_ecn_maxretries);
 #define	V_tcp_do_ecn		VNET(tcp_do_ecn)
 #define	V_tcp_ecn_maxretries	VNET(tcp_ecn_maxretries)
 
+VNET_DECLARE(int, tcp_do_fastopen);		/* TCP Fast Open enabled/disabled */
+#define	V_tcp_do_fastopen	VNET(tcp_do_fastopen)
+
 VNET_DECLARE(struct hhook_head *, tcp_hhh[HHOOK_TCP_LAST + 1]);
 #define	V_tcp_hhh		VNET(tcp_hhh)
 
@@ -746,6 +769,8 @@ void	 tcp_hc_destroy(void);
 void	 tcp_hc_get(struct in_conninfo *, struct hc_metrics_lite *);
 u_long	 tcp_hc_getmtu(struct in_conninfo *);
 void	 tcp_hc_updatemtu(struct in_conninfo *, u_long);
+int	 tcp_hc_gettfo(struct in_conninfo *, u_char *);
+void	 tcp_hc_updatetfo(struct in_conninfo *, const u_char *, int);
 void	 tcp_hc_update(struct in_conninfo *, struct hc_metrics_lite *);
 
 extern	struct pr_usrreqs tcp_usrreqs;
@@ -49,6 +49,9 @@ struct udphdr {
  * User-settable options (used with setsockopt).
  */
 #define	UDP_ENCAP			0x01
+/* Same values as Linux, which the BSDs don't have an equivalent of */
+#define	UDP_SEGMENT			103 /* split sends into datagrams */
+#define	UDP_GRO				104 /* coalesce received datagrams */
 
 
 /*
@@ -801,9 +801,7 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 {
 	int error = 0, optval;
 	struct inpcb *inp;
-#ifdef IPSEC_NAT_T
 	struct udpcb *up;
-#endif
 
 	inp = sotoinpcb(so);
 	KASSERT(inp != NULL, ("%s: inp == NULL", __func__));
@@ -866,6 +864,29 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 			}
 			INP_UNLOCK(inp);
 			break;
+		case UDP_SEGMENT:
+		case UDP_GRO:
+			INP_UNLOCK(inp);
+			error = sooptcopyin(sopt, &optval, sizeof optval,
+					    sizeof optval);
+			if (error)
+				break;
+			inp = sotoinpcb(so);
+			KASSERT(inp != NULL, ("%s: inp == NULL", __func__));
+			INP_LOCK(inp);
+			up = intoudpcb(inp);
+			KASSERT(up != NULL, ("%s: up == NULL", __func__));
+			if (sopt->sopt_name == UDP_GRO) {
+				if (optval)
+					up->u_flags |= UF_GRO;
+				else
+					up->u_flags &= ~UF_GRO;
+			} else if (optval < 0 || optval > IP_MAXPACKET)
+				error = EINVAL;
+			else
+				up->u_segsz = optval;
+			INP_UNLOCK(inp);
+			break;
 		default:
 			INP_UNLOCK(inp);
 			error = ENOPROTOOPT;
@@ -874,6 +895,17 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 		break;
 	case SOPT_GET:
 		switch (sopt->sopt_name) {
+		case UDP_SEGMENT:
+		case UDP_GRO:
+			up = intoudpcb(inp);
+			KASSERT(up != NULL, ("%s: up == NULL", __func__));
+			if (sopt->sopt_name == UDP_GRO)
+				optval = (up->u_flags & UF_GRO) != 0;
+			else
+				optval = up->u_segsz;
+			INP_UNLOCK(inp);
+			error = sooptcopyout(sopt, &optval, sizeof optval);
+			break;
 #ifdef IPSEC_NAT_T
 		case UDP_ENCAP:
 			up = intoudpcb(inp);
@@ -911,6 +943,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct bsd_sockaddr *addr,
 	u_short fport, lport;
 	int unlock_udbinfo;
 	u_char tos;
+	u_short segsz;
 
 	/*
 	 * udp_output() may need to temporarily bind or connect the current
@@ -928,6 +961,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct bsd_sockaddr *addr,
 	src.sin_family = 0;
 	INP_LOCK(inp);
 	tos = inp->inp_ip_tos;
+	segsz = intoudpcb(inp)->u_segsz;
 	if (control != NULL) {
 		/*
 		 * XXX: Currently, we assume all the optional information is
@@ -948,6 +982,15 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct bsd_sockaddr *addr,
 				error = EINVAL;
 				break;
 			}
+			if (cm->cmsg_level == IPPROTO_UDP &&
+			    cm->cmsg_type == UDP_SEGMENT) {
+				if (cm->cmsg_len != CMSG_LEN(sizeof(u_short))) {
+					error = EINVAL;
+					break;
+				}
+				segsz = *(u_short *)CMSG_DATA(cm);
+				continue;
+			}
 			if (cm->cmsg_level != IPPROTO_IP)
 				continue;
 
@@ -983,6 +1026,9 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct bsd_sockaddr *addr,
 		}
 		m_freem(control);
 	}
+	if (error == 0 && segsz && len > segsz &&
+	    howmany(len, segsz) > UDP_MAX_SEGMENTS)
+		error = EINVAL;
 	if (error) {
 		INP_UNLOCK(inp);
 		m_freem(m);
@@ -1174,7 +1220,17 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct bsd_sockaddr *addr,
 	((struct ip *)ui)->ip_len = sizeof (struct udpiphdr) + len;
 	((struct ip *)ui)->ip_ttl = inp->inp_ip_ttl;	/* XXX */
 	((struct ip *)ui)->ip_tos = tos;		/* XXX */
-	UDPSTAT_INC(udps_opackets);
+	/*
+	 * With UDP_SEGMENT, the data is a run of datagrams handed down as one
+	 * packet, under a single pcb lock and route lookup, and split into
+	 * separate datagrams by the interface or by ip_output().
+	 */
+	if (segsz && len > segsz) {
+		m->M_dat.MH.MH_pkthdr.csum_flags |= CSUM_UDP_SEG;
+		m->M_dat.MH.MH_pkthdr.tso_segsz = segsz;
+		UDPSTAT_ADD(udps_opackets, howmany(len, segsz));
+	} else
+		UDPSTAT_INC(udps_opackets);
 
 	if (unlock_udbinfo == UH_WLOCKED)
 		INP_HASH_WUNLOCK(&V_udbinfo);
@@ -1516,6 +1572,66 @@ udp_send(struct socket *so, int flags, struct mbuf *m, struct bsd_sockaddr *addr
 	KASSERT(inp != NULL, ("udp_send: inp == NULL"));
 	return (udp_output(inp, m, addr, control, td));
 }
+
+/*
+ * With UDP_GRO, a receive coalesces a run of datagrams from the same sender,
+ * each as long as the first but the last which may be shorter, and reports
+ * their size in a UDP_GRO control message.  The datagrams are merged on their
+ * way out of the receive buffer, so none is delayed waiting for the next.
+ */
+static int
+udp_soreceive(struct socket *so, struct bsd_sockaddr **psa, struct uio *uio,
+    struct mbuf **mp0, struct mbuf **controlp, int *flagsp)
+{
+	struct inpcb *inp;
+	struct bsd_sockaddr *from = NULL;
+	struct mbuf *m, *m2, **cp;
+	ssize_t resid, seglen, len;
+	int error, gro, nsegs, segsz;
+
+	inp = sotoinpcb(so);
+	KASSERT(inp != NULL, ("udp_soreceive: inp == NULL"));
+	INP_LOCK(inp);
+	gro = (intoudpcb(inp)->u_flags & UF_GRO) != 0;
+	INP_UNLOCK(inp);
+	if (!gro || mp0 != NULL ||
+	    (flagsp != NULL && (*flagsp & (MSG_PEEK | MSG_OOB))))
+		return (soreceive_dgram(so, psa, uio, mp0, controlp, flagsp));
+
+	resid = uio->uio_resid;
+	error = soreceive_dgram(so, &from, uio, mp0, controlp, flagsp);
+	if (error || from == NULL ||
+	    (flagsp != NULL && (*flagsp & MSG_TRUNC)))
+		goto out;
+
+	seglen = resid - uio->uio_resid;
+	nsegs = 1;
+	while (seglen > 0 && nsegs < UDP_MAX_SEGMENTS) {
+		m = sodequeue_dgram(so, from, lmin(seglen, uio->uio_resid),
+		    &len);
+		if (m == NULL)
+			break;
+		nsegs++;
+		for (m2 = m; m2 != NULL && error == 0; m2 = m2->m_hdr.mh_next)
+			error = uiomove(mtod(m2, char *), m2->m_hdr.mh_len, uio);
+		m_freem(m);
+		if (error || len < seglen)
+			break;
+	}
+	if (error == 0 && nsegs > 1 && controlp != NULL) {
+		segsz = seglen;
+		for (cp = controlp; *cp != NULL; cp = &(*cp)->m_hdr.mh_next)
+			;
+		*cp = sbcreatecontrol((caddr_t)&segsz, sizeof(segsz),
+		    UDP_GRO, IPPROTO_UDP);
+	}
+out:
+	if (psa != NULL)
+		*psa = from;
+	else
+		free(from);
+	return (error);
+}
 #endif /* INET */
 
 int
@@ -1542,7 +1658,7 @@ struct pr_usrreqs udp_usrreqs = initialize_with([] (pr_usrreqs& x) {
 	x.pru_disconnect =	udp_disconnect;
 	x.pru_peeraddr =		in_getpeeraddr;
 	x.pru_send =		udp_send;
-	x.pru_soreceive =	soreceive_dgram;
+	x.pru_soreceive =	udp_soreceive;
 	x.pru_sosend =		sosend_dgram;
 	x.pru_shutdown =		udp_shutdown;
 	x.pru_sockaddr =		in_getsockaddr;
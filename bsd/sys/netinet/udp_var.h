@@ -59,6 +59,7 @@ typedef void(*udp_tun_func_t)(struct mbuf *, int off, struct inpcb *);
 struct udpcb {
 	udp_tun_func_t	u_tun_func;	/* UDP kernel tunneling callback. */
 	u_int		u_flags;	/* Generic UDP flags. */
+	u_short		u_segsz;	/* UDP_SEGMENT datagram size, or 0. */
 };
 
 #define	intoudpcb(ip)	((struct udpcb *)(ip)->inp_ppcb)
@@ -69,6 +70,10 @@ struct udpcb {
 	/* .. per draft-ietf-ipsec-nat-t-ike-0[01],
 	 * and draft-ietf-ipsec-udp-encaps-(00/)01.txt */
 #define	UF_ESPINUDP		0x00000002	/* w/ non-ESP marker. */
+#define	UF_GRO			0x00000004	/* UDP_GRO: coalesce on receive */
+
+/* Most datagrams a single UDP_SEGMENT send may be split into, as in Linux */
+#define	UDP_MAX_SEGMENTS	64
 
 struct udpstat {
 				/* input statistics: */
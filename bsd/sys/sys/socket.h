@@ -114,6 +114,7 @@
 #define	SO_USER_COOKIE	0x1015		/* user cookie (dummynet etc.) */
 #define	SO_PROTOCOL	0x1016		/* get socket protocol (Linux name) */
 #define	SO_PROTOTYPE	SO_PROTOCOL	/* alias for SO_PROTOCOL (SunOS name) */
+#define	SO_MAX_PACING_RATE	0x1018	/* socket's max TX pacing rate (Linux name) */
 #endif
 
 #if __BSD_VISIBLE
@@ -403,6 +404,7 @@ struct sockproto {
 #endif
 #if __BSD_VISIBLE
 #define	MSG_NOSIGNAL	0x20000		/* do not generate SIGPIPE on EOF */
+#define	MSG_FASTOPEN	0x40000		/* send data in the SYN (TCP Fast Open) */
 #endif
 
 #if __BSD_VISIBLE
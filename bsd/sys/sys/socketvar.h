@@ -121,6 +121,7 @@ struct socket {
 	 */
 	int so_fibnum;		/* routing domain for this socket */
 	uint32_t so_user_cookie;
+	uint64_t so_max_pacing_rate = ~0ull;	/* TX pacing cap, bytes/s */
 	net_channel* so_nc = nullptr;
 	// a net channel only supports one consumer, so let others wait on a waitqueue instead
 	bool so_nc_busy = false;
@@ -353,6 +354,9 @@ int	soreceive_stream(struct socket *so, struct bsd_sockaddr **paddr,
 int	soreceive_dgram(struct socket *so, struct bsd_sockaddr **paddr,
 	    struct uio *uio, struct mbuf **mp0, struct mbuf **controlp,
 	    int *flagsp);
+struct mbuf *
+	sodequeue_dgram(struct socket *so, const struct bsd_sockaddr *from,
+	    ssize_t maxlen, ssize_t *lenp);
 int	soreceive_generic(struct socket *so, struct bsd_sockaddr **paddr,
 	    struct uio *uio, struct mbuf **mp0, struct mbuf **controlp,
 	    int *flagsp);
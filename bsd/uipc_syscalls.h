@@ -60,6 +60,9 @@ int linux_sendmsg(int s, struct msghdr* msg, int flags, ssize_t* bytes);
 int linux_sendto(int s, void* buf, int len, int flags, void* to, int tolen, ssize_t *bytes);
 int linux_send(int s, caddr_t buf, size_t len, int flags, ssize_t* bytes);
 int linux_recvmsg(int s, struct msghdr *msg, int flags, ssize_t* bytes);
+int linux_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags, int *count);
+int linux_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+    struct timespec *timeout, int *count);
 int linux_recv(int s, caddr_t buf, int len, int flags, ssize_t* bytes);
 int linux_recvfrom(int s, void* buf, size_t len, int flags,
 	struct bsd_sockaddr * from, socklen_t * fromlen, ssize_t* bytes);
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/aio.hh>
+#include <osv/file.h>
+#include <osv/vnode.h>
+#include <osv/dentry.h>
+#include <osv/device.h>
+#include <osv/buf.h>
+#include <osv/bio.h>
+#include <osv/io_wq.hh>
+#include <osv/trace.hh>
+#include <osv/mmu.hh>
+#include "fs/vfs/vfs.h"
+
+#include <sys/uio.h>
+#include <errno.h>
+
+TRACEPOINT(trace_aio_submit, "req=%p fd=%d op=%d offset=%d nbytes=%d", void*, int, int, off_t, size_t);
+TRACEPOINT(trace_aio_direct, "req=%p dev=%s bios=%d", void*, const char*, unsigned);
+TRACEPOINT(trace_aio_done, "req=%p res=%d", void*, int64_t);
+
+namespace osv {
+namespace aio {
+
+static void run(request* req);
+
+// Shared by every libaio context and POSIX aio
+static io_wq<request*> wq("aio-wq", run);
+
+// Where blocking is fine: the submitter or a worker
+static void complete(request* req, int64_t res)
+{
+    trace_aio_done(req, res);
+    if (req->_fp) {
+        fdrop(req->_fp);
+        req->_fp = nullptr;
+    }
+    // req may be gone once done() returns
+    req->done(req, res);
+}
+
+// From a block driver's completion thread. Dropping the last reference to
+// the file closes it, which may block, so that is left to a worker, as is
+// a done() which may block.
+static void complete_from_driver(request* req, int64_t res)
+{
+    if (fdrop_unless_last(req->_fp)) {
+        req->_fp = nullptr;
+        if (!req->done_may_block) {
+            complete(req, res);
+            return;
+        }
+    }
+    req->_res = res;
+    req->_stage = request::stage::finishing;
+    wq.enqueue(req, wq.bounded);
+}
+
+// Direct submission of whole sectors to a block device, as bios whose
+// bio_done finishes the request. Anything else is left to the worker pool.
+static device* block_device(struct file* fp)
+{
+    if (fp->f_type != DTYPE_VNODE || !fp->f_dentry) {
+        return nullptr;
+    }
+    auto vp = fp->f_dentry->d_vnode;
+    if (vp->v_type != VBLK) {
+        return nullptr;
+    }
+    auto dev = static_cast<device*>(vp->v_data);
+    if (!dev || dev->driver->devops->strategy == no_strategy) {
+        return nullptr;
+    }
+    return dev;
+}
+
+static void put_bio(request* req)
+{
+    if (req->_pending_bios.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        int error = req->_error.load(std::memory_order_relaxed);
+        complete_from_driver(req, error ? -error : static_cast<int64_t>(req->_bytes));
+    }
+}
+
+static void direct_bio_done(struct bio* bio)
+{
+    auto req = static_cast<request*>(bio->bio_caller1);
+    if (bio->bio_flags & BIO_ERROR) {
+        req->_error.store(EIO, std::memory_order_relaxed);
+    }
+    mmu::io_unpin(bio->bio_data, bio->bio_bcount);
+    destroy_bio(bio);
+    put_bio(req);
+}
+
+static bool submit_direct(request* req)
+{
+    struct iovec one { req->buf, req->nbytes };
+    const struct iovec* iov = &one;
+    int iovcnt = 1;
+    int cmd;
+    int mode;
+
+    switch (req->opcode) {
+    case request::op::readv:
+        iov = static_cast<const struct iovec*>(req->buf);
+        iovcnt = req->nbytes;
+        // fall through
+    case request::op::read:
+        cmd = BIO_READ;
+        mode = FREAD;
+        break;
+    case request::op::writev:
+        iov = static_cast<const struct iovec*>(req->buf);
+        iovcnt = req->nbytes;
+        // fall through
+    case request::op::write:
+        cmd = BIO_WRITE;
+        mode = FWRITE;
+        break;
+    case request::op::fsync:
+    case request::op::fdatasync:
+        cmd = BIO_FLUSH;
+        mode = 0;
+        iovcnt = 0;
+        break;
+    default:
+        return false;
+    }
+
+    auto dev = block_device(req->_fp);
+    if (!dev || (req->_fp->f_flags & mode) != mode) {
+        return false;
+    }
+
+    size_t bytes = 0;
+    unsigned nbios = cmd == BIO_FLUSH ? 1 : 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len % BSIZE) {
+            return false;
+        }
+        bytes += iov[i].iov_len;
+        nbios += iov[i].iov_len != 0;
+    }
+    if (cmd != BIO_FLUSH &&
+        (req->offset < 0 || req->offset % BSIZE ||
+         req->offset + static_cast<off_t>(bytes) > dev->size)) {
+        return false;
+    }
+
+    trace_aio_direct(req, dev->name, nbios);
+    req->_bytes = bytes;
+    req->_error.store(0, std::memory_order_relaxed);
+    // One reference of our own keeps the request from completing while
+    // bios are still being issued
+    req->_pending_bios.store(nbios + 1, std::memory_order_relaxed);
+
+    off_t offset = req->offset;
+    unsigned issued = 0;
+    for (int i = 0; issued < nbios; i++) {
+        if (cmd != BIO_FLUSH && iov[i].iov_len == 0) {
+            continue;
+        }
+        auto bio = alloc_bio();
+        if (!bio) {
+            req->_error.store(ENOMEM, std::memory_order_relaxed);
+            req->_pending_bios.fetch_sub(nbios - issued, std::memory_order_relaxed);
+            break;
+        }
+        bio->bio_cmd = cmd;
+        bio->bio_dev = dev;
+        bio->bio_caller1 = req;
+        bio->bio_done = direct_bio_done;
+        if (cmd != BIO_FLUSH) {
+            bio->bio_data = iov[i].iov_base;
+            bio->bio_offset = offset;
+            bio->bio_bcount = iov[i].iov_len;
+            offset += iov[i].iov_len;
+            mmu::io_pin(bio->bio_data, bio->bio_bcount);
+        }
+        issued++;
+        dev->driver->devops->strategy(bio);
+    }
+    put_bio(req);
+    return true;
+}
+
+static int64_t execute(request* req)
+{
+    auto fp = req->_fp;
+    size_t done = 0;
+    int error;
+
+    switch (req->opcode) {
+    case request::op::read: {
+        struct iovec iov { req->buf, req->nbytes };
+        error = sys_read(fp, &iov, 1, req->offset, &done);
+        break;
+    }
+    case request::op::write: {
+        struct iovec iov { req->buf, req->nbytes };
+        error = sys_write(fp, &iov, 1, req->offset, &done);
+        break;
+    }
+    case request::op::readv:
+        error = sys_read(fp, static_cast<struct iovec*>(req->buf), req->nbytes,
+                         req->offset, &done);
+        break;
+    case request::op::writev:
+        error = sys_write(fp, static_cast<struct iovec*>(req->buf), req->nbytes,
+                          req->offset, &done);
+        break;
+    case request::op::fsync:
+    case request::op::fdatasync:
+        error = sys_fsync(fp);
+        break;
+    case request::op::nop:
+        error = 0;
+        break;
+    default:
+        error = EINVAL;
+        break;
+    }
+    return error ? -error : static_cast<int64_t>(done);
+}
+
+static void run(request* req)
+{
+    switch (req->_stage) {
+    case request::stage::deferred:
+        if (submit_direct(req)) {
+            return;
+        }
+        // fall through
+    case request::stage::queued:
+        complete(req, execute(req));
+        break;
+    case request::stage::finishing:
+        complete(req, req->_res);
+        break;
+    }
+}
+
+// Takes the file reference; false if the request is already completed
+static bool prepare(request* req)
+{
+    trace_aio_submit(req, req->fd, static_cast<int>(req->opcode), req->offset, req->nbytes);
+
+    req->_fp = nullptr;
+    if (fget(req->fd, &req->_fp) != 0) {
+        req->_fp = nullptr;
+        complete(req, -EBADF);
+        return false;
+    }
+    return true;
+}
+
+static io_wq<request*>::work_class work_class(request* req)
+{
+    return req->_fp->f_type == DTYPE_VNODE ? wq.bounded : wq.unbounded;
+}
+
+void submit(request* req)
+{
+    if (!prepare(req)) {
+        return;
+    }
+    if (req->opcode == request::op::nop) {
+        complete(req, 0);
+        return;
+    }
+    if (submit_direct(req)) {
+        return;
+    }
+    req->_stage = request::stage::queued;
+    wq.enqueue(req, work_class(req));
+}
+
+void submit_deferred(request* req)
+{
+    if (!prepare(req)) {
+        return;
+    }
+    req->_stage = request::stage::deferred;
+    wq.enqueue(req, work_class(req));
+}
+
+request* cancel(std::function<bool (const request&)> match)
+{
+    request* req = nullptr;
+    if (!wq.cancel([&] (request* const& r) {
+            return r->_stage != request::stage::finishing && match(*r); }, req)) {
+        return nullptr;
+    }
+    fdrop(req->_fp);
+    req->_fp = nullptr;
+    return req;
+}
+
+}
+}
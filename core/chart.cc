@@ -4,6 +4,7 @@
 #include "drivers/clock.hh"
 #include <osv/barrier.hh>
 #include <osv/boot.hh>
+#include <algorithm>
 
 double boot_time_chart::to_msec(u64 time)
 {
@@ -18,6 +19,12 @@ void boot_time_chart::print_one_time(int index)
     auto field = arrays[index].stamp;
     auto last = arrays[index - 1].stamp;
     auto initial = arrays[0].stamp;
+    if (arrays[index].start) {
+        auto start = arrays[index].start;
+        printf("\t%s: %.2fms-%.2fms, (%.2fms)\n", arrays[index].str,
+            to_msec(start - initial), to_msec(field - initial), to_msec(field - start));
+        return;
+    }
     printf("\t%s: %.2fms, (+%.2fms)\n", arrays[index].str, to_msec(field - initial), to_msec(field - last));
 }
 
@@ -33,17 +40,30 @@ void boot_time_chart::event(int event_idx, const char *str)
 
 void boot_time_chart::event(int event_idx, const char *str, u64 stamp)
 {
+    if (event_idx >= max_events) {
+        return;
+    }
     arrays[event_idx].str = str;
     arrays[event_idx].stamp = stamp;
 }
 
+void boot_time_chart::span(const char *str, u64 start)
+{
+    auto idx = _event++;
+    if (idx >= max_events) {
+        return;
+    }
+    arrays[idx].start = start;
+    event(idx, str, processor::ticks());
+}
+
 void boot_time_chart::print_chart()
 {
     if (clock::get()->processor_to_nano(10000) == 0) {
         debug("Skipping bootchart: please run this with a clocksource that can do ticks/nanoseconds conversion.\n");
         return;
     }
-    int events = _event;
+    int events = std::min(_event.load(), max_events);
     for (auto i = 1; i < events; ++i) {
         print_one_time(i);
     }
@@ -51,7 +71,7 @@ void boot_time_chart::print_chart()
 
 void boot_time_chart::print_total_time()
 {
-    auto last = arrays[_event - 1].stamp;
+    auto last = arrays[std::min(_event.load(), max_events) - 1].stamp;
     auto initial = arrays[0].stamp;
     printf("Booted up in %.2f ms\n", to_msec(last - initial));
 }
@@ -30,9 +30,12 @@
 #include <osv/export.h>
 #include <boost/version.hpp>
 #include <deque>
+#include <fstream>
+#include <sstream>
 #include <osv/string_utils.hh>
 
 #include "arch.hh"
+#include "drivers/clock.hh"
 #include "arch-elf.hh"
 #include "cpuid.hh"
 
@@ -382,6 +385,10 @@ void object::set_base(void* base)
         _headers_start = reinterpret_cast<void*>(p->p_vaddr) + _ehdr.e_phoff;
     } else {
         // Otherwise for kernel, PIEs and shared libraries set the base as requested by caller
+        if (!is_core() && _prog.prefault_exec()) {
+            // Let prefault_segment() back text with huge pages
+            base = align_up(base, mmu::huge_page_size);
+        }
         _base = align(base, p->p_align, p->p_vaddr & (p->p_align - 1)) - p->p_vaddr;
         _headers_start = _base + _ehdr.e_phoff;
     }
@@ -419,6 +426,11 @@ void file::load_segment(const Elf64_Phdr& phdr)
 
     unsigned perm = get_segment_mmap_permissions(phdr);
 
+    if (!(perm & mmu::perm_write) && _prog.prefault_exec()) {
+        prefault_segment(_base + vstart, filesz, memsz, align_down(phdr.p_offset, mmu::page_size), perm);
+        return;
+    }
+
     auto flag = mmu::mmap_fixed | (mlocked() ? mmu::mmap_populate : 0);
     mmu::map_file(_base + vstart, filesz, flag, perm, _f, align_down(phdr.p_offset, mmu::page_size));
     if (phdr.p_filesz != phdr.p_memsz) {
@@ -431,6 +443,34 @@ void file::load_segment(const Elf64_Phdr& phdr)
     elf_debug("Loaded and mapped PT_LOAD segment at: %018p of size: 0x%x\n", _base + vstart, filesz);
 }
 
+// Instead of a file mapping, which OSv always backs with small pages filled
+// in one fault at a time, copy the segment into populated anonymous memory.
+// Its 2MB-aligned parts get huge pages, much like Linux's THP for text.
+void file::prefault_segment(void* addr, ulong filesz, ulong memsz, off_t offset, unsigned perm)
+{
+    auto start = processor::ticks();
+    mmu::map_anon(addr, memsz, mmu::mmap_fixed | mmu::mmap_populate, mmu::perm_rw);
+
+    auto fsize = ::size(_f);
+    auto end = std::min<off_t>(offset + filesz, fsize);
+    for (auto off = offset; off < end; off += mmu::huge_page_size) {
+        auto len = std::min<off_t>(end - off, mmu::huge_page_size);
+        ::read(_f, static_cast<char*>(addr) + (off - offset), off, len);
+    }
+
+    mmu::mprotect(addr, memsz, perm);
+    if (perm & mmu::perm_exec) {
+        mmu::synchronize_cpu_caches(addr, memsz);
+    }
+
+    auto a = reinterpret_cast<uintptr_t>(addr);
+    auto hp_start = align_up(a, mmu::huge_page_size);
+    auto hp_end = align_down(a + memsz, mmu::huge_page_size);
+    size_t huge_pages = hp_end > hp_start ? (hp_end - hp_start) / mmu::huge_page_size : 0;
+    _prog.note_prefault(_pathname, memsz / mmu::page_size, huge_pages, start);
+    elf_debug("Prefaulted PT_LOAD segment at: %018p of size: 0x%x\n", addr, memsz);
+}
+
 bool object::mlocked()
 {
     for (auto&& s : sections()) {
@@ -502,6 +542,7 @@ void object::process_headers()
                 break;
             }
             void *start = _base + phdr.p_vaddr;
+            read_build_id(static_cast<char*>(start), phdr.p_memsz);
             char *str = align_up((char *)start + 3 * sizeof(Elf64_Word), 4);
             struct Elf64_Note header(start, str);
 
@@ -562,6 +603,32 @@ void object::process_headers()
     }
 }
 
+void object::read_build_id(const char* notes, size_t len)
+{
+    auto end = notes + len;
+    while (notes + 3 * sizeof(Elf64_Word) <= end) {
+        auto hdr = reinterpret_cast<const Elf64_Word*>(notes);
+        auto namesz = hdr[0], descsz = hdr[1], type = hdr[2];
+        auto name = const_cast<char*>(notes) + 3 * sizeof(Elf64_Word);
+        auto desc = align_up(name + namesz, 4);
+        auto next = align_up(desc + descsz, 4);
+        if (next > end) {
+            return;
+        }
+        if (type == NT_GNU_BUILD_ID && namesz == 4 && !memcmp(name, "GNU", 4)) {
+            static const char hex[] = "0123456789abcdef";
+            _build_id.clear();
+            for (unsigned i = 0; i < descsz; i++) {
+                auto c = static_cast<u8>(desc[i]);
+                _build_id += hex[c >> 4];
+                _build_id += hex[c & 0xf];
+            }
+            return;
+        }
+        notes = next;
+    }
+}
+
 void file::unload_segment(const Elf64_Phdr& phdr)
 {
     ulong vstart = align_down(phdr.p_vaddr, mmu::page_size);
@@ -716,9 +783,16 @@ symbol_module object::symbol(unsigned idx, bool ignore_missing)
     if (binding == STB_LOCAL) {
         return symbol_module(sym, this);
     }
+    auto cached = _reloc_bindings.find(idx);
+    if (cached != _reloc_bindings.end()) {
+        return symbol_module(cached->second.first, cached->second.second);
+    }
     auto nameidx = sym->st_name;
     auto name = dynamic_ptr<const char>(DT_STRTAB) + nameidx;
     auto ret = _prog.lookup(name, this);
+    if (ret.symbol && _reloc_recording) {
+        _reloc_record[idx] = {ret.symbol, ret.obj};
+    }
     if (!ret.symbol && binding == STB_WEAK) {
         return symbol_module(sym, this);
     }
@@ -908,6 +982,12 @@ void* object::resolve_pltgot(unsigned index)
 void object::relocate()
 {
     assert(!dynamic_exists(DT_REL));
+    std::vector<object*> context;
+    if (_prog.reloc_cache_enabled()) {
+        context = reloc_cache_context();
+        apply_reloc_cache(context);
+        _reloc_recording = _prog.reloc_cache_dump() && !context.empty();
+    }
     if (dynamic_exists(DT_JMPREL)) {
         relocate_pltgot();
     }
@@ -917,6 +997,119 @@ void object::relocate()
     if (dynamic_exists(DT_RELR)) {
         relocate_relr();
     }
+    if (_reloc_recording) {
+        dump_reloc_bindings(context);
+        _reloc_recording = false;
+    }
+    _reloc_bindings.clear();
+    _reloc_record.clear();
+}
+
+// How the relocation cache refers to a module
+static const std::string& reloc_cache_id(object* module)
+{
+    return module->build_id();
+}
+
+// The modules symbols of this object may be bound to, in lookup order. It is
+// empty if this object or any of them, the kernel included, has no build-id
+// since the cache couldn't tell whether they have changed.
+std::vector<object*> object::reloc_cache_context()
+{
+    std::vector<object*> context;
+    if (_build_id.empty()) {
+        return context;
+    }
+    _prog.with_modules([&](const elf::program::modules_list &ml) {
+        for (auto module : ml.objects) {
+            if (!module->visible()) {
+                continue;
+            }
+            if (module->_build_id.empty()) {
+                context.clear();
+                return;
+            }
+            context.push_back(module);
+        }
+    });
+    return context;
+}
+
+void object::apply_reloc_cache(const std::vector<object*>& context)
+{
+    if (context.empty()) {
+        return;
+    }
+    std::vector<std::string> ids;
+    for (auto module : context) {
+        ids.push_back(reloc_cache_id(module));
+    }
+    auto entry = _prog.find_reloc_cache(_build_id, ids);
+    if (!entry) {
+        return;
+    }
+
+    auto symtab = dynamic_ptr<Elf64_Sym>(DT_SYMTAB);
+    auto strtab = dynamic_ptr<const char>(DT_STRTAB);
+    auto nsyms = symtab_end();
+    std::vector<unsigned> provider_nsyms(context.size(), 0);
+    for (auto& b : entry->bindings) {
+        auto idx = b[0], pos = b[1], pidx = b[2];
+        if (idx >= nsyms || pos >= context.size()) {
+            continue;
+        }
+        auto provider = context[pos];
+        if (!provider_nsyms[pos]) {
+            provider_nsyms[pos] = provider->symtab_end();
+        }
+        if (pidx >= provider_nsyms[pos]) {
+            continue;
+        }
+        // Matching build-ids mean matching symbol tables, but a build-id is
+        // only as good as the linker's, so check we got the symbol we are
+        // after.
+        auto psym = &provider->dynamic_ptr<Elf64_Sym>(DT_SYMTAB)[pidx];
+        if (psym->st_shndx == SHN_UNDEF ||
+            strcmp(strtab + symtab[idx].st_name, provider->symbol_name(psym))) {
+            continue;
+        }
+        _reloc_bindings[idx] = {psym, provider};
+    }
+    elf_debug("Took %d symbol bindings from the relocation cache\n", _reloc_bindings.size());
+}
+
+void object::dump_reloc_bindings(const std::vector<object*>& context)
+{
+    std::string out = "reloc-cache: object " + _build_id + " " + _pathname + "\n";
+    out += "reloc-cache: context";
+    for (auto module : context) {
+        out += " " + reloc_cache_id(module);
+    }
+    out += "\n";
+
+    std::string line;
+    unsigned in_line = 0;
+    for (auto& r : _reloc_record) {
+        auto provider = r.second.second;
+        auto it = std::find(context.begin(), context.end(), provider);
+        if (it == context.end()) {
+            continue;
+        }
+        auto pidx = r.second.first - provider->dynamic_ptr<Elf64_Sym>(DT_SYMTAB);
+        if (!in_line) {
+            line = "reloc-cache: bind";
+        }
+        line += " " + std::to_string(r.first) + "," + std::to_string(it - context.begin()) +
+                "," + std::to_string(pidx);
+        if (++in_line == 16) {
+            out += line + "\n";
+            in_line = 0;
+        }
+    }
+    if (in_line) {
+        out += line + "\n";
+    }
+    printf("%s", out.c_str());
 }
 
 unsigned long
@@ -1039,6 +1232,16 @@ symbol_module object::lookup_symbol_deep(const char* name)
     return sym;
 }
 
+// One past the highest symbol index. Unlike symtab_len() this includes the
+// symbols DT_GNU_HASH doesn't cover (those below its symoffset).
+unsigned object::symtab_end()
+{
+    if (dynamic_exists(DT_HASH)) {
+        return symtab_len();
+    }
+    return dynamic_ptr<Elf64_Word>(DT_GNU_HASH)[1] + symtab_len();
+}
+
 unsigned object::symtab_len()
 {
     if (dynamic_exists(DT_HASH)) {
@@ -1443,6 +1646,85 @@ void program::initialize_libvdso()
     }
 }
 
+bool program::load_reloc_cache(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::unordered_multimap<std::string, reloc_cache_entry> cache;
+    std::string line, build_id;
+    reloc_cache_entry entry;
+    auto add_entry = [&] {
+        if (!build_id.empty()) {
+            cache.emplace(build_id, std::move(entry));
+        }
+        build_id.clear();
+        entry = {};
+    };
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string keyword, word;
+        ls >> keyword;
+        if (keyword == "object") {
+            add_entry();
+            ls >> build_id;
+        } else if (keyword == "context") {
+            while (ls >> word) {
+                entry.context.push_back(word);
+            }
+        } else if (keyword == "bind") {
+            while (ls >> word) {
+                std::array<u32, 3> b;
+                if (sscanf(word.c_str(), "%u,%u,%u", &b[0], &b[1], &b[2]) == 3) {
+                    entry.bindings.push_back(b);
+                }
+            }
+        }
+    }
+    add_entry();
+
+    if (cache.empty()) {
+        return false;
+    }
+    SCOPE_LOCK(_mutex);
+    _reloc_cache = std::move(cache);
+    return true;
+}
+
+const program::reloc_cache_entry*
+program::find_reloc_cache(const std::string& build_id,
+                          const std::vector<std::string>& context) const
+{
+    auto range = _reloc_cache.equal_range(build_id);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.context == context) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+void program::set_prefault_exec(bool prefault, bool report)
+{
+    _prefault_exec = prefault;
+    _prefault_report = report;
+}
+
+void program::note_prefault(const std::string& name, size_t pages, size_t huge_pages, u64 start)
+{
+    SCOPE_LOCK(_mutex);
+    _prefault_pages += pages;
+    _prefault_huge_pages += huge_pages;
+    if (_prefault_report) {
+        auto ms = (double)clock::get()->processor_to_nano(processor::ticks() - start) / 1000000;
+        printf("\tprefault %s: (%.2fms), %zu faults avoided, %zu huge pages"
+               " (total: %zu faults avoided, %zu huge pages)\n", name.c_str(), ms,
+               pages, huge_pages, _prefault_pages, _prefault_huge_pages);
+    }
+}
+
 void program::set_search_path(std::initializer_list<std::string> path)
 {
     _search_path = path;
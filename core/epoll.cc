@@ -19,8 +19,9 @@
 #include <osv/file.h>
 #include <osv/poll.h>
 #include <fs/fs.hh>
-#include <boost/lockfree/queue.hpp>
-#include <boost/lockfree/policies.hpp>
+#include <osv/rcu.hh>
+#include <boost/intrusive/list.hpp>
+#include <sys/ioctl.h>
 
 #include <osv/debug.hh>
 #include <osv/export.h>
@@ -59,47 +60,140 @@ inline uint32_t events_poll_to_epoll(uint32_t e)
     return e;
 }
 
+// Not yet in all libc headers
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1U << 28)
+#endif
+
+// Per-instance busy polling parameters, as in Linux's <linux/eventpoll.h>
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#ifndef EPIOCSPARAMS
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#define EPIOCGPARAMS _IOR(EPOLL_IOC_TYPE, 0x02, struct epoll_params)
+#endif
+
+// A file registered with an epoll instance.
+//
+// An epitem is on the ready list whenever 'queued' is set, so that queueing
+// an already queued item is a single atomic exchange. Wakers push onto
+// epoll_file::_pending, a lock-free stack which epoll_wait() moves into the
+// intrusive _ready list, so neither side hashes or allocates anything.
+//
+// Wakers may hold a reference to an epitem after it was unregistered (the
+// net channel wakes from an rcu read-side section), so epitems are freed
+// with rcu_dispose(). An unregistered epitem is marked 'dead' and freed by
+// whoever takes it off the ready list, or right away if it was not queued.
+struct epitem {
+    explicit epitem(epoll_key key, const epoll_event& event)
+        : key(key), event(event) {}
+    const epoll_key key;
+    // protected by the epoll instance's f_lock:
+    epoll_event event;
+    bool dead = false;
+    std::atomic<bool> queued = { false };
+    epitem* pending_next = nullptr;
+    boost::intrusive::list_member_hook<> ready_link;
+};
+
 class epoll_file final : public special_file {
 
     // lock ordering (fp == some file being polled):
     //    f_lock > fp->f_lock
-    //    fp->f_lock > _activity_lock
-    // we never hold both f_lock and activity_lock.
+    //    f_lock > _activity_lock
+    // Wakers, which hold fp->f_lock or run in rcu context, take neither.
+
+    using ready_list = boost::intrusive::list<epitem,
+            boost::intrusive::member_hook<epitem,
+                    boost::intrusive::list_member_hook<>,
+                    &epitem::ready_link>,
+            boost::intrusive::constant_time_size<false>>;
 
     // protected by f_lock:
-    std::unordered_map<epoll_key, epoll_event> map;
+    std::unordered_map<epoll_key, epitem*> map;
+    // pushed to by wakers without locks, taken whole by epoll_wait():
+    std::atomic<epitem*> _pending = { nullptr };
+    // The thread blocked in epoll_wait() that wakers wake. Other waiters
+    // sleep on _waiters and are handed the role when it leaves.
+    sched::thread_handle _wait_owner;
     mutex _activity_lock;
     // below, all protected by _activity_lock:
-    std::unordered_set<epoll_key> _activity;
+    ready_list _ready;
+    bool _wait_owner_claimed = false;
     waitqueue _waiters;
-    boost::lockfree::queue<epoll_key, boost::lockfree::fixed_sized<true>> _activity_ring{512};
-    std::atomic<bool> _activity_ring_overflow = { false };
-    sched::thread_handle _activity_ring_owner;
+    std::chrono::microseconds _busy_poll{0};
+    epoll_params _params = {};
 public:
     epoll_file()
         : special_file(0, DTYPE_UNSPEC)
     {
     }
+    virtual ~epoll_file() {
+        // close() unregistered everything, what is left are queued items
+        // waiting to be reaped
+        take_pending();
+        _ready.clear_and_dispose([] (epitem* item) {
+            assert(item->dead);
+            osv::rcu_dispose(item);
+        });
+    }
     virtual int close() override {
         WITH_LOCK(f_lock) {
             for (auto& e : map) {
-                e.first._file->epoll_del({ this, e.first });
+                e.first._file->epoll_del(ptr(e.second));
+                retire(e.second);
             }
+            map.clear();
         }
         return 0;
     }
+    virtual int ioctl(u_long com, void *data) override {
+        auto params = static_cast<epoll_params*>(data);
+        switch (com) {
+        case EPIOCSPARAMS:
+            if (params->busy_poll_usecs > INT_MAX ||
+                params->prefer_busy_poll > 1 || params->__pad) {
+                return EINVAL;
+            }
+            WITH_LOCK(_activity_lock) {
+                _params = *params;
+                _busy_poll = std::chrono::microseconds(params->busy_poll_usecs);
+            }
+            return 0;
+        case EPIOCGPARAMS:
+            WITH_LOCK(_activity_lock) {
+                *params = _params;
+            }
+            return 0;
+        default:
+            return ENOTTY;
+        }
+    }
     int add(epoll_key key, struct epoll_event *event)
     {
         auto fp = key._file;
+        if (event->events & EPOLLEXCLUSIVE) {
+            constexpr uint32_t allowed = EPOLLEXCLUSIVE | EPOLLIN | EPOLLOUT |
+                    EPOLLERR | EPOLLHUP | EPOLLET | EPOLLWAKEUP;
+            if ((event->events & ~allowed) || dynamic_cast<epoll_file*>(fp)) {
+                return EINVAL;
+            }
+        }
         WITH_LOCK(f_lock) {
             if (map.count(key)) {
                 return EEXIST;
             }
-            map.emplace(key, *event);
-            fp->epoll_add({ this, key});
-        }
-        if (fp->poll(events_epoll_to_poll(event->events))) {
-            wake(key);
+            auto item = new epitem(key, *event);
+            map.emplace(key, item);
+            fp->epoll_add(ptr(item));
+            if (fp->poll(events_epoll_to_poll(event->events))) {
+                wake(item);
+            }
         }
         return 0;
     }
@@ -107,27 +201,33 @@ public:
     {
         auto fp = key._file;
         WITH_LOCK(f_lock) {
-            try {
-                map.at(key) = *event;
-            } catch (std::out_of_range &e) {
+            auto i = map.find(key);
+            if (i == map.end()) {
                 return ENOENT;
             }
-            fp->epoll_add({ this, key });
-        }
-        if (fp->poll(events_epoll_to_poll(event->events))) {
-            wake(key);
+            auto item = i->second;
+            if ((event->events | item->event.events) & EPOLLEXCLUSIVE) {
+                return EINVAL;
+            }
+            item->event = *event;
+            fp->epoll_add(ptr(item));
+            if (fp->poll(events_epoll_to_poll(event->events))) {
+                wake(item);
+            }
         }
         return 0;
     }
     int del(epoll_key key)
     {
         WITH_LOCK(f_lock) {
-            if (map.erase(key)) {
-                key._file->epoll_del({ this, key });
-                return 0;
-            } else {
+            auto i = map.find(key);
+            if (i == map.end()) {
                 return ENOENT;
             }
+            key._file->epoll_del(ptr(i->second));
+            retire(i->second);
+            map.erase(i);
+            return 0;
         }
     }
     int wait(struct epoll_event *events, int maxevents, int timeout_ms)
@@ -138,74 +238,87 @@ public:
             tmr.set(*tmo);
         }
         int nr = 0;
+        bool owner = false;
         WITH_LOCK(_activity_lock) {
-            while (!tmr.expired() && nr == 0) {
-                if (tmo) {
-                    _activity_ring_owner.reset(*sched::thread::current());
-                    sched::thread::wait_for(_activity_lock,
-                            _waiters,
-                            tmr,
-                            [&] { return !_activity.empty(); },
-                            [&] { return !_activity_ring.empty(); },
-                            [&] { return _activity_ring_overflow.load(std::memory_order_relaxed); }
-                    );
-                    _activity_ring_owner.clear();
+            while (true) {
+                take_pending();
+                if (!_ready.empty()) {
+                    // Take the whole list, so that concurrent waiters do
+                    // not poll the same files, and put back what is left.
+                    ready_list batch;
+                    batch.swap(_ready);
+                    ready_list again;
+                    DROP_LOCK(_activity_lock) {
+                        nr = process_activity(batch, again, events, maxevents);
+                    }
+                    _ready.splice(_ready.begin(), batch);
+                    _ready.splice(_ready.end(), again);
+                    if (nr) {
+                        break;
+                    }
+                    continue;
                 }
-
-                flush_activity_ring();
-                // We need to drop _activity_lock and take f_lock in process_activity(),
-                // so move _activity to local storage for processing.
-                auto activity = std::move(_activity);
-                assert(_activity.empty());
-                DROP_LOCK(_activity_lock) {
-                    nr = process_activity(activity, events, maxevents);
+                if (!tmo || tmr.expired()) {
+                    break;
                 }
-                // move back !EPOLLET back to main storage
-                if (_activity.empty()) {
-                    // nothing happened, move entire set back in
-                    _activity = std::move(activity);
-                } else {
-                    // move item by item (realistically a copy)
-                    std::move(activity.begin(), activity.end(),
-                            std::inserter(_activity, _activity.begin()));
+                if (!owner && !_wait_owner_claimed) {
+                    owner = _wait_owner_claimed = true;
+                    _wait_owner.reset(*sched::thread::current());
                 }
-                if (!tmo) {
-                    break;
+                if (!owner) {
+                    sched::thread::wait_for(_activity_lock, _waiters, tmr);
+                    continue;
+                }
+                if (_busy_poll.count() && busy_poll(*tmo)) {
+                    continue;
                 }
+                sched::thread::wait_for(_activity_lock, tmr,
+                        [&] { return _pending.load(std::memory_order_relaxed) != nullptr; });
+            }
+            if (owner) {
+                _wait_owner.clear();
+                _wait_owner_claimed = false;
+            }
+            // Hand over to the next waiter: to pick up the events we left
+            // behind, or to take our place as the thread wakers wake.
+            if ((owner || !_ready.empty()) && !_waiters.empty()) {
+                _waiters.wake_one(_activity_lock);
             }
         }
         return nr;
     }
-    int process_activity(std::unordered_set<epoll_key>& activity,
+    int process_activity(ready_list& batch, ready_list& again,
                          epoll_event* events, int maxevents) {
         int nr = 0;
         WITH_LOCK(f_lock) {
-            auto i = activity.begin();
-            while (i != activity.end() && nr < maxevents) {
-                epoll_key key = *i;
-                auto found = map.find(key);
-                auto cur = i++;
-                if (found == map.end()) {
-                    activity.erase(cur);
-                    continue; // raced
+            while (!batch.empty() && nr < maxevents) {
+                auto item = &batch.front();
+                batch.pop_front();
+                if (item->dead) {
+                    osv::rcu_dispose(item);
+                    continue; // raced with del
                 }
-                epoll_event& evt = found->second;
+                // Dequeue before polling, so that an event arriving from
+                // here on queues the item again
+                item->queued.store(false, std::memory_order_seq_cst);
+                auto key = item->key;
+                epoll_event& evt = item->event;
                 int active = 0;
                 if (evt.events) {
                     active = key._file->poll(events_epoll_to_poll(evt.events));
                 }
                 active = events_poll_to_epoll(active);
-                if (!active || (evt.events & EPOLLET)) {
-                    activity.erase(cur);
-                } else {
-                    key._file->epoll_add({ this, key });
-                }
                 if (!active) {
                     continue;
                 }
                 if (evt.events & EPOLLONESHOT) {
                     evt.events = 0;
-                    key._file->epoll_del({ this, key });
+                    key._file->epoll_del(ptr(item));
+                } else if (!(evt.events & EPOLLET)) {
+                    // Level triggered, stays ready until polled empty
+                    if (!item->queued.exchange(true, std::memory_order_acq_rel)) {
+                        again.push_back(*item);
+                    }
                 }
                 trace_epoll_ready(key._fd, key._file, active);
                 events[nr].data = evt.data;
@@ -215,39 +328,74 @@ public:
         }
         return nr;
     }
-    void flush_activity_ring() {
-        epoll_key ep;
-        while (_activity_ring.pop(ep)) {
-            _activity.insert(ep);
-        }
-        if (_activity_ring_overflow.load(std::memory_order_relaxed)) {
-            _activity_ring_overflow.store(false, std::memory_order_relaxed);
-            for (auto&& x : map) {
-                _activity.insert(x.first);
+    // Spins on the ready list for up to the busy poll time before the
+    // caller goes to sleep, trading CPU for wakeup latency: a socket's net
+    // channel queues its epitem straight from the receive path, so an
+    // event is picked up without a context switch. Returns true if events
+    // arrived.
+    bool busy_poll(file::clock::time_point deadline) {
+        auto until = std::min(deadline, file::clock::now() + _busy_poll);
+        DROP_LOCK(_activity_lock) {
+            while (file::clock::now() < until) {
+                if (_pending.load(std::memory_order_relaxed)) {
+                    return true;
+                }
+#ifdef __x86_64__
+                __asm __volatile("pause");
+#endif
+#ifdef __aarch64__
+                __asm __volatile("isb sy");
+#endif
             }
         }
-        // events on _activity_ring only wake up one waiter, so wake up all the rest  now.
-        // we need to do this even if no events were received, since if we exit, then
-        // _activity_ring_owner will remain unset.
-        _waiters.wake_all(_activity_lock);
+        return false;
     }
-    void wake(epoll_key key) {
-        if (_activity_ring.push(key)) {
-            _activity_ring_owner.wake();
-            return;
+    // Moves items pushed by wakers onto _ready, oldest first.
+    void take_pending() {
+        auto item = _pending.exchange(nullptr, std::memory_order_acquire);
+        ready_list taken;
+        while (item) {
+            auto next = item->pending_next;
+            taken.push_front(*item);
+            item = next;
         }
-        WITH_LOCK(_activity_lock) {
-            auto ins = _activity.insert(key);
-            if (ins.second) {
-                _waiters.wake_all(_activity_lock);
-            }
+        _ready.splice(_ready.end(), taken);
+    }
+    // Queues an item, returning true if it started a new batch, in which
+    // case the waiter has to be woken. Wakeups for items queued while the
+    // waiter has yet to run are thereby coalesced into one.
+    bool queue(epitem* item) {
+        if (item->queued.exchange(true, std::memory_order_acq_rel)) {
+            return false;
         }
+        auto head = _pending.load(std::memory_order_relaxed);
+        do {
+            item->pending_next = head;
+        } while (!_pending.compare_exchange_weak(head, item,
+                std::memory_order_release, std::memory_order_relaxed));
+        return !head;
     }
-    void wake_in_rcu(epoll_key key) {
-        if (!_activity_ring.push(key)) {
-            _activity_ring_overflow.store(true, std::memory_order_relaxed);
+    void retire(epitem* item) {
+        item->dead = true;
+        if (!item->queued.exchange(true, std::memory_order_acq_rel)) {
+            osv::rcu_dispose(item);
         }
-        _activity_ring_owner.wake_from_kernel_or_with_irq_disabled();
+    }
+    void wake(epitem* item) {
+        if (queue(item)) {
+            _wait_owner.wake();
+        }
+    }
+    void wake_in_rcu(epitem* item) {
+        if (queue(item)) {
+            _wait_owner.wake_from_kernel_or_with_irq_disabled();
+        }
+    }
+    bool has_waiter() const {
+        return _wait_owner;
+    }
+    epoll_ptr ptr(epitem* item) {
+        return { this, item->key, item, bool(item->event.events & EPOLLEXCLUSIVE) };
     }
 };
 
@@ -401,10 +549,23 @@ void epoll_file_closed(epoll_ptr ptr)
 
 void epoll_wake(const epoll_ptr& ep)
 {
-    ep.epoll->wake(ep.key);
+    ep.epoll->wake(ep.item);
 }
 
 void epoll_wake_in_rcu(const epoll_ptr& ep)
 {
-    ep.epoll->wake_in_rcu(ep.key);
+    ep.epoll->wake_in_rcu(ep.item);
+}
+
+bool epoll_wake_if_waiting(const epoll_ptr& ep, bool in_rcu)
+{
+    if (!ep.epoll->has_waiter()) {
+        return false;
+    }
+    if (in_rcu) {
+        ep.epoll->wake_in_rcu(ep.item);
+    } else {
+        ep.epoll->wake(ep.item);
+    }
+    return true;
 }
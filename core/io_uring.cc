@@ -37,6 +37,7 @@
 #include <osv/sched.hh>
 #include <osv/clock.hh>
 #include <osv/condvar.h>
+#include <osv/io_wq.hh>
 #include "fs/vfs/vfs.h"
 
 #include <sys/mman.h>
@@ -62,6 +63,13 @@
 class io_uring_file;
 struct cancel_token;
 struct io_uring_work;
+struct io_uring_ctx;
+
+/* A ring's io-wq worker pool, running SQE chains */
+typedef osv::io_wq<std::shared_ptr<std::vector<io_uring_work>>> io_uring_wq;
+
+static void exec_sqe_chain(struct io_uring_ctx *ctx,
+                            std::vector<io_uring_work> chain);
 
 /*
  * Return the io_uring_ctx backing a file, or nullptr if `fp` is not an
@@ -204,28 +212,12 @@ struct io_uring_ctx {
     std::deque<struct io_uring_cqe> cq_overflow;
 
     /*
-     * io-wq worker pool.  Replaces the former detached-thread-per-chain model
-     * (which created one sched::thread per submitted SQE chain -- a thread-
-     * creation amplifier under PostgreSQL-style batch submit).  Persistent
-     * workers pull chains from per-class queues and are reused across
-     * submissions, so thread creation is bounded to wq_max_workers per class
-     * for the whole lifetime of the ring rather than growing with load.
-     *
-     * Two classes mirror Linux io-wq and IORING_REGISTER_IOWQ_MAX_WORKERS,
-     * which takes a [bounded, unbounded] pair:
-     *   index 0 = WQ_BOUNDED   -- file/disk ops that complete promptly.
-     *   index 1 = WQ_UNBOUNDED -- net/poll/timeout ops that may block
-     *                             indefinitely; kept in a separate pool so a
-     *                             burst of blocking waits cannot starve disk
-     *                             I/O of workers.
-     * All fields protected by mtx.
+     * io-wq worker pool (see <osv/io_wq.hh>), running SQE chains.  Its two
+     * classes are the [bounded, unbounded] pair of
+     * IORING_REGISTER_IOWQ_MAX_WORKERS.  It has its own lock; mtx may be
+     * held when queueing.
      */
-    std::deque<std::shared_ptr<std::vector<io_uring_work>>> wq_queue[2];
-    waitqueue   wq_wait[2];
-    uint32_t    wq_nr_workers[2];   /* threads created per class */
-    uint32_t    wq_idle[2];         /* workers currently blocked on wq_wait */
-    uint32_t    wq_max_workers[2];  /* cap per class (IOWQ_MAX_WORKERS) */
-    std::vector<sched::thread*> wq_threads;  /* all workers, joined at teardown */
+    io_uring_wq wq;
 
     io_uring_ctx()
         : pending_ops(0), shutdown(false),
@@ -234,14 +226,11 @@ struct io_uring_ctx {
           registered_files(nullptr), nr_registered_files(0),
           setup_flags(0), disabled(false),
           sq_poll_thread(nullptr), sq_idle_ms(0), sq_thread_cpu(0),
-          eventfd_fd(-1)
+          eventfd_fd(-1),
+          wq("iou-wq", [this](std::shared_ptr<std::vector<io_uring_work>> cp) {
+              exec_sqe_chain(this, std::move(*cp));
+          })
     {
-        unsigned ncpu = (unsigned)sched::cpus.size();
-        if (ncpu == 0) ncpu = 1;
-        wq_max_workers[0] = std::max(4u, ncpu);       /* bounded (disk) */
-        wq_max_workers[1] = std::max(16u, ncpu * 4);  /* unbounded (net) */
-        wq_nr_workers[0] = wq_nr_workers[1] = 0;
-        wq_idle[0] = wq_idle[1] = 0;
     }
 };
 
@@ -1882,20 +1871,12 @@ static void exec_sqe_chain(struct io_uring_ctx *ctx,
 /* -------------------------------------------------------------------------
  * io-wq worker pool.
  *
- * A chain is classified as bounded (disk/file, WQ_BOUNDED, index 0) or
- * unbounded (net/poll/timeout, WQ_UNBOUNDED, index 1) by the opcode of its
- * first non-LINK_TIMEOUT entry.  Unbounded ops may block for an unbounded
- * time (recv/accept/poll/timeout), so they run in a separate worker pool to
- * keep prompt disk I/O from being starved of workers.
- *
- * Workers are persistent: each blocks on wq_wait[cls] for work, executes one
- * chain via exec_sqe_chain(), then loops.  A new worker is created lazily on
- * enqueue only when no worker is idle and the per-class cap wq_max_workers[cls]
- * has not been reached.  This bounds thread creation to the cap for the ring's
- * whole lifetime instead of one thread per submission.
+ * A chain is classified as bounded (disk/file) or unbounded (net/poll/
+ * timeout) by the opcode of its first non-LINK_TIMEOUT entry, and queued on
+ * the ring's osv::io_wq, whose workers run it with exec_sqe_chain().
  * ---------------------------------------------------------------------- */
 
-static int io_uring_work_class(uint8_t opcode)
+static io_uring_wq::work_class io_uring_work_class(uint8_t opcode)
 {
     switch (opcode) {
     case IORING_OP_POLL_ADD:
@@ -1920,9 +1901,9 @@ static int io_uring_work_class(uint8_t opcode)
     case IORING_OP_SENDMSG_ZC:
     case IORING_OP_EPOLL_WAIT:   /* blocks until an epoll event is ready */
     case IORING_OP_FUTEX_WAIT:   /* blocks until woken */
-        return 1;   /* WQ_UNBOUNDED */
+        return io_uring_wq::unbounded;
     default:
-        return 0;   /* WQ_BOUNDED */
+        return io_uring_wq::bounded;
     }
 }
 
@@ -1934,51 +1915,15 @@ static uint8_t chain_lead_opcode(const std::vector<io_uring_work> &chain)
     return chain.empty() ? (uint8_t)IORING_OP_NOP : chain.front().sqe.opcode;
 }
 
-/* Persistent worker loop for pool class `cls`.  ctx->mtx must NOT be held. */
-static void io_uring_wq_worker(struct io_uring_ctx *ctx, int cls)
-{
-    WITH_LOCK(ctx->mtx) {
-        for (;;) {
-            while (ctx->wq_queue[cls].empty() && !ctx->shutdown) {
-                ctx->wq_idle[cls]++;
-                ctx->wq_wait[cls].wait(ctx->mtx);
-                ctx->wq_idle[cls]--;
-            }
-            if (ctx->shutdown && ctx->wq_queue[cls].empty())
-                return;
-
-            auto cp = std::move(ctx->wq_queue[cls].front());
-            ctx->wq_queue[cls].pop_front();
-
-            DROP_LOCK(ctx->mtx) {
-                exec_sqe_chain(ctx, std::move(*cp));
-            }
-        }
-    }
-}
-
 /*
- * Hand a chain to the worker pool.  ctx->mtx must be held.  The chain has
- * already been registered in ctx->cancellable and counted in pending_ops by
- * the caller.  Spawns a new worker only when none is idle and the class cap
- * is not yet reached.
+ * Hand a chain to the worker pool.  The chain has already been registered
+ * in ctx->cancellable and counted in pending_ops by the caller.
  */
 static void io_uring_wq_enqueue(struct io_uring_ctx *ctx,
                                 std::shared_ptr<std::vector<io_uring_work>> cp)
 {
-    int cls = io_uring_work_class(chain_lead_opcode(*cp));
-    ctx->wq_queue[cls].push_back(std::move(cp));
-
-    if (ctx->wq_idle[cls] == 0 &&
-        ctx->wq_nr_workers[cls] < ctx->wq_max_workers[cls]) {
-        ctx->wq_nr_workers[cls]++;
-        auto *t = sched::thread::make(
-            [ctx, cls]() { io_uring_wq_worker(ctx, cls); });
-        ctx->wq_threads.push_back(t);
-        t->start();
-    } else {
-        ctx->wq_wait[cls].wake_one(ctx->mtx);
-    }
+    auto cls = io_uring_work_class(chain_lead_opcode(*cp));
+    ctx->wq.enqueue(std::move(cp), cls);
 }
 
 /* -------------------------------------------------------------------------
@@ -2380,8 +2325,6 @@ int io_uring_file::close()
         _ctx->shutdown = true;
         _ctx->wait_sq.wake_all(_ctx->mtx);
         _ctx->wait_cq.wake_all(_ctx->mtx);
-        _ctx->wq_wait[0].wake_all(_ctx->mtx);
-        _ctx->wq_wait[1].wake_all(_ctx->mtx);
     }
 
     if (_ctx->sq_poll_thread) {
@@ -2391,18 +2334,14 @@ int io_uring_file::close()
     }
 
     /*
-     * Join every io-wq worker.  A worker either exits promptly (idle, woken by
-     * the wake_all above) or after finishing its current chain: exec_sqe_chain
-     * observes ctx->shutdown (POLL_ADD bails, in-flight interruptible ops keep
-     * running to completion) and returns, then the worker sees an empty queue
-     * with shutdown set and exits.  Joining here guarantees no worker touches
-     * the ctx after we start freeing it below.
+     * Join every io-wq worker.  A worker either exits promptly (idle) or after
+     * running what is queued: exec_sqe_chain observes ctx->shutdown (POLL_ADD
+     * bails, in-flight interruptible ops keep running to completion) and
+     * returns, then the worker sees an empty queue and exits.  No chain can
+     * be queued any more, as submission checks ctx->shutdown.  Joining here
+     * guarantees no worker touches the ctx after we start freeing it below.
      */
-    for (auto *t : _ctx->wq_threads) {
-        t->join();
-        delete t;
-    }
-    _ctx->wq_threads.clear();
+    _ctx->wq.shutdown();
 
     WITH_LOCK(_ctx->mtx) {
         while (_ctx->pending_ops > 0)
@@ -3026,12 +2965,8 @@ static int io_uring_register_impl(int fd, unsigned opcode, void *arg, unsigned n
              */
             if (!arg || nr_args != 2) { ret = -EINVAL; break; }
             auto *vals = static_cast<uint32_t *>(arg);
-            for (int c = 0; c < 2; c++) {
-                uint32_t prev = ctx->wq_max_workers[c];
-                if (vals[c] != 0)
-                    ctx->wq_max_workers[c] = vals[c];
-                vals[c] = prev;
-            }
+            vals[0] = ctx->wq.set_max_workers(io_uring_wq::bounded, vals[0]);
+            vals[1] = ctx->wq.set_max_workers(io_uring_wq::unbounded, vals[1]);
             break;
         }
 
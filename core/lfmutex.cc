@@ -10,6 +10,7 @@
 #include <osv/sched.hh>
 #include <osv/wait_record.hh>
 #include <osv/export.h>
+#include <osv/lockstat.hh>
 
 namespace lockfree {
 
@@ -20,6 +21,53 @@ TRACEPOINT(trace_mutex_try_lock, "%p, success=%d", mutex *, bool);
 TRACEPOINT(trace_mutex_unlock, "%p", mutex *);
 TRACEPOINT(trace_mutex_send_lock, "%p, wr=%p", mutex *, wait_record *);
 TRACEPOINT(trace_mutex_receive_lock, "%p", mutex *);
+TRACEPOINT(trace_mutex_lock_spin, "%p, success=%d", mutex *, bool);
+
+unsigned mutex::spin_limit = 256;
+
+// Waits for the lock by spinning instead of sleeping, as long as it looks
+// like the wait will be short: the lock is held by a thread which is
+// running on another cpu, and nobody is queued for it yet (if somebody is,
+// unlock() will hand the lock over to them, not to us). Returns true if we
+// got the lock.
+bool mutex::spin(sched::thread *current)
+{
+    if (!spin_limit || sched::cpus.size() < 2) {
+        return false;
+    }
+    sched::thread *last_owner = nullptr;
+    for (unsigned i = 0; i < spin_limit; i++) {
+        int c = count.load(std::memory_order_relaxed);
+        if (c == 0) {
+            if (count.compare_exchange_weak(c, 1, std::memory_order_acquire)) {
+                owner.store(current, std::memory_order_relaxed);
+                depth = 1;
+                trace_mutex_lock_spin(this, true);
+                return true;
+            }
+        } else if (c > 1) {
+            break;
+        } else {
+            // owner is null for a short while after the lock was taken and
+            // before it is released, keep spinning then.
+            auto o = owner.load(std::memory_order_relaxed);
+            if (o && o != last_owner) {
+                if (!sched::thread::on_cpu(o)) {
+                    break;
+                }
+                last_owner = o;
+            }
+        }
+#ifdef __x86_64__
+        __asm __volatile("pause");
+#endif
+#ifdef __aarch64__
+        __asm __volatile("isb sy");
+#endif
+    }
+    trace_mutex_lock_spin(this, false);
+    return false;
+}
 
 void mutex::lock()
 {
@@ -27,7 +75,8 @@ void mutex::lock()
 
     sched::thread *current = sched::thread::current();
 
-    if (count.fetch_add(1, std::memory_order_acquire) == 0) {
+    int zero = 0;
+    if (count.compare_exchange_strong(zero, 1, std::memory_order_acquire)) {
         // Uncontended case (no other thread is holding the lock, and no
         // concurrent lock() attempts). We got the lock.
         // Setting count=1 already got us the lock; we set owner and depth
@@ -41,11 +90,29 @@ void mutex::lock()
     // a recursive mutex so it's possible the lock holder is us - in which
     // case we need to increment depth instead of waiting.
     if (owner.load(std::memory_order_relaxed) == current) {
-        count.fetch_add(-1, std::memory_order_relaxed);
         ++depth;
         return;
     }
 
+    // The lock is owned by a different thread, so from here on we are
+    // contending for it until we return.
+    lockstat::wait_timer contention(this, lockstat::lock_type::mutex,
+                                    __builtin_return_address(0));
+
+    // Before committing to wait for it by incrementing count, spin for a
+    // while if its owner is busy on another cpu: short critical sections
+    // will often be over before a context switch would have been.
+    if (spin(current)) {
+        return;
+    }
+
+    if (count.fetch_add(1, std::memory_order_acquire) == 0) {
+        // The lock was released while we were getting here.
+        owner.store(current, std::memory_order_relaxed);
+        depth = 1;
+        return;
+    }
+
     // If we're here still here the lock is owned by a different thread.
     // Put this thread in a waiting queue, so it will eventually be woken
     // when another thread releases the lock.
@@ -234,6 +301,10 @@ void mutex::unlock()
         return;
     }
 
+    if (lockstat::active()) {
+        lockstat::released(this, __builtin_return_address(0));
+    }
+
     // Otherwise there is at least one concurrent lock(). Awaken one if
     // it's waiting on the waitqueue, otherwise use the RHO protocol to
     // have the lock() responsible for waking someone up.
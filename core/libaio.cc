@@ -8,105 +8,211 @@
 // This is the Linux-specific asynchronous I/O API / ABI from libaio.
 // Note that this API is different from the POSIX AIO API.
 //
-// OSv has no user/kernel boundary, so "async" I/O is achieved the same way
-// io_uring does it: each submitted iocb is run on a short-lived worker thread
-// that performs the blocking read/write/fsync via the VFS, then queues an
-// io_event and wakes any thread parked in io_getevents().  A context caps the
-// number of in-flight ops at the nr_events requested at io_setup() time.
+// Each iocb becomes an osv::aio::request, see <osv/aio.hh>. Completions are
+// posted to a lock-free ring, like io_uring's CQ, which io_getevents()
+// harvests without taking a lock; a thread only sleeps on the context's
+// condvar when the ring is empty.
+//
+// A context admits at most the nr_events requested at io_setup() time. A slot
+// is taken at io_submit() and given back when io_getevents() reaps the event,
+// so the completion ring can never overflow.
 
 #include <api/libaio.h>
 
-#include <sys/uio.h>
 #include <unistd.h>
 #include <errno.h>
-#include <deque>
+#include <cassert>
+#include <atomic>
+#include <memory>
 
 #include <osv/export.h>
 #include <osv/mutex.h>
 #include <osv/condvar.h>
-#include <osv/sched.hh>
-#include <osv/file.h>
 #include <osv/clock.hh>
+#include <osv/sched.hh>
+#include <osv/ilog2.hh>
+#include <osv/aio.hh>
+#include <arch.hh>
+
+// Bounded multi-producer / multi-consumer ring (Vyukov). Each cell carries a
+// sequence number telling whether it is ready to be written or read for the
+// current lap, so producers and consumers only contend on their own index.
+template <typename T>
+class completion_ring {
+public:
+    explicit completion_ring(unsigned size)
+        : _mask(size - 1), _cells(new cell[size])
+    {
+        assert(is_power_of_two(size));
+        for (unsigned i = 0; i < size; i++) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T& v)
+    {
+        unsigned pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = _cells[pos & _mask];
+            int diff = c.seq.load(std::memory_order_acquire) - pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = v;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& v)
+    {
+        unsigned pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = _cells[pos & _mask];
+            int diff = c.seq.load(std::memory_order_acquire) - (pos + 1);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = c.value;
+                    c.seq.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct cell {
+        std::atomic<unsigned> seq;
+        T value;
+    };
+    const unsigned _mask;
+    std::unique_ptr<cell[]> _cells;
+    std::atomic<unsigned> _head CACHELINE_ALIGNED = { 0 };
+    std::atomic<unsigned> _tail CACHELINE_ALIGNED = { 0 };
+};
 
-#include "fs/vfs/vfs.h"
+struct libaio_req {
+    osv::aio::request       req;
+    struct io_context      *ctx;
+    struct iocb            *cb;
+};
 
 struct io_context {
+    explicit io_context(unsigned nr_events);
+
+    unsigned                max_events;     // capacity requested at io_setup()
+    std::atomic<unsigned>   slots{0};       // events submitted but not yet reaped
+    std::atomic<unsigned>   inflight{0};    // ops submitted but not yet retired
+    // One per in-flight op and io_getevents() caller, plus the owner's; the
+    // last one to go frees the context
+    std::atomic<unsigned>   refs{1};
+    std::atomic<unsigned>   waiters{0};     // threads asleep in io_getevents()
+    std::atomic<bool>       destroying{false};
+    std::unique_ptr<libaio_req[]> reqs;
+    completion_ring<libaio_req*> free_reqs;
+    completion_ring<io_event> completed;    // retired events awaiting io_getevents
     mutex                   mtx;
     condvar                 cv;             // signalled when an event completes
-    unsigned                max_events;     // capacity requested at io_setup()
-    unsigned                inflight = 0;   // ops submitted but not yet retired
-    unsigned                waiters = 0;    // threads parked in io_getevents()
-    bool                    destroying = false;
-    std::deque<io_event>    completed;      // retired events awaiting io_getevents
 };
 
-// Run one iocb to completion and record its io_event.  Executed on a worker
-// thread so the submitting thread returns immediately.
-static void libaio_run_one(struct io_context *ctx, struct iocb *cb)
+io_context::io_context(unsigned nr_events)
+    : max_events(nr_events)
+    , reqs(new libaio_req[nr_events])
+    , free_reqs(1u << ilog2_roundup(nr_events))
+    , completed(1u << ilog2_roundup(nr_events))
 {
-    int64_t res;
-    struct file *fp = nullptr;
-
-    if (fget(cb->aio_fildes, &fp) != 0) {
-        res = -EBADF;
-    } else {
-        size_t done = 0;
-        int error = 0;
-        switch (cb->aio_lio_opcode) {
-        case IO_CMD_PREAD: {
-            struct iovec iov { reinterpret_cast<void*>(cb->aio_buf),
-                               static_cast<size_t>(cb->aio_nbytes) };
-            error = sys_read(fp, &iov, 1, cb->aio_offset, &done);
-            break;
-        }
-        case IO_CMD_PWRITE: {
-            struct iovec iov { reinterpret_cast<void*>(cb->aio_buf),
-                               static_cast<size_t>(cb->aio_nbytes) };
-            error = sys_write(fp, &iov, 1, cb->aio_offset, &done);
-            break;
-        }
-        case IO_CMD_PREADV:
-            error = sys_read(fp, reinterpret_cast<struct iovec*>(cb->aio_buf),
-                             cb->aio_nbytes, cb->aio_offset, &done);
-            break;
-        case IO_CMD_PWRITEV:
-            error = sys_write(fp, reinterpret_cast<struct iovec*>(cb->aio_buf),
-                              cb->aio_nbytes, cb->aio_offset, &done);
-            break;
-        case IO_CMD_FSYNC:
-        case IO_CMD_FDSYNC:
-            error = sys_fsync(fp);
-            done = 0;
-            break;
-        case IO_CMD_NOOP:
-            error = 0;
-            done = 0;
-            break;
-        default:
-            error = EINVAL;
-            break;
+    for (unsigned i = 0; i < nr_events; i++) {
+        reqs[i].ctx = this;
+        free_reqs.push(&reqs[i]);
+    }
+}
+
+static void put_ctx(struct io_context *ctx)
+{
+    if (ctx->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete ctx;
+    }
+}
+
+static void wake_waiters(struct io_context *ctx)
+{
+    // Pairs with the fence in io_getevents(): either it sees the event we
+    // have just posted, or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ctx->waiters.load(std::memory_order_relaxed)) {
+        WITH_LOCK(ctx->mtx) {
+            ctx->cv.wake_all();
         }
-        res = error ? -error : static_cast<int64_t>(done);
-        fdrop(fp);
     }
+}
+
+static void libaio_done(osv::aio::request *req, int64_t res)
+{
+    auto r = reinterpret_cast<libaio_req*>(req);
+    auto ctx = r->ctx;
+    auto cb = r->cb;
 
     io_event ev {};
     ev.data = cb->aio_data;
     ev.obj  = reinterpret_cast<uint64_t>(cb);
     ev.res  = res;
     ev.res2 = 0;
+    // The iocb may be reused as soon as the event is reaped
+    int resfd = cb->aio_flags & IOCB_FLAG_RESFD ? cb->aio_resfd : -1;
 
-    WITH_LOCK(ctx->mtx) {
-        ctx->completed.push_back(ev);
-        ctx->inflight--;
-        ctx->cv.wake_all();
-    }
+    r->req.owner = nullptr;
+    ctx->free_reqs.push(r);
+    // Can't fail: a slot was taken for this event in io_submit()
+    ctx->completed.push(ev);
+    wake_waiters(ctx);
 
     // Best-effort eventfd notification if the iocb asked for one.
-    if (cb->aio_flags & IOCB_FLAG_RESFD) {
+    if (resfd >= 0) {
         uint64_t val = 1;
-        (void)::write(cb->aio_resfd, &val, sizeof(val));
+        (void)::write(resfd, &val, sizeof(val));
+    }
+
+    // Pairs with io_destroy(), which sets destroying before it checks
+    // inflight: one of us sees the other's update
+    if (ctx->inflight.fetch_sub(1) == 1 && ctx->destroying.load()) {
+        WITH_LOCK(ctx->mtx) {
+            ctx->cv.wake_all();
+        }
+    }
+    put_ctx(ctx);
+}
+
+static bool libaio_prep(struct osv::aio::request *req, struct iocb *cb)
+{
+    using op = osv::aio::request::op;
+
+    switch (cb->aio_lio_opcode) {
+    case IO_CMD_PREAD:   req->opcode = op::read; break;
+    case IO_CMD_PWRITE:  req->opcode = op::write; break;
+    case IO_CMD_PREADV:  req->opcode = op::readv; break;
+    case IO_CMD_PWRITEV: req->opcode = op::writev; break;
+    case IO_CMD_FSYNC:   req->opcode = op::fsync; break;
+    case IO_CMD_FDSYNC:  req->opcode = op::fdatasync; break;
+    case IO_CMD_NOOP:    req->opcode = op::nop; break;
+    default:
+        return false;
     }
+    req->fd = cb->aio_fildes;
+    req->buf = reinterpret_cast<void*>(cb->aio_buf);
+    req->nbytes = cb->aio_nbytes;
+    req->offset = cb->aio_offset;
+    req->owner = cb;
+    req->done = libaio_done;
+    return true;
 }
 
 OSV_LIBAIO_API
@@ -116,16 +222,15 @@ int io_setup(int nr_events, io_context_t *ctxp)
         return -EFAULT;
     }
     // Linux requires a positive event capacity; a zero/negative nr_events is
-    // EINVAL (a zero cap would otherwise mean "unbounded", allowing unbounded
-    // worker-thread creation).
-    if (nr_events <= 0) {
+    // EINVAL.  A request is preallocated per event, so also refuse more than
+    // Linux's default aio-max-nr.
+    if (nr_events <= 0 || nr_events > 65536) {
         return -EINVAL;
     }
-    auto *ctx = new (std::nothrow) io_context;
+    auto *ctx = new (std::nothrow) io_context(nr_events);
     if (!ctx) {
         return -ENOMEM;
     }
-    ctx->max_events = nr_events;
     *ctxp = ctx;
     return 0;
 }
@@ -133,7 +238,7 @@ int io_setup(int nr_events, io_context_t *ctxp)
 OSV_LIBAIO_API
 int io_submit(io_context_t ctx, long nr, struct iocb *ios[])
 {
-    if (!ctx || nr < 0) {
+    if (!ctx || nr < 0 || ctx->destroying.load(std::memory_order_relaxed)) {
         return -EINVAL;
     }
     if (nr == 0) {
@@ -151,37 +256,46 @@ int io_submit(io_context_t ctx, long nr, struct iocb *ios[])
             // else return the partial count already submitted (Linux-style).
             return submitted > 0 ? submitted : -EFAULT;
         }
-        sched::thread *w;
-        WITH_LOCK(ctx->mtx) {
-            if (ctx->destroying) {
-                break;
-            }
-            // Respect the context's in-flight capacity.  If we already accepted
-            // at least one op, return the partial count (Linux does the same);
-            // otherwise signal EAGAIN.
-            if (ctx->max_events && ctx->inflight >= ctx->max_events) {
-                if (submitted > 0) {
-                    return submitted;
-                }
-                return -EAGAIN;
-            }
-            // one detached worker thread per iocb.  Simple and correct; if a
-            // caller submits huge batches and thread-create cost shows up, swap
-            // in a bounded worker pool like core/io_uring.cc's.
-            // TODO: bounded worker pool if batch thread-create cost matters.
-            w = sched::thread::make([ctx, cb]() { libaio_run_one(ctx, cb); },
-                    sched::thread::attr().detached().name("libaio"));
-            if (!w) {
-                // Thread allocation failed: do not count it as inflight (that
-                // would make io_destroy() wait forever).
+        // Respect the context's capacity.  If we already accepted at least
+        // one op, return the partial count (Linux does the same); otherwise
+        // signal EAGAIN.
+        unsigned used = ctx->slots.load(std::memory_order_relaxed);
+        do {
+            if (used >= ctx->max_events) {
                 return submitted > 0 ? submitted : -EAGAIN;
             }
-            ctx->inflight++;
+        } while (!ctx->slots.compare_exchange_weak(used, used + 1, std::memory_order_relaxed));
+
+        // There are as many requests as slots, so one is free, but it may
+        // still be on its way back to the ring from the completing thread
+        libaio_req *r;
+        while (!ctx->free_reqs.pop(r)) {
+            sched::thread::yield();
         }
-        w->start();
+        r->cb = cb;
+        if (!libaio_prep(&r->req, cb)) {
+            ctx->free_reqs.push(r);
+            ctx->slots.fetch_sub(1, std::memory_order_relaxed);
+            return submitted > 0 ? submitted : -EINVAL;
+        }
+        ctx->inflight.fetch_add(1, std::memory_order_relaxed);
+        ctx->refs.fetch_add(1, std::memory_order_relaxed);
+        osv::aio::submit(&r->req);
         submitted++;
     }
-    return submitted > 0 ? submitted : -EINVAL;
+    return submitted;
+}
+
+static long reap(io_context_t ctx, long nr, struct io_event *events)
+{
+    long n = 0;
+    while (n < nr && ctx->completed.pop(events[n])) {
+        n++;
+    }
+    if (n) {
+        ctx->slots.fetch_sub(n, std::memory_order_relaxed);
+    }
+    return n;
 }
 
 OSV_LIBAIO_API
@@ -204,36 +318,41 @@ int io_getevents(io_context_t ctx, long min_nr, long nr,
                           timeout->tv_nsec >= 1000000000L)) {
         return -EINVAL;
     }
+
+    // Fast path: enough events are already there
+    long collected = reap(ctx, nr, events);
+    if (collected >= min_nr) {
+        return collected;
+    }
+
     auto deadline = osv::clock::uptime::now();
     if (have_deadline) {
         deadline += std::chrono::seconds(timeout->tv_sec) +
                     std::chrono::nanoseconds(timeout->tv_nsec);
     }
 
-    long collected = 0;
+    // Keep ctx alive should io_destroy() be called while we sleep
+    ctx->refs.fetch_add(1, std::memory_order_relaxed);
     WITH_LOCK(ctx->mtx) {
-        ctx->waiters++;
-        while (collected < nr && !ctx->destroying) {
-            while (!ctx->completed.empty() && collected < nr) {
-                events[collected++] = ctx->completed.front();
-                ctx->completed.pop_front();
-            }
-            if (collected >= min_nr) {
-                break;     // satisfied the caller's minimum
+        ctx->waiters.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            collected += reap(ctx, nr - collected, events + collected);
+            if (collected >= min_nr || ctx->destroying.load(std::memory_order_relaxed)) {
+                break;
             }
             if (have_deadline) {
                 if (ctx->cv.wait(&ctx->mtx, deadline) != 0) {
+                    collected += reap(ctx, nr - collected, events + collected);
                     break; // timed out
                 }
             } else {
                 ctx->cv.wait(ctx->mtx);
             }
         }
-        // Let a concurrent io_destroy() know we have stopped touching ctx.
-        if (--ctx->waiters == 0) {
-            ctx->cv.wake_all();
-        }
+        ctx->waiters.fetch_sub(1, std::memory_order_relaxed);
     }
+    put_ctx(ctx);
     return collected;
 }
 
@@ -243,28 +362,53 @@ int io_destroy(io_context_t ctx)
     if (!ctx) {
         return -EINVAL;
     }
+    if (ctx->destroying.exchange(true)) {
+        return -EINVAL;
+    }
+    // Drop what has not started yet, then wait for the rest to retire
+    while (osv::aio::cancel([ctx] (const osv::aio::request& r) {
+            return r.done == libaio_done && reinterpret_cast<const libaio_req&>(r).ctx == ctx; })) {
+        ctx->inflight.fetch_sub(1);
+        put_ctx(ctx);
+    }
     WITH_LOCK(ctx->mtx) {
-        ctx->destroying = true;
         // Wake any thread parked in io_getevents() so it observes destroying
-        // and stops touching ctx.
         ctx->cv.wake_all();
-        // Wait for all in-flight ops to retire AND for every io_getevents()
-        // waiter to leave, so no worker or waiter still references ctx once we
-        // free it (each worker is detached and self-reaps).
-        while (ctx->inflight > 0 || ctx->waiters > 0) {
+        while (ctx->inflight.load() > 0) {
             ctx->cv.wait(ctx->mtx);
         }
     }
-    delete ctx;
+    put_ctx(ctx);
     return 0;
 }
 
 OSV_LIBAIO_API
 int io_cancel(io_context_t ctx, struct iocb *iocb, struct io_event *evt)
 {
-    // An op is executed on a worker thread that runs the blocking VFS call to
-    // completion; there is no safe mid-flight cancellation point, so report
-    // EINVAL (a valid Linux response when the op cannot be cancelled).
-    (void)ctx; (void)iocb; (void)evt;
-    return -EINVAL;
+    if (!ctx || !iocb || !evt) {
+        return -EINVAL;
+    }
+    // Only an op still waiting for a worker can be cancelled: one handed to
+    // a block driver or running the blocking VFS call has no safe
+    // cancellation point, so report EINVAL like Linux does for an iocb it
+    // cannot cancel.
+    auto req = osv::aio::cancel([ctx, iocb] (const osv::aio::request& r) {
+        return r.owner == iocb && r.done == libaio_done &&
+               reinterpret_cast<const libaio_req&>(r).ctx == ctx;
+    });
+    if (!req) {
+        return -EINVAL;
+    }
+    *evt = {};
+    evt->data = iocb->aio_data;
+    evt->obj  = reinterpret_cast<uint64_t>(iocb);
+    evt->res  = -ECANCELED;
+
+    auto r = reinterpret_cast<libaio_req*>(req);
+    r->req.owner = nullptr;
+    ctx->free_reqs.push(r);
+    ctx->slots.fetch_sub(1, std::memory_order_relaxed);
+    ctx->inflight.fetch_sub(1, std::memory_order_relaxed);
+    put_ctx(ctx);
+    return 0;
 }
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/lockstat.hh>
+#include <osv/clock.hh>
+#include <osv/elf.hh>
+#include <osv/demangle.hh>
+#include <osv/printf.hh>
+#include <algorithm>
+
+namespace lockstat {
+
+std::atomic<bool> enabled;
+
+namespace {
+
+struct entry {
+    std::atomic<const void*> lock;
+    std::atomic<lock_type> type;
+    std::atomic<u64> contended;
+    std::atomic<u64> wait_ns;
+    std::atomic<u64> max_wait_ns;
+    std::atomic<const void*> waiter_site;
+    std::atomic<const void*> holder_site;
+};
+
+constexpr unsigned table_bits = 12;
+constexpr unsigned table_size = 1u << table_bits;
+constexpr unsigned max_probe = 32;
+
+entry table[table_size];
+std::atomic<u64> dropped_count;
+
+// Open addressing on the lock's address. Entries are claimed with a CAS
+// and never given back until reset(), so a lock found once stays put.
+entry* find(const void* lock, lock_type type, bool create)
+{
+    u64 h = (reinterpret_cast<uintptr_t>(lock) >> 3) * 0x9e3779b97f4a7c15ull;
+    h >>= 64 - table_bits;
+    for (unsigned i = 0; i < max_probe; i++) {
+        auto& e = table[(h + i) & (table_size - 1)];
+        auto l = e.lock.load(std::memory_order_acquire);
+        if (l == lock) {
+            return &e;
+        }
+        if (!l) {
+            if (!create) {
+                return nullptr;
+            }
+            if (e.lock.compare_exchange_strong(l, lock, std::memory_order_acq_rel)) {
+                e.type.store(type, std::memory_order_relaxed);
+                return &e;
+            }
+            if (l == lock) {
+                return &e;
+            }
+        }
+    }
+    if (create) {
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return nullptr;
+}
+
+}
+
+void enable(bool on)
+{
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+// Racing with locks being recorded at the same time can leave a few stale
+// counts behind, which is fine for statistics.
+void reset()
+{
+    for (auto& e : table) {
+        e.contended.store(0, std::memory_order_relaxed);
+        e.wait_ns.store(0, std::memory_order_relaxed);
+        e.max_wait_ns.store(0, std::memory_order_relaxed);
+        e.waiter_site.store(nullptr, std::memory_order_relaxed);
+        e.holder_site.store(nullptr, std::memory_order_relaxed);
+        e.lock.store(nullptr, std::memory_order_release);
+    }
+    dropped_count.store(0, std::memory_order_relaxed);
+}
+
+u64 start()
+{
+    if (!active()) {
+        return 0;
+    }
+    return osv::clock::uptime::now().time_since_epoch().count();
+}
+
+void contended(const void* lock, lock_type type, u64 start, const void* site)
+{
+    auto e = find(lock, type, true);
+    if (!e) {
+        return;
+    }
+    u64 wait = osv::clock::uptime::now().time_since_epoch().count() - start;
+    e->contended.fetch_add(1, std::memory_order_relaxed);
+    e->wait_ns.fetch_add(wait, std::memory_order_relaxed);
+    auto max = e->max_wait_ns.load(std::memory_order_relaxed);
+    while (wait > max) {
+        if (e->max_wait_ns.compare_exchange_weak(max, wait, std::memory_order_relaxed)) {
+            e->waiter_site.store(site, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+void released(const void* lock, const void* site)
+{
+    // Only locks which already made somebody wait are worth an entry
+    auto e = find(lock, lock_type::mutex, false);
+    if (e) {
+        e->holder_site.store(site, std::memory_order_relaxed);
+    }
+}
+
+std::vector<lock_stat> get_stats()
+{
+    std::vector<lock_stat> ret;
+    for (auto& e : table) {
+        auto lock = e.lock.load(std::memory_order_acquire);
+        auto contended = e.contended.load(std::memory_order_relaxed);
+        if (!lock || !contended) {
+            continue;
+        }
+        ret.push_back(lock_stat{lock, e.type.load(std::memory_order_relaxed),
+            contended, e.wait_ns.load(std::memory_order_relaxed),
+            e.max_wait_ns.load(std::memory_order_relaxed),
+            e.waiter_site.load(std::memory_order_relaxed),
+            e.holder_site.load(std::memory_order_relaxed)});
+    }
+    std::sort(ret.begin(), ret.end(), [] (const lock_stat& a, const lock_stat& b) {
+        return a.wait_ns > b.wait_ns;
+    });
+    return ret;
+}
+
+u64 dropped()
+{
+    return dropped_count.load(std::memory_order_relaxed);
+}
+
+const char* type_name(lock_type type)
+{
+    switch (type) {
+    case lock_type::mutex:
+        return "mutex";
+    case lock_type::rwlock:
+        return "rwlock";
+    case lock_type::spinlock:
+        return "spinlock";
+    }
+    return "?";
+}
+
+// Locks which are global variables get the variable's name, the others
+// (embedded in some dynamically allocated object) their address.
+std::string name(const void* addr)
+{
+    if (!addr) {
+        return "-";
+    }
+    auto ei = elf::get_program()->lookup_addr(addr);
+    if (!ei.sym) {
+        return osv::sprintf("%p", addr);
+    }
+    char buf[256];
+    if (!osv::demangle(ei.sym, buf, sizeof(buf))) {
+        snprintf(buf, sizeof(buf), "%s", ei.sym);
+    }
+    auto offset = reinterpret_cast<uintptr_t>(addr) - reinterpret_cast<uintptr_t>(ei.addr);
+    if (offset) {
+        return osv::sprintf("%s+%lu", buf, offset);
+    }
+    return buf;
+}
+
+std::string procfs_lockstat()
+{
+    std::string ret = osv::sprintf("lockstat %s, %lu dropped\n",
+        active() ? "enabled" : "disabled", dropped());
+    ret += osv::sprintf("%-8s %10s %14s %12s %12s  %s\n", "type", "contended",
+        "wait-total(us)", "wait-max(us)", "wait-avg(ns)", "lock / waiter / holder");
+    for (auto& s : get_stats()) {
+        ret += osv::sprintf("%-8s %10lu %14lu %12lu %12lu  %s / %s / %s\n",
+            type_name(s.type), s.contended, s.wait_ns / 1000,
+            s.max_wait_ns / 1000, s.wait_ns / s.contended, name(s.lock).c_str(),
+            name(s.waiter_site).c_str(), name(s.holder_site).c_str());
+    }
+    return ret;
+}
+
+}
@@ -6,6 +6,7 @@
  */
 
 #include <osv/mempool.hh>
+#include <osv/pagealloc.hh>
 #include <osv/ilog2.hh>
 #include "arch-setup.hh"
 #include <cassert>
@@ -30,6 +31,7 @@
 #include <osv/sched.hh>
 #include <algorithm>
 #include <osv/prio.hh>
+#include <osv/psi.hh>
 #include <stdlib.h>
 #include <osv/shrinker.h>
 #include <osv/defer.hh>
@@ -584,6 +586,7 @@ void reclaimer::wait_for_memory(size_t mem)
     if (mem > memory::stats::total())
         abort("Unreasonable allocation attempt, larger than memory. Aborting.");
     trace_memory_wait(mem);
+    psi::stall stall(psi::resource::memory);
     _oom_blocked.wait(mem);
 }
 
@@ -607,6 +610,9 @@ public:
     void for_each(Func f) {
         for_each<Func>(0, f);
     }
+    // Like for_each(), but visits the smallest ranges first
+    template<typename Func>
+    void for_each_best_fit(unsigned min_order, Func f);
 
     bool empty() const {
         return _not_empty.none();
@@ -636,6 +642,69 @@ public:
     }
 
 private:
+    // Small allocations are kept away from the 2MB-aligned blocks of a
+    // range whenever it has enough unaligned room at one of its ends, so
+    // that small-page churn does not eat into the memory alloc_huge_page()
+    // needs. These return how much unaligned room there is at either end.
+    static uintptr_t range_start(const page_range& pr) {
+        return reinterpret_cast<uintptr_t>(&pr);
+    }
+    static size_t head_slack(const page_range& pr) {
+        auto start = range_start(pr);
+        return std::min(align_up(start, mmu::huge_page_size) - start, pr.size);
+    }
+    static size_t tail_slack(const page_range& pr) {
+        auto end = range_start(pr) + pr.size;
+        return std::min(end - align_down(end, mmu::huge_page_size), pr.size);
+    }
+    static bool has_huge_block(const page_range& pr) {
+        return align_up(range_start(pr), mmu::huge_page_size) + mmu::huge_page_size
+            <= range_start(pr) + pr.size;
+    }
+    static bool fits_in_slack(const page_range& pr, size_t size) {
+        return !has_huge_block(pr) || head_slack(pr) >= size || tail_slack(pr) >= size;
+    }
+    page_range& pick(unsigned order, size_t size) {
+        static constexpr unsigned max_scan = 8;
+        if (size < mmu::huge_page_size) {
+            unsigned scanned = 0;
+            for (auto& pr : _free[order]) {
+                if (fits_in_slack(pr, size)) {
+                    return pr;
+                }
+                if (++scanned == max_scan) {
+                    break;
+                }
+            }
+        }
+        return _free[order].front();
+    }
+    // Splits size bytes off pr, which has been removed from the free lists,
+    // and puts the rest back
+    template<bool UseBitmap = true>
+    page_range& carve(page_range& pr, size_t size) {
+        if (pr.size > size) {
+            if (size < mmu::huge_page_size && head_slack(pr) < size &&
+                (tail_slack(pr) >= size || has_huge_block(pr))) {
+                pr.size -= size;
+                insert<UseBitmap>(pr);
+                auto& ret = *new (static_cast<void*>(&pr) + pr.size) page_range(size);
+                if (UseBitmap) {
+                    set_bits(ret, false);
+                }
+                return ret;
+            }
+            auto& np = *new (static_cast<void*>(&pr) + size)
+                            page_range(pr.size - size);
+            insert<UseBitmap>(np);
+            pr.size = size;
+        }
+        if (UseBitmap) {
+            set_bits(pr, false);
+        }
+        return pr;
+    }
+
     template<bool UseBitmap = true>
     void insert(page_range& pr) {
         auto addr = static_cast<void*>(&pr);
@@ -773,34 +842,36 @@ page_range* page_range_allocator::alloc(size_t size, bool contiguous)
             return nullptr;
         }
     } else if (order == max_order) {
-        range = &*_free_huge.rbegin();
+        // Small requests come out of the smallest of the huge ranges, which
+        // leaves the largest ones whole for large allocations
+        if (size < mmu::huge_page_size) {
+            range = &*_free_huge.begin();
+        } else {
+            range = &*_free_huge.rbegin();
+        }
         if (range->size < size) {
             return nullptr;
         }
         remove_huge(*range);
     } else {
-        range = &_free[order].front();
+        range = &pick(order, size);
         remove_list(order, *range);
     }
 
-    auto& pr = *range;
-    if (pr.size > size) {
-        auto& np = *new (static_cast<void*>(&pr) + size)
-                        page_range(pr.size - size);
-        insert<UseBitmap>(np);
-        pr.size = size;
-    }
-    if (UseBitmap) {
-        set_bits(pr, false);
-    }
-    return &pr;
+    return &carve<UseBitmap>(*range, size);
 }
 
 page_range* page_range_allocator::alloc_aligned(size_t size, size_t offset,
                                                 size_t alignment, bool fill)
 {
     page_range* ret_header = nullptr;
-    for_each(std::max(ilog2(size / page_size), 1u) - 1, [&] (page_range& header) {
+    // Best fit: breaking up the smallest range that can satisfy the request
+    // keeps the large ones available for the next aligned allocation
+    auto min_order = ilog2(size / page_size);
+    if (min_order > max_order) {
+        min_order = max_order;
+    }
+    for_each_best_fit(min_order, [&] (page_range& header) {
         char* v = reinterpret_cast<char*>(&header);
         auto expected_ret = v + header.size - size + offset;
         auto alignment_shift = expected_ret - align_down(expected_ret, alignment);
@@ -886,6 +957,23 @@ void page_range_allocator::for_each(unsigned min_order, Func f)
     }
 }
 
+template<typename Func>
+void page_range_allocator::for_each_best_fit(unsigned min_order, Func f)
+{
+    for (auto order = min_order; order < max_order; order++) {
+        for (auto& pr : _free[order]) {
+            if (!f(pr)) {
+                return;
+            }
+        }
+    }
+    for (auto& pr : _free_huge) {
+        if (!f(pr)) {
+            return;
+        }
+    }
+}
+
 namespace stats {
     void get_page_ranges_stats(page_ranges_stats &stats)
     {
@@ -1811,6 +1899,47 @@ void free_page(void* v)
  * Memory allocated with alloc_huge_page() must be freed with free_huge_page(),
  * not free(), as the memory is not preceded by a header.
  */
+
+// Huge pages set aside at boot with --hugepages, for when fragmentation
+// leaves free_page_ranges without an aligned 2MB range. Like Linux's
+// hugepages=, the reserved memory no longer counts as free. Free reserved
+// pages are chained through their first word; everything is protected by
+// free_page_ranges_lock.
+struct reserved_huge_page {
+    reserved_huge_page* next;
+};
+static reserved_huge_page* huge_reserve;
+static size_t huge_reserve_total;
+static size_t huge_reserve_free;
+
+static void* alloc_reserved_huge_page()
+{
+    auto p = huge_reserve;
+    if (p) {
+        huge_reserve = p->next;
+        huge_reserve_free--;
+    }
+    return p;
+}
+
+size_t reserve_huge_pages(size_t nr)
+{
+    WITH_LOCK(free_page_ranges_lock) {
+        while (huge_reserve_total < nr) {
+            auto pr = free_page_ranges.alloc_aligned(mmu::huge_page_size, 0,
+                                                     mmu::huge_page_size, true);
+            if (!pr) {
+                break;
+            }
+            on_alloc(mmu::huge_page_size);
+            huge_reserve = new (pr) reserved_huge_page{huge_reserve};
+            huge_reserve_total++;
+            huge_reserve_free++;
+        }
+        return huge_reserve_total;
+    }
+}
+
 void* alloc_huge_page(size_t N)
 {
     WITH_LOCK(free_page_ranges_lock) {
@@ -1822,6 +1951,11 @@ void* alloc_huge_page(size_t N)
             // pages allocated. However, this would be inefficient, and since we
             // only use alloc_huge_page in one place, maybe not worth it.
         }
+        if (N == mmu::huge_page_size) {
+            if (auto p = alloc_reserved_huge_page()) {
+                return p;
+            }
+        }
         // Definitely a sign we are somewhat short on memory. It doesn't *mean* we
         // are, because that might be just fragmentation. But we wake up the reclaimer
         // just to be sure, and if this is not real pressure, it will just go back to
@@ -1834,7 +1968,46 @@ void* alloc_huge_page(size_t N)
 
 void free_huge_page(void* v, size_t N)
 {
-    free_page_range(v, N);
+    WITH_LOCK(free_page_ranges_lock) {
+        // Refill the reserve before giving memory back to everyone else
+        if (N == mmu::huge_page_size && huge_reserve_free < huge_reserve_total) {
+            huge_reserve = new (v) reserved_huge_page{huge_reserve};
+            huge_reserve_free++;
+            return;
+        }
+        free_page_range_locked(new (v) page_range(N));
+    }
+}
+
+namespace stats {
+    void get_fragmentation_stats(fragmentation_stats &stats)
+    {
+        stats = {};
+        WITH_LOCK(free_page_ranges_lock) {
+            free_page_ranges.for_each([&] (page_range& pr) {
+                auto start = reinterpret_cast<uintptr_t>(&pr);
+                auto hstart = align_up(start, mmu::huge_page_size);
+                auto hend = align_down(start + pr.size, mmu::huge_page_size);
+                stats.free += pr.size;
+                if (hend > hstart) {
+                    stats.huge_capable += hend - hstart;
+                }
+                return true;
+            });
+            stats.huge_reserved = huge_reserve_total * mmu::huge_page_size;
+            stats.huge_reserve_free = huge_reserve_free * mmu::huge_page_size;
+        }
+    }
+
+    float fragmentation_index()
+    {
+        fragmentation_stats stats;
+        get_fragmentation_stats(stats);
+        if (!stats.free) {
+            return 0;
+        }
+        return 1 - float(stats.huge_capable) / stats.free;
+    }
 }
 
 void free_initial_memory_range(void* addr, size_t size)
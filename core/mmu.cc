@@ -280,11 +280,29 @@ void split_large_page(hw_ptep<1> ptep)
     allocate_intermediate_level(ptep, pte_orig);
 }
 
+// A 1GB page is split into 2MB pages rather than small ones. Large ptes
+// have the same layout at both levels, so the new level 1 table is filled
+// with copies of the original pte, kept large, each with its own address.
+template<>
+void split_large_page(hw_ptep<2> ptep)
+{
+    pt_element<2> pte_orig = ptep.read();
+    phys pt_page = allocate_intermediate_level<2>([pte_orig](int i) {
+        auto tmp = pte_orig;
+        phys addend = phys(i) << (page_size_shift + pte_per_page_shift);
+        tmp.set_addr(tmp.addr() | addend, true);
+        return tmp;
+    });
+    ptep.write(make_intermediate_pte(ptep, pt_page));
+}
+
 struct page_allocator {
     virtual bool map(uintptr_t offset, hw_ptep<0> ptep, pt_element<0> pte, bool write) = 0;
     virtual bool map(uintptr_t offset, hw_ptep<1> ptep, pt_element<1> pte, bool write) = 0;
+    virtual bool map(uintptr_t offset, hw_ptep<2> ptep, pt_element<2> pte, bool write) = 0;
     virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<0> ptep) = 0;
     virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<1> ptep) = 0;
+    virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<2> ptep) = 0;
     virtual ~page_allocator() {}
 };
 
@@ -308,13 +326,18 @@ constexpr unsigned pt_index(uintptr_t virt, unsigned level)
     return pt_index(reinterpret_cast<void*>(virt), level);
 }
 
-unsigned nr_page_sizes = 2; // FIXME: detect 1GB pages
+unsigned nr_page_sizes = 2; // raised to 3 by arch setup if 1GB pages are supported
 
 void set_nr_page_sizes(unsigned nr)
 {
     nr_page_sizes = nr;
 }
 
+unsigned get_nr_page_sizes()
+{
+    return nr_page_sizes;
+}
+
 enum class allocate_intermediate_opt : bool {no = true, yes = false};
 enum class skip_empty_opt : bool {no = true, yes = false};
 enum class descend_opt : bool {no = true, yes = false};
@@ -358,11 +381,12 @@ public:
     void intermediate_page_pre(hw_ptep<1> ptep, uintptr_t offset) {}
     void intermediate_page_post(hw_ptep<1> ptep, uintptr_t offset) {}
     // Page walker calls page() when it a whole leaf page need to be handled, but if it
-    // has 2M pte and less then 2M of virt memory to operate upon and split is disabled
+    // has 2M (or 1G) pte and less then 2M of virt memory to operate upon and split is disabled
     // sup_page is called instead. So if you are here it means that page walker encountered
-    // 2M pte and page table operation wants to do something special with sub-region of it
+    // a large pte and page table operation wants to do something special with sub-region of it
     // since it disabled splitting.
-    void sub_page(hw_ptep<1> ptep, int level, uintptr_t offset) { return; }
+    template<int N>
+    void sub_page(hw_ptep<N> ptep, int level, uintptr_t offset) { return; }
 };
 
 template<typename PageOps, int N>
@@ -393,28 +417,30 @@ page(PageOps& pops, hw_ptep<N> ptep, uintptr_t offset)
     return false;
 }
 
+// Intermediate page handling is about 2M ranges covered by small pages, it is
+// not called for 1G ranges covered by 2M pages.
 template<typename PageOps, int N>
-static inline typename std::enable_if<pt_level_traits<N>::large_capable::value>::type
+static inline typename std::enable_if<N == 1>::type
 intermediate_page_pre(PageOps& pops, hw_ptep<N> ptep, uintptr_t offset)
 {
     pops.intermediate_page_pre(ptep, offset);
 }
 
 template<typename PageOps, int N>
-static inline typename std::enable_if<!pt_level_traits<N>::large_capable::value>::type
+static inline typename std::enable_if<N != 1>::type
 intermediate_page_pre(PageOps& pops, hw_ptep<N> ptep, uintptr_t offset)
 {
 }
 
 template<typename PageOps, int N>
-static inline typename std::enable_if<pt_level_traits<N>::large_capable::value>::type
+static inline typename std::enable_if<N == 1>::type
 intermediate_page_post(PageOps& pops, hw_ptep<N> ptep, uintptr_t offset)
 {
     pops.intermediate_page_post(ptep, offset);
 }
 
 template<typename PageOps, int N>
-static inline typename std::enable_if<!pt_level_traits<N>::large_capable::value>::type
+static inline typename std::enable_if<N != 1>::type
 intermediate_page_post(PageOps& pops, hw_ptep<N> ptep, uintptr_t offset)
 {
 }
@@ -557,19 +583,27 @@ template<allocate_intermediate_opt Allocate, skip_empty_opt Skip = skip_empty_op
 class vma_operation :
         public page_table_operation<Allocate, Skip, descend_opt::yes, once_opt::no, split_opt::yes> {
 public:
-    // returns true if tlb flush is needed after address range processing is completed.
-    bool tlb_flush_needed(void) { return false; }
+    void set_vma_start(uintptr_t vma_start) { _vma_start = vma_start; }
+    // Records that the translation of the page at offset changed, and has to
+    // be invalidated once the address range has been processed.
+    void invalidate(uintptr_t offset) { _tlb.add(_vma_start + offset); }
+    // called by operate_range() once the address range has been processed,
+    // to invalidate everything recorded with invalidate() on all cpus.
+    void flush_tlb(void) { mmu::flush_tlb(_tlb); }
     // this function is called at the very end of operate_range(). vma_operation may do
     // whatever cleanup is needed here.
     void finalize(void) { return; }
 
     ulong account_results(void) { return _total_operated; }
     void account(size_t size) { if (this->opt2bool(Account)) _total_operated += size; }
+protected:
+    tlb_batch _tlb;
 private:
     // We don't need locking because each walk will create its own instance, so
     // while two instances can operate over the same linear address (therefore
     // all the cmpxcghs), the same instance will go linearly over its duty.
     ulong _total_operated = 0;
+    uintptr_t _vma_start = 0;
 };
 
 /*
@@ -645,28 +679,26 @@ public:
     unsigned nr_page_sizes(void) { return 1; }
 };
 
+// Pages unmapped by unpopulate may only be freed once no cpu can reach them
+// through a stale TLB entry, so they are gathered here and freed after the
+// translations recorded in the tlb_batch so far have been invalidated.
 struct tlb_gather {
-    static constexpr size_t max_pages = 20;
+    static constexpr size_t max_pages = 64;
     struct tlb_page {
         void* addr;
         size_t size;
     };
     size_t nr_pages = 0;
     tlb_page pages[max_pages];
-    bool push(void* addr, size_t size) {
-        bool flushed = false;
+    void push(tlb_batch& batch, void* addr, size_t size) {
         if (nr_pages == max_pages) {
-            flush();
-            flushed = true;
+            flush(batch);
         }
         pages[nr_pages++] = { addr, size };
-        return flushed;
     }
-    bool flush() {
-        if (!nr_pages) {
-            return false;
-        }
-        mmu::flush_tlb_all();
+    void flush(tlb_batch& batch) {
+        mmu::flush_tlb(batch);
+        batch.clear();
         for (auto i = 0u; i < nr_pages; ++i) {
             auto&& tp = pages[i];
             if (tp.size == page_size) {
@@ -676,7 +708,6 @@ struct tlb_gather {
             }
         }
         nr_pages = 0;
-        return true;
     }
 };
 
@@ -689,7 +720,6 @@ class unpopulate : public vma_operation<allocate_intermediate_opt::no, skip_empt
 private:
     tlb_gather _tlb_gather;
     page_allocator* _pops;
-    bool do_flush = false;
 public:
     unpopulate(page_allocator* pops) : _pops(pops) {}
     template<int N>
@@ -700,10 +730,9 @@ public:
         // evacuate() makes sure we are only called for allocated pages, and
         // not-present may only mean mprotect(PROT_NONE).
         if (_pops->unmap(addr, offset, ptep)) {
-            do_flush = !_tlb_gather.push(addr, size);
-        } else {
-            do_flush = true;
+            _tlb_gather.push(this->_tlb, addr, size);
         }
+        this->invalidate(offset);
         this->account(size);
         return true;
     }
@@ -711,8 +740,8 @@ public:
         osv::rcu_defer([](void *page) { memory::free_page(page); }, phys_to_virt(ptep.read().addr()));
         ptep.write(make_empty_pte<1>());
     }
-    bool tlb_flush_needed(void) {
-        return !_tlb_gather.flush() && do_flush;
+    void flush_tlb(void) {
+        _tlb_gather.flush(this->_tlb);
     }
     void finalize(void) {}
 };
@@ -720,24 +749,23 @@ public:
 class protection : public vma_operation<allocate_intermediate_opt::no, skip_empty_opt::yes> {
 private:
     unsigned int perm;
-    bool do_flush;
 public:
-    protection(unsigned int perm) : perm(perm), do_flush(false) { }
+    protection(unsigned int perm) : perm(perm) { }
     template<int N>
     bool page(hw_ptep<N> ptep, uintptr_t offset) {
-        do_flush |= change_perm(ptep, perm);
+        if (change_perm(ptep, perm)) {
+            invalidate(offset);
+        }
         return true;
     }
-    bool tlb_flush_needed(void) {return do_flush;}
 };
 
 template <typename T, account_opt Account = account_opt::no>
 class dirty_cleaner : public vma_operation<allocate_intermediate_opt::no, skip_empty_opt::yes, Account> {
 private:
-    bool do_flush;
     T handler;
 public:
-    dirty_cleaner(T handler) : do_flush(false), handler(handler) {}
+    dirty_cleaner(T handler) : handler(handler) {}
 
     template<int N>
     bool page(hw_ptep<N> ptep, uintptr_t offset) {
@@ -745,14 +773,13 @@ public:
         if (!pte.dirty()) {
             return true;
         }
-        do_flush |= true;
+        this->invalidate(offset);
         pte.set_dirty(false);
         ptep.write(pte);
         handler(ptep.read().addr(), offset, pt_level_traits<N>::size::value);
         return true;
     }
 
-    bool tlb_flush_needed(void) {return do_flush;}
     void finalize() {
         handler.finalize();
     }
@@ -810,7 +837,8 @@ public:
         result = ptep.read().addr() | (v & ~pte_level_mask(N));
         return true;
     }
-    void sub_page(hw_ptep<1> ptep, int l, uintptr_t offset) {
+    template<int N>
+    void sub_page(hw_ptep<N> ptep, int l, uintptr_t offset) {
         assert(ptep.read().large());
         page(ptep, offset);
     }
@@ -846,7 +874,13 @@ public:
             do_flush = true;
         }
     }
-    bool tlb_flush_needed() { return do_flush; }
+    void set_vma_start(uintptr_t vma_start) {}
+    // Freed page tables may be cached by the cpus too, flush everything
+    void flush_tlb() {
+        if (do_flush) {
+            mmu::flush_tlb_all();
+        }
+    }
     void finalize() {}
     ulong account_results(void) { return 0; }
 private:
@@ -874,7 +908,8 @@ public:
         assert(pt_level_traits<N>::large_capable::value == pte.large());
         return true;
     }
-    void sub_page(hw_ptep<1> ptep, int l, uintptr_t offset) {
+    template<int N>
+    void sub_page(hw_ptep<N> ptep, int l, uintptr_t offset) {
         page(ptep, offset);
     }
 };
@@ -884,15 +919,12 @@ template<typename T> ulong operate_range(T mapper, void *vma_start, void *start,
     start = align_down(start, page_size);
     size = std::max(align_up(size, page_size), page_size);
     uintptr_t virt = reinterpret_cast<uintptr_t>(start);
+    mapper.set_vma_start(reinterpret_cast<uintptr_t>(vma_start));
     map_range(reinterpret_cast<uintptr_t>(vma_start), virt, size, mapper);
 
-    // TODO: consider if instead of requesting a full TLB flush, we should
-    // instead try to make more judicious use of INVLPG - e.g., in
-    // split_large_page() and other specific places where we modify specific
-    // page table entries.
-    if (mapper.tlb_flush_needed()) {
-        mmu::flush_tlb_all();
-    }
+    // One shootdown for the whole range, invalidating just the pages the
+    // operation changed unless there are too many of them.
+    mapper.flush_tlb();
     mapper.finalize();
     return mapper.account_results();
 }
@@ -1020,9 +1052,9 @@ public:
     bool operator()(uintptr_t x, const vma_range& y) const { return x < y.start(); }
 };
 
-uintptr_t find_hole(uintptr_t start, uintptr_t size)
+uintptr_t find_hole(uintptr_t start, uintptr_t size, size_t alignment = huge_page_size)
 {
-    bool small = size < huge_page_size;
+    bool small = size < alignment;
     uintptr_t good_enough = 0;
 
     SCOPE_LOCK(vma_range_set_mutex.for_read());
@@ -1044,8 +1076,8 @@ uintptr_t find_hole(uintptr_t start, uintptr_t size)
                 return good_enough;
             }
             //See if huge hole fits between p and n
-            if (n->start() - align_up(good_enough, huge_page_size) >= size) {
-                return align_up(good_enough, huge_page_size);
+            if (n->start() - align_up(good_enough, alignment) >= size) {
+                return align_up(good_enough, alignment);
             }
         }
         //If nothing worked move next in the list
@@ -1109,7 +1141,7 @@ static error sync(const void* addr, size_t length, int flags)
 }
 
 class uninitialized_anonymous_page_provider : public page_allocator {
-private:
+protected:
     virtual void* fill(void* addr, uint64_t offset, uintptr_t size) {
         return addr;
     }
@@ -1136,6 +1168,11 @@ public:
         size_t size = pt_level_traits<1>::size::value;
         return set_pte(fill(memory::alloc_huge_page(size), offset, size), ptep, pte);
     }
+    // 1GB pages are only used where asked for with MAP_HUGE_1GB. Refusing
+    // here makes populate() fall back to 2MB pages.
+    virtual bool map(uintptr_t offset, hw_ptep<2> ptep, pt_element<2> pte, bool write) override {
+        throw std::exception();
+    }
     virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<0> ptep) override {
         clear_pte(ptep);
         return true;
@@ -1144,10 +1181,14 @@ public:
         clear_pte(ptep);
         return true;
     }
+    virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<2> ptep) override {
+        clear_pte(ptep);
+        return true;
+    }
 };
 
 class initialized_anonymous_page_provider : public uninitialized_anonymous_page_provider {
-private:
+protected:
     virtual void* fill(void* addr, uint64_t offset, uintptr_t size) override {
         if (addr) {
             memset(addr, 0, size);
@@ -1171,6 +1212,27 @@ public:
 static huge_only_page_provider page_allocator_huge_only;
 static page_allocator *page_allocator_huge_onlyp = &page_allocator_huge_only;
 
+// Page provider for MAP_HUGETLB|MAP_HUGE_1GB: like huge_only_page_provider,
+// but only 1GB pages will do.
+class huge_1g_only_page_provider : public initialized_anonymous_page_provider {
+public:
+    virtual bool map(uintptr_t offset, hw_ptep<0> ptep,
+                     pt_element<0> pte, bool write) override {
+        return false;
+    }
+    virtual bool map(uintptr_t offset, hw_ptep<1> ptep,
+                     pt_element<1> pte, bool write) override {
+        return false;
+    }
+    virtual bool map(uintptr_t offset, hw_ptep<2> ptep,
+                     pt_element<2> pte, bool write) override {
+        size_t size = pt_level_traits<2>::size::value;
+        return set_pte(fill(memory::alloc_huge_page(size), offset, size), ptep, pte);
+    }
+};
+static huge_1g_only_page_provider page_allocator_huge_1g_only;
+static page_allocator *page_allocator_huge_1g_onlyp = &page_allocator_huge_1g_only;
+
 class map_file_page_read : public uninitialized_anonymous_page_provider {
 private:
     file *_file;
@@ -1211,12 +1273,19 @@ public:
     virtual bool map(uintptr_t offset, hw_ptep<1> ptep, pt_element<1> pte, bool write) override {
         return _file->map_page(offset + _foffset, ptep, pte, write, _shared);
     }
+    // Files are never mapped with 1GB pages
+    virtual bool map(uintptr_t offset, hw_ptep<2> ptep, pt_element<2> pte, bool write) override {
+        throw std::exception();
+    }
     virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<0> ptep) override {
         return _file->put_page(addr, offset + _foffset, ptep);
     }
     virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<1> ptep) override {
         return _file->put_page(addr, offset + _foffset, ptep);
     }
+    virtual bool unmap(void *addr, uintptr_t offset, hw_ptep<2> ptep) override {
+        abort("1GB page in a file mapping");
+    }
 };
 
 uintptr_t allocate(vma *v, uintptr_t start, size_t size, bool search)
@@ -1226,7 +1295,8 @@ uintptr_t allocate(vma *v, uintptr_t start, size_t size, bool search)
         if (!start) {
             start = 0x200000000000ul;
         }
-        start = find_hole(start, size);
+        start = find_hole(start, size,
+                          v->has_flags(mmap_huge_1g) ? huge_page_size_1g : huge_page_size);
     } else {
         // we don't know if the given range is free, need to evacuate it first
         evacuate(start, start+size);
@@ -1359,7 +1429,15 @@ ulong populate_vma(vma *vma, void *v, size_t size, bool write = false)
 void* map_anon(const void* addr, size_t size, unsigned flags, unsigned perm)
 {
     bool search = !(flags & mmap_fixed);
-    size = align_up(size, mmu::page_size);
+    if (flags & mmap_huge_1g) {
+        // Like Linux, round hugetlb mappings up to a whole number of pages
+        size = align_up(size, huge_page_size_1g);
+        if (!search && (reinterpret_cast<uintptr_t>(addr) & (huge_page_size_1g - 1))) {
+            throw make_error(EINVAL);
+        }
+    } else {
+        size = align_up(size, mmu::page_size);
+    }
     auto start = reinterpret_cast<uintptr_t>(addr);
     auto* vma = new mmu::anon_vma(addr_range(start, start + size), perm, flags);
     PREVENT_STACK_PAGE_FAULT
@@ -1367,7 +1445,7 @@ void* map_anon(const void* addr, size_t size, unsigned flags, unsigned perm)
     auto v = (void*) allocate(vma, start, size, search);
     if (flags & mmap_populate) {
         auto mapped = populate_vma<account_opt::yes>(vma, v, size);
-        if ((flags & mmap_huge) && mapped < size) {
+        if ((flags & (mmap_huge | mmap_huge_1g)) && mapped < size) {
             // MAP_HUGETLB strict mode: huge page allocation failed for some pages.
             // Free the partially-mapped region and signal ENOMEM to the caller.
             // Evacuate the address actually chosen by allocate(), not the
@@ -1402,7 +1480,11 @@ void* map_file(const void* addr, size_t size, unsigned flags, unsigned perm,
     WITH_LOCK(vma_list_mutex.for_write()) {
         v = (void*) allocate(vma, start, size, search);
         if (flags & mmap_populate) {
-            populate_vma(vma, v, std::min(size, align_up(::size(f), page_size)));
+            // Best effort, pages that cannot be read now fault in later
+            try {
+                populate_vma(vma, v, std::min(size, align_up(::size(f), page_size)));
+            } catch (error&) {
+            }
         }
     }
     return v;
@@ -1792,7 +1874,10 @@ void vma::fault(uintptr_t addr, exception_frame *ef)
     auto hp_start = align_up(_range.start(), huge_page_size);
     auto hp_end = align_down(_range.end(), huge_page_size);
     size_t size;
-    if (!has_flags(
+    if (has_flags(mmap_huge_1g)) {
+        addr = align_down(addr, huge_page_size_1g);
+        size = huge_page_size_1g;
+    } else if (!has_flags(
 #if CONF_memory_jvm_balloon
 mmap_jvm_balloon|
 #endif
@@ -1827,6 +1912,7 @@ static page_allocator *page_allocator_noinitp = &page_allocator_noinit, *page_al
 
 anon_vma::anon_vma(addr_range range, unsigned perm, unsigned flags)
     : vma(range, perm, flags, true,
+          (flags & mmap_huge_1g)       ? page_allocator_huge_1g_onlyp :
           (flags & mmap_huge)          ? page_allocator_huge_onlyp :
           (flags & mmap_uninitialized) ? page_allocator_noinitp    :
                                          page_allocator_initp)
@@ -1851,6 +1937,276 @@ error anon_vma::sync(uintptr_t start, uintptr_t end)
     return no_error();
 }
 
+// Background huge page collapse.
+//
+// Anonymous memory only gets 2MB pages when a whole aligned 2MB range is
+// populated at once. A heap that grows a page at a time stays on 4K pages
+// forever, even after every one of them has been touched. The collapser is
+// a low priority thread that periodically walks the anonymous vmas looking
+// for 2MB-aligned regions which are fully populated with small pages, and
+// replaces each of them with a freshly allocated huge page.
+//
+// The small pages are write protected (and the TLBs flushed) while their
+// contents are copied, with vma_list_mutex held for write, so concurrent
+// reads go on and a concurrent write just faults and waits for the new
+// mapping, which then replaces the page table in a single PMD write. Stacks
+// (mmap_nocollapse) are left alone, as a thread may write to its stack with
+// preemption disabled, where it cannot take a fault; so is memory pinned by
+// io_pin() for a device to access directly. The work is rate limited: every
+// pass looks at a bounded number of regions, collapses a bounded number of
+// them and the thread then sleeps, resuming the scan where it left off.
+
+TRACEPOINT(trace_mmu_huge_collapse, "addr=%p, ok=%d", void*, bool);
+
+static constexpr unsigned collapse_scan_regions = 1024;
+static constexpr unsigned collapse_max_per_pass = 8;
+static constexpr auto collapse_interval = std::chrono::seconds(1);
+static constexpr float collapse_priority = 10.0;
+
+static std::atomic<u64> collapse_scanned, collapse_collapsed, collapse_failed;
+
+// Pinned I/O buffers, counted per 2MB region. The count is hashed, so a
+// region may look pinned because of another one, and is then just skipped.
+static constexpr unsigned io_pin_buckets = 1024;
+static std::atomic<unsigned> io_pins[io_pin_buckets];
+// The region being collapsed right now, or 0
+static std::atomic<uintptr_t> collapse_region;
+
+static std::atomic<unsigned>& io_pin_count(uintptr_t region)
+{
+    return io_pins[(region / huge_page_size) % io_pin_buckets];
+}
+
+template <typename Func>
+static void for_each_io_region(const void* addr, size_t size, Func func)
+{
+    // Only vma memory, below the linear map, is ever collapsed
+    if (!size || static_cast<const char*>(addr) >= phys_mem) {
+        return;
+    }
+    auto start = reinterpret_cast<uintptr_t>(addr);
+    for (auto r = align_down(start, huge_page_size); r < start + size; r += huge_page_size) {
+        func(r);
+    }
+}
+
+void io_pin(const void* addr, size_t size)
+{
+    bool busy = false;
+    for_each_io_region(addr, size, [&busy] (uintptr_t r) {
+        // Pairs with huge_collapse: either it sees our pin, or we see the
+        // region it is collapsing
+        io_pin_count(r).fetch_add(1);
+        busy |= collapse_region.load() == r;
+    });
+    if (busy) {
+        // The collapser holds vma_list_mutex for write until the new
+        // mapping is in place; the caller translates addresses after us
+        PREVENT_STACK_PAGE_FAULT
+        WITH_LOCK(vma_list_mutex.for_read()) {
+        }
+    }
+}
+
+void io_unpin(const void* addr, size_t size)
+{
+    for_each_io_region(addr, size, [] (uintptr_t r) {
+        io_pin_count(r).fetch_sub(1, std::memory_order_release);
+    });
+}
+
+// Returns true if pte points to a page table whose 512 entries all map
+// private, accessible small pages
+static bool collapsible(pt_element<1> pte)
+{
+    if (pte.empty() || pte.large()) {
+        return false;
+    }
+    auto pt = hw_ptep<0>::force(phys_cast<pt_element<0>>(pte.next_pt_addr()));
+    for (unsigned i = 0; i < pte_per_page; i++) {
+        auto small = pt.at(i).read();
+        if (small.empty() || !small.valid() || pte_is_cow(small)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class huge_collapse_check :
+        public page_table_operation<allocate_intermediate_opt::no, skip_empty_opt::yes,
+                                    descend_opt::no, once_opt::yes, split_opt::no> {
+public:
+    bool found = false;
+    template<int N>
+    bool page(hw_ptep<N> ptep, uintptr_t offset) {
+        return true;
+    }
+    bool page(hw_ptep<1> ptep, uintptr_t offset) {
+        found = collapsible(ptep.read());
+        return true;
+    }
+};
+
+class huge_collapse :
+        public page_table_operation<allocate_intermediate_opt::no, skip_empty_opt::yes,
+                                    descend_opt::no, once_opt::yes, split_opt::no> {
+    uintptr_t _addr;
+    unsigned _perm;
+public:
+    enum class result { skipped, collapsed, failed };
+    result res = result::skipped;
+    huge_collapse(uintptr_t addr, unsigned perm) : _addr(addr), _perm(perm) {}
+    template<int N>
+    bool page(hw_ptep<N> ptep, uintptr_t offset) {
+        return true;
+    }
+    bool page(hw_ptep<1> ptep, uintptr_t offset) {
+        auto pte = ptep.read();
+        if (!collapsible(pte)) {
+            return true;
+        }
+        auto huge = static_cast<char*>(memory::alloc_huge_page(huge_page_size));
+        if (!huge) {
+            res = result::failed;
+            return true;
+        }
+        collapse_region.store(_addr);
+        if (io_pin_count(_addr).load()) {
+            collapse_region.store(0, std::memory_order_relaxed);
+            memory::free_huge_page(huge, huge_page_size);
+            return true;
+        }
+        // Marked cow rather than just read-only, so that a write takes the
+        // slow fault path and waits for us instead of getting SIGSEGV
+        auto pt = hw_ptep<0>::force(phys_cast<pt_element<0>>(pte.next_pt_addr()));
+        for (unsigned i = 0; i < pte_per_page; i++) {
+            pt.at(i).write(pte_mark_cow(pt.at(i).read(), true));
+        }
+        mmu::flush_tlb_all();
+        for (unsigned i = 0; i < pte_per_page; i++) {
+            memcpy(huge + i * page_size, phys_to_virt(pt.at(i).read().addr()), page_size);
+        }
+        auto leaf = make_leaf_pte(ptep, virt_to_phys(huge), _perm);
+        leaf.set_dirty(true);
+        ptep.write(leaf);
+        mmu::flush_tlb_all();
+        collapse_region.store(0, std::memory_order_release);
+        for (unsigned i = 0; i < pte_per_page; i++) {
+            memory::free_page(phys_to_virt(pt.at(i).read().addr()));
+        }
+        osv::rcu_defer([](void *page) { memory::free_page(page); }, phys_to_virt(pte.next_pt_addr()));
+        if (_perm & perm_exec) {
+            synchronize_cpu_caches(huge, huge_page_size);
+        }
+        res = result::collapsed;
+        return true;
+    }
+};
+
+static bool collapse_eligible(vma& v)
+{
+    if (!dynamic_cast<anon_vma*>(&v) || v.has_flags(mmap_small | mmap_stack | mmap_nocollapse) ||
+        !v.perm()) {
+        return false;
+    }
+    auto pops = v.page_ops();
+    return pops == page_allocator_initp || pops == page_allocator_noinitp;
+}
+
+// Scans up to collapse_scan_regions regions starting from cursor and
+// collapses the first few candidates found. Returns false if we ran out of
+// huge pages, in which case there is no point in trying again soon.
+static bool collapse_pass(uintptr_t& cursor)
+{
+    std::vector<uintptr_t> candidates;
+    WITH_LOCK(vma_list_mutex.for_read()) {
+        unsigned scanned = 0;
+        auto i = vma_list.upper_bound(cursor, addr_compare());
+        --i;
+        for (; i != vma_list.end(); ++i) {
+            if (!collapse_eligible(*i)) {
+                continue;
+            }
+            auto start = std::max(align_up(i->start(), huge_page_size),
+                                  align_up(cursor, huge_page_size));
+            for (auto a = start; a + huge_page_size <= i->end(); a += huge_page_size) {
+                if (scanned == collapse_scan_regions ||
+                    candidates.size() == collapse_max_per_pass) {
+                    break;
+                }
+                scanned++;
+                cursor = a + huge_page_size;
+                huge_collapse_check check;
+                map_range(a, a, huge_page_size, check);
+                if (check.found) {
+                    candidates.push_back(a);
+                }
+            }
+            if (scanned == collapse_scan_regions ||
+                candidates.size() == collapse_max_per_pass) {
+                break;
+            }
+        }
+        if (i == vma_list.end()) {
+            cursor = 0;
+        }
+        collapse_scanned.fetch_add(scanned, std::memory_order_relaxed);
+    }
+
+    for (auto a : candidates) {
+        huge_collapse::result res = huge_collapse::result::skipped;
+        PREVENT_STACK_PAGE_FAULT
+        WITH_LOCK(vma_list_mutex.for_write()) {
+            // The vma may have been unmapped, shrunk or mprotect()ed since
+            // we looked at it
+            auto i = find_intersecting_vma(a);
+            if (i == vma_list.end() || !collapse_eligible(*i) ||
+                a < i->start() || a + huge_page_size > i->end()) {
+                continue;
+            }
+            huge_collapse op(a, i->perm());
+            map_range(a, a, huge_page_size, op);
+            res = op.res;
+        }
+        if (res == huge_collapse::result::collapsed) {
+            collapse_collapsed.fetch_add(1, std::memory_order_relaxed);
+            trace_mmu_huge_collapse(reinterpret_cast<void*>(a), true);
+        } else if (res == huge_collapse::result::failed) {
+            collapse_failed.fetch_add(1, std::memory_order_relaxed);
+            trace_mmu_huge_collapse(reinterpret_cast<void*>(a), false);
+            return false;
+        }
+    }
+    return true;
+}
+
+huge_page_collapse_stats get_huge_page_collapse_stats()
+{
+    return huge_page_collapse_stats{
+        collapse_scanned.load(std::memory_order_relaxed),
+        collapse_collapsed.load(std::memory_order_relaxed),
+        collapse_failed.load(std::memory_order_relaxed),
+    };
+}
+
+void start_huge_page_collapser()
+{
+    if (nr_page_sizes < 2) {
+        return;
+    }
+    auto t = sched::thread::make([] {
+        uintptr_t cursor = 0;
+        unsigned backoff = 1;
+        while (true) {
+            sched::thread::sleep(collapse_interval * backoff);
+            // Out of huge pages: back off, up to a minute between passes
+            backoff = collapse_pass(cursor) ? 1 : std::min(backoff * 2, 64u);
+        }
+    }, sched::thread::attr().name("hugepage-collapse"));
+    t->set_priority(collapse_priority);
+    t->start();
+}
+
 #if CONF_memory_jvm_balloon
 // Balloon is backed by no pages, but in the case of partial copy, we may have
 // to back some of the pages. For that and for that only, we initialize a page
@@ -2104,8 +2460,13 @@ void file_vma::fault(uintptr_t addr, exception_frame *ef)
         size = page_size;
     }
 
-    populate_vma<account_opt::no>(this, (void*)addr, size,
-            mmu::is_page_fault_write(ef->get_error()));
+    try {
+        populate_vma<account_opt::no>(this, (void*)addr, size,
+                mmu::is_page_fault_write(ef->get_error()));
+    } catch (error&) {
+        // the file could not provide the page, e.g. for lack of memory
+        vm_sigbus(addr, ef);
+    }
 }
 
 file_vma::~file_vma()
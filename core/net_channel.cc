@@ -47,9 +47,21 @@ void net_channel::wake_pollers()
 #if CONF_core_epoll
         // can't call epoll_wake from rcu, so copy the data
         if (!_epollers.empty()) {
+            const epoll_ptr* exclusive = nullptr;
+            bool woke_exclusive = false;
             _epollers.reader_for_each([&] (const epoll_ptr& ep) {
-                epoll_wake_in_rcu(ep);
+                if (!ep.exclusive) {
+                    epoll_wake_in_rcu(ep);
+                } else if (!woke_exclusive) {
+                    woke_exclusive = epoll_wake_if_waiting(ep, true);
+                    if (!exclusive) {
+                        exclusive = &ep;
+                    }
+                }
             });
+            if (exclusive && !woke_exclusive) {
+                epoll_wake_in_rcu(*exclusive);
+            }
         }
 #endif
     }
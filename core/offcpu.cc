@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/offcpu.hh>
+#include <osv/sched.hh>
+#include <osv/execinfo.hh>
+#include <osv/printf.hh>
+#include <osv/ilog2.hh>
+#include <algorithm>
+
+namespace prof {
+
+std::atomic<bool> offcpu_enabled;
+
+namespace {
+
+constexpr unsigned max_depth = 16;
+constexpr unsigned table_bits = 10;
+constexpr unsigned table_size = 1u << table_bits;
+constexpr unsigned max_probe = 16;
+// Runqueue waits are counted in power of two buckets of microseconds,
+// from under 2us to 8s and more
+constexpr unsigned nr_buckets = 24;
+
+// One distinct backtrace. The scheduler must not allocate or take locks,
+// so backtraces go to a fixed table: an entry is claimed by setting its
+// hash, then filled, then marked ready for readers.
+struct stack_entry {
+    std::atomic<u64> hash;
+    std::atomic<bool> ready;
+    unsigned depth;
+    void* pc[max_depth];
+    std::atomic<u64> count;
+    std::atomic<u64> blocked_ns;
+    std::atomic<u64> runq_ns;
+};
+
+stack_entry table[table_size];
+std::atomic<u64> dropped;
+std::atomic<u64> runq_hist[nr_buckets];
+
+u64 hash_stack(void** pc, unsigned depth)
+{
+    u64 h = 14695981039346656037ull;
+    for (unsigned i = 0; i < depth; i++) {
+        h = (h ^ reinterpret_cast<uintptr_t>(pc[i])) * 1099511628211ull;
+    }
+    // 0 marks a free entry
+    return h | 1;
+}
+
+// Returns the index of the backtrace's entry plus one, or 0 if the table
+// is full
+unsigned find_stack(void** pc, unsigned depth)
+{
+    auto h = hash_stack(pc, depth);
+    for (unsigned i = 0; i < max_probe; i++) {
+        unsigned idx = (h + i) & (table_size - 1);
+        auto& e = table[idx];
+        auto eh = e.hash.load(std::memory_order_relaxed);
+        if (eh == h) {
+            return idx + 1;
+        }
+        if (!eh && e.hash.compare_exchange_strong(eh, h, std::memory_order_relaxed)) {
+            e.depth = depth;
+            std::copy(pc, pc + depth, e.pc);
+            e.ready.store(true, std::memory_order_release);
+            return idx + 1;
+        }
+        if (eh == h) {
+            return idx + 1;
+        }
+    }
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+}
+
+void offcpu_switch_out(offcpu_state& s)
+{
+    void* pc[max_depth];
+    int depth = backtrace_safe(pc, max_depth);
+    s.stack = depth > 0 ? find_stack(pc, depth) : 0;
+}
+
+void offcpu_switch_in(offcpu_state& s, u64 blocked_ns, u64 runq_ns)
+{
+    auto& e = table[s.stack - 1];
+    e.count.fetch_add(1, std::memory_order_relaxed);
+    e.blocked_ns.fetch_add(blocked_ns, std::memory_order_relaxed);
+    e.runq_ns.fetch_add(runq_ns, std::memory_order_relaxed);
+    unsigned bucket = runq_ns < 2000 ? 0 : std::min(ilog2(runq_ns / 1000), nr_buckets - 1);
+    runq_hist[bucket].fetch_add(1, std::memory_order_relaxed);
+    s.stack = 0;
+}
+
+void start_offcpu_profiler()
+{
+    // The profile is made of the scheduler's sleep and runqueue times
+    sched::enable_schedstat();
+    offcpu_enabled.store(true, std::memory_order_relaxed);
+}
+
+// Threads switched out while the profiler was on still report when they
+// run again, so stopping takes effect gradually.
+void stop_offcpu_profiler()
+{
+    offcpu_enabled.store(false, std::memory_order_relaxed);
+}
+
+// Totals of threads which are off the cpu while this runs may end up
+// accounted to the wrong backtrace.
+void reset_offcpu_profile()
+{
+    for (auto& e : table) {
+        e.ready.store(false, std::memory_order_relaxed);
+        e.count.store(0, std::memory_order_relaxed);
+        e.blocked_ns.store(0, std::memory_order_relaxed);
+        e.runq_ns.store(0, std::memory_order_relaxed);
+        e.hash.store(0, std::memory_order_relaxed);
+    }
+    for (auto& b : runq_hist) {
+        b.store(0, std::memory_order_relaxed);
+    }
+    dropped.store(0, std::memory_order_relaxed);
+}
+
+std::string get_offcpu_profile()
+{
+    std::string ret = osv::sprintf("# offcpu %s, %lu dropped\n",
+        offcpu_active() ? "enabled" : "disabled", dropped.load());
+    ret += "# runqueue wait histogram: runq <from-us> <count>\n";
+    for (unsigned i = 0; i < nr_buckets; i++) {
+        auto n = runq_hist[i].load(std::memory_order_relaxed);
+        if (n) {
+            ret += osv::sprintf("# runq %lu %lu\n", i ? 1ul << i : 0, n);
+        }
+    }
+    for (auto& e : table) {
+        if (!e.ready.load(std::memory_order_acquire)) {
+            continue;
+        }
+        auto count = e.count.load(std::memory_order_relaxed);
+        if (!count) {
+            continue;
+        }
+        for (unsigned i = e.depth; i > 0; i--) {
+            ret += osv::sprintf(i > 1 ? "%p;" : "%p", e.pc[i - 1]);
+        }
+        ret += osv::sprintf(" %lu %lu %lu\n", count,
+            e.blocked_ns.load(std::memory_order_relaxed),
+            e.runq_ns.load(std::memory_order_relaxed));
+    }
+    return ret;
+}
+
+}
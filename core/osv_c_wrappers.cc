@@ -16,6 +16,7 @@
 #include <osv/commands.hh>
 #include <osv/firmware.hh>
 #include <osv/hypervisor.hh>
+#include <osv/snapshot.hh>
 #include "cpuid.hh"
 #include <vector>
 
@@ -157,3 +158,8 @@ extern "C" OSV_MODULE_API
 bool osv_debug_enabled() {
     return verbose;
 }
+
+extern "C" OSV_MODULE_API
+void osv_snapshot_point() {
+    osv::snapshot::pause_point();
+}
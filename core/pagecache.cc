@@ -24,6 +24,7 @@
 #include <osv/prio.hh>
 #include <osv/sched.hh>
 #include <osv/clock.hh>
+#include <osv/align.hh>
 
 // The OSv page cache serves two filesystem families through one set of
 // entry points (get()/release()/sync()):
@@ -571,6 +572,41 @@ bool map_owned_read_cached_page(hashkey *key, void *page)
     return true;
 }
 
+// Drop every read cache page of inode (@dev, @ino) that falls in
+// [@start, @end), unmapping it from all address spaces first. Filesystems
+// that lend their own memory to the read cache (ramfs) call this before
+// freeing or repurposing that memory.
+void invalidate_read_cache(dev_t dev, ino_t ino, off_t start, off_t end)
+{
+    start = align_down(start, (off_t)mmu::page_size);
+    SCOPE_LOCK(read_lock);
+    std::vector<cached_page*> victims;
+    if ((uint64_t)(end - start) / mmu::page_size < read_cache.size()) {
+        for (off_t off = start; off < end; off += mmu::page_size) {
+            hashkey key {dev, ino, off};
+            cached_page* cp = find_in_cache(read_cache, key);
+            if (cp) {
+                victims.push_back(cp);
+            }
+        }
+    } else {
+        for (auto& e : read_cache) {
+            auto& key = e.first;
+            if (key.dev == dev && key.ino == ino &&
+                key.offset >= start && key.offset < end) {
+                victims.push_back(e.second);
+            }
+        }
+    }
+    unsigned flushed = 0;
+    for (auto cp : victims) {
+        flushed += drop_read_cached_page(read_cache, cp, false);
+    }
+    if (flushed) {
+        mmu::flush_tlb_all();
+    }
+}
+
 // C-linkage helpers used by ZFS vop_cache (zfs_vnops_os.c is a C file).
 extern "C" void osv_pagecache_map_page(void *key, void *page)
 {
@@ -816,6 +852,8 @@ static void insert(cached_page_write* cp) {
 
 #define IS_ZFS(st_dev) ((st_dev & (0xffULL<<56)) == ZFS_ID)
 
+static constexpr int max_read_page_failures = 3;
+
 bool get(vfs_file* fp, off_t offset, mmu::hw_ptep<0> ptep, mmu::pt_element<0> pte, bool write, bool shared)
 {
     struct stat st;
@@ -858,6 +896,7 @@ bool get(vfs_file* fp, off_t offset, mmu::hw_ptep<0> ptep, mmu::pt_element<0> pt
         }
     } else if (!wcp) {
         int ret;
+        int failures = 0;
         // read fault and page is not in write cache yet, return one from cache, mark it cow
         do {
             if (IS_ZFS(st.st_dev)) {
@@ -889,6 +928,13 @@ bool get(vfs_file* fp, off_t offset, mmu::hw_ptep<0> ptep, mmu::pt_element<0> pt
                     readahead_if_sequential(fp, key);
             }
 
+            // the file system could not provide the page (e.g. ramfs ran out
+            // of memory copying it out of bootfs). Try a few more times, then
+            // fail the fault instead of re-faulting with no progress.
+            if (ret > 0 && ++failures == max_read_page_failures) {
+                throw make_error(ret);
+            }
+
             // we dropped write lock, need to re-check write cache again
             wcp = find_in_cache(write_cache, key);
             if (wcp) {
@@ -340,7 +340,7 @@ int poll(struct pollfd _pfd[], nfds_t _nfds, int _timeout)
 {
     trace_poll(_pfd, _nfds, _timeout);
 
-    if (_nfds > FDMAX) {
+    if (_nfds > FDLIMIT) {
         errno = EINVAL;
         trace_poll_err(errno);
         return -1;
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/psi.hh>
+#include <osv/sched.hh>
+#include <osv/clock.hh>
+#include <osv/mutex.h>
+#include <osv/printf.hh>
+#include <cmath>
+
+namespace psi {
+
+namespace {
+
+// Like Linux, the averages move at most every two seconds, and cover about
+// the last 10, 60 and 300 seconds
+constexpr u64 avg_period_ns = 2000000000ull;
+constexpr double avg_windows_s[] = { 10, 60, 300 };
+constexpr unsigned nr_resources = 3;
+
+struct tracker {
+    unsigned nr_stalled = 0;
+    u64 stalled_since = 0;
+    u64 total_ns = 0;
+    // Running averages, in percent, and what they were last updated from
+    u64 avg_time = 0;
+    u64 avg_total_ns = 0;
+    double avg[3] = {};
+};
+
+mutex psi_mutex;
+tracker trackers[nr_resources];
+
+u64 now_ns()
+{
+    return osv::clock::uptime::now().time_since_epoch().count();
+}
+
+tracker& get(resource r)
+{
+    return trackers[static_cast<unsigned>(r)];
+}
+
+u64 cpu_stall_ns()
+{
+    u64 total = 0;
+    for (auto c : sched::cpus) {
+        total += c->stall_ns.load(std::memory_order_relaxed);
+    }
+    return total / sched::cpus.size();
+}
+
+}
+
+stall::stall(resource r) : _r(r)
+{
+    SCOPE_LOCK(psi_mutex);
+    auto& t = get(r);
+    if (t.nr_stalled++ == 0) {
+        t.stalled_since = now_ns();
+    }
+}
+
+stall::~stall()
+{
+    SCOPE_LOCK(psi_mutex);
+    auto& t = get(_r);
+    if (--t.nr_stalled == 0) {
+        t.total_ns += now_ns() - t.stalled_since;
+    }
+}
+
+std::string procfs_pressure(resource r)
+{
+    SCOPE_LOCK(psi_mutex);
+    auto& t = get(r);
+    auto now = now_ns();
+    u64 total;
+    if (r == resource::cpu) {
+        total = cpu_stall_ns();
+    } else {
+        total = t.total_ns + (t.nr_stalled ? now - t.stalled_since : 0);
+    }
+    // The averages are updated lazily, when read, as if the stall time since
+    // the last update had been spread evenly over it
+    auto elapsed = now - t.avg_time;
+    if (elapsed >= avg_period_ns) {
+        double pct = 100.0 * (total - t.avg_total_ns) / elapsed;
+        if (pct > 100) {
+            pct = 100;
+        }
+        for (unsigned i = 0; i < 3; i++) {
+            double e = std::exp(-(elapsed / 1e9) / avg_windows_s[i]);
+            t.avg[i] = t.avg[i] * e + pct * (1 - e);
+        }
+        t.avg_time = now;
+        t.avg_total_ns = total;
+    }
+    return osv::sprintf("some avg10=%.2f avg60=%.2f avg300=%.2f total=%lu\n"
+                        "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n",
+                        t.avg[0], t.avg[1], t.avg[2], total / 1000);
+}
+
+}
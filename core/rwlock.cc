@@ -10,6 +10,7 @@
 #include <osv/sched.hh>
 #include <osv/rwlock.h>
 #include <osv/export.h>
+#include <osv/lockstat.hh>
 
 using namespace sched;
 
@@ -130,6 +131,7 @@ void rwlock::rlock()
     //We have failed to acquire the lock for reading and bumped the pending readers count
     //Let us wait until wunlock() or downgrade() wakes us and bumps the _readers
     //by (READER_LOCK_INC - 1) on our behalf
+    lockstat::wait_timer contention(this, lockstat::lock_type::rwlock, __builtin_return_address(0));
     lockfree::linked_item<thread*> read_waiter(thread::current());
     _read_waiters.push(&read_waiter);
     std::atomic<thread*> *value = reinterpret_cast<std::atomic<thread*>*>(&read_waiter.value);
@@ -151,6 +153,9 @@ void rwlock::runlock()
         //Wake the _wmtx owner - pending writer - if not null
         auto pending_writer = _wmtx.get_owner();
         if (pending_writer) {
+            if (lockstat::active()) {
+                lockstat::released(this, __builtin_return_address(0));
+            }
             //Synchronize with pending writer by setting _writer_wait to false
             _writer_wait.store(false, std::memory_order_release);
             pending_writer->wake();
@@ -241,6 +246,7 @@ void rwlock::wlock()
 
     //There were some active readers
     //Wait for last active reader to wake us
+    lockstat::wait_timer contention(this, lockstat::lock_type::rwlock, __builtin_return_address(0));
     thread::wait_until( [this] {
         return !this->_writer_wait.load(std::memory_order_acquire);
     });
@@ -289,6 +295,9 @@ void rwlock::wunlock()
     //Allow pending readers to acquire a lock before new writer comes in
     //or the 1st from the pending one wakes from the the sleep
     unsigned pending_readers = _readers.fetch_and(~WRITER_LOCK, std::memory_order_acq_rel) & PENDING_READERS_MASK;
+    if (pending_readers && lockstat::active()) {
+        lockstat::released(this, __builtin_return_address(0));
+    }
 
     //Wake the pending readers and acquire the lock for reading on their behalf
     wake_pending_readers(pending_readers);
@@ -78,6 +78,18 @@ cpu __thread * current_cpu;
 unsigned __thread preempt_counter = 1;
 bool __thread need_reschedule = false;
 
+static std::atomic<bool> schedstat_enabled;
+
+static inline bool schedstat_active()
+{
+    return schedstat_enabled.load(std::memory_order_relaxed);
+}
+
+void enable_schedstat()
+{
+    schedstat_enabled.store(true, std::memory_order_relaxed);
+}
+
 elf::tls_data tls;
 
 inter_processor_interrupt wakeup_ipi{IPI_WAKEUP, [] {}};
@@ -265,6 +277,10 @@ void cpu::reschedule_from_interrupt(bool called_from_yield,
     trace_sched_sched();
     assert(sched::exception_depth <= 1);
     need_reschedule = false;
+    thread* p = thread::current();
+    // Until now, anything but the idle thread in the runqueue was kept
+    // waiting by p
+    bool stalled = p != idle_thread && runqueue.size() > 1;
     handle_incoming_wakeups();
 
     auto now = osv::clock::uptime::now();
@@ -275,8 +291,11 @@ void cpu::reschedule_from_interrupt(bool called_from_yield,
         // To avoid scheduler loops, let's make it non-zero.
         // Also ignore backward jumps in the clock.
         interval = context_switch_penalty;
+    } else if (stalled) {
+        stall_ns.store(stall_ns.load(std::memory_order_relaxed) + interval.count(),
+                std::memory_order_relaxed);
     }
-    thread* p = thread::current();
+    u64 now_ns = now.time_since_epoch().count();
 
     const auto p_status = p->_detached_state->st.load();
     assert(p_status != thread::status::queued);
@@ -346,10 +365,23 @@ void cpu::reschedule_from_interrupt(bool called_from_yield,
 
         trace_sched_preempt();
         p->stat_preemptions.incr();
+        if (schedstat_active()) {
+            p->_stopped_at = now_ns;
+            p->_woken_at.store(now_ns, std::memory_order_relaxed);
+        }
     } else {
         // p is no longer running, so we'll switch to a different thread.
         // Return the runtime p borrowed for hysteresis.
         p->_runtime.hysteresis_run_stop();
+        if (schedstat_active()) {
+            p->_stopped_at = now_ns;
+            // A thread still waiting is runnable only once wake() says so
+            p->_woken_at.store(p_status == thread::status::waiting ? 0 : now_ns,
+                    std::memory_order_relaxed);
+            if (p_status == thread::status::waiting && prof::offcpu_active()) {
+                prof::offcpu_switch_out(p->_offcpu);
+            }
+        }
     }
 
     auto ni = runqueue.begin();
@@ -369,10 +401,24 @@ void cpu::reschedule_from_interrupt(bool called_from_yield,
         trace_sched_idle_ret();
     }
     n->stat_switches.incr();
+    if (n->_stopped_at) {
+        // A wake() racing with the switch out may have been missed, in which
+        // case all the time is counted as spent in the runqueue
+        u64 woken = n->_woken_at.load(std::memory_order_relaxed);
+        if (woken < n->_stopped_at || woken > now_ns) {
+            woken = n->_stopped_at;
+        }
+        n->stat_sleep_ns.incr(woken - n->_stopped_at);
+        n->stat_runq_ns.incr(now_ns - woken);
+        if (n->_offcpu.stack) {
+            prof::offcpu_switch_in(n->_offcpu, woken - n->_stopped_at, now_ns - woken);
+        }
+    }
 
     trace_sched_load(runqueue.size());
 
     n->_detached_state->st.store(thread::status::running);
+    running_thread.store(n, std::memory_order_relaxed);
     n->_runtime.hysteresis_run_start();
 
     assert(n!=p);
@@ -868,6 +914,16 @@ void cpu::notifier::fire()
     }
 }
 
+bool thread::on_cpu(const thread* t)
+{
+    for (auto c : cpus) {
+        if (c->running_thread.load(std::memory_order_relaxed) == t) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void thread::yield(thread_runtime::duration preempt_after)
 {
     trace_sched_yield();
@@ -1321,6 +1377,10 @@ void thread::wake_impl(detached_state* st, unsigned allowed_initial_states_mask)
         unsigned c = cpu::current()->id;
         // we can now use st->t here, since the thread cannot terminate while
         // it's waking, but not afterwards, when it may be running
+        if (schedstat_active()) {
+            st->t->_woken_at.store(osv::clock::uptime::now().time_since_epoch().count(),
+                    std::memory_order_relaxed);
+        }
 #if CONF_lazy_stack_invariant
         assert(!sched::preemptable());
 #endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/snapshot.hh>
+#include <osv/mutex.h>
+#include <osv/sched.hh>
+#include <osv/clock.hh>
+#include <osv/trace.hh>
+#include "drivers/clock.hh"
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+TRACEPOINT(trace_snapshot_pause, "");
+TRACEPOINT(trace_snapshot_resume, "paused=%d ms", s64);
+
+using namespace std::chrono;
+
+namespace osv {
+namespace snapshot {
+
+// How often the host's time is checked while waiting at the pause point
+static constexpr auto poll_interval = milliseconds(10);
+// Host adjustments of the wall clock (NTP) are far smaller than this in
+// one poll interval, so a bigger jump means the VM was paused
+static constexpr s64 min_pause_ns = 50000000;
+
+struct hooks {
+    std::function<void ()> before;
+    std::function<void ()> after;
+};
+
+static mutex hooks_mutex;
+static std::vector<hooks> registered;
+static mutex pause_mutex;
+static std::atomic<bool> resume_requested;
+
+void register_hooks(std::function<void ()> before, std::function<void ()> after)
+{
+    SCOPE_LOCK(hooks_mutex);
+    registered.push_back({std::move(before), std::move(after)});
+}
+
+static s64 wait_for_resume()
+{
+    auto c = ::clock::get();
+    auto boot = c->boot_time();
+    while (!resume_requested.load(std::memory_order_relaxed)) {
+        sched::thread::sleep(poll_interval);
+        c->sync();
+        auto paused = c->boot_time() - boot;
+        if (paused > min_pause_ns) {
+            return paused;
+        }
+    }
+    return 0;
+}
+
+void pause_point()
+{
+    SCOPE_LOCK(pause_mutex);
+    resume_requested.store(false);
+
+    std::vector<hooks> hs;
+    WITH_LOCK(hooks_mutex) {
+        hs = registered;
+    }
+    for (auto& h : hs) {
+        if (h.before) {
+            h.before();
+        }
+    }
+    sync();
+
+    trace_snapshot_pause();
+    printf("%s\n", ready_marker);
+    fflush(stdout);
+    auto paused = wait_for_resume();
+    auto start = osv::clock::uptime::now();
+    trace_snapshot_resume(paused / 1000000);
+
+    ::clock::get()->resume();
+    for (auto h = hs.rbegin(); h != hs.rend(); ++h) {
+        if (h->after) {
+            h->after();
+        }
+    }
+
+    auto took = duration_cast<microseconds>(osv::clock::uptime::now() - start).count();
+    printf("OSv: resumed after %.3fs paused, ready in %.2fms\n",
+           paused / 1e9, took / 1000.0);
+}
+
+void resume()
+{
+    resume_requested.store(true);
+}
+
+}
+}
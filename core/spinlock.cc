@@ -7,10 +7,15 @@
 
 #include <osv/spinlock.h>
 #include <osv/sched.hh>
+#include <osv/lockstat.hh>
 
 void spin_lock(spinlock_t *sl)
 {
     sched::preempt_disable();
+    if (!__sync_lock_test_and_set(&sl->_lock, 1)) {
+        return;
+    }
+    lockstat::wait_timer contention(sl, lockstat::lock_type::spinlock, __builtin_return_address(0));
     while (__sync_lock_test_and_set(&sl->_lock, 1)) {
         while (sl->_lock) {
 #ifdef __x86_64__
@@ -41,6 +46,10 @@ void spin_unlock(spinlock_t *sl)
 
 void np_spin_lock(np_spinlock_t *sl)
 {
+    if (!__sync_lock_test_and_set(&sl->_lock, 1)) {
+        return;
+    }
+    lockstat::wait_timer contention(sl, lockstat::lock_type::spinlock, __builtin_return_address(0));
     while (__sync_lock_test_and_set(&sl->_lock, 1)) {
         while (sl->_lock) {
 #ifdef __x86_64__
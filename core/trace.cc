@@ -13,6 +13,7 @@
 #include <atomic>
 #include <regex.h>
 #include <unordered_map>
+#include <deque>
 #include <boost/range/algorithm/remove.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -23,6 +24,8 @@
 #include <osv/percpu.hh>
 #include <osv/ilog2.hh>
 #include <osv/semaphore.hh>
+#include <osv/condvar.h>
+#include <osv/printf.hh>
 #include <osv/elf.hh>
 #include <osv/string_utils.hh>
 #include <cxxabi.h>
@@ -67,13 +70,16 @@ struct trace_buf {
            _base;
     size_t _last;
     size_t _size;
+    // Number of records ever written, for the trace stream to tell how
+    // many it lost
+    u64 _records;
 
     trace_buf() :
-            _base(nullptr, free), _last(0), _size(0) {
+            _base(nullptr, free), _last(0), _size(0), _records(0) {
     }
     trace_buf(size_t size) :
             _base(static_cast<char*>(aligned_alloc(sizeof(long), size)), free), _last(
-                    0), _size(size) {
+                    0), _size(size), _records(0) {
         static_assert(is_power_of_two(trace_page_size), "just checking");
         assert(is_power_of_two(size) && "size must be power of two");
         assert((size & (trace_page_size - 1)) == 0 && "size must be multiple of trace_page_size");
@@ -85,6 +91,7 @@ struct trace_buf {
     {
         memcpy(_base.get(), buf._base.get(), _size);
         _last = buf._last;
+        _records = buf._records;
     }
     trace_buf(trace_buf && buf) = default;
 
@@ -118,6 +125,7 @@ struct trace_buf {
         }
         barrier();
         _last = pn;
+        ++_records;
         return tr1;
 
     }
@@ -548,29 +556,26 @@ trace::remove_symbol_callback(generator_id id) {
     }
 }
 
-//The code below will be compiled out with conf_hide_symbols=1 as create_trace_dump() is
-//not in the list of the symbols to be exported and is ONLY used
-//by full API httpserver-api module
-#if HIDE_SYMBOLS < 1
 #include <fstream>
-// Helper type to build trace dump binary files
-class trace_out: public std::ofstream {
+#include <sstream>
+// Helper type to build trace dump binary files, and pieces of trace streams
+class trace_out {
 public:
-    std::string path;
+    typedef std::ostream::char_type char_type;
+    typedef std::ostream::pos_type pos_type;
 
-    trace_out() {
-        for (;;) {
-            std::unique_ptr<char> tmp(::tempnam(nullptr, nullptr));
-            if (tmp) {
-                auto f = ::open(tmp.get(), O_EXCL | O_CREAT);
-                if (f != -1) {
-                    ofstream::open(tmp.get(), ios::out|ios::binary);
-                    path = tmp.get();
-                    ::close(f);
-                    break;
-                }
-            }
-        }
+    explicit trace_out(std::ostream& os) : _os(os) {
+    }
+    pos_type tellp() {
+        return _os.tellp();
+    }
+    trace_out & seekp(pos_type pos) {
+        _os.seekp(pos);
+        return *this;
+    }
+    trace_out & put(char_type c) {
+        _os.put(c);
+        return *this;
     }
     trace_out & align(size_t a) {
         while (tellp() & (a - 1)) {
@@ -582,7 +587,10 @@ public:
         return align(std::alignment_of<T>::value);
     }
 
-    using std::ofstream::write;
+    trace_out & write(const char_type* s, std::streamsize n) {
+        _os.write(s, n);
+        return *this;
+    }
 
     template<typename T> trace_out & write(T && t) {
         align<T>();
@@ -614,6 +622,8 @@ public:
         write(s.c_str(), s.size());
         return *this;
     }
+private:
+    std::ostream& _os;
 };
 
 template<typename T = uint32_t>
@@ -729,22 +739,322 @@ dump = <chunk> {
   } +; // 1 or more
 };
 
+A trace stream (see trace::start_trace_stream()) is laid out like a dump,
+but is written as it goes and so never ends. Its trace data chunks hold
+the records drained from one cpu at a time, and come in the order they
+were drained, so records of different cpus are only ordered within a
+chunk. Records which were overwritten before they could be drained are
+reported in lost chunks, in the data of the cpu which lost them.
+
+stream = <chunk> {
+  uint32_t tag = 'OSVS';
+  uint64_t size = ~0; // unknown
+  uint32_t endian = 1;
+  uint32_t format_version;
+
+  trace_dictionary, loaded_modules, symbol_table; // as in a dump
+
+  {
+    trace_data;
+    lost_records = <chunk, align 8> {
+      uint32_t tag = 'LOST';
+      uint64_t size = <chunk size>;
+      uint32_t cpu;
+      uint64_t count;
+    };
+  } *; // in any order, for as long as the stream runs
+};
+
  */
+
+namespace {
+
+// Dealing with 'FOUR' fourcc tags
+struct tag {
+    tag(const char (&s)[5]) :
+        _val((s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3])
+    {}
+    operator uint32_t() const {
+        return _val;
+    }
+    const uint32_t _val;
+};
+
+// RIFF-like chunk (see file format description).
+// Always aligned on 8
+class chunk {
+public:
+    chunk(trace_out & out, const tag & tt) :
+            _out(out) {
+        out.align(8);
+        out.write(uint32_t(tt));
+        out.align(8);
+        _pos = out.tellp();
+        out.write(uint64_t(0));
+    }
+    ~chunk() {
+        auto p = _out.tellp();
+        _out.seekp(_pos);
+        _out.write(uint64_t(p - _pos - sizeof(uint64_t)));
+        _out.seekp(p);
+    }
+private:
+    trace_out & _out;
+    trace_out::pos_type _pos;
+};
+
+bool is_valid_tracepoint(const tracepoint_base * tp_test)
+{
+    for (auto & tp : tracepoint_base::tp_list) {
+        if (&tp == tp_test) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void write_trace_dictionary(trace_out & out)
+{
+    chunk dict(out, "TRCD");
+
+    out.write(uint32_t(tracepoint_base::backtrace_len));
+    out.write(uint32_t(tracepoint_base::tp_list.size()));
+
+    for (auto & tp : tracepoint_base::tp_list) {
+        out.write(reinterpret_cast<uint64_t>(&tp)); // tag/ptr
+        out.swrite(tp.name); // id
+        out.swrite(tp.name); // name (TODO: useful names)
+        out.swrite("OSv"); // provider
+        out.swrite(tp.format); // print format (?)
+        out.write<uint32_t>(strlen(tp.sig));
+        int n = 0;
+        auto s = tp.sig;
+        while (*s) {
+            out.swrite(std::to_string(n++)); // no arg names
+            out.write(*s);
+            ++s;
+        }
+    }
+}
+
+void write_modules(trace_out & out)
+{
+    elf::get_program()->with_modules(
+            [&](const elf::program::modules_list &ml)
+            {
+                {
+                    chunk mods(out, "MODS");
+                    out.write(uint32_t(ml.objects.size()));
+                    for (auto module : ml.objects) {
+                        out.swrite(module->pathname());
+                        out.write(uint64_t(module->base()));
+                        out.write(uint64_t(module->end()) - uint64_t(module->base()));
+
+                        if (module->module_index() == elf::program::core_module_index) {
+                            out.write(uint32_t(0));
+                            continue;
+                        }
+                        // Sections
+                        auto sections = module->sections();
+                        out.write(uint32_t(sections.size()));
+                        for (auto & section : sections) {
+                            out.swrite(module->section_name(section));
+                            out.write(uint32_t(section.sh_type));
+                            out.write(uint32_t(section.sh_info));
+                            out.write(uint64_t(section.sh_flags));
+                            out.write(uint64_t(section.sh_addr));
+                            out.write(uint64_t(section.sh_offset));
+                            out.write(uint64_t(section.sh_size));
+                        }
+                    }
+                }
+
+                struct demangler {
+                    demangler()
+                    {}
+                    ~demangler()
+                    {
+                        if (buf) {
+                            free(buf);
+                        }
+                    }
+                    const char * operator()(const char * name) {
+                        int status;
+                        auto * demangled = abi::__cxa_demangle(name, buf, &len, &status);
+                        if (demangled) {
+                            buf = demangled;
+                            return buf;
+                        }
+                        return name;
+                    }
+                private:
+                    char * buf = nullptr;
+                    size_t len = 0;
+                };
+
+                demangler demangle;
+
+                for (auto module : ml.objects) {
+                    auto syms = module->symbols();
+                    if (syms.empty()) {
+                        continue;
+                    }
+                    chunk mods(out, "SYMB");
+                    length<> len(out);
+                    for (auto & es : syms) {
+                        auto t = es.st_info & elf::STT_HIPROC;
+                        if (t != elf::STT_FUNC && t != elf::STT_OBJECT) {
+                            continue;
+                        }
+                        auto * n = module->symbol_name(&es);
+                        if (n && *n) {
+                            elf::symbol_module m(&es, module);
+                            ++len.value;
+                            out.swrite(demangle(n));
+                            out.write(uint64_t(m.relocated_addr()));
+                            out.write(uint64_t(m.size()));
+                            out.swrite(nullptr);
+                            out.write(uint32_t(0));
+                        }
+                    }
+
+                }
+            });
+}
+
+void write_symbol_tables(trace_out & out)
+{
+    WITH_LOCK(symbol_func_mutex) {
+        for (auto & p : symbol_functions) {
+            chunk symb(out, "SYMB");
+            length<> len(out);
+            p.second([&](const trace::symbol & s) {
+                ++len.value;
+                out.swrite(s.name);
+                out.write(uint64_t(s.addr));
+                out.write(uint64_t(s.size));
+                out.swrite(s.filename);
+                out.write(s.n_locations);
+                for (uint32_t i = 0; i < s.n_locations; ++i) {
+                    auto loc = s.location(i);
+                    out.write(loc.first);
+                    out.write(loc.second);
+                }
+            });
+        }
+    }
+}
+
+// Writes the records found from s to e in a copy of a trace buffer starting
+// at the page aligned base, skipping the padding at the end of pages, and
+// returns how many there were
+u64 write_trace_records(trace_out & out, const char * base, const char * s, const char * e)
+{
+    u64 n = 0;
+    while (s < e) {
+        auto * tr = reinterpret_cast<const trace_record*>(s);
+        if (tr->tp == nullptr) {
+            // alignment up to 8 is fine on the pointer itself.
+            // page alignment we must do per offset.
+            size_t off = s - base;
+            s = base + align_up(off + 1, trace_page_size);
+            continue;
+        }
+        if (tr->tp == trace_buf::invalid_trace_point) {
+            break;
+        }
+
+        assert(is_valid_tracepoint(tr->tp));
+
+        out.twrite<trace_record>(s);
+
+        if (tr->backtrace) {
+            out.twrite<void *>(s, tracepoint_base::backtrace_len);
+        }
+        auto sig = tr->tp->sig;
+        while (*sig != 0) {
+            switch (*sig++) {
+            case 'c':
+                out.twrite<char>(s);
+                break;
+            case 'b':
+            case 'B':
+                out.twrite<u8>(s);
+                break;
+            case 'h':
+            case 'H':
+                out.twrite<u16>(s);
+                break;
+            case 'i':
+            case 'I':
+            case 'f':
+                out.twrite<u32>(s);
+                break;
+            case 'q':
+            case 'Q':
+            case 'd':
+            case 'P':
+                out.twrite<u64>(s);
+                break;
+            case '?':
+                out.twrite<bool>(s);
+                break;
+            case 'p': {
+                out.twrite<char>(s,
+                        object_serializer<const char*>::max_len);
+                break;
+            }
+            case '*': {
+                s = align_up(s, sizeof(u16));
+                auto len = *reinterpret_cast<const u16*>(s);
+                s += 2;
+                out.write(len);
+                out.twrite<char>(s, len);
+                break;
+            }
+            default:
+                assert(0 && "should not reach");
+            }
+        }
+        s = align_up(s, sizeof(long));
+        ++n;
+    }
+    return n;
+}
+
+}
+
+//The code below will be compiled out with conf_hide_symbols=1 as create_trace_dump() is
+//not in the list of the symbols to be exported and is ONLY used
+//by full API httpserver-api module
+#if HIDE_SYMBOLS < 1
+// A trace dump, written to a new temporary file
+class trace_dump_file: public std::ofstream {
+public:
+    std::string path;
+
+    trace_dump_file() {
+        for (;;) {
+            std::unique_ptr<char> tmp(::tempnam(nullptr, nullptr));
+            if (tmp) {
+                auto f = ::open(tmp.get(), O_EXCL | O_CREAT);
+                if (f != -1) {
+                    ofstream::open(tmp.get(), ios::out|ios::binary);
+                    path = tmp.get();
+                    ::close(f);
+                    break;
+                }
+            }
+        }
+    }
+};
+
 std::string
 trace::create_trace_dump()
 {
     semaphore signal(0);
     std::vector<trace_buf> copies(sched::cpus.size());
 
-    auto is_valid_tracepoint = [](const tracepoint_base * tp_test) {
-        for (auto & tp : tracepoint_base::tp_list) {
-            if (&tp == tp_test) {
-                return true;
-            }
-        }
-        return false;
-    };
-
     // Copy the trace buffers from each cpu, locking out trace generation
     // during the extraction (disable preemption, just like trace write)
     unsigned i = 0;
@@ -765,47 +1075,14 @@ trace::create_trace_dump()
     // Redundant. But just to verify.
     signal.wait(sched::cpus.size());
 
-    // Dealing with 'FOUR' fourcc tags
-    struct tag {
-        tag(const char (&s)[5]) :
-            _val((s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3])
-        {}
-        operator uint32_t() const {
-            return _val;
-        }
-        const uint32_t _val;
-    };
-
-    // RIFF-like chunk (see file format description).
-    // Always aligned on 8
-    class chunk {
-    public:
-        chunk(trace_out & out, const tag & tt) :
-                _out(out) {
-            out.align(8);
-            out.write(uint32_t(tt));
-            out.align(8);
-            _pos = out.tellp();
-            out.write(uint64_t(0));
-        }
-        ~chunk() {
-            auto p = _out.tellp();
-            _out.seekp(_pos);
-            _out.write(uint64_t(p - _pos - sizeof(uint64_t)));
-            _out.seekp(p);
-        }
-    private:
-        trace_out & _out;
-        trace_out::pos_type _pos;
-    };
-
     static const int tf_version_major = 0;
     static const int tf_version_minor = 1;
 
-    trace_out out;
+    trace_dump_file file;
+    trace_out out(file);
 
     // Want early fail
-    out.exceptions(trace_out::failbit);
+    file.exceptions(trace_dump_file::failbit);
 
     {
         chunk osvt(out, "OSVT"); // magic
@@ -813,136 +1090,11 @@ trace::create_trace_dump()
         out.write(uint32_t((tf_version_major << 16) | tf_version_minor)); // version
 
         // Trace dictionary
-        {
-            chunk dict(out, "TRCD");
-
-            out.write(uint32_t(tracepoint_base::backtrace_len));
-            out.write(uint32_t(tracepoint_base::tp_list.size()));
-
-            for (auto & tp : tracepoint_base::tp_list) {
-                out.write(reinterpret_cast<uint64_t>(&tp)); // tag/ptr
-                out.swrite(tp.name); // id
-                out.swrite(tp.name); // name (TODO: useful names)
-                out.swrite("OSv"); // provider
-                out.swrite(tp.format); // print format (?)
-                out.write<uint32_t>(strlen(tp.sig));
-                int n = 0;
-                auto s = tp.sig;
-                while (*s) {
-                    out.swrite(std::to_string(n++)); // no arg names
-                    out.write(*s);
-                    ++s;
-                }
-            }
-        }
-
-        { // Module list
-            elf::get_program()->with_modules(
-                    [&](const elf::program::modules_list &ml)
-                    {
-                        {
-                            chunk mods(out, "MODS");
-                            out.write(uint32_t(ml.objects.size()));
-                            for (auto module : ml.objects) {
-                                out.swrite(module->pathname());
-                                out.write(uint64_t(module->base()));
-                                out.write(uint64_t(module->end()) - uint64_t(module->base()));
-
-                                if (module->module_index() == elf::program::core_module_index) {
-                                    out.write(uint32_t(0));
-                                    continue;
-                                }
-                                // Sections
-                                auto sections = module->sections();
-                                out.write(uint32_t(sections.size()));
-                                for (auto & section : sections) {
-                                    out.swrite(module->section_name(section));
-                                    out.write(uint32_t(section.sh_type));
-                                    out.write(uint32_t(section.sh_info));
-                                    out.write(uint64_t(section.sh_flags));
-                                    out.write(uint64_t(section.sh_addr));
-                                    out.write(uint64_t(section.sh_offset));
-                                    out.write(uint64_t(section.sh_size));
-                                }
-                            }
-                        }
-
-                        struct demangler {
-                            demangler()
-                            {}
-                            ~demangler()
-                            {
-                                if (buf) {
-                                    free(buf);
-                                }
-                            }
-                            const char * operator()(const char * name) {
-                                int status;
-                                auto * demangled = abi::__cxa_demangle(name, buf, &len, &status);
-                                if (demangled) {
-                                    buf = demangled;
-                                    return buf;
-                                }
-                                return name;
-                            }
-                        private:
-                            char * buf = nullptr;
-                            size_t len = 0;
-                        };
-
-                        demangler demangle;
-
-                        for (auto module : ml.objects) {
-                            auto syms = module->symbols();
-                            if (syms.empty()) {
-                                continue;
-                            }
-                            chunk mods(out, "SYMB");
-                            length<> len(out);
-                            for (auto & es : syms) {
-                                auto t = es.st_info & elf::STT_HIPROC;
-                                if (t != elf::STT_FUNC && t != elf::STT_OBJECT) {
-                                    continue;
-                                }
-                                auto * n = module->symbol_name(&es);
-                                if (n && *n) {
-                                    elf::symbol_module m(&es, module);
-                                    ++len.value;
-                                    out.swrite(demangle(n));
-                                    out.write(uint64_t(m.relocated_addr()));
-                                    out.write(uint64_t(m.size()));
-                                    out.swrite(nullptr);
-                                    out.write(uint32_t(0));
-                                }
-                            }
-
-                        }
-                    });
-        }
-
-
-        {
-            // Symbol tables
-            WITH_LOCK(symbol_func_mutex) {
-                for (auto & p : symbol_functions) {
-                    chunk symb(out, "SYMB");
-                    length<> len(out);
-                    p.second([&](const symbol & s) {
-                        ++len.value;
-                        out.swrite(s.name);
-                        out.write(uint64_t(s.addr));
-                        out.write(uint64_t(s.size));
-                        out.swrite(s.filename);
-                        out.write(s.n_locations);
-                        for (uint32_t i = 0; i < s.n_locations; ++i) {
-                            auto loc = s.location(i);
-                            out.write(loc.first);
-                            out.write(loc.second);
-                        }
-                    });
-                }
-            }
-        }
+        write_trace_dictionary(out);
+        // Module list
+        write_modules(out);
+        // Symbol tables
+        write_symbol_tables(out);
 
         // Trace data, one chunk for each cpu buffer
         for (auto & buf : copies) {
@@ -957,83 +1109,356 @@ trace::create_trace_dump()
             out.align(8);
 
             for (auto & r : regs) {
-                const char * s = r.first;
-                const char * e = r.second;
-
-                while (s < e) {
-                    auto * tr = reinterpret_cast<const trace_record*>(s);
-                    if (tr->tp == nullptr) {
-                        // alignment up to 8 is fine on the pointer itself.
-                        // page alignment we must do per offset.
-                        size_t off = s - r.first;
-                        s = r.first + align_up(off + 1, trace_page_size);
-                        continue;
-                    }
-                    if (tr->tp == trace_buf::invalid_trace_point) {
-                        break;
-                    }
+                write_trace_records(out, r.first, r.first, r.second);
+            }
+        }
 
-                    assert(is_valid_tracepoint(tr->tp));
+    }
+    file.flush();
+    file.close();
 
-                    out.twrite<trace_record>(s);
+    return std::move(file.path);
+}
+#endif
 
-                    if (tr->backtrace) {
-                        out.twrite<void *>(s, tracepoint_base::backtrace_len);
-                    }
-                    auto sig = tr->tp->sig;
-                    while (*sig != 0) {
-                        switch (*sig++) {
-                        case 'c':
-                            out.twrite<char>(s);
-                            break;
-                        case 'b':
-                        case 'B':
-                            out.twrite<u8>(s);
-                            break;
-                        case 'h':
-                        case 'H':
-                            out.twrite<u16>(s);
-                            break;
-                        case 'i':
-                        case 'I':
-                        case 'f':
-                            out.twrite<u32>(s);
-                            break;
-                        case 'q':
-                        case 'Q':
-                        case 'd':
-                        case 'P':
-                            out.twrite<u64>(s);
-                            break;
-                        case '?':
-                            out.twrite<bool>(s);
-                            break;
-                        case 'p': {
-                            out.twrite<char>(s,
-                                    object_serializer<const char*>::max_len);
-                            break;
-                        }
-                        case '*': {
-                            s = align_up(s, sizeof(u16));
-                            auto len = *reinterpret_cast<const u16*>(s);
-                            s += 2;
-                            out.write(len);
-                            out.twrite<char>(s, len);
-                            break;
-                        }
-                        default:
-                            assert(0 && "should not reach");
-                        }
-                    }
-                    s = align_up(s, sizeof(long));
+namespace {
+
+constexpr int ts_version_major = 1;
+constexpr int ts_version_minor = 0;
+
+// Trace data is copied out of a cpu's buffer this much at a time, with
+// interrupts disabled
+constexpr size_t stream_batch_size = 16 * trace_page_size;
+constexpr auto stream_interval = std::chrono::milliseconds(10);
+// The drain threads only get a small share of a busy cpu, like the huge
+// page collapser
+constexpr float stream_priority = 10.0;
+// How much stream data is kept for an HTTP reader before chunks are dropped
+constexpr size_t stream_memory_max = 4 << 20;
+
+class stream_sink {
+public:
+    virtual ~stream_sink() {}
+    // Writes a whole piece of the stream, or nothing. Returns false when
+    // the piece was dropped.
+    virtual bool write(const std::string & data) = 0;
+    virtual void close() {}
+};
+
+// Streams to a file, or a device such as a serial port
+class file_sink : public stream_sink {
+public:
+    explicit file_sink(const std::string & path) :
+        _fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))
+    {
+        if (_fd < 0) {
+            throw std::runtime_error("Cannot open trace stream '" + path + "': " + strerror(errno));
+        }
+    }
+    ~file_sink() {
+        ::close(_fd);
+    }
+    bool write(const std::string & data) override {
+        SCOPE_LOCK(_mutex);
+        if (_failed) {
+            return false;
+        }
+        auto p = data.data();
+        auto left = data.size();
+        while (left) {
+            auto n = ::write(_fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // A partial piece would corrupt the stream for good
+                _failed = true;
+                return false;
+            }
+            p += n;
+            left -= n;
+        }
+        return true;
+    }
+private:
+    int _fd;
+    bool _failed = false;
+    ::mutex _mutex;
+};
+
+// Keeps the stream in memory for trace::read_trace_stream()
+class memory_sink : public stream_sink {
+public:
+    bool write(const std::string & data) override {
+        SCOPE_LOCK(_mutex);
+        if (_size + data.size() > stream_memory_max && !_data.empty()) {
+            return false;
+        }
+        _data.push_back(data);
+        _size += data.size();
+        _cond.wake_all();
+        return true;
+    }
+    void close() override {
+        WITH_LOCK(_mutex) {
+            _closed = true;
+            _cond.wake_all();
+        }
+    }
+    std::string read(size_t max, std::chrono::milliseconds timeout) {
+        std::string ret;
+        WITH_LOCK(_mutex) {
+            auto deadline = osv::clock::uptime::now() + timeout;
+            while (_data.empty() && !_closed && osv::clock::uptime::now() < deadline) {
+                _cond.wait(&_mutex, deadline);
+            }
+            while (!_data.empty() && ret.size() < max) {
+                auto & front = _data.front();
+                auto n = std::min(max - ret.size(), front.size());
+                ret.append(front, 0, n);
+                _size -= n;
+                if (n == front.size()) {
+                    _data.pop_front();
+                } else {
+                    front.erase(0, n);
                 }
             }
         }
+        return ret;
+    }
+private:
+    std::deque<std::string> _data;
+    size_t _size = 0;
+    bool _closed = false;
+    ::mutex _mutex;
+    condvar _cond;
+};
+
+struct stream_cpu {
+    sched::cpu* cpu;
+    std::unique_ptr<sched::thread> thread;
+    // Position of the next record to drain in the cpu's trace buffer
+    size_t pos = 0;
+    // Records drained or lost so far
+    u64 consumed = 0;
+    // Records lost, and not yet reported in the stream
+    u64 lost = 0;
+    std::unique_ptr<char[]> batch;
+};
 
+struct trace_stream {
+    std::string path;
+    std::shared_ptr<stream_sink> sink;
+    std::vector<stream_cpu> cpus;
+    std::atomic<bool> stopping { false };
+    std::atomic<u64> records { 0 };
+    std::atomic<u64> lost { 0 };
+    std::atomic<u64> bytes { 0 };
+
+    bool write(const std::string & data) {
+        if (!sink->write(data)) {
+            return false;
+        }
+        bytes.fetch_add(data.size(), std::memory_order_relaxed);
+        return true;
     }
-    out.flush();
-    out.close();
+};
 
-    return std::move(out.path);
+::mutex stream_mutex;
+std::unique_ptr<trace_stream> stream;
+
+std::string stream_header()
+{
+    std::ostringstream os;
+    trace_out out(os);
+
+    out.write(uint32_t(tag("OSVS")));
+    out.align(8);
+    out.write(~uint64_t(0)); // size, unknown
+    out.write(uint32_t(1)); // endian (verify)
+    out.write(uint32_t((ts_version_major << 16) | ts_version_minor)); // version
+    write_trace_dictionary(out);
+    write_modules(out);
+    write_symbol_tables(out);
+    out.align(8);
+    return os.str();
+}
+
+// Drains the next batch of the current cpu's trace buffer to the stream.
+// Returns true when that was all of it.
+bool drain_batch(trace_stream & ts, stream_cpu & sc)
+{
+    auto * batch = sc.batch.get();
+    size_t last, base, begin, end;
+    u64 written;
+    {
+        // Lock out trace generation on this cpu while copying, just like
+        // trace::create_trace_dump() does
+        arch::irq_flag_notrace irq;
+        irq.save();
+        arch::irq_disable_notrace();
+        auto & tb = *percpu_trace_buffer;
+        // The page being written to has been partially overwritten, so
+        // the oldest complete records start on the next page
+        last = tb._last;
+        auto oldest = last > tb._size ? align_up(last, trace_page_size) - tb._size : 0;
+        begin = std::max(sc.pos, oldest);
+        base = align_down(begin, trace_page_size);
+        end = std::min(last, base + stream_batch_size);
+        for (auto p = base; p < end;) {
+            auto i = p & (tb._size - 1);
+            auto n = std::min(end - p, tb._size - i);
+            memcpy(batch + (p - base), tb._base.get() + i, n);
+            p += n;
+        }
+        written = tb._records;
+        irq.restore();
+    }
+    sc.pos = end;
+
+    std::ostringstream records_os;
+    trace_out records(records_os);
+    u64 n = 0;
+    if (begin != end) {
+        chunk trcs(records, "TRCS");
+        records.align(8);
+        n = write_trace_records(records, batch, batch + (begin - base), batch + (end - base));
+        records.align(8);
+    }
+
+    std::ostringstream os;
+    if (sc.lost) {
+        trace_out out(os);
+        chunk lost(out, "LOST");
+        out.write(uint32_t(sc.cpu->id));
+        out.write(uint64_t(sc.lost));
+        out.align(8);
+    }
+    os << records_os.str();
+    auto piece = os.str();
+    if (!piece.empty()) {
+        if (ts.write(piece)) {
+            sc.lost = 0;
+            ts.records.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            sc.lost += n;
+            ts.lost.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    sc.consumed += n;
+    if (end != last) {
+        return false;
+    }
+    // Caught up: whatever was written and not drained by now was overwritten
+    // before we got to it
+    auto overwritten = written - sc.consumed;
+    sc.lost += overwritten;
+    ts.lost.fetch_add(overwritten, std::memory_order_relaxed);
+    sc.consumed = written;
+    return true;
+}
+
+void drain(trace_stream & ts, stream_cpu & sc)
+{
+    {
+        arch::irq_flag_notrace irq;
+        irq.save();
+        arch::irq_disable_notrace();
+        // Only what is traced from now on is streamed
+        sc.pos = percpu_trace_buffer->_last;
+        sc.consumed = percpu_trace_buffer->_records;
+        irq.restore();
+    }
+    bool stopping;
+    do {
+        stopping = ts.stopping.load(std::memory_order_relaxed);
+        // Bounded, so that a cpu tracing faster than it can be drained
+        // does not keep us from stopping
+        for (unsigned i = 0; i < 64 && !drain_batch(ts, sc); i++) {
+        }
+        if (!stopping) {
+            sched::thread::sleep(stream_interval);
+        }
+    } while (!stopping);
+}
+
+}
+
+void trace::start_trace_stream(const std::string & path)
+{
+    ensure_log_initialized();
+    WITH_LOCK(stream_mutex) {
+        if (stream) {
+            throw std::runtime_error("A trace stream is already running");
+        }
+        std::unique_ptr<trace_stream> ts(new trace_stream);
+        ts->path = path;
+        if (path.empty()) {
+            ts->sink = std::make_shared<memory_sink>();
+        } else {
+            ts->sink = std::make_shared<file_sink>(path);
+        }
+        ts->write(stream_header());
+        ts->cpus.resize(sched::cpus.size());
+        for (auto c : sched::cpus) {
+            auto & sc = ts->cpus[c->id];
+            sc.cpu = c;
+            sc.batch.reset(new char[stream_batch_size]);
+            auto * tsp = ts.get();
+            sc.thread.reset(sched::thread::make([tsp, &sc] { drain(*tsp, sc); },
+                sched::thread::attr().pin(c).name(osv::sprintf("tracestream%d", c->id))));
+            sc.thread->set_priority(stream_priority);
+        }
+        for (auto & sc : ts->cpus) {
+            sc.thread->start();
+        }
+        stream = std::move(ts);
+    }
+}
+
+void trace::stop_trace_stream()
+{
+    WITH_LOCK(stream_mutex) {
+        if (!stream) {
+            return;
+        }
+        stream->stopping.store(true, std::memory_order_relaxed);
+        for (auto & sc : stream->cpus) {
+            sc.thread->join();
+        }
+        stream->sink->close();
+        stream.reset();
+    }
+}
+
+trace::stream_status
+trace::get_stream_status()
+{
+    stream_status ret;
+    WITH_LOCK(stream_mutex) {
+        ret.active = bool(stream);
+        if (stream) {
+            ret.path = stream->path;
+            ret.records = stream->records.load(std::memory_order_relaxed);
+            ret.lost = stream->lost.load(std::memory_order_relaxed);
+            ret.bytes = stream->bytes.load(std::memory_order_relaxed);
+        }
+    }
+    return ret;
+}
+
+std::string
+trace::read_trace_stream(size_t max, std::chrono::milliseconds timeout)
+{
+    std::shared_ptr<memory_sink> sink;
+    WITH_LOCK(stream_mutex) {
+        if (stream && stream->path.empty()) {
+            sink = std::static_pointer_cast<memory_sink>(stream->sink);
+        }
+    }
+    if (!sink) {
+        throw std::runtime_error("No trace stream is being kept in memory");
+    }
+    return sink->read(max, timeout);
 }
-#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include <osv/xmit_batch.hh>
+
+namespace osv {
+
+__thread unsigned xmit_batch::_depth;
+__thread unsigned xmit_batch::_nr_deferred;
+__thread xmit_batch::flusher* xmit_batch::_deferred[xmit_batch::max_deferred];
+
+bool xmit_batch::defer_kick(flusher* f)
+{
+    if (!_depth) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < _nr_deferred; i++) {
+        if (_deferred[i] == f) {
+            return true;
+        }
+    }
+
+    if (_nr_deferred == max_deferred) {
+        return false;
+    }
+
+    _deferred[_nr_deferred++] = f;
+    return true;
+}
+
+void xmit_batch::flush()
+{
+    //
+    // flush_kick() never transmits, so nothing can be deferred behind our
+    // back while we walk the array.
+    //
+    for (unsigned i = 0; i < _nr_deferred; i++) {
+        _deferred[i]->flush_kick();
+    }
+    _nr_deferred = 0;
+}
+
+}
@@ -20,6 +20,12 @@ void clock::register_clock(clock* c)
     _c = c;
 }
 
+void clock::replace_clock(clock* c)
+{
+    assert(_c);
+    _c = c;
+}
+
 clock* clock::get()
 {
     return _c;
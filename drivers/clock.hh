@@ -18,8 +18,10 @@
  *
  * clock::get() returns the single concrete instance of this interface,
  * which may be a kvmclock, xenclock, or hpetclock - depending on which
- * of these the hypervisor provides. This clock instance may then be
- * queried for the current time - for example, clock::get()->time().
+ * of these the hypervisor provides. When the cpu has an invariant TSC,
+ * that clock is wrapped by one reading the TSC directly. This clock
+ * instance may then be queried for the current time - for example,
+ * clock::get()->time().
  *
  * The methods of this class are not type-safe, in that they return times
  * as unadorned integers (s64) whose type does not specify the time units
@@ -31,6 +33,11 @@ class clock {
 public:
     virtual ~clock();
     static void register_clock(clock* c);
+    /**
+     * Replace the registered clock by one built on top of it, like the TSC
+     * clock, which keeps the original as its reference.
+     */
+    static void replace_clock(clock* c);
     /**
      * Get a pointer to the single concrete instance of the clock class.
      *
@@ -99,6 +106,19 @@ public:
      * Not all clocks are required to implement it.
      */
     virtual u64 processor_to_nano(u64 ticks) { return 0; }
+
+    /*
+     * Fetch the host's wall-clock time right away rather than at the next
+     * periodic synchronization, for clocks which do that. A VM paused and
+     * later resumed sees boot_time() move forward by the time it was paused.
+     */
+    virtual void sync() {}
+    /*
+     * Called when the VM runs again after it was snapshotted, possibly on
+     * another host. Besides sync(), clocks derived from the processor's
+     * counter have to recalibrate as its frequency may have changed.
+     */
+    virtual void resume() { sync(); }
 private:
     static clock* _c;
 };
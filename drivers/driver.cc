@@ -8,11 +8,19 @@
 #include "drivers/driver.hh"
 #include <osv/pci.hh>
 #include <osv/debug.hh>
+#include <osv/sched.hh>
+#include <osv/boot.hh>
+#include <map>
+#include <memory>
+#include <string.h>
+#include "processor.hh"
 
 #include "driver.hh"
 
 using namespace pci;
 
+extern boot_time_chart boot_time;
+
 namespace hw {
 
     driver_manager* driver_manager::_instance = nullptr;
@@ -27,23 +35,72 @@ namespace hw {
         unload_all();
     }
 
-    void driver_manager::register_driver(std::function<hw_driver* (hw_device*)> probe)
+    void driver_manager::register_driver(std::function<hw_driver* (hw_device*)> probe,
+                                         unsigned chain)
     {
-        _probes.push_back(probe);
+        _probes.push_back({probe, chain});
     }
 
-    void driver_manager::load_all()
+    std::vector<hw_driver*> driver_manager::probe_chain(unsigned chain,
+        const std::vector<hw_device*>& devices)
     {
-        auto dm = device_manager::instance();
-        dm->for_each_device([this] (hw_device* dev) {
-            for (auto probe : _probes) {
-                if (auto drv = probe(dev)) {
+        std::vector<hw_driver*> drivers;
+
+        for (auto dev : devices) {
+            for (auto& p : _probes) {
+                if (p.chain != chain) {
+                    continue;
+                }
+                auto start = processor::ticks();
+                if (auto drv = p.probe(dev)) {
                     dev->set_attached();
-                    _drivers.push_back(drv);
+                    drivers.push_back(drv);
+                    // The chart keeps the pointer till the end of the boot
+                    boot_time.span(strdup(drv->get_name().c_str()), start);
                     break;
                 }
             }
+        }
+
+        return drivers;
+    }
+
+    void driver_manager::load_all()
+    {
+        std::vector<hw_device*> devices;
+        device_manager::instance()->for_each_device([&devices] (hw_device* dev) {
+            devices.push_back(dev);
         });
+
+        std::map<unsigned, std::vector<hw_driver*>> chain_drivers;
+        for (auto& p : _probes) {
+            chain_drivers[p.chain];
+        }
+
+        std::vector<std::unique_ptr<sched::thread>> workers;
+        for (auto& c : chain_drivers) {
+            if (c.first == probe_chain_serial) {
+                continue;
+            }
+            auto chain = c.first;
+            auto* out = &c.second;
+            workers.emplace_back(sched::thread::make([this, chain, out, &devices] {
+                *out = probe_chain(chain, devices);
+            }, sched::thread::attr().name("probe-" + std::to_string(chain))));
+            workers.back()->start();
+        }
+
+        auto serial = probe_chain(probe_chain_serial, devices);
+
+        for (auto& t : workers) {
+            t->join();
+        }
+
+        // Keep the list in a stable order no matter which chain finished first
+        _drivers.insert(_drivers.end(), serial.begin(), serial.end());
+        for (auto& c : chain_drivers) {
+            _drivers.insert(_drivers.end(), c.second.begin(), c.second.end());
+        }
     }
 
     void driver_manager::unload_all()
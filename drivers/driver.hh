@@ -29,6 +29,17 @@ namespace hw {
         virtual void dump_config() = 0;
     };
 
+    // Probe chains the in-tree drivers are registered on (see
+    // driver_manager::register_driver())
+    enum probe_chain : unsigned {
+        probe_chain_serial = 0,
+        // virtio-blk and virtio-scsi share the vblk numbering
+        probe_chain_virtio_disk,
+        probe_chain_virtio_net,
+        probe_chain_virtio_fs,
+        probe_chain_nvme,
+    };
+
     class driver_manager {
     public:
         driver_manager();
@@ -42,14 +53,28 @@ namespace hw {
             return _instance;
         }
 
-        void register_driver(std::function<hw_driver* (hw_device*)> probe);
+        // Drivers registered on the same probe chain are probed by a single
+        // thread, one device at a time in enumeration order, so they may share
+        // state such as the device numbering. probe_chain_serial runs on the
+        // thread calling load_all(), every other chain on a thread of its own,
+        // concurrently. A driver may only go on a chain of its own if its
+        // probe doesn't touch anything another driver might touch at the same
+        // time, and no two probes may claim the same device.
+        void register_driver(std::function<hw_driver* (hw_device*)> probe,
+                             unsigned chain = probe_chain_serial);
         void load_all();
         void unload_all();
         void list_drivers();
 
     private:
         static driver_manager* _instance;
-        std::vector<std::function<hw_driver* (hw_device*)>> _probes;
+        struct probe_info {
+            std::function<hw_driver* (hw_device*)> probe;
+            unsigned chain;
+        };
+        std::vector<hw_driver*> probe_chain(unsigned chain,
+                                            const std::vector<hw_device*>& devices);
+        std::vector<probe_info> _probes;
         std::vector<hw_driver*> _drivers;
     };
 }
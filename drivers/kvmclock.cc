@@ -27,6 +27,7 @@ public:
     kvmclock();
     virtual u64 processor_to_nano(u64 ticks) override __attribute__((no_instrument_function));
     static bool probe();
+    virtual void sync() override { sync_wall_clock(); }
 protected:
     virtual u64 wall_clock_boot();
     virtual u64 system_time();
@@ -39,6 +39,9 @@
 #include <osv/device.h>
 #include <osv/uio.h>
 #include <osv/debug.hh>
+#include <osv/snapshot.hh>
+#include "drivers/clock.hh"
+#include "processor.hh"
 
 #include <dev/random/randomdev.h>
 #include <dev/random/randomdev_soft.h>
@@ -162,6 +165,16 @@ drng_read(void *buf, int size)
 }
 #endif
 
+// VMs restored from the same snapshot all start with the same generator
+// state. Mix in something telling them apart and reseed, which also pulls
+// in fresh output of the hardware sources, before anything reads again.
+static void reseed_after_resume()
+{
+    u64 stamp[2] = { processor::ticks(), static_cast<u64>(clock::get()->time()) };
+    random_harvest(stamp, sizeof(stamp), 0, RANDOM_CACHED);
+    (*random_adaptor->reseed)();
+}
+
 random_device::random_device()
 {
     struct random_device_priv *prv;
@@ -177,6 +190,7 @@ random_device::random_device()
             "provide high-quality randomness.\n");
     }
     (random_adaptor->init)();
+    osv::snapshot::register_hooks(nullptr, reseed_after_resume);
 
     // Create random
     _random_dev = device_create(&random_device_driver, "random", D_CHR);
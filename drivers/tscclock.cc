@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#include "clock.hh"
+#include "cpuid.hh"
+#include "processor.hh"
+#include <osv/types.h>
+#include <osv/prio.hh>
+#include <osv/sched.hh>
+#include <osv/export.h>
+#include <osv/debug.hh>
+#include <osv/mutex.h>
+#include <atomic>
+#include <time.h>
+
+// A clock reading the TSC directly, used when the cpu advertises an
+// invariant TSC. It is layered on top of the clock registered by the
+// hypervisor driver (kvmclock, hpet, ...), which it keeps using as its
+// reference: until calibration is done every read is forwarded to it, and
+// afterwards a background thread keeps the TSC-derived time slewing
+// towards it, so host adjustments and calibration errors are absorbed
+// without time ever going backwards.
+//
+// Readers compute ns_base + ((tsc - tsc_base) * mult >> 32) from a block
+// of parameters published under a sequence counter, so reading the time
+// costs one rdtsc and a multiplication, and takes no lock. The block is
+// plain global data, which lets the vDSO use it without switching to the
+// kernel's TLS.
+
+namespace {
+
+struct tsc_params {
+    std::atomic<u32> seq;
+    u64 tsc_base;
+    s64 ns_base;
+    // nanoseconds per tick, as a 32.32 fixed point number; 0 until the
+    // TSC is calibrated
+    u64 mult;
+    s64 boot_time;
+};
+
+tsc_params params;
+
+constexpr unsigned shift = 32;
+constexpr s64 ns_per_sec = 1000000000;
+// How often the TSC-derived time is compared to the reference clock
+constexpr auto refresh_interval = std::chrono::seconds(1);
+// Largest correction applied in one interval, in parts per million, small
+// enough to stay invisible to anything timing with the clock
+constexpr s64 max_slew_ppm = 500;
+// Beyond this the two clocks disagree because the guest was paused, not
+// because of drift, and the TSC clock jumps forward to catch up
+constexpr s64 max_lag_ns = 100000000;
+
+inline __attribute__((always_inline, no_instrument_function))
+bool read_params(u64& tsc, s64& ns, s64* boot_time)
+{
+    u32 seq;
+    u64 mult;
+    do {
+        seq = params.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        tsc = processor::rdtsc();
+        mult = params.mult;
+        s64 delta = tsc - params.tsc_base;
+        // The TSC of another cpu may be slightly behind the one which
+        // published the parameters
+        if (delta < 0) {
+            delta = 0;
+        }
+        ns = params.ns_base + (u64)(((unsigned __int128)delta * mult) >> shift);
+        if (boot_time) {
+            *boot_time = params.boot_time;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || params.seq.load(std::memory_order_relaxed) != seq);
+    return mult != 0;
+}
+
+void publish(u64 tsc_base, s64 ns_base, u64 mult, s64 boot_time)
+{
+    auto seq = params.seq.load(std::memory_order_relaxed);
+    params.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    params.tsc_base = tsc_base;
+    params.ns_base = ns_base;
+    params.mult = mult;
+    params.boot_time = boot_time;
+    params.seq.store(seq + 2, std::memory_order_release);
+}
+
+}
+
+class tscclock : public clock {
+public:
+    explicit tscclock(clock* base);
+    static bool probe();
+    virtual s64 uptime() override __attribute__((no_instrument_function));
+    virtual s64 time() override __attribute__((no_instrument_function));
+    virtual s64 boot_time() override __attribute__((no_instrument_function));
+    virtual u64 processor_to_nano(u64 ticks) override __attribute__((no_instrument_function));
+    virtual void sync() override;
+    virtual void resume() override;
+private:
+    bool sample(u64& tsc, s64& ns);
+    void calibrate();
+    void refresh();
+private:
+    clock* _base;
+    u64 _cal_tsc;
+    s64 _cal_ns;
+    // Serializes publish() calls
+    mutex _mutex;
+    std::atomic<bool> _recalibrate = {false};
+    sched::thread* _thread;
+};
+
+tscclock::tscclock(clock* base)
+    : _base(base)
+{
+    _thread = sched::thread::make([this] {
+        // The reference clock only starts moving once all cpus are up,
+        // which is also when this thread first gets to run
+        calibrate();
+        while (true) {
+            sched::timer tmr(*sched::thread::current());
+            tmr.set(refresh_interval);
+            sched::thread::wait_until([&] {
+                return tmr.expired() || _recalibrate.load(std::memory_order_relaxed);
+            });
+            if (_recalibrate.exchange(false)) {
+                calibrate();
+            } else {
+                refresh();
+            }
+        }
+    }, sched::thread::attr().name("tsc_clock_sync"));
+    _thread->start();
+}
+
+bool tscclock::probe()
+{
+    auto& f = processor::features();
+    if (!f.invariant_tsc) {
+        return false;
+    }
+    // kvmclock tells whether the host keeps the TSCs of all vcpus in sync
+    if ((f.kvm_clocksource || f.kvm_clocksource2) && !f.kvm_clocksource_stable) {
+        return false;
+    }
+    // Xen may migrate vcpus between pcpus with unrelated TSCs
+    return !f.xen_clocksource;
+}
+
+// Reads the reference clock together with the TSC. A read which took too
+// long was probably interrupted and is retried, as the TSC would not
+// correspond to the time returned.
+bool tscclock::sample(u64& tsc, s64& ns)
+{
+    for (int i = 0; i < 10; i++) {
+        u64 t0 = processor::rdtsc();
+        s64 n = _base->uptime();
+        u64 t1 = processor::rdtsc();
+        if (t1 - t0 < 20000) {
+            tsc = t0 + (t1 - t0) / 2;
+            ns = n;
+            return true;
+        }
+    }
+    return false;
+}
+
+void tscclock::calibrate()
+{
+    u64 tsc0, tsc1;
+    s64 ns0, ns1;
+    while (!sample(tsc0, ns0) || ns0 == 0) {
+        sched::thread::sleep(std::chrono::milliseconds(10));
+    }
+    sched::thread::sleep(std::chrono::milliseconds(200));
+    while (!sample(tsc1, ns1)) {
+        sched::thread::sleep(std::chrono::milliseconds(10));
+    }
+    _cal_tsc = tsc0;
+    _cal_ns = ns0;
+    u64 mult = ((unsigned __int128)(ns1 - ns0) << shift) / (tsc1 - tsc0);
+    SCOPE_LOCK(_mutex);
+    if (_recalibrate.load()) {
+        // resume() was called meanwhile, so the samples may straddle it
+        return;
+    }
+    publish(tsc1, ns1, mult, _base->boot_time());
+    debugf("tsc clock: %lu kHz\n", (u64)(((unsigned __int128)1000000 << shift) / mult));
+}
+
+void tscclock::refresh()
+{
+    u64 tsc;
+    s64 ref;
+    SCOPE_LOCK(_mutex);
+    if (!params.mult || !sample(tsc, ref)) {
+        return;
+    }
+    // Current time according to the published parameters, which is where
+    // the new ones have to start from for the clock to stay continuous
+    s64 ns = params.ns_base +
+        (u64)(((unsigned __int128)(tsc - params.tsc_base) * params.mult) >> shift);
+    // The rate measured since calibration gets more accurate as the
+    // interval grows
+    u64 mult = ((unsigned __int128)(ref - _cal_ns) << shift) / (tsc - _cal_tsc);
+    s64 err = ref - ns;
+    if (err > max_lag_ns) {
+        ns = ref;
+        err = 0;
+    }
+    // Catch up with the error over the next interval, but never faster
+    // than max_slew_ppm
+    s64 interval = std::chrono::duration_cast<std::chrono::nanoseconds>(refresh_interval).count();
+    s64 max_err = interval / 1000000 * max_slew_ppm;
+    err = std::max(-max_err, std::min(err, max_err));
+    mult = (unsigned __int128)mult * (interval + err) / interval;
+    publish(tsc, ns, mult, _base->boot_time());
+}
+
+void tscclock::sync()
+{
+    SCOPE_LOCK(_mutex);
+    _base->sync();
+    if (params.mult) {
+        publish(params.tsc_base, params.ns_base, params.mult, _base->boot_time());
+    }
+}
+
+// The VM may now run on a host whose TSC ticks at another rate, so go back
+// to reading the reference clock until the TSC is calibrated again. Time
+// read from the TSC may have been slightly ahead of it, by at most what the
+// slewing had not absorbed yet.
+void tscclock::resume()
+{
+    WITH_LOCK(_mutex) {
+        _base->resume();
+        publish(0, 0, 0, 0);
+        _recalibrate.store(true);
+    }
+    _thread->wake();
+}
+
+s64 tscclock::uptime()
+{
+    u64 tsc;
+    s64 ns;
+    if (read_params(tsc, ns, nullptr)) {
+        return ns;
+    }
+    return _base->uptime();
+}
+
+s64 tscclock::time()
+{
+    u64 tsc;
+    s64 ns, boot;
+    if (read_params(tsc, ns, &boot)) {
+        return boot + ns;
+    }
+    return _base->time();
+}
+
+s64 tscclock::boot_time()
+{
+    u64 tsc;
+    s64 ns, boot;
+    if (read_params(tsc, ns, &boot)) {
+        return boot;
+    }
+    return _base->boot_time();
+}
+
+u64 tscclock::processor_to_nano(u64 ticks)
+{
+    u64 mult = params.mult;
+    if (mult) {
+        return ((unsigned __int128)ticks * mult) >> shift;
+    }
+    return _base->processor_to_nano(ticks);
+}
+
+// Used by the vDSO, so it must not touch the kernel's TLS. Returns -1 when
+// the TSC clock is not in use, or for clocks it does not handle, in which
+// case the caller falls back to clock_gettime().
+extern "C" OSV_MODULE_API __attribute__((no_instrument_function))
+int tsc_clock_gettime(clockid_t clk_id, struct timespec* ts)
+{
+    u64 tsc;
+    s64 ns, boot;
+    switch (clk_id) {
+    case CLOCK_BOOTTIME:
+    case CLOCK_MONOTONIC:
+    case CLOCK_MONOTONIC_COARSE:
+    case CLOCK_MONOTONIC_RAW:
+        if (!read_params(tsc, ns, nullptr)) {
+            return -1;
+        }
+        break;
+    case CLOCK_REALTIME:
+    case CLOCK_REALTIME_COARSE:
+        if (!read_params(tsc, ns, &boot)) {
+            return -1;
+        }
+        ns += boot;
+        break;
+    default:
+        return -1;
+    }
+    ts->tv_sec = ns / ns_per_sec;
+    ts->tv_nsec = ns % ns_per_sec;
+    return 0;
+}
+
+static __attribute__((constructor(init_prio::tsc_clock))) void setup_tscclock()
+{
+    auto base = clock::get();
+    if (base && tscclock::probe()) {
+        clock::replace_clock(new tscclock(base));
+    }
+}
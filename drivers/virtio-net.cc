@@ -159,10 +159,42 @@ inline void net::txq::kick_pending(u16 thresh)
 {
     if (_pkts_to_kick >= thresh) {
         _pkts_to_kick = 0;
+        _pkts_deferred = 0;
         stats.tx_worker_kicks += !!kick_hw();
     }
 }
 
+bool net::txq::defer_kick()
+{
+    if (_pkts_deferred < _batch_thresh && osv::xmit_batch::defer_kick(this)) {
+        _pkts_deferred++;
+        _pkts_to_kick++;
+        stats.tx_kicks_avoided++;
+        return true;
+    }
+
+    // The caller is going to kick, which covers everything deferred so far
+    _pkts_deferred = 0;
+    _pkts_to_kick = 0;
+    return false;
+}
+
+void net::txq::kick_deferred_locked()
+{
+    //
+    // The dispatcher (or a full batch) may have kicked for these packets
+    // already.
+    //
+    if (!_pkts_deferred) {
+        return;
+    }
+
+    stats.tx_batch_kicks += !!kick_hw();
+    stats.tx_batch_packets += _pkts_deferred;
+    _pkts_deferred = 0;
+    _pkts_to_kick = 0;
+}
+
 static void if_init(void* xsc)
 {
     net_d("Virtio-net init");
@@ -212,6 +244,9 @@ void net::fill_qstats(const struct txq& txq, struct if_data* out_data) const
     out_data->ifi_oworker_packets = txq.stats.tx_worker_packets;
     out_data->ifi_okicks          = txq.stats.tx_kicks;
     out_data->ifi_oqueue_is_full  = txq.stats.tx_hw_queue_is_full;
+    out_data->ifi_okicks_avoided  = txq.stats.tx_kicks_avoided;
+    out_data->ifi_obatch_kicks    = txq.stats.tx_batch_kicks;
+    out_data->ifi_obatch_packets  = txq.stats.tx_batch_packets;
     out_data->ifi_owakeup_stats   = txq.stats.tx_wakeup_stats;
 }
 
@@ -279,6 +314,12 @@ net::net(virtio_device& dev)
     _ifn->if_getinfo = if_getinfo;
     IFQ_SET_MAXLEN(&_ifn->if_snd, _txq.vqueue->size());
 
+    //
+    // Once the Tx ring runs low let a multi-fragment (e.g. TSO) packet take a
+    // single slot so that a batch of packets doesn't stall on ring space.
+    //
+    _txq.vqueue->set_use_indirect(true);
+
     _ifn->if_capabilities = 0;
 
     if (_csum) {
@@ -485,6 +526,13 @@ void net::receiver()
         // truncating it.
         net_hdr_mrg_rxbuf* mhdr;
 
+        //
+        // Whatever the stack sends in response to this bunch of packets
+        // (ACKs, mostly, possibly for many sockets) goes out with a single
+        // Tx kick when we are done with it.
+        //
+        osv::xmit_batch tx_batch;
+
         while (void* buffer = vq->get_buf_elem(&len)) {
 
             vq->get_buf_finalize();
@@ -14,6 +14,7 @@
 #include <bsd/sys/sys/mbuf.h>
 
 #include <osv/percpu_xmit.hh>
+#include <osv/xmit_batch.hh>
 #include <osv/contiguous_alloc.hh>
 
 #include "drivers/virtio.hh"
@@ -303,6 +304,9 @@ private:
         u64 tx_worker_wakeups;
         u64 tx_worker_packets;
         u64 tx_hw_queue_is_full;
+        u64 tx_kicks_avoided;  /* packets posted without their own kick */
+        u64 tx_batch_kicks;    /* kicks issued at the end of an xmit_batch */
+        u64 tx_batch_packets;  /* packets covered by those kicks */
 
         wakeup_stats tx_wakeup_stats;
     };
@@ -333,12 +337,13 @@ private:
      *
      *  TODO: Make it a class!
      */
-    struct txq {
+    struct txq : public osv::xmit_batch::flusher {
         friend osv::xmitter_functor<txq>;
 
         txq(net* parent, vring* vq) :
             vqueue(vq), _parent(parent), _xmit_it(this),
             _kick_thresh(vqueue->size()),
+            _batch_thresh(std::min(_kick_thresh, 64)),
             _xmitter(this,
                      // TODO: implement a proper StopPred when we fix a SP code
                      [] { return false; },
@@ -397,6 +402,28 @@ private:
          */
         bool kick_hw();
 
+        /**
+         * Called by the xmitter after a packet has been posted without the
+         * kick: leave the kick to the end of the current osv::xmit_batch if
+         * there is one.
+         *
+         * Must run with "running" lock taken.
+         *
+         * @return TRUE if the kick has been deferred, FALSE if the caller
+         *         has to kick now.
+         */
+        bool defer_kick();
+
+        /**
+         * Kick the vqueue on behalf of the deferred packets, if any.
+         *
+         * Must run with "running" lock taken.
+         */
+        void kick_deferred_locked();
+
+        // osv::xmit_batch::flusher
+        virtual void flush_kick() override { _xmitter.kick_deferred(); }
+
         int xmit(mbuf* m_head);
 
         void update_wakeup_stats(const u64 wakeup_packets) {
@@ -460,7 +487,13 @@ private:
         net* _parent;
         osv::tx_xmit_iterator<txq> _xmit_it;
         const int _kick_thresh;
+        //
+        // Don't let an xmit_batch hold back more than that many packets so
+        // that a long batch doesn't delay the first of them for too long.
+        //
+        const int _batch_thresh;
         u16 _pkts_to_kick = 0;
+        u16 _pkts_deferred = 0;
         //
         // 4096 is the size of the buffers ring of the FreeBSD virtio-net
         // driver. So, we are using this as a baseline. We may ajust this value
@@ -168,6 +168,8 @@ public:
     void kick_pending();
     void kick_pending_with_thresh();
     bool kick_hw();
+    // Tx kicks are not batched across callers on vmxnet3 (see osv::xmit_batch)
+    bool defer_kick() { return false; }
     int xmit_prep(mbuf* m_head, void*& cooky);
     int try_xmit_one_locked(void* cooky);
     void xmit_one_locked(void *req);
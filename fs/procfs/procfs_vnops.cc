@@ -19,9 +19,13 @@
 #include <libgen.h>
 #include <osv/mempool.hh>
 #include <osv/printf.hh>
+#include <osv/lockstat.hh>
+#include <osv/psi.hh>
 
 #include <sys/resource.h>
 #include <mntent.h>
+#include <unordered_map>
+#include <vector>
 
 #include "cpuid.hh"
 
@@ -33,18 +37,17 @@ using namespace pseudofs;
 static mutex_t procfs_mutex;
 static uint64_t inode_count = 1; /* inode 0 is reserved to root */
 
-static std::string procfs_stats()
+// Formats a line of /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat
+static std::string format_stat(int pid, const char* comm, char state,
+                               unsigned long utime, int cpu)
 {
-    int pid = 0, ppid = 0, pgrp = 0, session = 0, tty = 0, tpgid = -1,
+    int ppid = 0, pgrp = 0, session = 0, tty = 0, tpgid = -1,
         flags = 0;
     // Postpone this one. We need to hook into ZFS statistics to properly figure
     // out which faults are maj, which are min.
     int min_flt = 0, cmin_flt = 0, maj_flt = 0, cmaj_flt = 0;
     unsigned long stime = 0, cutime = 0, cstime = 0;
 
-    using namespace std::chrono;
-    unsigned long utime = duration_cast<microseconds>(sched::osv_run_stats()).count();
-    char state = 'R';
     int priority = getpriority(PRIO_PROCESS, 0);
     int nice = priority;
     int nlwp = sched::thread::numthreads();
@@ -66,7 +69,6 @@ static std::string procfs_stats()
     unsigned long nextalarm = 0;
     // Except for this. This is maintained, but we also don't deliver any signal
     unsigned long exit_signal = 0;
-    int cpu = sched::cpu::current()->id;
     int wchan = 0, rt_priority = 0, policy = 0; // SCHED_OTHER = 0
     int zero = 0;
 
@@ -81,7 +83,7 @@ static std::string procfs_stats()
                         "%lu %lx %lu %lu "
                         "%d %d %d "
                         "%lu %d %d %d",
-                        pid, program_invocation_short_name, state,
+                        pid, comm, state,
                         ppid, pgrp, session, tty, tpgid,
                         flags, min_flt, cmin_flt, maj_flt, cmaj_flt,
                         utime, stime, cutime, cstime,
@@ -94,6 +96,149 @@ static std::string procfs_stats()
                         exit_signal, cpu, rt_priority, policy);
 }
 
+static std::string procfs_stats()
+{
+    using namespace std::chrono;
+    unsigned long utime = duration_cast<microseconds>(sched::osv_run_stats()).count();
+    return format_stat(0, program_invocation_short_name, 'R', utime,
+                       sched::cpu::current()->id);
+}
+
+static char thread_state(sched::thread& t)
+{
+    using status = sched::thread::status;
+    switch (t.get_status()) {
+    case status::running:
+    case status::queued:
+    case status::waking:
+        return 'R';
+    case status::terminating:
+    case status::terminated:
+        return 'X';
+    default:
+        return 'S';
+    }
+}
+
+// Times are in microseconds, as sysconf(_SC_CLK_TCK) reports
+static std::string procfs_thread_stat(unsigned id)
+{
+    std::string ret;
+    sched::with_thread_by_id(id, [&] (sched::thread* t) {
+        if (t) {
+            using namespace std::chrono;
+            unsigned long utime = duration_cast<microseconds>(t->thread_clock()).count();
+            ret = format_stat(id, t->name().c_str(), thread_state(*t), utime,
+                              t->tcpu() ? t->tcpu()->id : 0);
+        }
+    });
+    return ret;
+}
+
+// The time spent running and waiting in the runqueue in nanoseconds, and the
+// number of times switched in, as in Linux. A fourth field, which Linux does
+// not have, is the time spent sleeping in nanoseconds. Like Linux's
+// sched_schedstats, the runqueue and sleep times are only accounted once
+// enabled, which the first read does.
+static std::string procfs_thread_schedstat(unsigned id)
+{
+    sched::enable_schedstat();
+    std::string ret;
+    sched::with_thread_by_id(id, [&] (sched::thread* t) {
+        if (t) {
+            using namespace std::chrono;
+            ret = osv::sprintf("%lu %lu %lu %lu\n",
+                               (unsigned long)duration_cast<nanoseconds>(t->thread_clock()).count(),
+                               t->stat_runq_ns.get(), t->stat_switches.get(),
+                               t->stat_sleep_ns.get());
+        }
+    });
+    return ret;
+}
+
+// /proc/self/task, with a directory for each live thread. Directories of
+// threads that are gone are no longer listed or found, and are freed once
+// no vnode refers to them.
+class task_dir_node : public pseudo_dir_node {
+public:
+    explicit task_dir_node(uint64_t ino) : pseudo_dir_node(ino) {}
+
+    virtual void refresh() override {
+        std::vector<unsigned> ids;
+        sched::with_all_threads([&] (sched::thread& t) {
+            ids.push_back(t.id());
+        });
+        _children.clear();
+        for (auto id : ids) {
+            auto& node = _threads[id];
+            if (!node) {
+                node = make_thread_dir(id);
+            }
+            _children.insert({std::to_string(id), node});
+        }
+        // What is left only here is the directory of a thread which is gone
+        for (auto i = _threads.begin(); i != _threads.end();) {
+            if (i->second.use_count() == 1) {
+                i = _threads.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+private:
+    // Thread directories and files get inodes above those of static nodes
+    static constexpr uint64_t thread_ino_base = 1ull << 32;
+
+    static shared_ptr<pseudo_node> make_thread_dir(unsigned id) {
+        uint64_t ino = thread_ino_base + uint64_t(id) * 4;
+        auto dir = make_shared<pseudo_dir_node>(ino);
+        dir->add("stat", ino + 1, [id] { return procfs_thread_stat(id); });
+        dir->add("schedstat", ino + 2, [id] { return procfs_thread_schedstat(id); });
+        return dir;
+    }
+
+    std::unordered_map<unsigned, shared_ptr<pseudo_node>> _threads;
+};
+
+// Free memory comes from the page allocator, and memory sitting in the
+// per-cpu and global page pools is reclaimable at no cost. There is no page
+// cache accounted separately, nor swap.
+static std::string procfs_meminfo()
+{
+    size_t pooled = 0;
+    memory::stats::pool_stats ps;
+    memory::stats::get_global_l2_stats(ps);
+    pooled += ps._nr;
+    for (auto c : sched::cpus) {
+        memory::stats::get_l1_stats(c->id, ps);
+        pooled += ps._nr;
+    }
+    memory::stats::fragmentation_stats fs;
+    memory::stats::get_fragmentation_stats(fs);
+
+    auto total = memory::stats::total() >> 10;
+    auto free = memory::stats::free() >> 10;
+    auto available = free + ((pooled * memory::page_size) >> 10);
+    return osv::sprintf("MemTotal:       %8lu kB\n"
+                        "MemFree:        %8lu kB\n"
+                        "MemAvailable:   %8lu kB\n"
+                        "Buffers:        %8lu kB\n"
+                        "Cached:         %8lu kB\n"
+                        "SwapCached:     %8lu kB\n"
+                        "SwapTotal:      %8lu kB\n"
+                        "SwapFree:       %8lu kB\n"
+                        "HugePages_Total:   %5lu\n"
+                        "HugePages_Free:    %5lu\n"
+                        "HugePages_Rsvd:    %5lu\n"
+                        "HugePages_Surp:    %5lu\n"
+                        "Hugepagesize:   %8lu kB\n",
+                        total, free, available, 0ul, 0ul, 0ul, 0ul, 0ul,
+                        fs.huge_reserved / mmu::huge_page_size,
+                        fs.huge_reserve_free / mmu::huge_page_size, 0ul, 0ul,
+                        mmu::huge_page_size >> 10);
+}
+
 static std::string procfs_status()
 {
     // The /proc/self/status in Linux contains most of the same
@@ -163,6 +308,7 @@ procfs_mount(mount* mp, const char *dev, int flags, const void* data)
 
     auto exe = make_shared<pseudo_symlink_node>(inode_count++, procfs_exe);
     self->add("exe", exe);
+    self->add("task", make_shared<task_dir_node>(inode_count++));
 
     auto kernel = make_shared<pseudo_dir_node>(inode_count++);
     kernel->add("hostname", inode_count++, procfs_hostname);
@@ -176,8 +322,15 @@ procfs_mount(mount* mp, const char *dev, int flags, const void* data)
     root->add("mounts", inode_count++, procfs_mounts);
     root->add("sys", sys);
 
+    auto pressure = make_shared<pseudo_dir_node>(inode_count++);
+    pressure->add("cpu", inode_count++, [] { return psi::procfs_pressure(psi::resource::cpu); });
+    pressure->add("memory", inode_count++, [] { return psi::procfs_pressure(psi::resource::memory); });
+    pressure->add("io", inode_count++, [] { return psi::procfs_pressure(psi::resource::io); });
+    root->add("pressure", pressure);
+
     root->add("cpuinfo", inode_count++, [] { return processor::features_str(); });
-    root->add("meminfo", inode_count++, [] { return pseudofs::meminfo("MemTotal:\t%ld kB\nMemFree: \t%ld kB\n"); });
+    root->add("meminfo", inode_count++, procfs_meminfo);
+    root->add("lockstat", inode_count++, lockstat::procfs_lockstat);
 
     vp->v_data = static_cast<void*>(root);
 
@@ -200,6 +353,18 @@ procfs_readdir(vnode *vp, file *fp, dirent *dir) {
     return pseudofs::readdir(vp, fp, dir);
 }
 
+static int
+procfs_lookup(vnode *dvp, char *name, vnode **vpp) {
+    std::lock_guard <mutex_t> lock(procfs::procfs_mutex);
+    return pseudofs::lookup(dvp, name, vpp);
+}
+
+static int
+procfs_inactive(vnode *vp) {
+    std::lock_guard <mutex_t> lock(procfs::procfs_mutex);
+    return pseudofs::inactive(vp);
+}
+
 int procfs_init(void)
 {
     return 0;
@@ -214,7 +379,7 @@ vnops procfs_vnops = {
     pseudofs::ioctl,              // vop_ioctl
     (vnop_fsync_t)    vop_nullop, // vop_fsync
     procfs_readdir,               // vop_readdir
-    pseudofs::lookup,             // vop_lookup
+    procfs_lookup,                // vop_lookup
     (vnop_create_t)   vop_einval, // vop_create
     (vnop_remove_t)   vop_einval, // vop_remove
     (vnop_rename_t)   vop_einval, // vop_remame
@@ -222,7 +387,7 @@ vnops procfs_vnops = {
     (vnop_rmdir_t)    vop_einval, // vop_rmdir
     pseudofs::getattr,            // vop_getattr
     (vnop_setattr_t)  vop_eperm,  // vop_setattr
-    (vnop_inactive_t) vop_nullop, // vop_inactive
+    procfs_inactive,              // vop_inactive
     (vnop_truncate_t) vop_nullop, // vop_truncate
     (vnop_link_t)     vop_eperm,  // vop_link
     (vnop_cache_t)     nullptr,   // vop_arc
@@ -100,6 +100,7 @@ int lookup(vnode *dvp, char *name, vnode **vpp) {
     if (!*name || !parent) {
         return ENOENT;
     }
+    parent->refresh();
     auto node = parent->lookup(name);
     if (!node) {
         return ENOENT;
@@ -114,6 +115,7 @@ int lookup(vnode *dvp, char *name, vnode **vpp) {
         return ENOMEM;
     }
     vp->v_data = node.get();
+    node->hold_for_vnode(node);
     vp->v_type = node->type();
     vp->v_mode = node->mode();
     vp->v_size = node->size();
@@ -123,10 +125,20 @@ int lookup(vnode *dvp, char *name, vnode **vpp) {
     return 0;
 }
 
+int inactive(vnode *vp) {
+    auto *np = to_node(vp);
+    if (np) {
+        // May free the node
+        np->release_for_vnode();
+    }
+    return 0;
+}
+
 int readdir(vnode *vp, file *fp, dirent *dir) {
     pseudo_dir_node *dnp;
 
     if (fp->f_offset == 0) {
+        to_dir_node(vp)->refresh();
         dir->d_type = DT_DIR;
         if (vfs_dname_copy((char *) &dir->d_name, ".", sizeof(dir->d_name))) {
             return EINVAL;
@@ -10,6 +10,7 @@
 
 #include <osv/dentry.h>
 #include <osv/vnode.h>
+#include <osv/mutex.h>
 
 #include <functional>
 #include <memory>
@@ -36,9 +37,33 @@ public:
 
     virtual mode_t mode() const = 0;
 
+    // Each vnode referring to the node keeps it allocated, even once its
+    // directory has dropped it; see lookup() and inactive(). There may be
+    // more than one: vput() unhashes a vnode before calling VOP_INACTIVE, so
+    // a lookup in between creates another.
+    void hold_for_vnode(shared_ptr<pseudo_node> self) {
+        WITH_LOCK(_vnode_mtx) {
+            if (_vnodes++ == 0) {
+                _vnode_ref = move(self);
+            }
+        }
+    }
+    void release_for_vnode() {
+        shared_ptr<pseudo_node> last;
+        WITH_LOCK(_vnode_mtx) {
+            if (--_vnodes == 0) {
+                last = move(_vnode_ref);
+            }
+        }
+        // Dropping last may free the node, so only now that it is unlocked
+    }
+
 private:
     uint64_t _ino;
     int _type;
+    mutex_t _vnode_mtx;
+    unsigned _vnodes = 0;
+    shared_ptr<pseudo_node> _vnode_ref;
 };
 
 class pseudo_file_node : public pseudo_node {
@@ -87,6 +112,11 @@ class pseudo_dir_node : public pseudo_node {
 public:
     pseudo_dir_node(uint64_t ino) : pseudo_node(ino, VDIR) {}
 
+    // Called before children are looked up or listed, so directories whose
+    // contents change can update them. Vnodes hold a reference to the nodes
+    // they refer to, so a directory is free to drop its children.
+    virtual void refresh() {}
+
     shared_ptr <pseudo_node> lookup(string name) {
         auto it = _children.find(name);
         if (it == _children.end()) {
@@ -123,7 +153,7 @@ public:
         return S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
     }
 
-private:
+protected:
     pseudo_node::nmap _children;
 };
 
@@ -141,6 +171,8 @@ int ioctl(vnode *vp, file *fp, u_long cmd, void *arg);
 
 int lookup(vnode *dvp, char *name, vnode **vpp);
 
+int inactive(vnode *vp);
+
 int readdir(vnode *vp, file *fp, dirent *dir);
 
 int getattr(vnode *vp, vattr *attr);
@@ -31,7 +31,10 @@
 #define _RAMFS_H
 
 #include <osv/prex.h>
-#include <map>
+#include <string_view>
+#include <unordered_map>
+
+#include "ramfs_radix.hh"
 
 /* #define DEBUG_RAMFS 1 */
 
@@ -43,42 +46,48 @@
 
 #define ASSERT(e)    assert(e)
 
-struct ramfs_file_segment {
-    size_t size;
-    char *data;
-};
-
 /*
  * File/directory node for RAMFS
  */
 struct ramfs_node {
     struct ramfs_node *rn_next;   /* next node in the same directory */
+    struct ramfs_node *rn_prev;   /* previous node in the same directory */
     struct ramfs_node *rn_child;  /* first child node */
+    struct ramfs_node *rn_last_child;  /* last child node */
     int rn_type;    /* file or directory */
     char *rn_name;    /* name (null-terminated) */
     size_t rn_namelen;    /* length of name not including terminator */
     size_t rn_size;    /* file size */
     uint64_t inode_no;
+    dev_t rn_fsid;    /* id of the mount the node belongs to */
+
+    /* Children of a directory keyed by name, the rn_child list above keeps
+     * the creation order readdir() walks in. rn_readdir_node caches the
+     * child returned for rn_readdir_pos so that a sequential readdir() does
+     * not rescan the list from the start on every call. */
+    std::unordered_map<std::string_view, struct ramfs_node *> *rn_children;
+    struct ramfs_node *rn_readdir_node;
+    off_t rn_readdir_pos;
 
-    /* Holds data for both symlinks and regular files.
-     * Each ramfs_file_segment holds single chunk of file and is keyed
-     * in the map by its offset in that file; the first entry will have a key 0
-     * and hold the very first chunk of the file. This way as file grows
-     * we do not need to free old and allocate new memory buffer, instead
-     * we only allocate new file segment for new chunk of the file and add
-     * it to the map */
-    std::map<off_t,struct ramfs_file_segment> *rn_file_segments_by_offset;
-    /* Sum of sizes of all segments - typically bigger than actual file size
-     * We could have iterated over all entries in the map to calculate it
-     * but it is faster to cache it as a field */
-    size_t rn_total_segments_size;
+    /* Regular file data is kept in page-aligned extents: 4K pages indexed
+     * by page number in rn_pages and 2MB huge pages indexed by huge page
+     * number in rn_huge_pages. A range present in neither index is a hole
+     * and reads back as zeroes. See ramfs_data.cc for the allocation
+     * policy. */
+    ramfs_radix rn_pages;
+    ramfs_radix rn_huge_pages;
+
+    /* Symlink target, or the data of a file loaded from bootfs which is
+     * used in place until the file is first modified. rn_owns_buf tells
+     * whether rn_buf has to be freed along with the node. */
+    char *rn_buf;
+    bool rn_owns_buf;
 
     struct timespec rn_ctime;
     struct timespec rn_atime;
     struct timespec rn_mtime;
 
     int rn_mode;
-    bool rn_owns_buf;
     int rn_ref_count;
     bool rn_removed;
 };
@@ -87,4 +96,10 @@ struct ramfs_node *ramfs_allocate_node(const char *name, int type);
 
 void ramfs_free_node(struct ramfs_node *node);
 
+int ramfs_data_read(struct ramfs_node *np, struct uio *uio, size_t len);
+int ramfs_data_write(struct ramfs_node *np, struct uio *uio);
+int ramfs_data_truncate(struct ramfs_node *np, off_t length);
+void ramfs_data_free(struct ramfs_node *np);
+void *ramfs_data_cache_page(struct ramfs_node *np, off_t offset, bool *owned);
+
 #endif /* !_RAMFS_H */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// File data management for ramfs.
+//
+// A file is a set of page-aligned extents indexed by file offset: 4K pages
+// in rn_pages and 2MB huge pages in rn_huge_pages (see ramfs.h). Ranges
+// with no extent are holes and read back as zeroes, so ftruncate() to grow
+// a file and writes past EOF cost no memory for the gap.
+//
+// Because every 4K block of a file lives in its own page-aligned memory,
+// mmap() lends those pages to the page cache read path directly instead of
+// copying them (see ramfs_map_cached_page()).
+//
+// Invariant: bytes of an extent past rn_size are always zero. New extents
+// are zeroed where the write does not cover them and truncation clears the
+// tail of the extent it cuts through, so growing a file never exposes stale
+// data.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <osv/align.hh>
+#include <osv/mmu.hh>
+#include <osv/pagealloc.hh>
+#include <osv/pagecache.hh>
+#include <osv/uio.h>
+#include <osv/vnode.h>
+
+#include "ramfs.h"
+
+static constexpr size_t page_size = mmu::page_size;
+static constexpr size_t huge_page_size = mmu::huge_page_size;
+static constexpr uint64_t pages_per_huge_page = huge_page_size / page_size;
+
+static char zero_page[page_size] __attribute__((aligned(page_size)));
+
+// Returns the memory backing file offset @off and sets @avail to the number
+// of bytes that are contiguous from there. A null return means @off is in a
+// hole that extends at least @avail bytes.
+static char *
+extent_at(struct ramfs_node *np, off_t off, size_t *avail)
+{
+    auto huge = static_cast<char *>(np->rn_huge_pages.lookup(off / huge_page_size));
+    if (huge) {
+        auto in_huge = off % huge_page_size;
+        *avail = huge_page_size - in_huge;
+        return huge + in_huge;
+    }
+    auto in_page = off % page_size;
+    *avail = page_size - in_page;
+    auto page = static_cast<char *>(np->rn_pages.lookup(off / page_size));
+    return page ? page + in_page : nullptr;
+}
+
+// Like extent_at() but fills a hole at @off with a new extent. @fill is how
+// many bytes from @off the caller is about to write.
+//
+// A huge page is used when @appending - a write that starts at or before EOF
+// and so extends the file without leaving a gap - reaches a new 2MB aligned
+// region past the first one, which is how a file being written sequentially
+// grows. The head of every file, writes into holes and writes that start
+// past EOF get 4K pages, so small and sparse files never pin 2MB each. When
+// no huge page is available we quietly fall back to 4K pages.
+static char *
+extent_alloc(struct ramfs_node *np, off_t off, bool appending, size_t fill,
+             size_t *avail)
+{
+    auto p = extent_at(np, off, avail);
+    if (p) {
+        return p;
+    }
+
+    uint64_t huge_index = off / huge_page_size;
+    uint64_t first_page = huge_index * pages_per_huge_page;
+    if (appending && huge_index > 0 && off % huge_page_size == 0 &&
+        np->rn_pages.empty_range(first_page, first_page + pages_per_huge_page)) {
+        auto huge = static_cast<char *>(memory::alloc_huge_page(huge_page_size));
+        if (huge) {
+            if (np->rn_huge_pages.insert(huge_index, huge)) {
+                fill = std::min(fill, huge_page_size);
+                memset(huge + fill, 0, huge_page_size - fill);
+                *avail = huge_page_size;
+                return huge;
+            }
+            memory::free_huge_page(huge, huge_page_size);
+        }
+    }
+
+    auto page = static_cast<char *>(memory::alloc_page());
+    if (!page) {
+        return nullptr;
+    }
+    if (!np->rn_pages.insert(off / page_size, page)) {
+        memory::free_page(page);
+        return nullptr;
+    }
+    memset(page, 0, page_size);
+    return page + off % page_size;
+}
+
+static void
+free_extents(struct ramfs_node *np, off_t from, off_t to)
+{
+    if (np->rn_pages.empty() && np->rn_huge_pages.empty()) {
+        return;
+    }
+    uint64_t first_page = align_up(from, (off_t)page_size) / page_size;
+    pagecache::invalidate_read_cache(np->rn_fsid, np->inode_no,
+                                     first_page * page_size, align_up(to, (off_t)page_size));
+    np->rn_pages.erase_range(first_page, ramfs_radix::max_index,
+        [] (uint64_t, void *page) {
+            memory::free_page(page);
+        });
+    np->rn_huge_pages.erase_range(align_up(first_page, pages_per_huge_page) / pages_per_huge_page,
+                                  ramfs_radix::max_index,
+        [] (uint64_t, void *huge) {
+            memory::free_huge_page(huge, huge_page_size);
+        });
+}
+
+// Moves the data of a file still backed by its bootfs image into extents,
+// ahead of the first modification.
+static int
+ramfs_data_own(struct ramfs_node *np)
+{
+    if (!np->rn_buf || np->rn_type != VREG) {
+        return 0;
+    }
+    for (off_t off = 0; off < (off_t)np->rn_size;) {
+        size_t avail;
+        auto left = np->rn_size - off;
+        auto p = extent_alloc(np, off, true, left, &avail);
+        if (!p) {
+            free_extents(np, 0, off);
+            return ENOSPC;
+        }
+        auto len = std::min(avail, left);
+        memcpy(p, np->rn_buf + off, len);
+        off += len;
+    }
+    // Pages handed to the page cache so far were copies of rn_buf, they
+    // would go stale once the file gets written to.
+    pagecache::invalidate_read_cache(np->rn_fsid, np->inode_no,
+                                     0, align_up(np->rn_size, page_size));
+    if (np->rn_owns_buf) {
+        free(np->rn_buf);
+    }
+    np->rn_buf = nullptr;
+    np->rn_owns_buf = false;
+    return 0;
+}
+
+int
+ramfs_data_read(struct ramfs_node *np, struct uio *uio, size_t len)
+{
+    if (np->rn_buf) {
+        return uiomove(np->rn_buf + uio->uio_offset, len, uio);
+    }
+    while (len > 0) {
+        size_t avail;
+        auto p = extent_at(np, uio->uio_offset, &avail);
+        auto n = std::min(avail, len);
+        int error = uiomove(p ? p : zero_page, n, uio);
+        if (error) {
+            return error;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+int
+ramfs_data_write(struct ramfs_node *np, struct uio *uio)
+{
+    int error = ramfs_data_own(np);
+    if (error) {
+        return error;
+    }
+    off_t old_size = np->rn_size;
+    bool sequential = uio->uio_offset <= old_size;
+    while (uio->uio_resid > 0) {
+        size_t avail;
+        auto p = extent_alloc(np, uio->uio_offset,
+                              sequential && uio->uio_offset >= old_size,
+                              uio->uio_resid, &avail);
+        if (!p) {
+            return ENOSPC;
+        }
+        error = uiomove(p, std::min<size_t>(avail, uio->uio_resid), uio);
+        if (error) {
+            return error;
+        }
+    }
+    return 0;
+}
+
+int
+ramfs_data_truncate(struct ramfs_node *np, off_t length)
+{
+    int error = ramfs_data_own(np);
+    if (error) {
+        return error;
+    }
+    off_t old_size = np->rn_size;
+    if (length < old_size) {
+        size_t avail;
+        auto p = extent_at(np, length, &avail);
+        if (p) {
+            memset(p, 0, std::min<size_t>(avail, old_size - length));
+        }
+        free_extents(np, length, old_size);
+    }
+    return 0;
+}
+
+void
+ramfs_data_free(struct ramfs_node *np)
+{
+    if (np->rn_owns_buf) {
+        free(np->rn_buf);
+    }
+    np->rn_buf = nullptr;
+    np->rn_owns_buf = false;
+    free_extents(np, 0, np->rn_size);
+}
+
+// Returns the page backing the page-aligned file offset @offset for the
+// page cache. The page belongs to the file unless *owned is set, in which
+// case it is a private copy the page cache has to free. A null return
+// means the offset is in a hole and the zero page should be mapped.
+void *
+ramfs_data_cache_page(struct ramfs_node *np, off_t offset, bool *owned)
+{
+    if (np->rn_buf) {
+        // A bootfs image is not page aligned, so hand out a copy
+        auto page = static_cast<char *>(memory::alloc_page());
+        if (page) {
+            auto len = std::min<size_t>(page_size, np->rn_size - offset);
+            memcpy(page, np->rn_buf + offset, len);
+            memset(page + len, 0, page_size - len);
+        }
+        *owned = true;
+        return page;
+    }
+    size_t avail;
+    *owned = false;
+    return extent_at(np, offset, &avail);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef _RAMFS_RADIX_HH
+#define _RAMFS_RADIX_HH
+
+#include <cstdint>
+#include <new>
+#include <assert.h>
+
+// A small radix tree mapping a 64-bit index (a page or huge page number
+// within a file) to an opaque leaf pointer. Each level resolves 6 bits of
+// the index, so a 4K-page index of a 1TB file needs 5 levels. The tree
+// grows in height on demand and interior nodes are freed as soon as they
+// become empty, so a sparse file only pays for the populated ranges.
+//
+// The tree does not own its leaves; callers free them through the callback
+// passed to erase_range().
+class ramfs_radix {
+public:
+    ramfs_radix() = default;
+    ramfs_radix(const ramfs_radix&) = delete;
+    ramfs_radix& operator=(const ramfs_radix&) = delete;
+    ~ramfs_radix() {
+        erase_range(0, max_index, [] (uint64_t, void*) {});
+    }
+
+    bool empty() const { return !_root; }
+
+    void* lookup(uint64_t index) const {
+        if (!_root || !fits(index, _height)) {
+            return nullptr;
+        }
+        node* n = _root;
+        for (unsigned level = _height - 1; ; level--) {
+            void* slot = n->slots[slot_of(index, level)];
+            if (level == 0 || !slot) {
+                return slot;
+            }
+            n = static_cast<node*>(slot);
+        }
+    }
+
+    // Returns false if an interior node could not be allocated.
+    bool insert(uint64_t index, void* leaf) {
+        assert(leaf && index < max_index);
+        if (!_root) {
+            _root = new (std::nothrow) node();
+            if (!_root) {
+                return false;
+            }
+            _height = 1;
+        }
+        while (!fits(index, _height)) {
+            auto n = new (std::nothrow) node();
+            if (!n) {
+                return false;
+            }
+            n->slots[0] = _root;
+            n->count = 1;
+            _root = n;
+            _height++;
+        }
+        node* n = _root;
+        for (unsigned level = _height - 1; level > 0; level--) {
+            void*& slot = n->slots[slot_of(index, level)];
+            if (!slot) {
+                slot = new (std::nothrow) node();
+                if (!slot) {
+                    return false;
+                }
+                n->count++;
+            }
+            n = static_cast<node*>(slot);
+        }
+        void*& slot = n->slots[slot_of(index, 0)];
+        if (!slot) {
+            n->count++;
+        }
+        slot = leaf;
+        return true;
+    }
+
+    // Removes every leaf with first <= index < last, calling
+    // fn(index, leaf) for each of them before it is dropped.
+    template <typename Func>
+    void erase_range(uint64_t first, uint64_t last, Func fn) {
+        if (!_root || first >= last) {
+            return;
+        }
+        if (erase_range(_root, _height - 1, 0, first, last, fn)) {
+            delete _root;
+            _root = nullptr;
+            _height = 0;
+        }
+    }
+
+    // Returns true if no leaf exists with first <= index < last.
+    bool empty_range(uint64_t first, uint64_t last) const {
+        return !_root || first >= last ||
+               empty_range(_root, _height - 1, 0, first, last);
+    }
+
+    static constexpr uint64_t max_index = 1ULL << 52;
+private:
+    static constexpr unsigned bits = 6;
+    static constexpr unsigned fanout = 1U << bits;
+
+    struct node {
+        void* slots[fanout] = {};
+        unsigned count = 0;
+    };
+
+    static bool fits(uint64_t index, unsigned height) {
+        return height * bits >= 64 || !(index >> (height * bits));
+    }
+    static unsigned slot_of(uint64_t index, unsigned level) {
+        return (index >> (level * bits)) & (fanout - 1);
+    }
+
+    // Returns true if the node became empty and should be freed by the
+    // caller.
+    template <typename Func>
+    static bool erase_range(node* n, unsigned level, uint64_t base,
+                            uint64_t first, uint64_t last, Func& fn) {
+        uint64_t span = 1ULL << (level * bits);
+        for (unsigned i = 0; i < fanout && n->count; i++) {
+            uint64_t start = base + i * span;
+            if (start >= last) {
+                break;
+            }
+            if (start + span <= first || !n->slots[i]) {
+                continue;
+            }
+            if (level == 0) {
+                fn(start, n->slots[i]);
+            } else {
+                auto child = static_cast<node*>(n->slots[i]);
+                if (!erase_range(child, level - 1, start, first, last, fn)) {
+                    continue;
+                }
+                delete child;
+            }
+            n->slots[i] = nullptr;
+            n->count--;
+        }
+        return n->count == 0;
+    }
+
+    static bool empty_range(const node* n, unsigned level, uint64_t base,
+                            uint64_t first, uint64_t last) {
+        uint64_t span = 1ULL << (level * bits);
+        for (unsigned i = 0; i < fanout; i++) {
+            uint64_t start = base + i * span;
+            if (start >= last) {
+                break;
+            }
+            if (start + span <= first || !n->slots[i]) {
+                continue;
+            }
+            if (level == 0 || !empty_range(static_cast<const node*>(n->slots[i]),
+                                           level - 1, start, first, last)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    node* _root = nullptr;
+    unsigned _height = 0;
+};
+
+#endif /* _RAMFS_RADIX_HH */
@@ -32,9 +32,13 @@
 #include <osv/vnode.h>
 #include <osv/mount.h>
 #include <osv/dentry.h>
+#include <fs/vfs/vfs_id.h>
+#include <atomic>
 
 #include "ramfs.h"
 
+static std::atomic<uint32_t> ramfs_mounts(0);
+
 extern struct vnops ramfs_vnops;
 
 static int ramfs_mount(struct mount *mp, const char *dev, int flags, const void *data);
@@ -71,6 +75,13 @@ ramfs_mount(struct mount *mp, const char *dev, int flags, const void *data)
     np = ramfs_allocate_node("/", VDIR);
     if (np == NULL)
         return ENOMEM;
+
+    /* Give each mount its own device id, the page cache keys pages by it */
+    mp->m_fsid.__val[0] = ++ramfs_mounts;
+    mp->m_fsid.__val[1] = RAMFS_ID >> 32;
+    np->rn_fsid = ((uint32_t)mp->m_fsid.__val[0]) |
+                  ((dev_t) ((uint32_t)mp->m_fsid.__val[1]) << 32);
+
     mp->m_root->d_vnode->v_data = np;
     return 0;
 }
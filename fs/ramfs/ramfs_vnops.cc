@@ -45,6 +45,8 @@
 #include <osv/file.h>
 #include <osv/mount.h>
 #include <osv/vnode_attr.h>
+#include <osv/pagealloc.hh>
+#include <osv/pagecache.hh>
 
 #include "ramfs.h"
 
@@ -72,35 +74,37 @@ ramfs_allocate_node(const char *name, int type)
 {
     struct ramfs_node *np;
 
-    np = (ramfs_node *) malloc(sizeof(struct ramfs_node));
+    np = new (std::nothrow) ramfs_node();
     if (np == NULL)
         return NULL;
-    memset(np, 0, sizeof(struct ramfs_node));
 
     np->rn_namelen = strlen(name);
     np->rn_name = (char *) malloc(np->rn_namelen + 1);
     if (np->rn_name == NULL) {
-        free(np);
+        delete np;
         return NULL;
     }
     strlcpy(np->rn_name, name, np->rn_namelen + 1);
     np->rn_type = type;
 
-    if (type == VDIR)
+    if (type == VDIR) {
         np->rn_mode = S_IFDIR|0777;
-    else if (type == VLNK)
+        np->rn_children = new (std::nothrow) std::unordered_map<std::string_view, ramfs_node *>();
+        if (np->rn_children == NULL) {
+            free(np->rn_name);
+            delete np;
+            return NULL;
+        }
+    } else if (type == VLNK)
         np->rn_mode = S_IFLNK|0777;
     else
         np->rn_mode = S_IFREG|0777;
 
     set_times_to_now(&(np->rn_ctime), &(np->rn_atime), &(np->rn_mtime));
-    np->rn_owns_buf = true;
+    np->rn_owns_buf = false;
     np->rn_ref_count = 0;
     np->rn_removed = false;
 
-    np->rn_file_segments_by_offset = new std::map<off_t,struct ramfs_file_segment>();
-    np->rn_total_segments_size = 0;
-
     return np;
 }
 
@@ -111,26 +115,62 @@ ramfs_free_node(struct ramfs_node *np)
 	    return;
     }
 
-    if (np->rn_file_segments_by_offset != NULL) {
-        if (np->rn_owns_buf) {
-            for (auto it = np->rn_file_segments_by_offset->begin(); it != np->rn_file_segments_by_offset->end(); ++it) {
-                free(it->second.data);
-                it->second.data = NULL;
-            }
-        }
+    ramfs_data_free(np);
+    delete np->rn_children;
+
+    free(np->rn_name);
+    delete np;
+}
+
+static std::string_view
+ramfs_node_key(struct ramfs_node *np)
+{
+    return std::string_view(np->rn_name, np->rn_namelen);
+}
+
+/* Must be called with ramfs_lock held */
+static void
+ramfs_link_node(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+    (*dnp->rn_children)[ramfs_node_key(np)] = np;
 
-        delete np->rn_file_segments_by_offset;
+    /* Append to the directory list to keep readdir() in creation order */
+    np->rn_next = NULL;
+    np->rn_prev = dnp->rn_last_child;
+    if (dnp->rn_last_child == NULL) {
+        dnp->rn_child = np;
+    } else {
+        dnp->rn_last_child->rn_next = np;
     }
+    dnp->rn_last_child = np;
+}
 
+/* Must be called with ramfs_lock held */
+static void
+ramfs_unlink_node(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+    dnp->rn_children->erase(ramfs_node_key(np));
 
-    free(np->rn_name);
-    free(np);
+    if (np->rn_prev == NULL) {
+        dnp->rn_child = np->rn_next;
+    } else {
+        np->rn_prev->rn_next = np->rn_next;
+    }
+    if (np->rn_next == NULL) {
+        dnp->rn_last_child = np->rn_prev;
+    } else {
+        np->rn_next->rn_prev = np->rn_prev;
+    }
+    np->rn_next = np->rn_prev = NULL;
+
+    /* Entries past the removed one shift down by one */
+    dnp->rn_readdir_node = NULL;
 }
 
 static struct ramfs_node *
 ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 {
-    struct ramfs_node *np, *prev;
+    struct ramfs_node *np;
 
     np = ramfs_allocate_node(name, type);
     if (np == NULL)
@@ -138,16 +178,9 @@ ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 
     mutex_lock(&ramfs_lock);
     np->inode_no = inode_count++;
+    np->rn_fsid = dnp->rn_fsid;
 
-    /* Link to the directory list */
-    if (dnp->rn_child == NULL) {
-        dnp->rn_child = np;
-    } else {
-        prev = dnp->rn_child;
-        while (prev->rn_next != NULL)
-            prev = prev->rn_next;
-        prev->rn_next = np;
-    }
+    ramfs_link_node(dnp, np);
 
     set_times_to_now(&(dnp->rn_mtime), &(dnp->rn_ctime));
 
@@ -158,26 +191,17 @@ ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 static int
 ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
 {
-    struct ramfs_node *prev;
-
     if (dnp->rn_child == NULL)
         return EBUSY;
 
     mutex_lock(&ramfs_lock);
 
-    /* Unlink from the directory list */
-    if (dnp->rn_child == np) {
-        dnp->rn_child = np->rn_next;
-    } else {
-        for (prev = dnp->rn_child; prev->rn_next != np;
-             prev = prev->rn_next) {
-            if (prev->rn_next == NULL) {
-                mutex_unlock(&ramfs_lock);
-                return ENOENT;
-            }
-        }
-        prev->rn_next = np->rn_next;
+    auto it = dnp->rn_children->find(ramfs_node_key(np));
+    if (it == dnp->rn_children->end() || it->second != np) {
+        mutex_unlock(&ramfs_lock);
+        return ENOENT;
     }
+    ramfs_unlink_node(dnp, np);
 
     np->rn_removed = true;
     if (np->rn_ref_count <= 0) {
@@ -190,6 +214,7 @@ ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
     return 0;
 }
 
+/* Must be called with ramfs_lock held and np unlinked from its directory */
 static int
 ramfs_rename_node(struct ramfs_node *np, char *name)
 {
@@ -222,8 +247,6 @@ ramfs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
 {
     struct ramfs_node *np, *dnp;
     struct vnode *vp;
-    size_t len;
-    int found;
 
     *vpp = NULL;
 
@@ -232,20 +255,13 @@ ramfs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
 
     mutex_lock(&ramfs_lock);
 
-    len = strlen(name);
     dnp = (ramfs_node *) dvp->v_data;
-    found = 0;
-    for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
-        if (np->rn_namelen == len &&
-            memcmp(name, np->rn_name, len) == 0) {
-            found = 1;
-            break;
-        }
-    }
-    if (found == 0) {
+    auto it = dnp->rn_children->find(std::string_view(name));
+    if (it == dnp->rn_children->end()) {
         mutex_unlock(&ramfs_lock);
         return ENOENT;
     }
+    np = it->second;
     if (vget(dvp->v_mount, np->inode_no, &vp)) {
         /* found in cache */
         *vpp = vp;
@@ -301,13 +317,8 @@ ramfs_symlink(struct vnode *dvp, char *name, char *link)
     // Save the link target without the final null, as readlink() wants it.
     size_t len = strlen(link);
     np->rn_size = len;
-
-    ramfs_file_segment new_segment = {
-        .size = len,
-        .data = strndup(link, len)
-    };
-    (*np->rn_file_segments_by_offset)[0] = new_segment;
-    np->rn_total_segments_size = len;
+    np->rn_buf = strndup(link, len);
+    np->rn_owns_buf = true;
 
     return 0;
 }
@@ -335,7 +346,7 @@ ramfs_readlink(struct vnode *vp, struct uio *uio)
         len = uio->uio_resid;
 
     set_times_to_now( &(np->rn_atime));
-    return uiomove((*np->rn_file_segments_by_offset)[0].data + uio->uio_offset, len, uio);
+    return uiomove(np->rn_buf + uio->uio_offset, len, uio);
 }
 
 /* Remove a directory */
@@ -353,40 +364,6 @@ ramfs_remove(struct vnode *dvp, struct vnode *vp, char *name)
     return ramfs_remove_node((ramfs_node *) dvp->v_data, (ramfs_node *) vp->v_data);
 }
 
-#define ENLARGE_FACTOR 1.1f
-static int
-ramfs_enlarge_data_buffer(struct ramfs_node *np, size_t desired_length)
-{
-    // New total size has to be at least greater by the ENLARGE_FACTOR
-    auto new_total_segment_size = round_page(std::max<size_t>(np->rn_total_segments_size * ENLARGE_FACTOR, desired_length));
-    assert(new_total_segment_size >= desired_length);
-
-    auto new_segment_size = np->rn_owns_buf ? new_total_segment_size - np->rn_total_segments_size : new_total_segment_size;
-    ramfs_file_segment new_segment = {
-        .size = new_segment_size,
-        .data = (char*) malloc(new_segment_size)
-    };
-    if (!new_segment.data)
-        return EIO;
-
-    auto new_segment_file_offset = np->rn_total_segments_size;
-    if (!np->rn_owns_buf) {
-        // This is a file from bootfs and we cannot simply enlarge same way
-	// as regular one because because original segment is not be page-aligned.
-	// Therefore we need to created new segment and copy content of the old one
-        memcpy(new_segment.data, (*np->rn_file_segments_by_offset)[0].data, np->rn_size);
-        new_segment_file_offset = 0;
-    }
-
-    // Insert new segment with the file offset it starts at which happends
-    // to be old total segments size
-    (*np->rn_file_segments_by_offset)[new_segment_file_offset] = new_segment;
-    np->rn_total_segments_size = new_total_segment_size;
-    np->rn_owns_buf = true;
-
-    return 0;
-}
-
 /* Truncate file */
 static int
 ramfs_truncate(struct vnode *vp, off_t length)
@@ -396,21 +373,9 @@ ramfs_truncate(struct vnode *vp, off_t length)
     DPRINTF(("truncate %s length=%d\n", vp->v_path, length));
     np = (ramfs_node *) vp->v_data;
 
-    //TODO: Shall we free segments id new length < np->total_segments_size
-    if (length == 0) {
-        if (np->rn_owns_buf) {
-            for (auto it = (*np->rn_file_segments_by_offset).begin(); it != (*np->rn_file_segments_by_offset).end(); ++it) {
-                free(it->second.data);
-            }
-        }
-
-        (*np->rn_file_segments_by_offset).clear();
-        np->rn_total_segments_size = 0;
-    } else if (size_t(length) > np->rn_total_segments_size) {
-        auto ret = ramfs_enlarge_data_buffer(np, length);
-        if (ret) {
-            return ret;
-        }
+    auto ret = ramfs_data_truncate(np, length);
+    if (ret) {
+        return ret;
     }
 
     np->rn_size = length;
@@ -442,41 +407,6 @@ ramfs_create(struct vnode *dvp, char *name, mode_t mode)
     return 0;
 }
 
-static int
-ramfs_read_or_write_file_data(std::map<off_t,struct ramfs_file_segment> &file_segments_by_offset, struct uio *uio, size_t bytes_to_read_or_write)
-{
-    // Find the segment where we need to start reading from or writing to based on uio_offset
-    auto segment_to_read_or_write = file_segments_by_offset.lower_bound(uio->uio_offset);
-    if( segment_to_read_or_write == file_segments_by_offset.end()) {
-        segment_to_read_or_write = --file_segments_by_offset.end();
-    }
-    else if (segment_to_read_or_write->first > uio->uio_offset) {
-        segment_to_read_or_write--;
-    }
-    assert(uio->uio_offset >= segment_to_read_or_write->first &&
-           uio->uio_offset < (off_t)(segment_to_read_or_write->first + segment_to_read_or_write->second.size));
-
-    // Simply iterate starting with initial identified segment above to read or write
-    // until we have read all bytes or have iterated all segments
-    uint64_t file_offset = uio->uio_offset;
-    for (; segment_to_read_or_write != file_segments_by_offset.end() && bytes_to_read_or_write > 0; segment_to_read_or_write++) {
-        // First calculate where we need to start in this segment ...
-        auto offset_in_segment = file_offset - segment_to_read_or_write->first;
-        // .. then calculate how many bytes to read or write in this segment
-        auto maximum_bytes_to_read_or_write_in_segment = segment_to_read_or_write->second.size - offset_in_segment;
-        auto bytes_to_read_or_write_in_segment = std::min<uint64_t>(bytes_to_read_or_write,maximum_bytes_to_read_or_write_in_segment);
-        assert(offset_in_segment >= 0 && offset_in_segment < segment_to_read_or_write->second.size);
-        auto ret = uiomove(segment_to_read_or_write->second.data + offset_in_segment, bytes_to_read_or_write_in_segment, uio);
-        if (ret) {
-            return ret;
-        }
-        bytes_to_read_or_write -= bytes_to_read_or_write_in_segment;
-        file_offset += bytes_to_read_or_write_in_segment;
-    }
-
-    return 0;
-}
-
 static int
 ramfs_read(struct vnode *vp, struct file *fp, struct uio *uio, int ioflag)
 {
@@ -506,7 +436,7 @@ ramfs_read(struct vnode *vp, struct file *fp, struct uio *uio, int ioflag)
 
     set_times_to_now(&(np->rn_atime));
 
-    return ramfs_read_or_write_file_data(*(np->rn_file_segments_by_offset),uio,len);
+    return ramfs_data_read(np, uio, len);
 }
 
 int
@@ -520,17 +450,11 @@ ramfs_set_file_data(struct vnode *vp, const void *data, size_t size)
     if (vp->v_type != VREG) {
         return EINVAL;
     }
-    if (!(*np->rn_file_segments_by_offset).empty()) {
+    if (np->rn_buf || !np->rn_pages.empty() || !np->rn_huge_pages.empty()) {
         return EINVAL;
     }
 
-    ramfs_file_segment new_segment = {
-        .size = size,
-        .data = (char *) data
-    };
-    (*np->rn_file_segments_by_offset)[0] = new_segment;
-    np->rn_total_segments_size = size;
-
+    np->rn_buf = (char *) data;
     np->rn_size = size;
     np->rn_owns_buf = false;
 
@@ -563,30 +487,23 @@ ramfs_write(struct vnode *vp, struct uio *uio, int ioflag)
     if (ioflag & IO_APPEND)
         uio->uio_offset = np->rn_size;
 
-    if (size_t(uio->uio_offset + uio->uio_resid) > (size_t) vp->v_size) {
-        /* Expand the file size before writing to it */
-        off_t end_pos = uio->uio_offset + uio->uio_resid;
-        if (end_pos > (off_t) np->rn_total_segments_size) {
-            auto ret = ramfs_enlarge_data_buffer(np, end_pos);
-            if (ret) {
-                return ret;
-            }
-        }
-        np->rn_size = end_pos;
-        vp->v_size = end_pos;
-    }
-
     set_times_to_now(&(np->rn_mtime), &(np->rn_ctime));
 
-    assert(uio->uio_offset + uio->uio_resid <= (off_t)(np->rn_total_segments_size));
-    return ramfs_read_or_write_file_data(*(np->rn_file_segments_by_offset),uio,uio->uio_resid);
+    auto error = ramfs_data_write(np, uio);
+
+    /* Account for whatever got written, even if not all of it did */
+    if (uio->uio_offset > (off_t) np->rn_size) {
+        np->rn_size = uio->uio_offset;
+        vp->v_size = uio->uio_offset;
+    }
+    return error;
 }
 
 static int
 ramfs_rename(struct vnode *dvp1, struct vnode *vp1, char *name1,
              struct vnode *dvp2, struct vnode *vp2, char *name2)
 {
-    struct ramfs_node *np, *old_np;
+    struct ramfs_node *np, *dnp1, *dnp2;
     int error;
 
     if (vp2) {
@@ -595,31 +512,23 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, char *name1,
         if (error)
             return error;
     }
-    /* Same directory ? */
-    if (dvp1 == dvp2) {
-        /* Change the name of existing file */
-        error = ramfs_rename_node((ramfs_node *) vp1->v_data, name2);
-        if (error)
-            return error;
-    } else {
-        /* Create new file or directory */
-        old_np = (ramfs_node *) vp1->v_data;
-        np = ramfs_add_node((ramfs_node *) dvp2->v_data, name2, old_np->rn_type);
-        if (np == NULL)
-            return ENOMEM;
 
-        np->rn_size = old_np->rn_size;
-        np->rn_file_segments_by_offset = old_np->rn_file_segments_by_offset;
-        np->rn_total_segments_size = old_np->rn_total_segments_size;
-        np->rn_owns_buf = old_np->rn_owns_buf;
+    /* Move the node itself, so that it keeps its inode number and,
+     * for a directory, its children */
+    np = (ramfs_node *) vp1->v_data;
+    dnp1 = (ramfs_node *) dvp1->v_data;
+    dnp2 = (ramfs_node *) dvp2->v_data;
 
-        old_np->rn_file_segments_by_offset = NULL;
-        old_np->rn_owns_buf = false;
-
-        /* Remove source file */
-        ramfs_remove_node((ramfs_node *) dvp1->v_data, (ramfs_node *) vp1->v_data);
+    mutex_lock(&ramfs_lock);
+    ramfs_unlink_node(dnp1, np);
+    error = ramfs_rename_node(np, name2);
+    ramfs_link_node(error ? dnp1 : dnp2, np);
+    if (!error) {
+        set_times_to_now(&(dnp1->rn_mtime), &(dnp1->rn_ctime));
+        set_times_to_now(&(dnp2->rn_mtime), &(dnp2->rn_ctime));
     }
-    return 0;
+    mutex_unlock(&ramfs_lock);
+    return error;
 }
 
 /*
@@ -629,7 +538,7 @@ static int
 ramfs_readdir(struct vnode *vp, struct file *fp, struct dirent *dir)
 {
     struct ramfs_node *np, *dnp;
-    int i;
+    off_t i, pos;
 
     mutex_lock(&ramfs_lock);
 
@@ -643,19 +552,25 @@ ramfs_readdir(struct vnode *vp, struct file *fp, struct dirent *dir)
         strlcpy((char *) &dir->d_name, "..", sizeof(dir->d_name));
     } else {
         dnp = (ramfs_node *) vp->v_data;
-        np = dnp->rn_child;
+        pos = fp->f_offset - 2;
+        /* Resume from the last entry returned if we can */
+        if (dnp->rn_readdir_node != NULL && dnp->rn_readdir_pos <= pos) {
+            np = dnp->rn_readdir_node;
+            i = dnp->rn_readdir_pos;
+        } else {
+            np = dnp->rn_child;
+            i = 0;
+        }
+        for (; np != NULL && i != pos; i++) {
+            np = np->rn_next;
+        }
         if (np == NULL) {
             mutex_unlock(&ramfs_lock);
             return ENOENT;
         }
+        dnp->rn_readdir_node = np;
+        dnp->rn_readdir_pos = pos;
 
-        for (i = 0; i != (fp->f_offset - 2); i++) {
-            np = np->rn_next;
-            if (np == NULL) {
-                mutex_unlock(&ramfs_lock);
-                return ENOENT;
-            }
-        }
         if (np->rn_type == VDIR)
             dir->d_type = DT_DIR;
         else if (np->rn_type == VLNK)
@@ -695,6 +610,7 @@ ramfs_getattr(struct vnode *vnode, struct vattr *attr)
     memcpy(&(attr->va_mtime), &(np->rn_mtime), sizeof(struct timespec));
 
     attr->va_mode = np->rn_mode;
+    attr->va_fsid = np->rn_fsid;
 
     return 0;
 }
@@ -739,6 +655,49 @@ int ramfs_close(struct vnode *dvp, struct file *file)
     return 0;
 }
 
+/*
+ * Hand the page backing the file offset to the page cache, so that read
+ * only and private mappings of a ramfs file share its memory instead of
+ * copying it. Holes are left unfilled, which makes the page cache map the
+ * zero page.
+ */
+static int
+ramfs_map_cached_page(struct vnode *vp, struct file *fp, struct uio *uio)
+{
+    struct ramfs_node *np = (ramfs_node *) vp->v_data;
+
+    if (vp->v_type == VDIR)
+        return EISDIR;
+    if (vp->v_type != VREG)
+        return EINVAL;
+    if (uio->uio_offset < 0)
+        return EINVAL;
+    if (uio->uio_offset >= (off_t)vp->v_size)
+        return 0;
+    if (uio->uio_resid != mmu::page_size)
+        return EINVAL;
+    if (uio->uio_offset % mmu::page_size)
+        return EINVAL;
+
+    bool owned;
+    void *page = ramfs_data_cache_page(np, uio->uio_offset, &owned);
+    if (page == NULL) {
+        return owned ? ENOMEM : 0;
+    }
+
+    auto key = (pagecache::hashkey *) uio->uio_iov->iov_base;
+    if (owned) {
+        if (!pagecache::map_owned_read_cached_page(key, page)) {
+            memory::free_page(page);
+        }
+    } else {
+        pagecache::map_read_cached_page(key, page);
+    }
+    uio->uio_resid = 0;
+
+    return 0;
+}
+
 #define ramfs_seek      ((vnop_seek_t)vop_nullop)
 #define ramfs_ioctl     ((vnop_ioctl_t)vop_einval)
 #define ramfs_fsync     ((vnop_fsync_t)vop_nullop)
@@ -769,7 +728,7 @@ struct vnops ramfs_vnops = {
         ramfs_inactive,         /* inactive */
         ramfs_truncate,         /* truncate */
         ramfs_link,             /* link */
-        (vnop_cache_t) nullptr, /* arc */
+        ramfs_map_cached_page,  /* arc */
         ramfs_fallocate,        /* fallocate */
         ramfs_readlink,         /* read link */
         ramfs_symlink,          /* symbolic link */
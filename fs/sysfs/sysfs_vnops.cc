@@ -53,6 +53,16 @@ static string sysfs_free_page_ranges()
     return output;
 }
 
+static string sysfs_fragmentation()
+{
+    stats::fragmentation_stats stats;
+    stats::get_fragmentation_stats(stats);
+
+    return osv::sprintf("free %ld\nhuge_capable %ld\nhuge_reserved %ld\nhuge_reserve_free %ld\nindex %.3f\n",
+        stats.free, stats.huge_capable, stats.huge_reserved, stats.huge_reserve_free,
+        stats.free ? 1 - double(stats.huge_capable) / stats.free : 0.0);
+}
+
 static string sysfs_memory_pools()
 {
     stats::pool_stats stats;
@@ -99,6 +109,7 @@ sysfs_mount(mount* mp, const char *dev, int flags, const void* data)
     auto memory = make_shared<pseudo_dir_node>(inode_count++);
     memory->add("free_page_ranges", inode_count++, sysfs_free_page_ranges);
     memory->add("pools", inode_count++, sysfs_memory_pools);
+    memory->add("fragmentation", inode_count++, sysfs_fragmentation);
     memory->add("linear_maps", inode_count++, mmu::sysfs_linear_maps);
 
     auto osv_extension = make_shared<pseudo_dir_node>(inode_count++);
@@ -151,7 +162,7 @@ vnops sysfs_vnops = {
     (vnop_rmdir_t)    vop_einval, // vop_rmdir
     pseudofs::getattr,            // vop_getattr
     (vnop_setattr_t)  vop_eperm,  // vop_setattr
-    (vnop_inactive_t) vop_nullop, // vop_inactive
+    pseudofs::inactive,           // vop_inactive
     (vnop_truncate_t) vop_nullop, // vop_truncate
     (vnop_link_t)     vop_eperm,  // vop_link
     (vnop_cache_t)     nullptr,   // vop_arc
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <osv/file.h>
 #include <osv/poll.h>
 #include <osv/debug.h>
@@ -16,6 +17,8 @@
 #include <osv/rcu.hh>
 #include <osv/export.h>
 #include <boost/range/algorithm/find.hpp>
+#include <algorithm>
+#include <memory>
 
 #include <bsd/sys/sys/queue.h>
 
@@ -28,10 +31,114 @@ using namespace osv;
 /*
  * Global file descriptors table - in OSv we have a single process so file
  * descriptors are maintained globally.
+ *
+ * Next to the file pointers the table keeps a two level bitmap of used
+ * descriptors: a bit per fd in fdt_used, and a bit per fdt_used word in
+ * fdt_full, set when all 64 fds of that word are taken. Finding the lowest
+ * free fd, as POSIX requires, therefore looks at a couple of words rather
+ * than scanning the table.
+ *
+ * Readers (fget()) find the table through an rcu pointer and never take
+ * gfdt_lock. Writers serialize on gfdt_lock, and when the table runs out
+ * of room they copy it into one twice as big, publish that and dispose of
+ * the old one after a grace period.
  */
-rcu_ptr<file> gfdt[FDMAX] = {};
+struct fd_table {
+    explicit fd_table(unsigned n)
+        : size(n)
+        , files(new rcu_ptr<file>[n])
+        , used(new uint64_t[n / 64]())
+        , full(new uint64_t[n / 64 / 64]()) {}
+    const unsigned size;
+    std::unique_ptr<rcu_ptr<file>[]> files;
+    std::unique_ptr<uint64_t[]> used;
+    std::unique_ptr<uint64_t[]> full;
+};
+
+/* Table sizes are kept a multiple of the 4096 fds one fdt_full word covers */
+static constexpr unsigned fd_table_granularity = 64 * 64;
+
+static rcu_ptr<fd_table> gfdt;
 mutex_t gfdt_lock = MUTEX_INITIALIZER;
 
+static unsigned fd_table_round(unsigned n)
+{
+    return (n + fd_table_granularity - 1) & ~(fd_table_granularity - 1);
+}
+
+static bool fd_used(fd_table* t, unsigned fd)
+{
+    return t->used[fd / 64] & (1ULL << (fd % 64));
+}
+
+static void fd_mark_used(fd_table* t, unsigned fd)
+{
+    auto w = fd / 64;
+    t->used[w] |= 1ULL << (fd % 64);
+    if (t->used[w] == ~0ULL) {
+        t->full[w / 64] |= 1ULL << (w % 64);
+    }
+}
+
+static void fd_mark_free(fd_table* t, unsigned fd)
+{
+    auto w = fd / 64;
+    t->used[w] &= ~(1ULL << (fd % 64));
+    t->full[w / 64] &= ~(1ULL << (w % 64));
+}
+
+/* Returns the lowest unused fd >= min_fd, or -1 if the table is full */
+static int fd_find_free(fd_table* t, unsigned min_fd)
+{
+    unsigned nwords = t->size / 64;
+    unsigned w = min_fd / 64;
+    if (w >= nwords) {
+        return -1;
+    }
+    uint64_t bits = t->used[w] | ((1ULL << (min_fd % 64)) - 1);
+    if (~bits) {
+        return w * 64 + __builtin_ctzll(~bits);
+    }
+    for (w++; w < nwords; w = (w | 63) + 1) {
+        uint64_t full = t->full[w / 64] | ((1ULL << (w % 64)) - 1);
+        if (~full) {
+            w = (w & ~63U) + __builtin_ctzll(~full);
+            return w * 64 + __builtin_ctzll(~t->used[w]);
+        }
+    }
+    return -1;
+}
+
+/* Must be called with gfdt_lock held. Returns a table with room for fd. */
+static fd_table* fd_table_reserve(unsigned fd)
+{
+    auto t = gfdt.read_by_owner();
+    if (t && fd < t->size) {
+        return t;
+    }
+    if (fd >= FDLIMIT) {
+        return nullptr;
+    }
+    unsigned size = t ? std::min(2 * t->size, (unsigned)FDLIMIT) : fd_table_round(FDMAX);
+    size = std::max(size, fd_table_round(fd + 1));
+    auto nt = new (std::nothrow) fd_table(size);
+    if (!nt) {
+        return nullptr;
+    }
+    if (t) {
+        for (unsigned i = 0; i < t->size; i++) {
+            nt->files[i].assign(t->files[i].read_by_owner());
+        }
+        std::copy(t->used.get(), t->used.get() + t->size / 64, nt->used.get());
+        std::copy(t->full.get(), t->full.get() + t->size / 64 / 64, nt->full.get());
+    }
+    gfdt.assign(nt);
+    if (t) {
+        rcu_dispose(t);
+    }
+    return nt;
+}
+
 /*
  * Allocate a file descriptor and assign fd to it atomically.
  *
@@ -39,37 +146,47 @@ mutex_t gfdt_lock = MUTEX_INITIALIZER;
  */
 int _fdalloc(struct file *fp, int *newfd, int min_fd)
 {
-    int fd;
+    if (min_fd < 0 || min_fd >= FDLIMIT) {
+        return EINVAL;
+    }
 
     fhold(fp);
 
-    for (fd = min_fd; fd < FDMAX; fd++) {
-        if (gfdt[fd])
-            continue;
-
-        WITH_LOCK(gfdt_lock) {
-            /* Now that we hold the lock,
-             * make sure the entry is still available */
-            if (gfdt[fd].read_by_owner()) {
-                continue;
-            }
-
-            /* Install */
-            gfdt[fd].assign(fp);
+    WITH_LOCK(gfdt_lock) {
+        auto t = fd_table_reserve(min_fd);
+        int fd = t ? fd_find_free(t, min_fd) : -1;
+        if (t && fd < 0) {
+            /* Full from min_fd up, the first fd past the end is free */
+            fd = t->size;
+            t = fd_table_reserve(fd);
+        }
+        if (t) {
+            fd_mark_used(t, fd);
+            t->files[fd].assign(fp);
             *newfd = fd;
+            return 0;
         }
-
-        return 0;
     }
 
     fdrop(fp);
     return EMFILE;
 }
 
+// Like Linux, the RLIMIT_NOFILE soft limit, which is also sysconf(_SC_OPEN_MAX)
 extern "C" OSV_LIBC_API
 int getdtablesize(void)
 {
-    return FDMAX;
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+int fdtable_size(void)
+{
+    WITH_LOCK(rcu_read_lock) {
+        auto t = gfdt.read();
+        return t ? t->size : 0;
+    }
 }
 
 /*
@@ -86,14 +203,23 @@ int fdclose(int fd)
 {
     struct file* fp;
 
+    if (fd < 0) {
+        return EBADF;
+    }
+
     WITH_LOCK(gfdt_lock) {
+        auto t = gfdt.read_by_owner();
+        if (!t || (unsigned)fd >= t->size) {
+            return EBADF;
+        }
 
-        fp = gfdt[fd].read_by_owner();
+        fp = t->files[fd].read_by_owner();
         if (fp == nullptr) {
             return EBADF;
         }
 
-        gfdt[fd].assign(nullptr);
+        t->files[fd].assign(nullptr);
+        fd_mark_free(t, fd);
     }
 
     fdrop(fp);
@@ -109,15 +235,21 @@ int fdset(int fd, struct file *fp)
 {
     struct file *orig;
 
-    if (fd < 0 || fd >= FDMAX)
+    if (fd < 0 || fd >= FDLIMIT)
         return EBADF;
 
     fhold(fp);
 
     WITH_LOCK(gfdt_lock) {
-        orig = gfdt[fd].read_by_owner();
+        auto t = fd_table_reserve(fd);
+        if (!t) {
+            fdrop(fp);
+            return EMFILE;
+        }
+        orig = t->files[fd].read_by_owner();
         /* Install new file structure in place */
-        gfdt[fd].assign(fp);
+        t->files[fd].assign(fp);
+        fd_mark_used(t, fd);
     }
 
     if (orig)
@@ -146,7 +278,7 @@ int fget(int fd, struct file **out_fp)
 {
     struct file *fp;
 
-    if (fd < 0 || fd >= FDMAX)
+    if (fd < 0)
         return EBADF;
 
 #if CONF_lazy_stack_invariant
@@ -156,7 +288,11 @@ int fget(int fd, struct file **out_fp)
     arch::ensure_next_stack_page();
 #endif
     WITH_LOCK(rcu_read_lock) {
-        fp = gfdt[fd].read();
+        auto t = gfdt.read();
+        if (!t || (unsigned)fd >= t->size) {
+            return EBADF;
+        }
+        fp = t->files[fd].read();
         if (fp == nullptr) {
             return EBADF;
         }
@@ -185,8 +321,22 @@ void file::wake_epoll(int events)
         if (!f_epolls) {
             return;
         }
+        // Registrations made with EPOLLEXCLUSIVE only need one of their
+        // epoll instances woken, preferably one with a thread waiting on it
+        const epoll_ptr* exclusive = nullptr;
+        bool woke_exclusive = false;
         for (auto&& ep : *f_epolls) {
-            epoll_wake(ep);
+            if (!ep.exclusive) {
+                epoll_wake(ep);
+            } else if (!woke_exclusive) {
+                woke_exclusive = epoll_wake_if_waiting(ep, false);
+                if (!exclusive) {
+                    exclusive = &ep;
+                }
+            }
+        }
+        if (exclusive && !woke_exclusive) {
+            epoll_wake(*exclusive);
         }
     }
 #endif
@@ -197,6 +347,18 @@ void fhold(struct file* fp)
     __sync_fetch_and_add(&fp->f_count, 1);
 }
 
+bool fdrop_unless_last(struct file *fp)
+{
+    int o = fp->f_count;
+    do {
+        if (o == 1) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&fp->f_count, &o, o - 1, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
 OSV_LIBSOLARIS_API
 int fdrop(struct file *fp)
 {
@@ -19,6 +19,7 @@
 #include <sys/refcount.h>
 #include <osv/mutex.h>
 #include <osv/waitqueue.hh>
+#include <osv/psi.hh>
 
 OSV_LIBSOLARIS_API struct bio *
 alloc_bio(void)
@@ -39,8 +40,11 @@ OSV_LIBSOLARIS_API int
 bio_wait(struct bio *bio)
 {
 	SCOPE_LOCK(bio->bio_mutex);
-	while (!(bio->bio_flags & BIO_DONE)) {
-		bio->bio_wait.wait(bio->bio_mutex);
+	if (!(bio->bio_flags & BIO_DONE)) {
+		psi::stall stall(psi::resource::io);
+		while (!(bio->bio_flags & BIO_DONE)) {
+			bio->bio_wait.wait(bio->bio_mutex);
+		}
 	}
 	if (bio->bio_flags & BIO_ERROR) {
 		return EIO;
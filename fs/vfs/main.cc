@@ -77,6 +77,7 @@
 
 #include "fs/fs.hh"
 #include "libc/libc.hh"
+#include "libc/pipe_buffer.hh"
 
 #include <mntent.h>
 #include <sys/mman.h>
@@ -318,8 +319,12 @@ int close_range(unsigned int first, unsigned int last, unsigned int flags)
     }
 
     unsigned int end = last;
-    if (end >= (unsigned int)FDMAX) {
-        end = FDMAX - 1;
+    unsigned int size = fdtable_size();
+    if (size == 0) {
+        return 0;
+    }
+    if (end >= size) {
+        end = size - 1;
     }
     for (unsigned int fd = first; fd <= end; fd++) {
         if (flags & CLOSE_RANGE_CLOEXEC) {
@@ -1916,6 +1921,17 @@ int fcntl(int fd, int cmd, int arg)
     case F_SETOWN:
         WARN_ONCE("fcntl(F_SETOWN) stubbed\n");
         break;
+    case F_SETPIPE_SZ:
+    case F_GETPIPE_SZ:
+        // Only pipes know about these
+        if (!pipe_buffer_of(fp, FREAD) && !pipe_buffer_of(fp, FWRITE)) {
+            error = EBADF;
+            break;
+        }
+        tmp = arg;
+        error = fp->ioctl(cmd, &tmp);
+        ret = tmp;
+        break;
     default:
         kprintf("unsupported fcntl cmd 0x%x\n", cmd);
         error = EINVAL;
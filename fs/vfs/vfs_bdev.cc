@@ -16,6 +16,7 @@
 #include <osv/prex.h>
 #include <osv/buf.h>
 #include <osv/bio.h>
+#include <osv/mmu.hh>
 
 /*
  * Can this whole transfer take the fast path? That requires the starting
@@ -48,6 +49,9 @@ bdev_uio_sector_aligned(struct uio *uio)
  * strategy() adds dev->offset exactly once (partition base), mirroring the
  * rw_buf()->strategy() path this replaces, so partition addressing is
  * unchanged.
+ *
+ * The buffer is pinned for the duration of each bio, so the huge page
+ * collapser doesn't move it while the device is at it.
  */
 static int
 bdev_strategy_rw(struct device *dev, struct uio *uio, int bio_cmd)
@@ -71,8 +75,10 @@ bdev_strategy_rw(struct device *dev, struct uio *uio, int bio_cmd)
 		bio->bio_offset = uio->uio_offset;
 		bio->bio_bcount = iov->iov_len;
 
+		mmu::io_pin(iov->iov_base, iov->iov_len);
 		dev->driver->devops->strategy(bio);
 		int ret = bio_wait(bio);
+		mmu::io_unpin(iov->iov_base, iov->iov_len);
 		destroy_bio(bio);
 		if (ret)
 			return ret;
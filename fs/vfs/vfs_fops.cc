@@ -199,8 +199,11 @@ int vfs_file::read_page_from_cache(void* key, off_t offset)
     data.uio_rw = UIO_READ;
 
     vn_lock(vp);
-    assert(VOP_CACHE(vp, this, &data) == 0);
+    int error = VOP_CACHE(vp, this, &data);
     vn_unlock(vp);
+    if (error) {
+        return error;
+    }
 
     return (data.uio_resid != 0) ? -1 : 0;
 }
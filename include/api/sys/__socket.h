@@ -46,6 +46,14 @@ struct cmsghdr {
 };
 #endif /* __DEFINED_struct_msghdr */
 
+#ifndef __DEFINED_struct_mmsghdr
+#define __DEFINED_struct_mmsghdr
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+#endif
+
 struct linger
 {
         int l_onoff;
@@ -188,6 +188,7 @@ struct ucred
 #define SO_PEEK_OFF             42
 #define SO_NOFCS                43
 #define SO_LOCK_FILTER          44
+#define SO_MAX_PACING_RATE      47
 
 #define SOL_RAW         255
 #define SOL_DECNET      261
@@ -216,6 +217,7 @@ struct ucred
 #define MSG_NOSIGNAL  0x4000
 #define MSG_MORE      0x8000
 #define MSG_WAITFORONE 0x10000
+#define MSG_FASTOPEN  0x20000000
 #define MSG_CMSG_CLOEXEC 0x40000000
 
 #define __CMSG_LEN(cmsg) (((cmsg)->cmsg_len + sizeof(long) - 1) & ~(long)(sizeof(long) - 1))
@@ -269,6 +271,12 @@ ssize_t recvfrom (int, void *__restrict, size_t, int, struct sockaddr *__restric
 ssize_t sendmsg (int, const struct msghdr *, int);
 ssize_t recvmsg (int, struct msghdr *, int);
 
+#if defined(_GNU_SOURCE) || defined(_BSD_SOURCE)
+struct timespec;
+int sendmmsg (int, struct mmsghdr *, unsigned int, unsigned int);
+int recvmmsg (int, struct mmsghdr *, unsigned int, unsigned int, struct timespec *);
+#endif
+
 int getsockopt (int, int, int, void *__restrict, socklen_t *__restrict);
 int setsockopt (int, int, int, const void *, socklen_t);
 
@@ -72,14 +72,19 @@ protected:
     // it can be accessed with relaxed memory ordering.
     unsigned int depth;
     std::atomic<sched::thread *> owner;
-    queue_mpsc<wait_record> waitqueue;
-    std::atomic<unsigned int> handoff;
+    // "sequence" is at offset 16 on purpose: pthread_mutex_t embeds a mutex
+    // directly, and glibc's static initializers for recursive, errorcheck
+    // and adaptive mutexes put a small non-zero "kind" there. Any starting
+    // value is fine for the sequence number.
     unsigned int sequence;
+    std::atomic<unsigned int> handoff;
+    queue_mpsc<wait_record> waitqueue;
+    bool spin(sched::thread *current);
 public:
     // Note: mutex's constructor just initializes the whole structure to
     // zero, and its destructor does nothing. This is useful to know when
     // allocating a mutex in C.
-    constexpr mutex() : count(0), depth(0), owner(nullptr), waitqueue(), handoff(0), sequence(0) { }
+    constexpr mutex() : count(0), depth(0), owner(nullptr), sequence(0), handoff(0), waitqueue() { }
     ~mutex() { /*assert(count==0);*/ }
 
     void lock();
@@ -95,6 +100,10 @@ public:
     void send_lock(wait_record *wr);
     bool send_lock_unless_already_waiting(wait_record *wr);
     void receive_lock();
+
+    // How many times lock() may poll a mutex whose owner is running on
+    // another cpu before going to sleep. 0 disables spinning.
+    static unsigned spin_limit;
 };
 
 }
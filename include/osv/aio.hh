@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef OSV_AIO_HH_
+#define OSV_AIO_HH_
+
+#include <atomic>
+#include <functional>
+#include <sys/types.h>
+#include <stdint.h>
+
+struct file;
+
+namespace osv {
+namespace aio {
+
+/**
+ * One asynchronous file operation. This is the engine behind libaio's
+ * io_submit() and the POSIX aio_*() functions.
+ *
+ * Reads and writes of whole sectors on a block device are what bdev_read()
+ * and bdev_write() hand straight to the driver, only to sleep in bio_wait()
+ * right after. Here they go to the driver as bios whose completion finishes
+ * the request, so a single submitting thread can keep as many requests in
+ * flight as it likes. Any other operation - partial sectors, out of range
+ * offsets, a file opened without the right mode, files and sockets - runs on
+ * a worker of an osv::io_wq shared by all submitters, which goes through the
+ * VFS exactly like pread()/pwrite() would. Files and block devices are its
+ * bounded class and sockets and pipes, which may block for an unbounded
+ * time, the unbounded one.
+ */
+struct request {
+    enum class op {
+        read,
+        write,
+        readv,      // buf is a struct iovec array, nbytes its length
+        writev,
+        fsync,
+        fdatasync,
+        nop,
+    };
+
+    int fd;
+    op opcode;
+    void* buf;
+    size_t nbytes;
+    off_t offset;
+    // The control block (iocb, aiocb) the request was submitted for
+    const void* owner;
+    /**
+     * Called exactly once when the operation is over, with the number of
+     * bytes transferred or a negative errno. Unless done_may_block is set,
+     * it may run on a block driver's completion thread, where it must not
+     * block for long: short critical sections and waking waiters are fine,
+     * waiting for I/O, memory or other threads and starting threads are not.
+     */
+    void (*done)(request* req, int64_t res);
+    // done() may block, so it is always called by the submitter or a worker
+    bool done_may_block = false;
+
+    // Private to the engine
+    enum class stage {
+        queued,     // for a worker to execute
+        deferred,   // for a worker to submit, see submit_deferred()
+        finishing,  // for a worker to complete with _res
+    };
+    struct file* _fp;
+    stage _stage;
+    int64_t _res;
+    size_t _bytes;
+    std::atomic<unsigned> _pending_bios;
+    std::atomic<int> _error;
+};
+
+/**
+ * Start an operation. done() may be called before this returns, e.g. when
+ * the file descriptor is invalid.
+ */
+void submit(request* req);
+
+/**
+ * Like submit(), but the operation is started by a worker. Unlike submit(),
+ * it may be called from a done() callback.
+ */
+void submit_deferred(request* req);
+
+/**
+ * Take a request that has not started yet off the queue.
+ *
+ * \param match selects the request to cancel
+ * \return the request, whose done() will not be called, or nullptr if no
+ *         queued request matched. Requests already handed to a driver or a
+ *         worker cannot be cancelled.
+ */
+request* cancel(std::function<bool (const request&)> match);
+
+}
+}
+
+#endif /* OSV_AIO_HH_ */
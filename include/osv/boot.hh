@@ -2,11 +2,13 @@
 #define BOOT_HH
 
 #include "arch-setup.hh"
+#include <atomic>
 
 class time_element {
 public:
     const char *str;
     u64 stamp;
+    u64 start; // non-zero for a span, see boot_time_chart::span()
 };
 
 class boot_time_chart {
@@ -14,6 +16,9 @@ public:
     void event(const char *str);
     void event(int event_idx, const char *str);
     void event(int event_idx, const char *str, u64 stamp);
+    // Records something that started at the given stamp and ends now. Spans
+    // may overlap, e.g. drivers probed concurrently.
+    void span(const char *str, u64 start);
     void print_chart();
     void print_total_time();
 private:
@@ -22,8 +27,9 @@ private:
     // relatively late (the code that takes the measure is so early it cannot
     // call this one directly. Therefore, the measurements would appear in the
     // middle of the list, and we want to preserve order.
-    int _event = 4;
-    time_element arrays[16];
+    std::atomic<int> _event{4};
+    static constexpr int max_events = 64;
+    time_element arrays[max_events];
 
     void print_one_time(int index);
     double to_msec(u64 time);
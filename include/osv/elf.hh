@@ -12,6 +12,7 @@
 #include <vector>
 #include <map>
 #include <stack>
+#include <array>
 #include <memory>
 #include <unordered_set>
 #include <unordered_map>
@@ -135,6 +136,7 @@ enum {
 // Note section
 enum {
     NT_VERSION = 1,
+    NT_GNU_BUILD_ID = 3,
 };
 
 
@@ -432,6 +434,8 @@ public:
     Elf64_Half headers_count() { return _ehdr.e_phnum; }
     Elf64_Half headers_size() { return _ehdr.e_phentsize; }
     void* headers_start() { return _headers_start; }
+    // Hex string of the NT_GNU_BUILD_ID note, empty if the object has none
+    const std::string& build_id() const { return _build_id; }
 protected:
     virtual void load_segment(const Elf64_Phdr& segment) = 0;
     virtual void unload_segment(const Elf64_Phdr& segment) = 0;
@@ -465,6 +469,11 @@ private:
     void prepare_local_tls(std::vector<ptrdiff_t>& offsets);
     void alloc_static_tls();
     void make_text_writable(bool flag);
+    void read_build_id(const char* notes, size_t len);
+    unsigned symtab_end();
+    std::vector<object*> reloc_cache_context();
+    void apply_reloc_cache(const std::vector<object*>& context);
+    void dump_reloc_bindings(const std::vector<object*>& context);
 protected:
     program& _prog;
     std::string _pathname;
@@ -493,6 +502,14 @@ protected:
 
     std::unordered_map<std::string,void*> _cached_symbols;
 
+    std::string _build_id;
+    // Only populated while relocate() runs: symbol bindings taken from the
+    // program's relocation cache, and those resolved by lookup that are to
+    // be dumped for it (both by symbol index).
+    std::unordered_map<unsigned, std::pair<Elf64_Sym*, object*>> _reloc_bindings;
+    std::unordered_map<unsigned, std::pair<Elf64_Sym*, object*>> _reloc_record;
+    bool _reloc_recording = false;
+
     // Keep list of references to other modules, to prevent them from being
     // unloaded. When this object is unloaded, the reference count of all
     // objects listed here goes down, and they too may be unloaded.
@@ -540,6 +557,7 @@ protected:
     virtual void unload_segment(const Elf64_Phdr& phdr);
     virtual void read(Elf64_Off offset, void* data, size_t size) override;
 private:
+    void prefault_segment(void* addr, ulong filesz, ulong memsz, off_t offset, unsigned perm);
     ::fileref _f;
 };
 
@@ -671,6 +689,53 @@ public:
     elf::object *object_containing_addr(const void *addr);
     inline object *tls_object(ulong module);
     void *get_libvdso_base() { return _libvdso->base(); }
+
+    /**
+     * Load a relocation cache written by scripts/gen-reloc-cache.py.
+     *
+     * An object relocated afterwards whose build-id, and the build-ids of
+     * every module visible to it, match an entry of the cache takes its
+     * symbol bindings from there instead of looking every symbol up in all
+     * the loaded modules. Anything that doesn't match falls back to the
+     * regular lookup.
+     *
+     * \return false if the file could not be read or is not a relocation
+     *         cache.
+     */
+    bool load_reloc_cache(const std::string& path);
+    /**
+     * Print the symbol bindings of every object relocated from now on, in
+     * the format load_reloc_cache() reads, prefixed with "reloc-cache: ".
+     */
+    void set_reloc_cache_dump(bool dump) { _reloc_cache_dump = dump; }
+    bool reloc_cache_dump() const { return _reloc_cache_dump; }
+    bool reloc_cache_enabled() const { return _reloc_cache_dump || !_reloc_cache.empty(); }
+
+    struct reloc_cache_entry {
+        // Identities of the modules visible to the object, in lookup order
+        std::vector<std::string> context;
+        // Symbol index, position of the module defining it in the context
+        // and the index of the symbol there
+        std::vector<std::array<u32, 3>> bindings;
+    };
+    const reloc_cache_entry* find_reloc_cache(const std::string& build_id,
+            const std::vector<std::string>& context) const;
+
+    /**
+     * Read the non-writable PT_LOAD segments (text and read-only data) of
+     * the objects loaded from now on into memory at load time, in large
+     * sequential reads, instead of mapping them from the file and faulting
+     * every page in on first touch. Shared objects are also placed on a 2MB
+     * boundary, so the parts of these segments covering whole 2MB pages are
+     * backed by huge pages when available.
+     *
+     * \param report print a line in the boot chart format for every object
+     *               prefaulted
+     */
+    void set_prefault_exec(bool prefault, bool report = false);
+    bool prefault_exec() const { return _prefault_exec; }
+    // Accounts one prefaulted object, loaded from processor::ticks() start
+    void note_prefault(const std::string& name, size_t pages, size_t huge_pages, u64 start);
 private:
     void add_debugger_obj(object* obj);
     void del_debugger_obj(object* obj);
@@ -714,6 +779,14 @@ private:
     // this allows the objects resolved by get_library() get initialized
     // by init_library() at arbitrary time later - the delayed initialization scenario
     std::stack<std::vector<std::shared_ptr<object>>> _loaded_objects_stack;
+
+    std::unordered_multimap<std::string, reloc_cache_entry> _reloc_cache;
+    bool _reloc_cache_dump = false;
+    bool _prefault_exec = false;
+    bool _prefault_report = false;
+    // Totals over all the objects prefaulted, protected by _mutex
+    size_t _prefault_pages = 0;
+    size_t _prefault_huge_pages = 0;
 };
 
 extern void *missing_symbols_page_addr;
@@ -70,7 +70,12 @@ struct vnode;
 struct file;
 struct pollreq;
 
+/*
+ * The descriptor table starts out with FDMAX entries and grows on demand,
+ * up to FDLIMIT entries.
+ */
 #define FDMAX       (CONF_fs_max_file_descriptors)
+#define FDLIMIT     (1 << 20)
 
 #if defined(__cplusplus) && !defined(USE_C_INTERFACE)
 
@@ -109,14 +114,24 @@ struct hash<epoll_key> : private hash<int>, hash<file*> {
 }
 
 struct epoll_file;
+struct epitem;
 
+// A registration of a file with an epoll instance. Only the epoll instance
+// and the key identify it; item is the registration's ready-list entry,
+// which lets a wakeup queue it without a lookup.
 struct epoll_ptr {
     epoll_file* epoll;
     epoll_key key;
+    epitem* item = nullptr;
+    bool exclusive = false; // registered with EPOLLEXCLUSIVE
 };
 
 void epoll_wake(const epoll_ptr& ep);
 void epoll_wake_in_rcu(const epoll_ptr& ep);
+// For EPOLLEXCLUSIVE registrations: queue the event and wake the epoll
+// instance only if a thread is blocked in epoll_wait() on it. Returns false,
+// doing nothing, otherwise.
+bool epoll_wake_if_waiting(const epoll_ptr& ep, bool in_rcu);
 
 inline bool operator==(const epoll_ptr& p1, const epoll_ptr& p2) {
     return p1.epoll == p2.epoll && p1.key == p2.key;
@@ -232,6 +247,8 @@ int fdalloc(struct file* fp, int *newfd);
 int fdset(int fd, struct file* fp);
 void fdfree(int fd);
 int fdclose(int fd);
+/* Current size of the descriptor table, every open fd is below it */
+int fdtable_size(void);
 
 __BEGIN_DECLS
 
@@ -247,6 +264,8 @@ void file_setoffset(struct file *fp, off_t off);
  */
 void fhold(struct file* fp);
 int fdrop(struct file* fp);
+/* Drop a reference to fp unless it is the last one; returns whether it did */
+bool fdrop_unless_last(struct file* fp);
 
 __END_DECLS
 
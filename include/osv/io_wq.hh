@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef OSV_IO_WQ_HH_
+#define OSV_IO_WQ_HH_
+
+#include <osv/mutex.h>
+#include <osv/waitqueue.hh>
+#include <osv/sched.hh>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osv {
+
+/**
+ * Worker threads running I/O operations which block, after Linux's io-wq.
+ * Each io_uring ring has one, and the aio engine shares one between libaio
+ * and POSIX aio.
+ *
+ * Workers are persistent and created lazily, one more only when work is
+ * queued while none is idle, up to a cap per class. Bounded work - files and
+ * block devices - completes promptly; unbounded work - sockets, pipes, polls
+ * and timeouts - may wait forever, so it has workers of its own and cannot
+ * starve disk I/O.
+ *
+ * \tparam Work the queued item, handed by value to the function run for it
+ */
+template <typename Work>
+class io_wq {
+public:
+    enum work_class { bounded, unbounded, nr_classes };
+
+    io_wq(std::string name, std::function<void (Work)> run)
+        : _name(std::move(name)), _run(std::move(run)) {}
+
+    /**
+     * Queue w to be run by a worker of the given class. May be called from a
+     * block driver's completion thread.
+     */
+    void enqueue(Work w, work_class cls)
+    {
+        SCOPE_LOCK(_mtx);
+        _queue[cls].push_back(std::move(w));
+        if (_idle[cls] == 0 && _nr_workers[cls] < max_workers_locked(cls)) {
+            _nr_workers[cls]++;
+            auto t = sched::thread::make([this, cls] { worker(cls); },
+                sched::thread::attr().name(cls == bounded ? _name : _name + "-unbound"));
+            _threads.push_back(t);
+            t->start();
+        } else {
+            _wait[cls].wake_one(_mtx);
+        }
+    }
+
+    /**
+     * Take the first queued work for which match() holds off the queue.
+     *
+     * \return whether any did, in which case it is moved to w
+     */
+    bool cancel(std::function<bool (const Work&)> match, Work& w)
+    {
+        SCOPE_LOCK(_mtx);
+        for (auto& q : _queue) {
+            auto it = std::find_if(q.begin(), q.end(), match);
+            if (it != q.end()) {
+                w = std::move(*it);
+                q.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned max_workers(work_class cls)
+    {
+        SCOPE_LOCK(_mtx);
+        return max_workers_locked(cls);
+    }
+
+    /**
+     * Change the cap on the number of workers of a class, as
+     * IORING_REGISTER_IOWQ_MAX_WORKERS does: 0 leaves it unchanged. Workers
+     * already running are not stopped.
+     *
+     * \return the previous cap
+     */
+    unsigned set_max_workers(work_class cls, unsigned n)
+    {
+        SCOPE_LOCK(_mtx);
+        auto prev = max_workers_locked(cls);
+        if (n) {
+            _max_workers[cls] = n;
+        }
+        return prev;
+    }
+
+    /**
+     * Wait for the workers to run what is left in the queue and exit. No
+     * work may be queued after this is called.
+     */
+    void shutdown()
+    {
+        WITH_LOCK(_mtx) {
+            _shutdown = true;
+            for (auto& w : _wait) {
+                w.wake_all(_mtx);
+            }
+        }
+        for (auto t : _threads) {
+            t->join();
+            delete t;
+        }
+        _threads.clear();
+    }
+
+private:
+    // The default caps are computed on first use, as the pool may be
+    // constructed before the cpus are up
+    unsigned max_workers_locked(work_class cls)
+    {
+        if (!_max_workers[cls]) {
+            unsigned ncpu = std::max<unsigned>(sched::cpus.size(), 1);
+            _max_workers[cls] = cls == bounded ? std::max(16u, ncpu * 2)
+                                               : std::max(16u, ncpu * 4);
+        }
+        return _max_workers[cls];
+    }
+
+    void worker(work_class cls)
+    {
+        WITH_LOCK(_mtx) {
+            for (;;) {
+                while (_queue[cls].empty() && !_shutdown) {
+                    _idle[cls]++;
+                    _wait[cls].wait(_mtx);
+                    _idle[cls]--;
+                }
+                if (_queue[cls].empty()) {
+                    return;
+                }
+                auto w = std::move(_queue[cls].front());
+                _queue[cls].pop_front();
+
+                DROP_LOCK(_mtx) {
+                    _run(std::move(w));
+                }
+            }
+        }
+    }
+
+    std::string _name;
+    std::function<void (Work)> _run;
+    mutex _mtx;
+    bool _shutdown = false;
+    std::deque<Work> _queue[nr_classes];
+    waitqueue _wait[nr_classes];
+    unsigned _nr_workers[nr_classes] = {};
+    unsigned _idle[nr_classes] = {};
+    unsigned _max_workers[nr_classes] = {};    // 0 until first used
+    std::vector<sched::thread*> _threads;
+};
+
+}
+
+#endif /* OSV_IO_WQ_HH_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef OSV_LOCKSTAT_HH_
+#define OSV_LOCKSTAT_HH_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <osv/types.h>
+
+// Lock contention statistics.
+//
+// When enabled, the contended paths of lockfree::mutex, rwlock and the
+// spinlocks record, for each lock that made a thread wait, how many times
+// it did, for how long in total and at most, where the longest wait came
+// from, and where the lock was last released to a waiter. The uncontended
+// paths are not touched, so this is always compiled in and costs a single
+// load of a flag on contention while disabled.
+//
+// This is called from inside the locks themselves, so it must never take a
+// lock or allocate: statistics live in a fixed size table updated with
+// atomics, and locks that do not fit in it are only counted.
+namespace lockstat {
+
+enum class lock_type : u8 {
+    mutex,
+    rwlock,
+    spinlock,
+};
+
+extern std::atomic<bool> enabled;
+
+inline bool active()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void enable(bool on);
+// Forget all statistics collected so far
+void reset();
+
+// Current time for timing waits, 0 when disabled
+u64 start();
+// Records a wait for the given lock which started at start(), by a thread
+// which called it from site
+void contended(const void* lock, lock_type type, u64 start, const void* site);
+// Records that the lock was released, from site, to a thread waiting for it
+void released(const void* lock, const void* site);
+
+// Times a wait for a lock from its construction to its destruction
+class wait_timer {
+public:
+    wait_timer(const void* lock, lock_type type, const void* site)
+        : _lock(lock), _site(site), _start(start()), _type(type) {}
+    ~wait_timer() {
+        if (_start) {
+            contended(_lock, _type, _start, _site);
+        }
+    }
+private:
+    const void* _lock;
+    const void* _site;
+    u64 _start;
+    lock_type _type;
+};
+
+struct lock_stat {
+    const void* lock;
+    lock_type type;
+    u64 contended;
+    u64 wait_ns;
+    u64 max_wait_ns;
+    // Call site of the longest wait
+    const void* waiter_site;
+    // Call site which last released the lock to a waiter
+    const void* holder_site;
+};
+
+// Statistics of every lock seen contended, most waited for first
+std::vector<lock_stat> get_stats();
+// Number of contentions not accounted to any lock for lack of room
+u64 dropped();
+const char* type_name(lock_type type);
+// Symbolic name of a lock or call site, or its address
+std::string name(const void* addr);
+// Contents of /proc/lockstat
+std::string procfs_lockstat();
+
+}
+
+#endif /* OSV_LOCKSTAT_HH_ */
@@ -210,6 +210,18 @@ namespace stats {
 
     void get_page_ranges_stats(page_ranges_stats &stats);
 
+    struct fragmentation_stats {
+        size_t free;              // bytes in free page ranges
+        size_t huge_capable;      // of which in 2MB-aligned 2MB blocks
+        size_t huge_reserved;     // size of the --hugepages reserve
+        size_t huge_reserve_free; // of which not handed out
+    };
+
+    void get_fragmentation_stats(fragmentation_stats &stats);
+    // The share of free memory which cannot back a huge page: 0 when all
+    // of it comes in aligned 2MB blocks, approaching 1 as it gets scattered
+    float fragmentation_index();
+
     struct pool_stats {
         size_t _max;
         size_t _nr;
@@ -26,6 +26,7 @@ constexpr int pte_per_page = 512;
 constexpr int pte_per_page_shift = 9; // log2(pte_per_page)
 
 constexpr uintptr_t huge_page_size = mmu::page_size*pte_per_page; // 2 MB
+constexpr uintptr_t huge_page_size_1g = huge_page_size*pte_per_page; // 1 GB
 
 typedef uint64_t f_offset;
 
@@ -86,6 +87,8 @@ enum {
     mmap_file        = 1ul << 7,
     mmap_stack       = 1ul << 8,
     mmap_huge        = 1ul << 9,    // MAP_HUGETLB: require huge pages, fail if unavailable
+    mmap_huge_1g     = 1ul << 10,   // MAP_HUGETLB|MAP_HUGE_1GB: require 1GB pages
+    mmap_nocollapse  = 1ul << 11,   // never collapsed into huge pages in the background (stacks)
 };
 
 enum {
@@ -103,6 +106,36 @@ void flush_tlb_local();
 /* flush tlb for all */
 void flush_tlb_all();
 
+/*
+ * The virtual addresses whose translations were changed by a page table
+ * operation, to be invalidated together by flush_tlb() once it is done.
+ * One address per changed pte is enough whatever the page size, since
+ * invalidating an address drops whichever entry maps it. Past max_addrs
+ * addresses, invalidating them one by one costs more than flushing the
+ * whole TLB, so the batch turns into a full flush.
+ */
+struct tlb_batch {
+    static constexpr unsigned max_addrs = 32;
+    unsigned nr = 0;
+    bool all = false;
+    uintptr_t addrs[max_addrs];
+    void add(uintptr_t addr) {
+        if (nr == max_addrs) {
+            all = true;
+        } else if (!all) {
+            addrs[nr++] = addr;
+        }
+    }
+    void add_all() { all = true; }
+    bool empty() const { return !all && !nr; }
+    void clear() { nr = 0; all = false; }
+};
+
+/* invalidate the batch's addresses on all processors */
+void flush_tlb(const tlb_batch& batch);
+/* invalidate the batch's addresses on the current processor */
+void flush_tlb_local(const tlb_batch& batch);
+
 constexpr size_t page_size_level(unsigned level)
 {
     return size_t(1) << (page_size_shift + pte_per_page_shift * level);
@@ -110,8 +143,8 @@ constexpr size_t page_size_level(unsigned level)
 
 template<int N>
 struct pt_level_traits {
-    typedef typename std::integral_constant<bool, N == 0 || N == 1>::type leaf_capable;
-    typedef typename std::integral_constant<bool, N == 1>::type large_capable;
+    typedef typename std::integral_constant<bool, N == 0 || N == 1 || N == 2>::type leaf_capable;
+    typedef typename std::integral_constant<bool, N == 1 || N == 2>::type large_capable;
     typedef typename std::integral_constant<bool, N != 0>::type intermediate_capable;
     typedef typename std::integral_constant<size_t, page_size_level(N)>::type size;
 };
@@ -214,6 +214,15 @@ error mprotect(const void *addr, size_t size, unsigned int perm);
 error msync(const void* addr, size_t length, int flags);
 error mincore(const void *addr, size_t length, unsigned char *vec);
 bool is_linear_mapped(const void *addr, size_t size);
+/**
+ * Keep the pages backing [addr, addr + size) where they are while a device
+ * accesses them directly, i.e. stop the background huge page collapser from
+ * copying and freeing them. Waits if that memory is being collapsed right
+ * now. Every io_pin() must be followed by an io_unpin() of the same range
+ * once the I/O is over.
+ */
+void io_pin(const void* addr, size_t size);
+void io_unpin(const void* addr, size_t size);
 bool ismapped(const void *addr, size_t size);
 bool isreadable(void *addr, size_t size);
 std::unique_ptr<file_vma> default_file_mmap(file* file, addr_range range, unsigned flags, unsigned perm, off_t offset);
@@ -290,6 +299,7 @@ class virt_pte_visitor {
 public:
     virtual void pte(pt_element<0>) = 0;
     virtual void pte(pt_element<1>) = 0;
+    virtual void pte(pt_element<2>) = 0;
 };
 
 void virt_visit_pte_rcu(uintptr_t virt, virt_pte_visitor& visitor);
@@ -363,7 +373,10 @@ void linear_map(void* virt, phys addr, size_t size, const char* name,
 void free_initial_memory_range(uintptr_t addr, size_t size);
 void switch_to_runtime_page_tables();
 
+// The number of page sizes the mmu may use: 2 (4K and 2MB pages), or 3
+// when the cpu supports 1GB pages as well
 void set_nr_page_sizes(unsigned nr);
+unsigned get_nr_page_sizes();
 
 void vpopulate(void* addr, size_t size);
 void vdepopulate(void* addr, size_t size);
@@ -371,6 +384,16 @@ void vcleanup(void* addr, size_t size);
 
 error  advise(void* addr, size_t size, int advice);
 
+// Background thread collapsing fully populated 2MB runs of small anonymous
+// pages into huge pages
+struct huge_page_collapse_stats {
+    u64 scanned;    // 2MB regions looked at
+    u64 collapsed;  // regions moved to a huge page
+    u64 failed;     // collapses given up for lack of a huge page
+};
+huge_page_collapse_stats get_huge_page_collapse_stats();
+void start_huge_page_collapser();
+
 void vm_fault(uintptr_t addr, exception_frame* ef);
 
 std::string procfs_maps();
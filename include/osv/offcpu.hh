@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef _OSV_OFFCPU_HH
+#define _OSV_OFFCPU_HH
+
+#include <atomic>
+#include <string>
+#include <osv/types.h>
+
+// Off-cpu profiler.
+//
+// Where the sampler shows where threads spend their time on the cpu, this
+// shows where they spend it off the cpu. When a thread is switched out to
+// wait, its backtrace is taken; when it runs again, the time it spent
+// blocked (until wake()) and then runnable but waiting in the runqueue is
+// added to that backtrace. The totals are kept in the kernel per distinct
+// backtrace, so nothing has to be traced, and are read as folded stacks by
+// scripts/trace.py prof-offcpu.
+namespace prof {
+
+// Per-thread state, embedded in sched::thread. The times themselves are
+// the scheduler's own per-thread sleep and runqueue accounting.
+struct offcpu_state {
+    unsigned stack = 0;  // backtrace's entry plus one, 0 if not tracked
+};
+
+extern std::atomic<bool> offcpu_enabled;
+
+inline bool offcpu_active()
+{
+    return offcpu_enabled.load(std::memory_order_relaxed);
+}
+
+// Hooks for the scheduler, called with preemption disabled
+void offcpu_switch_out(offcpu_state& s);
+void offcpu_switch_in(offcpu_state& s, u64 blocked_ns, u64 runq_ns);
+
+void start_offcpu_profiler();
+void stop_offcpu_profiler();
+void reset_offcpu_profile();
+
+// The profile as text: a histogram of runqueue wait times, as comment lines,
+// then one line per backtrace with its addresses outermost first, separated
+// by ';', followed by the number of waits, the total time blocked and the
+// total time spent runnable in the runqueue, in nanoseconds.
+std::string get_offcpu_profile();
+
+}
+
+#endif
@@ -132,6 +132,13 @@ void osv_current_app_on_termination_request(void (*handler)());
  */
 int osv_run_app(const char *app_path, const char *args[], int args_len);
 
+/*
+ * Stop at the snapshot pause point: flush device state, let the host
+ * snapshot the VM and return once it runs again, from the snapshot or not.
+ * Meant to be called by an application once it is warmed up.
+ */
+void osv_snapshot_point();
+
 #ifdef __cplusplus
 }
 #endif
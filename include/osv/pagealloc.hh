@@ -16,6 +16,9 @@ void* alloc_page();
 void free_page(void* page);
 void* alloc_huge_page(size_t bytes);
 void free_huge_page(void *page, size_t bytes);
+// Sets aside up to nr 2MB pages for alloc_huge_page() to fall back on once
+// memory gets fragmented. Returns the size of the reserve.
+size_t reserve_huge_pages(size_t nr);
 
 }
 
@@ -71,6 +71,7 @@ void unmap_arc_buf(arc_buf_t* ab);
 void map_arc_buf(hashkey* key, arc_buf_t* ab, void* page);
 bool map_read_cached_page(hashkey *key, void *page);
 bool map_owned_read_cached_page(hashkey *key, void *page);
+void invalidate_read_cache(dev_t dev, ino_t ino, off_t start, off_t end);
 }
 
 #ifdef __cplusplus
@@ -294,8 +294,12 @@ public:
         // If we are here means we've aquired a RUNNING lock
         rc = _txq->try_xmit_one_locked(cooky);
 
-        // Alright!!!
-        if (!rc) {
+        //
+        // Alright!!! Kick right away unless the caller has more packets
+        // coming (see osv::xmit_batch) - then the kick is left to the end of
+        // its batch.
+        //
+        if (!rc && !_txq->defer_kick()) {
             _txq->kick_hw();
         }
 
@@ -324,6 +328,26 @@ public:
         return 0;
     }
 
+    /**
+     * Notify the HW about the packets whose kick has been deferred by
+     * xmit() during an osv::xmit_batch.
+     *
+     * Never blocks: if somebody else owns the HW channel the kick is handed
+     * over to the dispatcher, which kicks every time it gets the channel.
+     */
+    void kick_deferred() {
+        if (try_lock_running()) {
+            _txq->kick_deferred_locked();
+            unlock_running();
+
+            if (has_pending()) {
+                wake_worker();
+            }
+        } else if (!test_and_set_pending()) {
+            wake_worker();
+        }
+    }
+
 private:
     void wake_worker() {
         WITH_LOCK(migration_lock)
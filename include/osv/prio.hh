@@ -31,6 +31,7 @@ enum {
     sched,
     clock,
     hpet,
+    tsc_clock,
     tracepoint_base,
     malloc_pools,
     idt,
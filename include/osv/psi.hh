@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef OSV_PSI_HH_
+#define OSV_PSI_HH_
+
+#include <string>
+
+// Pressure stall information, in the format of Linux's /proc/pressure.
+//
+// For memory and io, the "some" figures are the share of wall time during
+// which at least one thread was stalled: waiting for the reclaimer to free
+// memory, or for a block request to complete. For cpu, it is the share of
+// the cpus' time during which a runnable thread had to wait for another to
+// run, which the scheduler accounts per cpu. The "full" figures, time with
+// every non-idle thread stalled, are not tracked and always read 0.
+namespace psi {
+
+enum class resource {
+    cpu,
+    memory,
+    io,
+};
+
+// Marks the calling thread as stalled on a memory or io resource from its
+// construction to its destruction
+class stall {
+public:
+    explicit stall(resource r);
+    ~stall();
+    stall(const stall&) = delete;
+    stall& operator=(const stall&) = delete;
+private:
+    resource _r;
+};
+
+// The contents of /proc/pressure/<resource>
+std::string procfs_pressure(resource r);
+
+}
+
+#endif
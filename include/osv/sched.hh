@@ -26,6 +26,7 @@
 #include <osv/rcu.hh>
 #include <osv/clock.hh>
 #include <osv/timer-set.hh>
+#include <osv/offcpu.hh>
 #include <osv/export.h>
 #include <osv/kernel_config_lazy_stack.h>
 #include <osv/kernel_config_lazy_stack_invariant.h>
@@ -594,6 +595,11 @@ public:
     stack_info get_stack_info();
     cpu* tcpu() const __attribute__((no_instrument_function));
     status get_status() const;
+    // Returns whether t is running on some cpu right now. t is only compared
+    // with each cpu's running thread, never dereferenced, so it may point to
+    // a thread which has since exited. The answer may be stale by the time
+    // it is returned, which is fine for heuristics like adaptive spinning.
+    static bool on_cpu(const thread* t);
     void join();
     void detach();
     void set_cleanup(std::function<void ()> cleanup);
@@ -907,8 +913,16 @@ public:
     stat_counter stat_switches;
     stat_counter stat_preemptions;
     stat_counter stat_migrations;
+    // Time spent off the cpu, in nanoseconds: waiting to be woken, and then
+    // runnable but waiting in the runqueue. Updated when switched back in,
+    // once enable_schedstat() was called.
+    stat_counter stat_sleep_ns;
+    stat_counter stat_runq_ns;
 private:
     thread_runtime::duration _total_cpu_time {0};
+    u64 _stopped_at = 0;             // uptime when last switched out
+    std::atomic<u64> _woken_at {0};  // uptime when made runnable again
+    prof::offcpu_state _offcpu;
     std::atomic<u64> _cputime_estimator {0}; // for thread_clock()
     inline void cputime_estimator_set(
             osv::clock::uptime::time_point running_since,
@@ -1011,6 +1025,10 @@ struct cpu : private timer_base::client {
     incoming_wakeup_queue* incoming_wakeups;
     thread* terminating_thread;
     osv::clock::uptime::time_point running_since;
+    // Time, in nanoseconds, during which threads were runnable on this cpu
+    // but had to wait for another one to run
+    std::atomic<u64> stall_ns = { 0 };
+    std::atomic<thread*> running_thread = { nullptr };
     char* percpu_base;
     static cpu* current();
     void init_on_cpu();
@@ -1561,6 +1579,11 @@ void with_all_threads(std::function<void(sched::thread &)>);
 // should return quickly.
 void with_thread_by_id(unsigned id, std::function<void(sched::thread *)>);
 
+// Start accounting every thread's sleep and runqueue time (stat_sleep_ns,
+// stat_runq_ns). It is off until first needed, because it costs a clock
+// read on every wakeup.
+void enable_schedstat();
+
 }
 
 #endif /* SCHED_HH_ */
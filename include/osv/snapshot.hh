@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef OSV_SNAPSHOT_HH_
+#define OSV_SNAPSHOT_HH_
+
+#include <functional>
+
+namespace osv {
+namespace snapshot {
+
+/**
+ * Marker printed on the console when the guest is ready to be snapshotted.
+ * scripts/firecracker.py waits for it before pausing the VM.
+ */
+constexpr const char* ready_marker = "OSv: snapshot point reached";
+
+/**
+ * Register work to do around a snapshot.
+ *
+ * \param before called at the pause point before the host is told the guest
+ *               can be snapshotted, e.g. to flush device state
+ * \param after  called once the guest runs again, from the snapshot or
+ *               because the host resumed the original VM, e.g. to drop
+ *               state which does not hold on another host
+ *
+ * Either can be empty. The before callbacks run in the order they were
+ * registered, the after ones in the reverse order.
+ */
+void register_hooks(std::function<void ()> before, std::function<void ()> after);
+
+/**
+ * Quiesce the guest, let the host know it can snapshot the VM and wait
+ * until the VM is resumed, be it from the snapshot or not.
+ *
+ * File systems are synced and the before hooks run first. A resume is
+ * noticed when the host's wall clock jumps ahead of the guest's, which
+ * happens when the VM is paused and the clock (kvmclock) is restored with
+ * it; resume() ends the wait explicitly otherwise. The clocks are then
+ * resynchronized with the host and the after hooks run before returning.
+ *
+ * Application threads are not stopped: the hypervisor pauses all vcpus
+ * while taking the snapshot. Only one thread can be at the pause point at
+ * a time.
+ */
+void pause_point();
+
+/**
+ * Make a thread waiting at pause_point() carry on as if the VM had been
+ * resumed, for hypervisors whose clock doesn't show the pause.
+ */
+void resume();
+
+}
+}
+
+#endif /* OSV_SNAPSHOT_HH_ */
@@ -3,7 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <regex.h>
+#include <stdint.h>
 
 class tracepoint_base;
 
@@ -57,6 +59,38 @@ set_event_state(tracepoint_base &, bool enable, bool stacktrace = false);
 std::string
 create_trace_dump();
 
+// Start streaming trace records, as they are written, to the given file or
+// device, or when path is empty, to memory for read_trace_stream().
+// Each cpu's buffer is drained by a low priority thread pinned to it, so
+// the stream only loses records when a cpu traces faster than that thread
+// gets to run; it then says how many.
+// The stream is in a format readable by scripts/trace.py, also while it is
+// being written (see core/trace.cc).
+// Throws std::runtime_error if a stream is already running, or the file
+// cannot be opened.
+void
+start_trace_stream(const std::string & path);
+
+void
+stop_trace_stream();
+
+struct stream_status {
+    bool active = false;
+    std::string path;
+    uint64_t records = 0;
+    uint64_t lost = 0;
+    uint64_t bytes = 0;
+};
+
+stream_status
+get_stream_status();
+
+// Take up to max bytes of a stream kept in memory, waiting up to timeout
+// for some to be there.
+// Throws std::runtime_error if there is no such stream.
+std::string
+read_trace_stream(size_t max, std::chrono::milliseconds timeout);
+
 struct symbol {
     std::string name;
     const void * addr;
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+#ifndef XMIT_BATCH_HH_
+#define XMIT_BATCH_HH_
+
+namespace osv {
+
+/**
+ * @class xmit_batch
+ *
+ * Marks a stretch of code on the current thread that is going to hand
+ * several packets to the network drivers - the equivalent of Linux's
+ * xmit_more. While a batch is open a driver may post a packet to its ring
+ * without notifying the device and register itself with defer_kick(); the
+ * device is notified once, when the outermost batch on the thread closes,
+ * no matter how many sockets the packets came from.
+ *
+ * Batches nest, so a caller does not need to know whether one is already
+ * open further up the stack.
+ */
+class xmit_batch {
+public:
+    /**
+     * Implemented by a Tx queue that has deferred its kick.
+     */
+    class flusher {
+    public:
+        /**
+         * Notify the device about everything posted since the last kick.
+         * Called on the thread that deferred the kick and must not block.
+         */
+        virtual void flush_kick() = 0;
+    protected:
+        ~flusher() {}
+    };
+
+    xmit_batch() { ++_depth; }
+    ~xmit_batch() {
+        if (--_depth == 0 && _nr_deferred) {
+            flush();
+        }
+    }
+    xmit_batch(const xmit_batch&) = delete;
+    xmit_batch& operator=(const xmit_batch&) = delete;
+
+    /**
+     * @return TRUE if the current thread has more packets coming.
+     */
+    static bool active() { return _depth != 0; }
+
+    /**
+     * Ask for f->flush_kick() to be called when the outermost batch of the
+     * current thread closes.
+     *
+     * @param f Tx queue that has just posted a packet without a kick
+     *
+     * @return TRUE if the kick has been deferred, FALSE if there is no open
+     *         batch or it already tracks too many queues - the caller should
+     *         kick right away in this case.
+     */
+    static bool defer_kick(flusher* f);
+
+private:
+    static void flush();
+
+    static constexpr unsigned max_deferred = 4;
+    static __thread unsigned _depth;
+    static __thread unsigned _nr_deferred;
+    static __thread flusher* _deferred[max_deferred];
+};
+
+}
+
+#endif /* XMIT_BATCH_HH_ */
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// POSIX asynchronous I/O, on the same engine as libaio, see <osv/aio.hh>.
+//
+// The status of an operation is kept in the aiocb: musl's __err and __ret
+// are at the same offsets as glibc's __error_code and __return_value, so
+// applications built against either C library can use it.
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+#include <osv/aio.hh>
+#include <osv/mutex.h>
+#include <osv/condvar.h>
+#include <osv/sched.hh>
+#include <osv/clock.hh>
+#include "libc/libc.hh"
+
+using op = osv::aio::request::op;
+
+// Notification for a whole lio_listio(LIO_NOWAIT) batch
+struct lio_group {
+    std::atomic<unsigned> pending;
+    struct sigevent sev;
+};
+
+struct posix_req {
+    osv::aio::request req;
+    struct aiocb *cb;
+    lio_group *group;
+    // See fd_writes
+    bool write;
+    int64_t epoch;
+};
+
+static mutex suspend_mutex;
+static condvar suspend_cv;
+static std::atomic<unsigned> suspend_waiters;
+
+// Operations in flight per fd, hashed, to tell AIO_ALLDONE from
+// AIO_NOTCANCELED when cancelling all of an fd's operations
+static constexpr unsigned fd_buckets = 256;
+static std::atomic<unsigned> fd_inflight[fd_buckets];
+
+// The writes in flight on an fd, and the aio_fsync() calls waiting for them.
+// As with glibc, which runs the operations on an fd in order, an fsync
+// covers every write queued before it. A write is tagged with the fd's
+// epoch, which each waiting fsync bumps and takes as its own, and the fsync
+// is only submitted once no write of an earlier epoch is left.
+struct fd_writes {
+    int64_t epoch = 0;
+    std::map<int64_t, unsigned> inflight;       // writes by epoch
+    std::deque<posix_req*> fsyncs;              // by epoch
+};
+
+static mutex fd_writes_mutex;
+static std::unordered_map<int, fd_writes> fd_writes_map;
+
+static bool lio_op(const struct aiocb *cb)
+{
+    return cb && (cb->aio_lio_opcode == LIO_READ || cb->aio_lio_opcode == LIO_WRITE);
+}
+
+static void notify(const struct sigevent& sev)
+{
+    switch (sev.sigev_notify) {
+    case SIGEV_SIGNAL:
+        kill(getpid(), sev.sigev_signo);
+        break;
+    case SIGEV_THREAD: {
+        // Never on the completing thread, which may be a block driver's.
+        // Like kill(), run it in a new application thread.
+        auto fn = sev.sigev_notify_function;
+        auto value = sev.sigev_value;
+        auto t = sched::thread::make([fn, value] { fn(value); },
+            sched::thread::attr().detached().stack(65536).name("aio_notify"),
+            false, true);
+        t->start();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void put_group(lio_group *group)
+{
+    if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        notify(group->sev);
+        delete group;
+    }
+}
+
+static void finish(struct aiocb *cb, int fd, int64_t res, lio_group *group)
+{
+    // Once __err is set the application may reuse the aiocb
+    struct sigevent sev = cb->aio_sigevent;
+
+    cb->__ret = res < 0 ? -1 : res;
+    __atomic_store_n(&cb->__err, res < 0 ? -res : 0, __ATOMIC_RELEASE);
+    fd_inflight[fd % fd_buckets].fetch_sub(1, std::memory_order_relaxed);
+
+    // Pairs with the fence in aio_suspend(): either it sees the status we
+    // have just set, or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (suspend_waiters.load(std::memory_order_relaxed)) {
+        WITH_LOCK(suspend_mutex) {
+            suspend_cv.wake_all();
+        }
+    }
+
+    notify(sev);
+    if (group) {
+        put_group(group);
+    }
+}
+
+// Returns the fsyncs which no longer have a write to wait for
+static std::vector<posix_req*> write_done(int fd, int64_t epoch)
+{
+    std::vector<posix_req*> ready;
+    SCOPE_LOCK(fd_writes_mutex);
+    auto it = fd_writes_map.find(fd);
+    auto& w = it->second;
+    auto e = w.inflight.find(epoch);
+    if (--e->second == 0) {
+        w.inflight.erase(e);
+    }
+    while (!w.fsyncs.empty() &&
+           (w.inflight.empty() || w.inflight.begin()->first >= w.fsyncs.front()->epoch)) {
+        ready.push_back(w.fsyncs.front());
+        w.fsyncs.pop_front();
+    }
+    if (w.inflight.empty() && w.fsyncs.empty()) {
+        fd_writes_map.erase(it);
+    }
+    return ready;
+}
+
+static void posix_done(osv::aio::request *req, int64_t res)
+{
+    auto r = reinterpret_cast<posix_req*>(req);
+    auto cb = r->cb;
+    auto fd = r->req.fd;
+    auto group = r->group;
+    auto write = r->write;
+    auto epoch = r->epoch;
+    delete r;
+    finish(cb, fd, res, group);
+    if (write) {
+        for (auto f : write_done(fd, epoch)) {
+            osv::aio::submit_deferred(&f->req);
+        }
+    }
+}
+
+static int submit(struct aiocb *cb, op opcode, lio_group *group = nullptr)
+{
+    if (cb->aio_fildes < 0) {
+        return libc_error(EBADF);
+    }
+    auto r = new (std::nothrow) posix_req;
+    if (!r) {
+        return libc_error(EAGAIN);
+    }
+    r->cb = cb;
+    r->group = group;
+    r->req.fd = cb->aio_fildes;
+    r->req.opcode = opcode;
+    r->req.buf = const_cast<void*>(cb->aio_buf);
+    r->req.nbytes = cb->aio_nbytes;
+    r->req.offset = cb->aio_offset;
+    r->req.owner = cb;
+    r->req.done = posix_done;
+    // posix_done() takes locks, signals and may start a SIGEV_THREAD thread
+    r->req.done_may_block = true;
+    r->write = opcode == op::write;
+    r->epoch = 0;
+
+    cb->__ret = 0;
+    __atomic_store_n(&cb->__err, EINPROGRESS, __ATOMIC_RELAXED);
+    fd_inflight[cb->aio_fildes % fd_buckets].fetch_add(1, std::memory_order_relaxed);
+
+    bool deferred = false;
+    switch (opcode) {
+    case op::write:
+        WITH_LOCK(fd_writes_mutex) {
+            auto& w = fd_writes_map[cb->aio_fildes];
+            r->epoch = w.epoch;
+            w.inflight[w.epoch]++;
+        }
+        break;
+    case op::fsync:
+    case op::fdatasync:
+        WITH_LOCK(fd_writes_mutex) {
+            auto it = fd_writes_map.find(cb->aio_fildes);
+            if (it != fd_writes_map.end()) {
+                // Writes queued from now on are not covered
+                r->epoch = ++it->second.epoch;
+                it->second.fsyncs.push_back(r);
+                deferred = true;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    if (!deferred) {
+        osv::aio::submit(&r->req);
+    }
+    return 0;
+}
+
+OSV_LIBC_API
+int aio_read(struct aiocb *cb)
+{
+    return submit(cb, op::read);
+}
+
+OSV_LIBC_API
+int aio_write(struct aiocb *cb)
+{
+    return submit(cb, op::write);
+}
+
+OSV_LIBC_API
+int aio_fsync(int mode, struct aiocb *cb)
+{
+    if (mode != O_SYNC && mode != O_DSYNC) {
+        return libc_error(EINVAL);
+    }
+    return submit(cb, mode == O_SYNC ? op::fsync : op::fdatasync);
+}
+
+OSV_LIBC_API
+int aio_error(const struct aiocb *cb)
+{
+    return __atomic_load_n(&cb->__err, __ATOMIC_ACQUIRE);
+}
+
+OSV_LIBC_API
+ssize_t aio_return(struct aiocb *cb)
+{
+    return cb->__ret;
+}
+
+// Wait until done() holds or the deadline passes; returns false on timeout
+template <typename Done>
+static bool wait_for(Done done, const struct timespec *ts)
+{
+    if (done()) {
+        return true;
+    }
+    auto deadline = osv::clock::uptime::now();
+    if (ts) {
+        deadline += std::chrono::seconds(ts->tv_sec) +
+                    std::chrono::nanoseconds(ts->tv_nsec);
+    }
+
+    bool ret = true;
+    WITH_LOCK(suspend_mutex) {
+        suspend_waiters.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (done()) {
+                break;
+            }
+            if (ts) {
+                if (suspend_cv.wait(&suspend_mutex, deadline) != 0) {
+                    ret = done();
+                    break;
+                }
+            } else {
+                suspend_cv.wait(suspend_mutex);
+            }
+        }
+        suspend_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+OSV_LIBC_API
+int aio_suspend(const struct aiocb *const list[], int nent, const struct timespec *ts)
+{
+    if (nent < 0 || (ts && (ts->tv_sec < 0 || ts->tv_nsec < 0 ||
+                            ts->tv_nsec >= 1000000000L))) {
+        return libc_error(EINVAL);
+    }
+    auto any_done = [list, nent] {
+        for (int i = 0; i < nent; i++) {
+            if (list[i] && aio_error(list[i]) != EINPROGRESS) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (!wait_for(any_done, ts)) {
+        return libc_error(EAGAIN);
+    }
+    return 0;
+}
+
+OSV_LIBC_API
+int aio_cancel(int fd, struct aiocb *cb)
+{
+    if (fcntl(fd, F_GETFD) < 0) {
+        return -1;
+    }
+    if (cb && cb->aio_fildes != fd) {
+        return libc_error(EINVAL);
+    }
+
+    // Only operations still waiting for a worker, or fsyncs still waiting
+    // for writes, can be cancelled
+    int ret = AIO_ALLDONE;
+    std::vector<posix_req*> fsyncs;
+    WITH_LOCK(fd_writes_mutex) {
+        auto it = fd_writes_map.find(fd);
+        if (it != fd_writes_map.end()) {
+            auto& q = it->second.fsyncs;
+            for (auto i = q.begin(); i != q.end();) {
+                if (!cb || (*i)->cb == cb) {
+                    fsyncs.push_back(*i);
+                    i = q.erase(i);
+                } else {
+                    ++i;
+                }
+            }
+        }
+    }
+    for (auto r : fsyncs) {
+        auto c = r->cb;
+        auto group = r->group;
+        delete r;
+        finish(c, fd, -ECANCELED, group);
+        ret = AIO_CANCELED;
+    }
+    while (auto req = osv::aio::cancel([fd, cb] (const osv::aio::request& r) {
+            return r.done == posix_done && r.fd == fd && (!cb || r.owner == cb); })) {
+        auto r = reinterpret_cast<posix_req*>(req);
+        auto c = r->cb;
+        auto group = r->group;
+        delete r;
+        finish(c, fd, -ECANCELED, group);
+        ret = AIO_CANCELED;
+    }
+    if (cb ? aio_error(cb) == EINPROGRESS
+           : fd_inflight[fd % fd_buckets].load(std::memory_order_relaxed) != 0) {
+        ret = AIO_NOTCANCELED;
+    }
+    return ret;
+}
+
+OSV_LIBC_API
+int lio_listio(int mode, struct aiocb *const list[], int nent, struct sigevent *sev)
+{
+    if ((mode != LIO_WAIT && mode != LIO_NOWAIT) || nent < 0) {
+        return libc_error(EINVAL);
+    }
+
+    lio_group *group = nullptr;
+    if (mode == LIO_NOWAIT && sev && sev->sigev_notify != SIGEV_NONE) {
+        group = new (std::nothrow) lio_group;
+        if (!group) {
+            return libc_error(EAGAIN);
+        }
+        // Our own reference, so the group can't complete while submitting
+        group->pending.store(1, std::memory_order_relaxed);
+        group->sev = *sev;
+    }
+
+    int error = 0;
+    for (int i = 0; i < nent; i++) {
+        auto cb = list[i];
+        if (!lio_op(cb)) {
+            continue;
+        }
+        if (group) {
+            group->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (submit(cb, cb->aio_lio_opcode == LIO_READ ? op::read : op::write, group) < 0) {
+            cb->__ret = -1;
+            __atomic_store_n(&cb->__err, errno, __ATOMIC_RELEASE);
+            error = EAGAIN;
+            if (group) {
+                group->pending.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (group) {
+        put_group(group);
+    }
+
+    if (mode == LIO_WAIT) {
+        auto all_done = [list, nent] {
+            for (int i = 0; i < nent; i++) {
+                if (lio_op(list[i]) && aio_error(list[i]) == EINPROGRESS) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        wait_for(all_done, nullptr);
+        for (int i = 0; i < nent; i++) {
+            if (lio_op(list[i]) && aio_error(list[i])) {
+                error = EIO;
+            }
+        }
+    }
+    return error ? libc_error(error) : 0;
+}
+
+#undef aio_read64
+#undef aio_write64
+#undef aio_fsync64
+#undef aio_error64
+#undef aio_return64
+#undef aio_suspend64
+#undef aio_cancel64
+#undef lio_listio64
+LFS64(aio_read);
+LFS64(aio_write);
+LFS64(aio_fsync);
+LFS64(aio_error);
+LFS64(aio_return);
+LFS64(aio_suspend);
+LFS64(aio_cancel);
+LFS64(lio_listio);
@@ -8,6 +8,7 @@
 #include "libc.hh"
 #include <osv/sched.hh>
 #include <osv/mutex.h>
+#include <osv/file.h>
 #include <stdio.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -85,7 +86,11 @@ static void init_rlimits_locked()
     }
     rlimits[RLIMIT_STACK].rlim_cur = rlimits[RLIMIT_STACK].rlim_max =
         default_stack_limit();
-    rlimits[RLIMIT_NOFILE].rlim_cur = rlimits[RLIMIT_NOFILE].rlim_max = 1024 * 10;
+    // The descriptor table can grow to FDLIMIT entries, but programs that
+    // close every descriptor up to sysconf(_SC_OPEN_MAX) should not have to
+    // go through a million of them, so like Linux the soft limit is lower.
+    rlimits[RLIMIT_NOFILE].rlim_cur = 1024 * 10;
+    rlimits[RLIMIT_NOFILE].rlim_max = FDLIMIT;
     rlimits[RLIMIT_NICE].rlim_cur = rlimits[RLIMIT_NICE].rlim_max = 0;
     rlimits_initialized = true;
 }
@@ -121,6 +126,10 @@ int setrlimit(int resource, const struct rlimit *rlim)
         errno = EINVAL;
         return -1;
     }
+    if (resource == RLIMIT_NOFILE && rlim->rlim_max > FDLIMIT) {
+        errno = EPERM;
+        return -1;
+    }
     // OSv does not enforce the limits, but we store them so getrlimit() is
     // consistent with what the application set.
     WITH_LOCK(rlimit_mutex) {
@@ -19,6 +19,11 @@
 #include <atomic>
 #include <osv/kernel_config_memory_jvm_balloon.h>
 
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
 #ifndef MAP_UNINITIALIZED
 #define MAP_UNINITIALIZED 0x4000000
 #endif
@@ -47,7 +52,7 @@ unsigned libc_flags_to_mmap(int flags)
         mmap_flags |= mmu::mmap_populate;
     }
     if (flags & MAP_STACK) {
-        mmap_flags |= mmu::mmap_stack;
+        mmap_flags |= mmu::mmap_stack | mmu::mmap_nocollapse;
     }
     if (flags & MAP_SHARED) {
         mmap_flags |= mmu::mmap_shared;
@@ -57,6 +62,9 @@ unsigned libc_flags_to_mmap(int flags)
     }
     if (flags & MAP_HUGETLB) {
         mmap_flags |= mmu::mmap_huge;
+        if ((flags & (MAP_HUGE_MASK << MAP_HUGE_SHIFT)) == MAP_HUGE_1GB) {
+            mmap_flags |= mmu::mmap_huge_1g;
+        }
         mmap_flags |= mmu::mmap_populate;  // pre-populate so ENOMEM is returned at map time
     }
     return mmap_flags;
@@ -118,6 +126,14 @@ int mmap_validate(void *addr, size_t length, int flags, off_t offset)
         !mmu::is_page_aligned(offset) || length == 0) {
         return EINVAL;
     }
+    // The huge page size, if one is given, has to be one the mmu can use
+    if (flags & MAP_HUGETLB) {
+        auto huge_size = flags & (MAP_HUGE_MASK << MAP_HUGE_SHIFT);
+        if (huge_size && huge_size != MAP_HUGE_2MB &&
+            (huge_size != MAP_HUGE_1GB || mmu::get_nr_page_sizes() < 3)) {
+            return EINVAL;
+        }
+    }
     return 0;
 }
 
@@ -34,7 +34,15 @@ public:
     virtual int read(uio* data, int flags) override;
     virtual int write(uio* data, int flags) override;
     virtual int poll(int events) override;
+    virtual int ioctl(u_long com, void *data) override;
     virtual int close() override;
+    pipe_buffer* buffer(int direction) {
+        if (direction == FWRITE) {
+            return writer ? writer->buf.get() : nullptr;
+        } else {
+            return reader ? reader->buf.get() : nullptr;
+        }
+    }
 private:
     pipe_writer* writer = nullptr;
     pipe_reader* reader = nullptr;
@@ -74,6 +82,28 @@ int pipe_file::poll(int events)
     }
 }
 
+int pipe_file::ioctl(u_long com, void *data)
+{
+    auto buf = (f_flags & FWRITE) ? writer->buf : reader->buf;
+    auto size = static_cast<int*>(data);
+    size_t result;
+    switch (com) {
+    case F_SETPIPE_SZ:
+        if (*size < 0) {
+            return EINVAL;
+        } else if (int error = buf->set_size(*size, &result)) {
+            return error;
+        }
+        *size = result;
+        return 0;
+    case F_GETPIPE_SZ:
+        *size = buf->size();
+        return 0;
+    default:
+        return special_file::ioctl(com, data);
+    }
+}
+
 int pipe_file::close()
 {
     if (f_flags & FWRITE) {
@@ -86,6 +116,15 @@ int pipe_file::close()
     return 0;
 }
 
+pipe_buffer* pipe_buffer_of(struct file* fp, int direction)
+{
+    auto pf = dynamic_cast<pipe_file*>(fp);
+    if (!pf || !(pf->f_flags & direction)) {
+        return nullptr;
+    }
+    return pf->buffer(direction);
+}
+
 OSV_LIBC_API
 int pipe2(int pipefd[2], int flags) {
     if (flags & ~(O_NONBLOCK | O_CLOEXEC)) {
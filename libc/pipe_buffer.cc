@@ -10,8 +10,29 @@
 
 #include "pipe_buffer.hh"
 
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+
+#include <osv/align.hh>
+#include <osv/pagealloc.hh>
 #include <osv/poll.h>
 
+pipe_buffer::pipe_buffer()
+    : pages(new char*[default_size / page_size]())
+    , npages(default_size / page_size)
+{
+}
+
+pipe_buffer::~pipe_buffer()
+{
+    for (unsigned i = 0; i < npages; i++) {
+        if (pages[i]) {
+            memory::free_page(pages[i]);
+        }
+    }
+}
+
 void pipe_buffer::detach_sender()
 {
     std::lock_guard<mutex> guard(mtx);
@@ -46,99 +67,214 @@ void pipe_buffer::attach_receiver(struct file *f)
     receiver = f;
 }
 
-int pipe_buffer::read_events_unlocked()
+// The writer may fill the ring up to the start of the page the reader is
+// in, but not that page itself, so that the reader can free each page as
+// soon as it is done with it.
+size_t pipe_buffer::free_space(uint64_t h, uint64_t t) const
 {
-    int ret = 0;
-    ret |= !q.empty() ? POLLIN : 0;
-    ret |= !sender ? POLLHUP : 0;
-    return ret;
+    return capacity() - (t - align_down(h, uint64_t(page_size)));
 }
 
-int pipe_buffer::write_events_unlocked()
+// Returns the memory for ring position pos, allocating its page if the
+// writer is the first to get there.
+char* pipe_buffer::writable(uint64_t pos)
 {
-    if (!receiver) {
-        return no_receiver_event;
+    auto& page = slot(pos);
+    if (!page) {
+        page = static_cast<char*>(memory::alloc_page());
+        if (!page) {
+            return nullptr;
+        }
     }
-    int ret = 0;
-    ret |= q.size() < max_buf ? POLLOUT : 0;
-    return ret;
+    return page + pos % page_size;
 }
 
-int pipe_buffer::read_events()
+// Frees the pages the reader finished with by moving from one ring position
+// to another. Slots whose page was passed to another pipe are empty.
+void pipe_buffer::consumed(uint64_t from, uint64_t to)
 {
-    WITH_LOCK(mtx) {
-        return read_events_unlocked();
+    for (auto end = align_up(from + 1, uint64_t(page_size)); end <= to; end += page_size) {
+        auto& page = slot(end - 1);
+        if (page) {
+            memory::free_page(page);
+            page = nullptr;
+        }
     }
 }
 
-int pipe_buffer::write_events()
+// Describes up to len bytes of the ring from pos on as an iovec array of at
+// most max_iov entries, returning the number of bytes described.
+size_t pipe_buffer::map(uint64_t pos, size_t len, bool alloc, iovec* iov, int* iovcnt)
 {
-    WITH_LOCK(mtx) {
-        return write_events_unlocked();
+    size_t mapped = 0;
+    *iovcnt = 0;
+    while (mapped < len && *iovcnt < int(max_iov)) {
+        char* p = alloc ? writable(pos) : slot(pos) + pos % page_size;
+        if (!p) {
+            break;
+        }
+        auto n = std::min(page_size - pos % page_size, len - mapped);
+        iov[(*iovcnt)++] = { p, n };
+        mapped += n;
+        pos += n;
     }
+    return mapped;
 }
 
-// Copy from the pipe into the given iovec array, until the array is full
-// or the queue is empty. Decrements uio->uio_resid.
-static void copy_to_uio(std::deque<char> &q, uio *uio)
+// Sleeping is the slow path, readers and writers only take mtx when the
+// other side is waiting (or polling) according to these counters. Each side
+// updates its position before checking the other's counter, and the other
+// side bumps its counter before checking the position, so one of them
+// always sees the other.
+int pipe_buffer::wait_readable(bool nonblock)
 {
-    for (int i = 0; i < uio->uio_iovcnt && !q.empty(); i++) {
-        auto &iov = uio->uio_iov[i];
-        auto n = std::min(q.size(), iov.iov_len);
-        char* p = static_cast<char*>(iov.iov_base);
-        std::copy(q.begin(), q.begin() + n, p);
-        q.erase(q.begin(), q.begin() + n);
-        uio->uio_resid -= n;
+    if (nonblock) {
+        return EAGAIN;
+    }
+    WITH_LOCK(mtx) {
+        readers_waiting.fetch_add(1);
+        while (sender.load() && head.load() == tail.load()) {
+            may_read.wait(&mtx);
+        }
+        readers_waiting.fetch_sub(1);
     }
+    return 0;
 }
 
-int pipe_buffer::read(uio* data, bool nonblock)
+int pipe_buffer::wait_writable(size_t room, bool nonblock)
 {
-    if (!data->uio_resid) {
-        return 0;
+    if (nonblock) {
+        return EAGAIN;
+    }
+    WITH_LOCK(mtx) {
+        writers_waiting.fetch_add(1);
+        while (receiver.load() && free_space(head.load(), tail.load()) < room) {
+            may_write.wait(&mtx);
+        }
+        writers_waiting.fetch_sub(1);
     }
-    std::unique_lock<mutex> lock(mtx);
-    if (nonblock && q.empty()) {
-        return sender ? EAGAIN : 0;
+    return 0;
+}
+
+void pipe_buffer::publish(uint64_t t)
+{
+    tail.store(t, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (readers_waiting.load(std::memory_order_relaxed) ||
+        polled.load(std::memory_order_relaxed)) {
+        WITH_LOCK(mtx) {
+            if (polled.load(std::memory_order_relaxed) && receiver) {
+                poll_wake(receiver, (POLLIN | POLLRDNORM));
+            }
+            may_read.wake_all();
+        }
     }
-    while (sender && q.empty()) {
-        may_read.wait(&mtx);
+}
+
+void pipe_buffer::consume(uint64_t h)
+{
+    head.store(h, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writers_waiting.load(std::memory_order_relaxed) ||
+        polled.load(std::memory_order_relaxed)) {
+        WITH_LOCK(mtx) {
+            if (polled.load(std::memory_order_relaxed) && sender) {
+                poll_wake(sender, (POLLOUT | POLLWRNORM));
+            }
+            may_write.wake_all();
+        }
     }
-    if (q.empty()) {
-        return 0;
+}
+
+int pipe_buffer::read_events()
+{
+    if (!polled.load(std::memory_order_relaxed)) {
+        polled.store(true);
     }
-    copy_to_uio(q, data);
-    if (write_events_unlocked() & POLLOUT)
-        poll_wake(sender, (POLLOUT | POLLWRNORM));
-    lock.unlock();
-    may_write.wake_all();
-    return 0;
+    int ret = 0;
+    ret |= !sender.load() ? POLLHUP : 0;
+    ret |= head.load() != tail.load() ? POLLIN : 0;
+    return ret;
 }
 
-// Copy from a certain iovec array into a pipe, starting at a given index
-// and offset, until the buffer or the array ends. Decrements uio->uio_resid,
-// and modifies ind and offset to where the copy stopped.
-static void copy_from_uio(uio *uio, size_t *ind, size_t *offset,
-        std::deque<char> &buf, size_t bufsize)
+int pipe_buffer::write_events()
 {
-    int i = *ind;
-    size_t off = *offset;
+    if (!polled.load(std::memory_order_relaxed)) {
+        polled.store(true);
+    }
+    if (!receiver.load()) {
+        return no_receiver_event;
+    }
+    int ret = 0;
+    WITH_LOCK(mtx) {
+        ret |= free_space(head.load(), tail.load()) ? POLLOUT : 0;
+    }
+    return ret;
+}
 
-    while (i < uio->uio_iovcnt && buf.size() < bufsize) {
-        auto &iov = uio->uio_iov[i];
-        auto n = std::min(bufsize - buf.size(), iov.iov_len - off);
-        char* p = static_cast<char*>(iov.iov_base) + off;
-        std::copy(p, p + n, std::back_inserter(buf));
-        uio->uio_resid -= n;
-        off += n;
-        if (off == iov.iov_len) {
-            ++i;
-            off = 0;
+// Walks a uio's iovec array without modifying it, decrementing uio_resid
+// as data is copied in or out.
+namespace {
+struct uio_cursor {
+    explicit uio_cursor(uio* u) : u(u) {}
+    template <typename Copy>
+    void copy(size_t n, Copy copy) {
+        while (n && i < u->uio_iovcnt) {
+            auto& iov = u->uio_iov[i];
+            auto len = std::min(n, iov.iov_len - off);
+            copy(static_cast<char*>(iov.iov_base) + off, len);
+            u->uio_resid -= len;
+            off += len;
+            n -= len;
+            if (off == iov.iov_len) {
+                i++;
+                off = 0;
+            }
         }
     }
+    uio* u;
+    int i = 0;
+    size_t off = 0;
+};
+}
 
-    *offset = off;
-    *ind = i;
+int pipe_buffer::read(uio* data, bool nonblock)
+{
+    if (!data->uio_resid) {
+        return 0;
+    }
+    uio_cursor cursor(data);
+    while (true) {
+        WITH_LOCK(read_mtx) {
+            // Check for the writer first: once it is gone, everything it
+            // wrote is visible.
+            bool writer = sender.load(std::memory_order_acquire);
+            auto h = head.load(std::memory_order_relaxed);
+            auto t = tail.load(std::memory_order_acquire);
+            if (h != t) {
+                auto end = h + std::min<uint64_t>(t - h, data->uio_resid);
+                for (auto pos = h; pos < end;) {
+                    auto n = std::min<uint64_t>(page_size - pos % page_size, end - pos);
+                    const char* p = slot(pos) + pos % page_size;
+                    cursor.copy(n, [&] (char* to, size_t len) {
+                        memcpy(to, p, len);
+                        p += len;
+                    });
+                    pos += n;
+                }
+                consumed(h, end);
+                consume(end);
+                return 0;
+            }
+            if (!writer) {
+                return 0;
+            }
+        }
+        int error = wait_readable(nonblock);
+        if (error) {
+            return error;
+        }
+    }
 }
 
 int pipe_buffer::write(uio* data, bool nonblock)
@@ -146,51 +282,251 @@ int pipe_buffer::write(uio* data, bool nonblock)
     if (!data->uio_resid) {
         return 0;
     }
-    WITH_LOCK(mtx) {
-        // A write() smaller than PIPE_BUF (=4096 in Linux) will not be split
-        // (i.e., will be "atomic"): For such a small write, we need to wait
-        // until there's enough room for all it in the buffer.
-        int needroom = data->uio_resid <= 4096 ? data->uio_resid : 1;
-        if (nonblock) {
-            if (!receiver) {
+    // A write() smaller than PIPE_BUF (=4096 in Linux) will not be split
+    // (i.e., will be "atomic"): For such a small write, we need to wait
+    // until there's enough room for all it in the buffer.
+    size_t needroom = data->uio_resid <= PIPE_BUF ? data->uio_resid : 1;
+    bool wrote = false;
+    uio_cursor cursor(data);
+    // A blocking write() to a pipe never returns with partial success -
+    // it waits, possibly writing its output in parts and waiting multiple
+    // times, until the whole given buffer is written.
+    while (true) {
+        WITH_LOCK(write_mtx) {
+            if (!receiver.load(std::memory_order_acquire)) {
                 // FIXME: If we don't generate a SIGPIPE here, at least assert
                 // that the user did not install a SIGPIPE handler.
-                return EPIPE;
-            } else if (q.size() + needroom > max_buf) {
-                return EAGAIN;
+                return wrote ? 0 : EPIPE;
             }
-        } else {
-            while (receiver && q.size() + needroom > max_buf) {
-                may_write.wait(&mtx);
+            auto t = tail.load(std::memory_order_relaxed);
+            auto space = free_space(head.load(std::memory_order_acquire), t);
+            if (space >= needroom) {
+                auto end = t + std::min<uint64_t>(space, data->uio_resid);
+                auto pos = t;
+                while (pos < end) {
+                    char* p = writable(pos);
+                    if (!p) {
+                        break;
+                    }
+                    auto n = std::min<uint64_t>(page_size - pos % page_size, end - pos);
+                    cursor.copy(n, [&] (char* from, size_t len) {
+                        memcpy(p, from, len);
+                        p += len;
+                    });
+                    pos += n;
+                }
+                if (pos == t) {
+                    return wrote ? 0 : ENOMEM;
+                }
+                publish(pos);
+                wrote = true;
+                needroom = 1;
+                if (!data->uio_resid) {
+                    return 0;
+                }
+                continue;
             }
-            if (!receiver) {
+        }
+        if (wrote && nonblock) {
+            return 0;
+        }
+        int error = wait_writable(needroom, nonblock);
+        if (error) {
+            return error;
+        }
+    }
+}
+
+int pipe_buffer::fill(size_t len, bool nonblock, const transfer_func& fn, size_t* done)
+{
+    *done = 0;
+    while (true) {
+        WITH_LOCK(write_mtx) {
+            if (!receiver.load(std::memory_order_acquire)) {
                 return EPIPE;
             }
+            auto t = tail.load(std::memory_order_relaxed);
+            auto space = free_space(head.load(std::memory_order_acquire), t);
+            if (space) {
+                iovec iov[max_iov];
+                int iovcnt;
+                if (!map(t, std::min(space, len), true, iov, &iovcnt)) {
+                    return ENOMEM;
+                }
+                auto r = fn(iov, iovcnt);
+                if (r < 0) {
+                    return -r;
+                }
+                if (r) {
+                    publish(t + r);
+                }
+                *done = r;
+                return 0;
+            }
+        }
+        int error = wait_writable(1, nonblock);
+        if (error) {
+            return error;
+        }
+    }
+}
+
+int pipe_buffer::drain(size_t len, bool nonblock, const transfer_func& fn, size_t* done)
+{
+    *done = 0;
+    while (true) {
+        WITH_LOCK(read_mtx) {
+            bool writer = sender.load(std::memory_order_acquire);
+            auto h = head.load(std::memory_order_relaxed);
+            auto t = tail.load(std::memory_order_acquire);
+            if (h != t) {
+                iovec iov[max_iov];
+                int iovcnt;
+                map(h, std::min<uint64_t>(t - h, len), false, iov, &iovcnt);
+                auto r = fn(iov, iovcnt);
+                if (r < 0) {
+                    return -r;
+                }
+                if (r) {
+                    consumed(h, h + r);
+                    consume(h + r);
+                }
+                *done = r;
+                return 0;
+            }
+            if (!writer) {
+                return 0;
+            }
+        }
+        int error = wait_readable(nonblock);
+        if (error) {
+            return error;
         }
+    }
+}
 
-        // A blocking write() to a pipe never returns with partial success -
-        // it waits, possibly writing its output in parts and waiting multiple
-        // times, until the whole given buffer is written.
-        size_t ind = 0, offset = 0;
-        while (data->uio_resid && receiver) {
-            copy_from_uio(data, &ind, &offset, q, max_buf);
-            if (data->uio_resid) {
-                // The buffer is full but we still have more to send. Wake up
-                // readers, and go to sleep ourselves.
-                assert(q.size() == max_buf);
-                poll_wake(receiver, (POLLIN | POLLRDNORM));
-                may_read.wake_all();
-                if (nonblock) {
+int pipe_buffer::splice(pipe_buffer& in, pipe_buffer& out, size_t len,
+                        bool nonblock, bool peek, size_t* done)
+{
+    *done = 0;
+    if (&in == &out) {
+        return EINVAL;
+    }
+    while (true) {
+        bool empty = false;
+        WITH_LOCK(in.read_mtx) {
+            bool writer = in.sender.load(std::memory_order_acquire);
+            auto h = in.head.load(std::memory_order_relaxed);
+            auto t = in.tail.load(std::memory_order_acquire);
+            if (h == t) {
+                if (!writer) {
                     return 0;
                 }
-                while (receiver && q.size() == max_buf) {
-                    may_write.wait(&mtx);
+                empty = true;
+            } else WITH_LOCK(out.write_mtx) {
+                if (!out.receiver.load(std::memory_order_acquire)) {
+                    return EPIPE;
+                }
+                auto ot = out.tail.load(std::memory_order_relaxed);
+                auto space = out.free_space(out.head.load(std::memory_order_acquire), ot);
+                if (space) {
+                    auto end = h + std::min<uint64_t>({len, t - h, space});
+                    auto pos = h;
+                    auto opos = ot;
+                    while (pos < end) {
+                        if (!peek && pos % page_size == 0 && opos % page_size == 0 &&
+                            end - pos >= page_size) {
+                            // A whole page on both sides, hand it over
+                            auto& to = out.slot(opos);
+                            if (to) {
+                                memory::free_page(to);
+                            }
+                            to = in.slot(pos);
+                            in.slot(pos) = nullptr;
+                            pos += page_size;
+                            opos += page_size;
+                            continue;
+                        }
+                        char* p = out.writable(opos);
+                        if (!p) {
+                            break;
+                        }
+                        auto n = std::min<uint64_t>({page_size - pos % page_size,
+                                                     page_size - opos % page_size,
+                                                     end - pos});
+                        memcpy(p, in.slot(pos) + pos % page_size, n);
+                        pos += n;
+                        opos += n;
+                    }
+                    if (pos == h) {
+                        return ENOMEM;
+                    }
+                    out.publish(opos);
+                    if (!peek) {
+                        in.consumed(h, pos);
+                        in.consume(pos);
+                    }
+                    *done = pos - h;
+                    return 0;
                 }
             }
         }
-        if (read_events_unlocked() & POLLIN)
-            poll_wake(receiver, (POLLIN | POLLRDNORM));
+        int error = empty ? in.wait_readable(nonblock) : out.wait_writable(1, nonblock);
+        if (error) {
+            return error;
+        }
+    }
+}
+
+int pipe_buffer::set_size(size_t size, size_t* result)
+{
+    if (size > max_size) {
+        return EPERM;
+    }
+    // Linux rounds up to a power of two pages. We want at least two, so
+    // that a PIPE_BUF write always fits into an empty pipe whatever page
+    // the reader is in.
+    unsigned n = 2;
+    while (n * page_size < size) {
+        n *= 2;
+    }
+    WITH_LOCK(write_mtx) {
+        WITH_LOCK(read_mtx) {
+            WITH_LOCK(mtx) {
+                auto h = head.load(std::memory_order_relaxed);
+                auto t = tail.load(std::memory_order_relaxed);
+                auto first = align_down(h, uint64_t(page_size));
+                if (align_up(t, uint64_t(page_size)) - first > n * page_size) {
+                    return EBUSY;
+                }
+                if (n != npages) {
+                    std::unique_ptr<char*[]> ring(new char*[n]());
+                    for (auto pos = first; pos < t; pos += page_size) {
+                        ring[(pos / page_size) & (n - 1)] = slot(pos);
+                        slot(pos) = nullptr;
+                    }
+                    for (unsigned i = 0; i < npages; i++) {
+                        if (pages[i]) {
+                            memory::free_page(pages[i]);
+                        }
+                    }
+                    pages = std::move(ring);
+                    npages = n;
+                    if (polled.load(std::memory_order_relaxed) && sender) {
+                        poll_wake(sender, (POLLOUT | POLLWRNORM));
+                    }
+                    may_write.wake_all();
+                }
+                *result = capacity();
+            }
+        }
     }
-    may_read.wake_all();
     return 0;
 }
+
+size_t pipe_buffer::size()
+{
+    WITH_LOCK(mtx) {
+        return capacity();
+    }
+}
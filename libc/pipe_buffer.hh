@@ -8,20 +8,41 @@
 #ifndef PIPE_BUFFER_HH_
 #define PIPE_BUFFER_HH_
 
-#include <deque>
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <boost/intrusive_ptr.hpp>
+#include <sys/uio.h>
 
 #include <osv/mutex.h>
 #include <osv/condvar.h>
 #include <osv/file.h>
+#include <osv/mmu-defs.hh>
 
+// A pipe's data lives in a ring of pages, indexed by the free-running byte
+// counters head (next byte to read) and tail (next byte to write). Pages
+// are allocated when the writer reaches them and freed as soon as the
+// reader has consumed them, so an idle pipe holds at most one page.
+//
+// The reader only ever moves head and the writer only ever moves tail, so a
+// single reader and a single writer exchange data without sharing a lock:
+// read_mtx serializes readers among themselves and write_mtx writers. mtx
+// and the condvars are only used to sleep and to attach or detach the ends.
+// The writer never enters the page the reader is in, which makes each page
+// owned by one side at a time.
 struct pipe_buffer {
-private:
-    static constexpr size_t max_buf = 8192;
 public:
-    pipe_buffer() = default;
+    static constexpr size_t default_size = 16 * mmu::page_size;
+    // Linux's default /proc/sys/fs/pipe-max-size
+    static constexpr size_t max_size = 1 << 20;
+    // Moves data between a pipe and something else, for splice(2). Gets
+    // the pipe's memory and returns the number of bytes transferred, or a
+    // negative errno.
+    using transfer_func = std::function<ssize_t (const iovec* iov, int iovcnt)>;
+
+    pipe_buffer();
     pipe_buffer(const pipe_buffer&) = delete;
+    ~pipe_buffer();
     int read(uio* data, bool nonblock);
     int write(uio* data, bool nonblock);
     int read_events();
@@ -33,14 +54,50 @@ public:
     void set_no_receiver_event(int event) {
         this->no_receiver_event = event;
     }
+    // F_SETPIPE_SZ and F_GETPIPE_SZ
+    int set_size(size_t size, size_t* result);
+    size_t size();
+    // Writes up to len bytes into the pipe by handing its free space to fn.
+    int fill(size_t len, bool nonblock, const transfer_func& fn, size_t* done);
+    // Reads up to len bytes out of the pipe by handing its data to fn.
+    int drain(size_t len, bool nonblock, const transfer_func& fn, size_t* done);
+    // Moves up to len bytes from one pipe to another, passing whole pages
+    // over instead of copying them where alignment allows. With peek, the
+    // data is copied and left in the source pipe, as tee(2) does.
+    static int splice(pipe_buffer& in, pipe_buffer& out, size_t len,
+                      bool nonblock, bool peek, size_t* done);
 private:
-    int read_events_unlocked();
-    int write_events_unlocked();
+    static constexpr size_t page_size = mmu::page_size;
+    static constexpr unsigned max_iov = 16;
+    size_t capacity() const { return npages * page_size; }
+    char*& slot(uint64_t pos) {
+        return pages[(pos / page_size) & (npages - 1)];
+    }
+    size_t free_space(uint64_t h, uint64_t t) const;
+    char* writable(uint64_t pos);
+    void consumed(uint64_t from, uint64_t to);
+    size_t map(uint64_t pos, size_t len, bool alloc, iovec* iov, int* iovcnt);
+    int wait_readable(bool nonblock);
+    int wait_writable(size_t room, bool nonblock);
+    void publish(uint64_t t);
+    void consume(uint64_t h);
 private:
+    // The ring, changed only with read_mtx, write_mtx and mtx all held
+    std::unique_ptr<char*[]> pages;
+    unsigned npages;
+    std::atomic<uint64_t> head = { 0 };
+    std::atomic<uint64_t> tail = { 0 };
+    mutex read_mtx;
+    mutex write_mtx;
     mutex mtx;
-    std::deque<char> q;
-    struct file *receiver = nullptr;
-    struct file *sender = nullptr;
+    // changed under mtx:
+    std::atomic<struct file*> receiver = { nullptr };
+    std::atomic<struct file*> sender = { nullptr };
+    std::atomic<unsigned> readers_waiting = { 0 };
+    std::atomic<unsigned> writers_waiting = { 0 };
+    // Set once an end has been polled: from then on every change has to
+    // be reported with poll_wake()
+    std::atomic<bool> polled = { false };
     std::atomic<unsigned> refs = {};
     condvar may_read;
     condvar may_write;
@@ -57,4 +114,8 @@ private:
 
 typedef boost::intrusive_ptr<pipe_buffer> pipe_buffer_ref;
 
+// Returns the buffer behind a pipe(2) end, with the given FREAD or FWRITE
+// direction, or nullptr if fp is something else.
+pipe_buffer* pipe_buffer_of(struct file* fp, int direction);
+
 #endif /* PIPE_BUFFER_HH */
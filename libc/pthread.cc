@@ -145,9 +145,9 @@ namespace pthread_private {
         }
         size_t size = attr.stack_size;
 #if CONF_lazy_stack
-        unsigned stack_flags = mmu::mmap_stack;
+        unsigned stack_flags = mmu::mmap_stack | mmu::mmap_nocollapse;
 #else
-        unsigned stack_flags = mmu::mmap_populate;
+        unsigned stack_flags = mmu::mmap_populate | mmu::mmap_nocollapse;
 #endif
         void *addr = mmu::map_anon(nullptr, size, stack_flags, mmu::perm_rw);
         mmu::mprotect(addr, attr.guard_size, 0);
@@ -394,28 +394,13 @@ int pthread_spin_unlock(pthread_spinlock_t *lock)
     return 0;
 }
 
-#ifdef LOCKFREE_MUTEX
-typedef lazy_indirect<mutex> indirect_mutex;
-static_assert(sizeof(indirect_mutex) <= sizeof(pthread_mutex_t), "mutex overflow");
-static_assert(sizeof(indirect_mutex) <= 16, "pthread_mutex_t not zeroed at byte 16");
-int pthread_mutex_init(pthread_mutex_t* __restrict m,
-        const pthread_mutexattr_t* __restrict attr)
-{
-    // FIXME: respect attr
-    new (m) indirect_mutex;
-    return 0;
-}
-int pthread_mutex_destroy(pthread_mutex_t *m)
-{
-    reinterpret_cast<indirect_mutex*>(m)->~indirect_mutex();
-    return 0;
-}
-mutex* from_libc(pthread_mutex_t* m)
-{
-    return reinterpret_cast<indirect_mutex*>(m)->get();
-}
-
-#else
+// The mutex lives right inside pthread_mutex_t, so that an all-zero
+// pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER) is a ready to use mutex, and
+// using one costs no allocation nor extra pointer chase. Our mutex is always
+// recursive and the mutex type set in attr is ignored, so neither the
+// error checking of PTHREAD_MUTEX_ERRORCHECK nor the self-deadlock of
+// PTHREAD_MUTEX_NORMAL is provided. Likewise, the type glibc's static
+// initializers leave at offset 16 is ignored (see lockfree/mutex.hh).
 static_assert(sizeof(mutex) <= sizeof(pthread_mutex_t), "mutex overflow");
 
 mutex* from_libc(pthread_mutex_t* m)
@@ -436,7 +421,6 @@ int pthread_mutex_destroy(pthread_mutex_t *m)
     from_libc(m)->~mutex();
     return 0;
 }
-#endif
 
 int pthread_mutex_lock(pthread_mutex_t *m)
 {
@@ -7,34 +7,38 @@
 
 // splice(2), vmsplice(2), tee(2).
 //
-// Linux implements these as zero-copy transfers through a pipe's page buffers.
-// OSv has no user/kernel boundary and the copies are cheap, so this is a
-// correct (not zero-copy) implementation built on the existing read/write and
-// pread/pwrite paths: move up to `len` bytes through a bounce buffer.  This
-// unblocks the many programs that use splice()/sendfile-style loops without
-// caring how the bytes move.
+// When one end is a pipe, data moves straight between the pipe's page ring
+// and the other file: splice() reads from or writes to the file with
+// preadv()/pwritev() (or readv()/writev()) on the pipe's own pages, so the
+// bytes are copied once rather than twice through a bounce buffer. Between
+// two pipes, whole pages are handed from one ring to the other without being
+// copied at all (see pipe_buffer::splice()), and tee() copies pipe data
+// without consuming it.
 //
-// TODO: this uses a bounce buffer rather than sharing pipe pages zero-copy.
-// If splice() ever shows up as a hot path, a pipe-page-sharing fast path could
-// be added; correctness does not need it.
+// vmsplice() copies between the caller's memory and the pipe. SPLICE_F_GIFT
+// is accepted but the pages are still copied: OSv has no page reference
+// counts, so the pipe cannot take ownership of memory that may be part of a
+// malloc() arena or a mapping the caller later unmaps.
 //
-// Limitation: Linux requires exactly one of splice()'s ends to be a pipe and
-// forbids a non-null offset on the pipe end.  fd_in/fd_out may be any fd the
-// read/write path accepts (filesystem files, pipes, sockets).  OSv's anonymous
-// pipe is not reliably distinguishable via fstat here, so we do NOT enforce the
-// "exactly one end is a pipe" rule; we DO reject a non-null offset on a
-// non-seekable fd (ESPIPE), which is the observable part of that rule.
+// Linux requires at least one end of splice() to be a pipe. For
+// compatibility we also accept two non-pipe files and move the data through
+// a bounce buffer, as before. A non-null offset on a non-seekable fd fails
+// with ESPIPE.
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <algorithm>
 #include <vector>
 
 #include <osv/export.h>
+#include <osv/fcntl.h>
+#include <fs/fs.hh>
 #include <libc/libc.hh>
+#include "pipe_buffer.hh"
 
 // A splice moves at most this many bytes per internal chunk.
 static const size_t SPLICE_CHUNK = 64 * 1024;
@@ -65,31 +69,45 @@ static ssize_t write_at(int fd, const void *buf, size_t n, off_t *off)
     return write(fd, buf, n);
 }
 
-extern "C" OSV_LIBC_API
-ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
-               size_t len, unsigned int flags)
+static size_t iov_total(const iovec* iov, int iovcnt)
 {
-    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) {
-        return libc_error(EINVAL);
-    }
-    if (len == 0) {
-        return 0;
-    }
-    // The return value is ssize_t; reject a length that could not be
-    // represented (and would make the total wrap negative).
-    if (len > SSIZE_MAX) {
-        return libc_error(EINVAL);
-    }
-    // Linux forbids a non-null offset on a pipe (or any non-seekable) fd; a
-    // non-seekable fd reports ESPIPE from lseek.  Reject that here (matching
-    // Linux's ESPIPE) rather than silently pread/pwrite'ing at a bogus offset.
-    if (off_in && lseek(fd_in, 0, SEEK_CUR) < 0 && errno == ESPIPE) {
-        return libc_error(ESPIPE);
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
     }
-    if (off_out && lseek(fd_out, 0, SEEK_CUR) < 0 && errno == ESPIPE) {
-        return libc_error(ESPIPE);
+    return total;
+}
+
+// Repeats a pipe transfer step until len bytes have moved, the step comes
+// up short or it would block. Only the first step may block, after that we
+// return what we have.
+template <typename Step>
+static ssize_t pipe_transfer(size_t len, bool nonblock, Step step)
+{
+    size_t total = 0;
+    while (total < len) {
+        size_t done;
+        bool more = false;
+        int error = step(len - total, nonblock || total, &done, &more);
+        if (error) {
+            if (total) {
+                break;
+            }
+            return libc_error(error);
+        }
+        total += done;
+        if (!done || !more) {
+            break;
+        }
     }
+    return total;
+}
 
+// Copies the bytes of the non-pipe end through a bounce buffer, for
+// splice() between two files that are not pipes.
+static ssize_t copy_files(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                          size_t len)
+{
     std::vector<char> buf(std::min(len, SPLICE_CHUNK));
     size_t total = 0;
     while (total < len) {
@@ -124,20 +142,93 @@ ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
     return total;
 }
 
+extern "C" OSV_LIBC_API
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len, unsigned int flags)
+{
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) {
+        return libc_error(EINVAL);
+    }
+    if (len == 0) {
+        return 0;
+    }
+    // The return value is ssize_t; reject a length that could not be
+    // represented (and would make the total wrap negative).
+    if (len > SSIZE_MAX) {
+        return libc_error(EINVAL);
+    }
+    // Linux forbids a non-null offset on a pipe (or any non-seekable) fd; a
+    // non-seekable fd reports ESPIPE from lseek.  Reject that here (matching
+    // Linux's ESPIPE) rather than silently pread/pwrite'ing at a bogus offset.
+    if (off_in && lseek(fd_in, 0, SEEK_CUR) < 0 && errno == ESPIPE) {
+        return libc_error(ESPIPE);
+    }
+    if (off_out && lseek(fd_out, 0, SEEK_CUR) < 0 && errno == ESPIPE) {
+        return libc_error(ESPIPE);
+    }
+
+    fileref fin(fileref_from_fd(fd_in));
+    fileref fout(fileref_from_fd(fd_out));
+    if (!fin || !fout) {
+        return libc_error(EBADF);
+    }
+    auto in = pipe_buffer_of(fin.get(), FREAD);
+    auto out = pipe_buffer_of(fout.get(), FWRITE);
+    if (!in && !out) {
+        return copy_files(fd_in, off_in, fd_out, off_out, len);
+    }
+    if ((in && off_in) || (out && off_out)) {
+        return libc_error(ESPIPE);
+    }
+    bool nonblock = (flags & SPLICE_F_NONBLOCK) ||
+                    is_nonblock(fin.get()) || is_nonblock(fout.get());
+
+    if (in && out) {
+        return pipe_transfer(len, nonblock, [&] (size_t n, bool nb, size_t *done, bool *more) {
+            *more = true;
+            return pipe_buffer::splice(*in, *out, n, nb, false, done);
+        });
+    }
+    // Stop at a short read or write of the other end, it may well block the
+    // next time around.
+    if (out) {
+        return pipe_transfer(len, nonblock, [&] (size_t n, bool nb, size_t *done, bool *more) {
+            return out->fill(n, nb, [&] (const iovec *iov, int iovcnt) -> ssize_t {
+                ssize_t r = off_in ? preadv(fd_in, iov, iovcnt, *off_in)
+                                   : readv(fd_in, iov, iovcnt);
+                if (r < 0) {
+                    return -errno;
+                }
+                if (off_in) {
+                    *off_in += r;
+                }
+                *more = (size_t)r == iov_total(iov, iovcnt);
+                return r;
+            }, done);
+        });
+    }
+    return pipe_transfer(len, nonblock, [&] (size_t n, bool nb, size_t *done, bool *more) {
+        return in->drain(n, nb, [&] (const iovec *iov, int iovcnt) -> ssize_t {
+            ssize_t r = off_out ? pwritev(fd_out, iov, iovcnt, *off_out)
+                                : writev(fd_out, iov, iovcnt);
+            if (r < 0) {
+                return -errno;
+            }
+            if (off_out) {
+                *off_out += r;
+            }
+            *more = (size_t)r == iov_total(iov, iovcnt);
+            return r;
+        }, done);
+    });
+}
+
 extern "C" OSV_LIBC_API
 ssize_t vmsplice(int fd, const struct iovec *iov, size_t nr_segs, unsigned int flags)
 {
     if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) {
         return libc_error(EINVAL);
     }
-    // vmsplice moves memory <-> a pipe.  Without zero-copy pipe buffers we
-    // implement only the memory -> pipe/fd direction (a plain write of the
-    // iovec into the fd), which is the common use.  SPLICE_F_GIFT (the caller
-    // gifting its pages to the kernel) is a no-op hint for us: there are no
-    // shared pipe pages to take ownership of, so we simply copy.  The
-    // unsupported pipe -> memory direction is rejected naturally: an fd opened
-    // only for reading (e.g. a pipe read end) makes write() below fail with
-    // EBADF, so we do not need an explicit direction check.
     // Bound nr_segs like the readv/writev path (UIO_MAXIOV) so a bogus count
     // cannot walk iov[] out of bounds, and guard the running total against
     // ssize_t overflow across large iovecs.
@@ -151,35 +242,86 @@ ssize_t vmsplice(int fd, const struct iovec *iov, size_t nr_segs, unsigned int f
         }
         total += iov[i].iov_len;
     }
+    fileref fp(fileref_from_fd(fd));
+    if (!fp) {
+        return libc_error(EBADF);
+    }
+    bool nonblock = (flags & SPLICE_F_NONBLOCK) || is_nonblock(fp.get());
 
-    ssize_t moved = 0;
-    for (size_t i = 0; i < nr_segs; i++) {
-        const char *p = static_cast<const char *>(iov[i].iov_base);
-        size_t left = iov[i].iov_len;
-        while (left) {
-            ssize_t w = write(fd, p, left);
-            if (w < 0) {
-                return moved ? moved : -1;
+    // Position in the caller's iovec array
+    size_t seg = 0, seg_off = 0;
+    auto copy = [&] (const iovec* piov, int piovcnt, bool to_pipe) {
+        size_t moved = 0;
+        for (int i = 0; i < piovcnt; i++) {
+            size_t off = 0;
+            while (off < piov[i].iov_len && seg < nr_segs) {
+                auto n = std::min(piov[i].iov_len - off, iov[seg].iov_len - seg_off);
+                auto pipe_mem = static_cast<char *>(piov[i].iov_base) + off;
+                auto user_mem = static_cast<char *>(iov[seg].iov_base) + seg_off;
+                if (to_pipe) {
+                    memcpy(pipe_mem, user_mem, n);
+                } else {
+                    memcpy(user_mem, pipe_mem, n);
+                }
+                off += n;
+                moved += n;
+                seg_off += n;
+                if (seg_off == iov[seg].iov_len) {
+                    seg++;
+                    seg_off = 0;
+                }
             }
-            if (w == 0) {
-                return moved;   // no progress; stop
-            }
-            p += w;
-            left -= w;
-            moved += w;
         }
+        return moved;
+    };
+
+    // Memory to pipe, or, as Linux also allows, pipe to memory
+    if (auto out = pipe_buffer_of(fp.get(), FWRITE)) {
+        return pipe_transfer(total, nonblock, [&] (size_t n, bool nb, size_t *done, bool *more) {
+            *more = true;
+            return out->fill(n, nb, [&] (const iovec *piov, int piovcnt) {
+                return (ssize_t)copy(piov, piovcnt, true);
+            }, done);
+        });
+    } else if (auto in = pipe_buffer_of(fp.get(), FREAD)) {
+        return pipe_transfer(total, nonblock, [&] (size_t n, bool nb, size_t *done, bool *more) {
+            *more = true;
+            return in->drain(n, nb, [&] (const iovec *piov, int piovcnt) {
+                return (ssize_t)copy(piov, piovcnt, false);
+            }, done);
+        });
     }
-    return moved;
+    return libc_error(EBADF);
 }
 
 extern "C" OSV_LIBC_API
 ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags)
 {
-    // tee() duplicates pipe data from fd_in to fd_out without consuming it.
-    // Preserving the input requires peeking, which OSv's pipe does not support,
-    // so we cannot implement true (non-consuming) tee.  Report ENOSYS rather
-    // than silently consuming the input (which would corrupt the caller's data
-    // flow).
-    (void)fd_in; (void)fd_out; (void)len; (void)flags;
-    return libc_error(ENOSYS);
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) {
+        return libc_error(EINVAL);
+    }
+    fileref fin(fileref_from_fd(fd_in));
+    fileref fout(fileref_from_fd(fd_out));
+    if (!fin || !fout) {
+        return libc_error(EBADF);
+    }
+    auto in = pipe_buffer_of(fin.get(), FREAD);
+    auto out = pipe_buffer_of(fout.get(), FWRITE);
+    if (!in || !out) {
+        return libc_error(EINVAL);
+    }
+    if (len == 0) {
+        return 0;
+    }
+    bool nonblock = (flags & SPLICE_F_NONBLOCK) ||
+                    is_nonblock(fin.get()) || is_nonblock(fout.get());
+    // Data is not consumed, so unlike splice() there is no second round:
+    // it would copy the same bytes again.
+    size_t done;
+    int error = pipe_buffer::splice(*in, *out, std::min(len, (size_t)SSIZE_MAX),
+                                    nonblock, true, &done);
+    if (error) {
+        return libc_error(error);
+    }
+    return done;
 }
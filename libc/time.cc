@@ -23,6 +23,10 @@ u64 convert(const timespec& ts)
 extern "C" OSV_LIBC_API
 int gettimeofday(struct timeval* tv, struct timezone* tz)
 {
+    if (tz) {
+        tz->tz_minuteswest = 0;
+        tz->tz_dsttime = 0;
+    }
     if (!tv) {
         return 0;
     }
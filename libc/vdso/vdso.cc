@@ -4,9 +4,22 @@
 
 #ifdef __x86_64__
 #include "tls-switch.hh"
+
+// Reads the clock from the TSC without going through the kernel's TLS, so
+// it can be called before switching fsbase, which is the expensive part
+// on cpus without fsgsbase. Fails when the TSC clock is not in use.
+extern "C" OSV_MODULE_API int tsc_clock_gettime(clockid_t clk_id, struct timespec *tp);
+
 extern "C" __attribute__((__visibility__("default")))
 time_t __vdso_time(time_t *tloc)
 {
+    struct timespec ts;
+    if (tsc_clock_gettime(CLOCK_REALTIME, &ts) == 0) {
+        if (tloc) {
+            *tloc = ts.tv_sec;
+        }
+        return ts.tv_sec;
+    }
     arch::tls_switch _tls_switch;
     return time(tloc);
 }
@@ -14,6 +27,20 @@ time_t __vdso_time(time_t *tloc)
 extern "C" __attribute__((__visibility__("default")))
 int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
 {
+    struct timespec ts;
+    // We are always on UTC
+    if (tz) {
+        tz->tz_minuteswest = 0;
+        tz->tz_dsttime = 0;
+    }
+    if (!tv) {
+        return 0;
+    }
+    if (tsc_clock_gettime(CLOCK_REALTIME, &ts) == 0) {
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+        return 0;
+    }
     arch::tls_switch _tls_switch;
     return gettimeofday(tv, tz);
 }
@@ -21,6 +48,9 @@ int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
 extern "C" __attribute__((__visibility__("default")))
 int __vdso_clock_gettime(clockid_t clk_id, struct timespec *tp)
 {
+    if (tsc_clock_gettime(clk_id, tp) == 0) {
+        return 0;
+    }
     arch::tls_switch _tls_switch;
     if (clock_gettime(clk_id, tp) < 0) {
         return -errno;
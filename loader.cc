@@ -31,10 +31,12 @@
 #include "arch.hh"
 #include "arch-setup.hh"
 #include "osv/trace.hh"
+#include <osv/tracecontrol.hh>
 #include <osv/strace.hh>
 #include <osv/power.hh>
 #include <osv/rcu.hh>
 #include <osv/mempool.hh>
+#include <osv/pagealloc.hh>
 #include <bsd/porting/networking.hh>
 #include <bsd/porting/shrinker.h>
 #include <bsd/porting/route.h>
@@ -45,8 +47,10 @@
 #include <osv/commands.hh>
 #include <osv/boot.hh>
 #include <osv/sampler.hh>
+#include <osv/lockstat.hh>
 #include <osv/app.hh>
 #include <osv/firmware.hh>
+#include <osv/snapshot.hh>
 #if CONF_drivers_xen
 #include <osv/xen.hh>
 #endif
@@ -154,6 +158,7 @@ bool opt_power_off_on_abort = false;
 #if CONF_tracepoints
 static bool opt_log_backtrace = false;
 static bool opt_list_tracepoints = false;
+static std::string opt_trace_stream;
 #if CONF_tracepoints_strace
 static bool opt_strace = false;
 #endif
@@ -162,6 +167,7 @@ static bool opt_mount = true;
 static bool opt_pivot = true;
 static std::string opt_rootfs;
 static bool opt_random = true;
+static bool opt_hugepage_collapse = true;
 static bool opt_init = true;
 static std::string opt_console = "all";
 static bool opt_verbose = false;
@@ -171,10 +177,15 @@ static std::vector<std::string> opt_ip;
 static std::string opt_defaultgw;
 static std::string opt_nameserver;
 static std::string opt_redirect;
+static std::string opt_reloc_cache;
+static bool opt_reloc_cache_dump = false;
+static bool opt_prefault_text = false;
+static std::chrono::nanoseconds opt_snapshot_after{-1};
 static std::chrono::nanoseconds boot_delay;
 std::vector<mntent> opt_mount_fs;
 bool opt_maxnic = false;
 int maxnic;
+static size_t opt_hugepages = 0;
 bool opt_pci_disabled = false;
 
 #if CONF_tracepoints_sampler
@@ -194,6 +205,8 @@ static void usage()
         "  --trace=arg           tracepoints to enable\n"
         "  --trace-backtrace     log backtraces in the tracepoint log\n"
         "  --trace-list          list available tracepoints\n"
+        "  --trace-stream=arg    stream trace records to a file or device as they are\n"
+        "                        written\n"
 #if CONF_tracepoints_strace
         "  --strace              start a thread to print tracepoints to the console on the fly\n"
 #endif
@@ -206,7 +219,10 @@ static void usage()
         "  --rootfs=arg          root filesystem to use (zfs, rofs, ramfs or virtiofs)\n"
         "  --assign-net          assign virtio network to the application\n"
         "  --maxnic=arg          maximum NIC number\n"
+        "  --hugepages=arg       number of 2MB pages to reserve for huge page mappings\n"
         "  --norandom            don't initialize any random device\n"
+        "  --nohugepage-collapse don't collapse small anonymous pages into huge pages\n"
+        "  --lockstat            collect lock contention statistics from boot\n"
         "  --noshutdown          continue running after main() returns\n"
         "  --power-off-on-abort  use poweroff instead of halt if it's aborted\n"
         "  --noinit              don't run commands from /init\n"
@@ -227,7 +243,16 @@ static void usage()
         "  --nopci               disable PCI enumeration\n"
         "  --extra-zfs-pools     import extra ZFS pools\n"
         "  --mount-fs=arg        mount extra filesystem, format:<fs_type,url,path>\n"
-        "  --preload-zfs-library preload ZFS library from /usr/lib/fs\n\n");
+        "  --preload-zfs-library preload ZFS library from /usr/lib/fs\n"
+        "  --reloc-cache=arg     resolve symbols of matching objects using the\n"
+        "                        relocation cache file generated by\n"
+        "                        scripts/gen-reloc-cache.py\n"
+        "  --reloc-cache-dump    print the symbol bindings of every object relocated,\n"
+        "                        as consumed by scripts/gen-reloc-cache.py\n"
+        "  --prefault-text       read text and read-only data of loaded objects into\n"
+        "                        memory up front, on huge pages where possible\n"
+        "  --snapshot-after=arg  seconds after starting the applications to stop at\n"
+        "                        the snapshot pause point, see scripts/firecracker.py\n\n");
 }
 
 static void handle_parse_error(const std::string &message)
@@ -281,6 +306,10 @@ static void parse_options(int loader_argc, char** loader_argv)
         maxnic = options::extract_option_int_value(options_values, "maxnic", handle_parse_error);
     }
 
+    if (options::option_value_exists(options_values, "hugepages")) {
+        opt_hugepages = options::extract_option_int_value(options_values, "hugepages", handle_parse_error);
+    }
+
 #if CONF_tracepoints
     if (extract_option_flag(options_values, "trace-backtrace")) {
         opt_log_backtrace = true;
@@ -289,6 +318,10 @@ static void parse_options(int loader_argc, char** loader_argv)
     if (extract_option_flag(options_values, "trace-list")) {
         opt_list_tracepoints = true;
     }
+
+    if (options::option_value_exists(options_values, "trace-stream")) {
+        opt_trace_stream = options::extract_option_value(options_values, "trace-stream");
+    }
 #endif
 
     if (extract_option_flag(options_values, "verbose")) {
@@ -328,6 +361,10 @@ static void parse_options(int loader_argc, char** loader_argv)
     opt_mount = !extract_option_flag(options_values, "nomount");
     opt_pivot = !extract_option_flag(options_values, "nopivot");
     opt_random = !extract_option_flag(options_values, "norandom");
+    opt_hugepage_collapse = !extract_option_flag(options_values, "nohugepage-collapse");
+    if (extract_option_flag(options_values, "lockstat")) {
+        lockstat::enable(true);
+    }
     opt_init = !extract_option_flag(options_values, "noinit");
 
     if (options::option_value_exists(options_values, "console")) {
@@ -397,6 +434,22 @@ static void parse_options(int loader_argc, char** loader_argv)
         opt_redirect = options::extract_option_value(options_values, "redirect");
     }
 
+    if (options::option_value_exists(options_values, "reloc-cache")) {
+        opt_reloc_cache = options::extract_option_value(options_values, "reloc-cache");
+    }
+
+    if (extract_option_flag(options_values, "reloc-cache-dump")) {
+        opt_reloc_cache_dump = true;
+    }
+
+    if (extract_option_flag(options_values, "prefault-text")) {
+        opt_prefault_text = true;
+    }
+
+    if (options::option_value_exists(options_values, "snapshot-after")) {
+        opt_snapshot_after = std::chrono::duration_cast<std::chrono::nanoseconds>(1_s * options::extract_option_float_value(options_values, "snapshot-after", handle_parse_error));
+    }
+
     if (options::option_value_exists(options_values, "delay")) {
         boot_delay = std::chrono::duration_cast<std::chrono::nanoseconds>(1_s * options::extract_option_float_value(options_values, "delay", handle_parse_error));
     } else {
@@ -605,6 +658,20 @@ void* do_main_thread(void *_main_args)
         }
     }
 
+    // The cache lives on the root filesystem, so it only helps the
+    // applications and the libraries they pull in, not anything loaded to
+    // mount it.
+    if (opt_reloc_cache_dump) {
+        elf::get_program()->set_reloc_cache_dump(true);
+    }
+    if (!opt_reloc_cache.empty()) {
+        if (elf::get_program()->load_reloc_cache(opt_reloc_cache)) {
+            boot_time.event("relocation cache loaded");
+        } else {
+            debugf("Could not load the relocation cache from %s\n", opt_reloc_cache.c_str());
+        }
+    }
+
     //This option is only used by ZFS builder
     if (opt_preload_zfs_library) {
         if (load_fs_library(libsolaris_path)) {
@@ -654,6 +721,16 @@ void* do_main_thread(void *_main_args)
 #if CONF_networking_dhcp
         }
 #endif
+        // A restored VM may be on another network segment than the one
+        // snapshotted, and clones of it may be given other addresses
+        osv::snapshot::register_hooks(nullptr, [] {
+            osv::if_announce();
+#if CONF_networking_dhcp
+            if (opt_ip.size() == 0) {
+                dhcp_renew(false);
+            }
+#endif
+        });
     }
 
     std::string if_ip;
@@ -718,6 +795,16 @@ void* do_main_thread(void *_main_args)
         }
     }
 
+#if CONF_tracepoints
+    if (!opt_trace_stream.empty()) {
+        try {
+            trace::start_trace_stream(opt_trace_stream);
+        } catch (std::runtime_error& e) {
+            printf("%s\n", e.what());
+        }
+    }
+#endif
+
     auto commands = prepare_commands(app_cmdline);
 
     // Run command lines in /init/* before the manual command line
@@ -755,6 +842,13 @@ void* do_main_thread(void *_main_args)
     // doesn't wait for the thread to finish before exiting OSv.
     std::vector<shared_app_t> detached;
     std::vector<shared_app_t> bg;
+    if (opt_snapshot_after.count() >= 0) {
+        // Give the applications time to warm up first
+        sched::thread::make([] {
+            sched::thread::sleep(opt_snapshot_after);
+            osv::snapshot::pause_point();
+        }, sched::thread::attr().name("snapshot").detached())->start();
+    }
     for (auto &it : commands) {
         std::vector<std::string> newvec(it.begin(), std::prev(it.end()));
         auto suffix = it.back();
@@ -806,6 +900,18 @@ void main_cont(int loader_argc, char** loader_argv)
 
     parse_options(loader_argc, loader_argv);
 
+    if (opt_prefault_text) {
+        elf::get_program()->set_prefault_exec(true, opt_bootchart);
+    }
+
+    // Reserve before anything else gets a chance to fragment memory
+    if (opt_hugepages) {
+        auto reserved = memory::reserve_huge_pages(opt_hugepages);
+        if (reserved < opt_hugepages) {
+            printf("Could only reserve %zu of %zu huge pages\n", reserved, opt_hugepages);
+        }
+    }
+
     setenv("OSV_VERSION", osv::version().c_str(), 1);
 
 #if CONF_drivers_xen
@@ -867,6 +973,10 @@ void main_cont(int loader_argc, char** loader_argv)
 
     arch::irq_enable();
 
+    if (opt_hugepage_collapse) {
+        mmu::start_huge_page_collapser();
+    }
+
 #ifndef AARCH64_PORT_STUB
 #if CONF_tracepoints_sampler
     if (opt_enable_sampler) {
@@ -900,6 +1010,10 @@ void main_cont(int loader_argc, char** loader_argv)
         sched::thread::wait_until([] { return false; });
     }
 
+#if CONF_tracepoints
+    trace::stop_trace_stream();
+#endif
+
 #if CONF_memory_tracker
     if (memory::tracker_enabled) {
         debug("Leak testing done. Please use 'osv leak show' in gdb to analyze results.\n");
@@ -19,6 +19,7 @@
 #include <osv/osv_c_wrappers.h>
 #include <algorithm>
 #include "../java-base/balloon/balloon_api.hh"
+#include <osv/mempool.hh>
 
 namespace httpserver {
 
@@ -92,6 +93,10 @@ void init(routes& routes)
         return memory::get_balloon_size();
     });
 
+    os_memory_fragmentation.set_handler([](const_req req) {
+        return memory::stats::fragmentation_index();
+    });
+
 #if !defined(MONITORING)
     os_shutdown.set_handler([](const_req req) {
         osv::shutdown();
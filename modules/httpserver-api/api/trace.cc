@@ -17,7 +17,9 @@
 #include <sys/stat.h>
 #include <osv/tracecontrol.hh>
 #include <osv/sampler.hh>
+#include <osv/offcpu.hh>
 #include <osv/trace-count.hh>
+#include <osv/lockstat.hh>
 
 #include <regex.h>
 
@@ -151,6 +153,47 @@ void httpserver::api::trace::init(routes & routes)
 
     trace_json::getTraceBuffers.set_handler(new create_trace_dump());
 
+    class read_trace_stream : public handler_base {
+    public:
+        void handle(const std::string& path, parameters* params,
+                const http::server::request& req, http::server::reply& rep)
+                        override {
+            try {
+                rep.content = ::trace::read_trace_stream(max_read, std::chrono::seconds(1));
+            } catch (std::runtime_error& e) {
+                throw bad_request_exception(e.what());
+            }
+            set_headers_explicit(rep, "application/octet-stream");
+        }
+    private:
+        static constexpr size_t max_read = 1 << 20;
+    };
+
+    trace_json::readTraceStream.set_handler(new read_trace_stream());
+
+    trace_json::startTraceStream.set_handler([](const_req req) {
+        try {
+            ::trace::start_trace_stream(req.get_query_param("path"));
+        } catch (std::runtime_error& e) {
+            throw bad_request_exception(e.what());
+        }
+        return "";
+    });
+    trace_json::stopTraceStream.set_handler([](const_req req) {
+        ::trace::stop_trace_stream();
+        return "";
+    });
+    trace_json::getTraceStreamStatus.set_handler([](const_req req) {
+        auto st = ::trace::get_stream_status();
+        httpserver::json::TraceStreamStatus ret;
+        ret.active = st.active;
+        ret.path = st.path;
+        ret.records = st.records;
+        ret.lost = st.lost;
+        ret.bytes = st.bytes;
+        return ret;
+    });
+
     trace_json::setCountEvent.set_handler([](const_req req) {
         const auto eventid = req.param.at("eventid").substr(1);
         const auto enabled = str2bool(req.get_query_param("enabled"));
@@ -188,4 +231,46 @@ void httpserver::api::trace::init(routes & routes)
         return "";
     });
 
+    trace_json::getLockStats.set_handler([](const_req req) {
+        httpserver::json::LockStats ret;
+        ret.enabled = lockstat::active();
+        ret.dropped = lockstat::dropped();
+        for (auto& s : lockstat::get_stats()) {
+            LockStat l;
+            l.lock = lockstat::name(s.lock);
+            l.type = lockstat::type_name(s.type);
+            l.contended = s.contended;
+            l.wait_total_ns = s.wait_ns;
+            l.wait_max_ns = s.max_wait_ns;
+            l.waiter = lockstat::name(s.waiter_site);
+            l.holder = lockstat::name(s.holder_site);
+            ret.list.push(l);
+        }
+        return ret;
+    });
+    trace_json::setLockStatState.set_handler([](const_req req) {
+        lockstat::enable(str2bool(req.get_query_param("enabled")));
+        return "";
+    });
+    trace_json::resetLockStats.set_handler([](const_req req) {
+        lockstat::reset();
+        return "";
+    });
+
+    trace_json::getOffcpuProfile.set_handler([](const_req req) {
+        return prof::get_offcpu_profile();
+    });
+    trace_json::setOffcpuProfilerState.set_handler([](const_req req) {
+        if (str2bool(req.get_query_param("enabled"))) {
+            prof::start_offcpu_profiler();
+        } else {
+            prof::stop_offcpu_profiler();
+        }
+        return "";
+    });
+    trace_json::resetOffcpuProfile.set_handler([](const_req req) {
+        prof::reset_offcpu_profile();
+        return "";
+    });
+
 }
@@ -36,3 +36,26 @@ trace::create_trace_dump()
     throw std::invalid_argument("this is just a dummy stub");
 }
 
+
+void
+trace::start_trace_stream(const std::string & path)
+{
+    throw std::runtime_error("this is just a dummy stub");
+}
+
+void
+trace::stop_trace_stream()
+{
+}
+
+trace::stream_status
+trace::get_stream_status()
+{
+    return stream_status();
+}
+
+std::string
+trace::read_trace_stream(size_t max, std::chrono::milliseconds timeout)
+{
+    throw std::runtime_error("this is just a dummy stub");
+}
@@ -12,10 +12,15 @@ import argparse
 import re
 import json
 import tempfile
+import socket
+import threading
 from datetime import datetime
 
 verbose = False
 
+# Printed by OSv at its snapshot pause point (see include/osv/snapshot.hh)
+snapshot_ready_marker = 'OSv: snapshot point reached'
+
 stty_params = None
 
 devnull = open('/dev/null', 'w')
@@ -60,6 +65,13 @@ class ApiClient(object):
             raise ApiException(res.text)
         return res.status_code
 
+    def make_patch_call(self, path, request_body):
+        url = self.api_socket_url(path)
+        res = self.session.patch(url, data=json.dumps(request_body))
+        if res.status_code != 204:
+            raise ApiException(res.text)
+        return res.status_code
+
     def create_instance(self, kernel_image_path, cmdline):
         boot_source = {
             'kernel_image_path': kernel_image_path,
@@ -142,6 +154,37 @@ class ApiClient(object):
         else:
             self.make_put_call('/machine-config', machine_config)
 
+    def pause_instance(self):
+        self.make_patch_call('/vm', {'state': 'Paused'})
+
+    def resume_instance(self):
+        self.make_patch_call('/vm', {'state': 'Resumed'})
+
+    def create_snapshot(self, snapshot_path, mem_file_path):
+        self.make_put_call('/snapshot/create', {
+            'snapshot_type': 'Full',
+            'snapshot_path': snapshot_path,
+            'mem_file_path': mem_file_path
+        })
+
+    def load_snapshot(self, snapshot_path, mem_file_path):
+        try:
+            self.make_put_call('/snapshot/load', {
+                'snapshot_path': snapshot_path,
+                'mem_backend': {
+                    'backend_path': mem_file_path,
+                    'backend_type': 'File'
+                },
+                'resume_vm': True
+            })
+        except ApiException:
+            # Versions before 1.0 only know about mem_file_path
+            self.make_put_call('/snapshot/load', {
+                'snapshot_path': snapshot_path,
+                'mem_file_path': mem_file_path
+            })
+            self.resume_instance()
+
     def firecracker_config_json(self):
         return json.dumps(self.firecracker_config, indent=3)
 
@@ -222,15 +265,27 @@ def disk_path(qcow_disk_path):
     return raw_disk_path
 
 
-def start_firecracker(firecracker_path, socket_path):
+def start_firecracker(firecracker_path, socket_path, on_line=None):
     # Delete socket file if exists
     if os.path.exists(socket_path):
         os.unlink(socket_path)
 
     # Start firecracker process to communicate over specified UNIX socket file
     stty_save()
-    return subprocess.Popen([firecracker_path, '--api-sock', socket_path],
-                           stdout=sys.stdout, stderr=subprocess.STDOUT)
+    if not on_line:
+        return subprocess.Popen([firecracker_path, '--api-sock', socket_path],
+                               stdout=sys.stdout, stderr=subprocess.STDOUT)
+
+    # Echo the console while passing every line to on_line()
+    process = subprocess.Popen([firecracker_path, '--api-sock', socket_path],
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    def pump():
+        for line in iter(process.stdout.readline, b''):
+            sys.stdout.buffer.write(line)
+            sys.stdout.flush()
+            on_line(line.decode(errors='replace'))
+    threading.Thread(target=pump, daemon=True).start()
+    return process
 
 def start_firecracker_with_no_api(firecracker_path, firecracker_config_json):
     #  Start firecracker process and pass configuration JSON as a file
@@ -242,6 +297,61 @@ def start_firecracker_with_no_api(firecracker_path, firecracker_config_json):
                            stdout=sys.stdout, stderr=subprocess.STDOUT), api_file.name
 
 
+def snapshot_files(snapshot_dir):
+    return os.path.join(snapshot_dir, 'vmstate'), os.path.join(snapshot_dir, 'memory')
+
+
+def probe_first_response(address, start, timeout=30):
+    # Time until the restored application answers a request on address,
+    # given as host:port
+    host, port = address.rsplit(':', 1)
+    deadline = start + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection((host, int(port)), timeout=1) as s:
+                s.sendall(b'GET / HTTP/1.0\r\n\r\n')
+                if s.recv(1):
+                    return time.time() - start
+        except OSError:
+            time.sleep(0.001)
+    return None
+
+
+def restore(options, firecracker_path, socket_path):
+    if options.networking:
+        setup_tap_interface('natted' if not options.bridge else 'bridged', 'fc_tap0',
+                            '172.16.0.1' if not options.bridge else None,
+                            options.physical_nic, options.bridge)
+
+    firecracker = start_firecracker(firecracker_path, socket_path)
+    client = ApiClient(socket_path.replace("/", "%2F"))
+    while not os.path.exists(socket_path):
+        time.sleep(0.01)
+
+    snapshot_path, mem_file_path = snapshot_files(options.restore)
+    try:
+        start = time.time()
+        client.load_snapshot(snapshot_path, mem_file_path)
+        print("Restored snapshot from %s in %.1f ms" % (options.restore, (time.time() - start) * 1000))
+        if options.probe:
+            latency = probe_first_response(options.probe, start)
+            if latency is None:
+                print("No response from %s after restore" % options.probe)
+            else:
+                print("Restore to first response from %s: %.1f ms" % (options.probe, latency * 1000))
+    except ApiException as e:
+        print("Failed to restore snapshot: %s." % e)
+        firecracker.kill()
+        stty_restore()
+        exit(-1)
+
+    try:
+        firecracker.wait()
+    except KeyboardInterrupt:
+        os.kill(firecracker.pid, signal.SIGINT)
+    stty_restore()
+
+
 def get_memory_size_in_mb(options):
     memory_in_mb = 128
     if options.memsize:
@@ -262,7 +372,20 @@ def main(options):
     # Firecracker is installed so lets start
     print_time("Start")
     socket_path = '/tmp/firecracker.socket'
-    if options.api:
+    if options.restore:
+        restore(options, firecracker_path, socket_path)
+        return
+
+    snapshot_ready = threading.Event()
+    def watch_console(line):
+        if snapshot_ready_marker in line:
+            snapshot_ready.set()
+
+    if options.snapshot:
+        options.api = True
+        os.makedirs(options.snapshot, exist_ok=True)
+        firecracker = start_firecracker(firecracker_path, socket_path, watch_console)
+    elif options.api:
         firecracker = start_firecracker(firecracker_path, socket_path)
 
     # Prepare arguments we are going to pass when creating VM instance
@@ -340,6 +463,24 @@ def main(options):
         stty_restore()
         exit(-1)
 
+    if options.snapshot:
+        # Wait for the guest to stop at its pause point, e.g. after
+        # --snapshot-after=<seconds>, then save it and stop the VM
+        while not snapshot_ready.wait(0.1):
+            if firecracker.poll() is not None:
+                print("Firecracker exited before the snapshot point was reached")
+                stty_restore()
+                exit(-1)
+        snapshot_path, mem_file_path = snapshot_files(options.snapshot)
+        try:
+            start = time.time()
+            client.pause_instance()
+            client.create_snapshot(snapshot_path, mem_file_path)
+            print("Saved snapshot to %s in %.1f ms" % (options.snapshot, (time.time() - start) * 1000))
+        except ApiException as e:
+            print("Failed to snapshot the VM: %s." % e)
+        firecracker.kill()
+
     print_time("Waiting for firecracker process to terminate")
     try:
         firecracker.wait()
@@ -382,6 +523,13 @@ if __name__ == "__main__":
                         help="name of the physical NIC (wired or wireless) to forward to if in natted mode")
     parser.add_argument("--arch", action="store", choices=["x86_64","aarch64"], default=host_arch,
                         help="specify Firecracker architecture: x86_64, aarch64")
+    parser.add_argument("--snapshot", action="store", default=None, metavar="DIR",
+                        help="snapshot the VM into DIR once OSv reaches its snapshot pause point "
+                             "(e.g. -e '--snapshot-after=10 <app>'), then stop it")
+    parser.add_argument("--restore", action="store", default=None, metavar="DIR",
+                        help="restore and resume the VM from the snapshot in DIR")
+    parser.add_argument("--probe", action="store", default=None, metavar="HOST:PORT",
+                        help="with --restore, measure the time until HOST:PORT answers a request")
 
     cmdargs = parser.parse_args()
     cmdargs.opt_path = "debug" if cmdargs.debug else "release" if cmdargs.release else "last"
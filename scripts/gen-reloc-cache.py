@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2026 OSv Authors
+#
+# This work is open source software, licensed under the terms of the
+# BSD license as described in the LICENSE file in the top-level directory.
+#
+# Boot an image once with --reloc-cache-dump and turn the symbol bindings
+# the dynamic linker prints into a relocation cache file. Add the file to
+# the image (e.g. to usr.manifest) and boot with --reloc-cache=<path> to
+# have the objects it covers skip symbol lookup when they are relocated.
+#
+# The cache is keyed by the build-id of every object and of the modules
+# visible to it, so an entry that no longer matches the image is simply
+# ignored, but it has to be regenerated to keep being useful.
+#
+# Usage: gen-reloc-cache.py -e "<command line>" [-o output] [-- run.py args]
+
+import argparse
+import os
+import subprocess
+import sys
+
+osv_base = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+prefix = 'reloc-cache: '
+
+def collect(cmdline, run_args, timeout):
+    cmd = [os.path.join(osv_base, 'scripts', 'run.py'),
+           '-e', '--reloc-cache-dump ' + cmdline] + run_args
+    try:
+        out = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             stdin=subprocess.DEVNULL, timeout=timeout).stdout
+    except subprocess.TimeoutExpired as e:
+        out = e.stdout or b''
+    lines = []
+    for line in out.decode(errors='replace').splitlines():
+        # The console may prepend other output to a line
+        pos = line.find(prefix)
+        if pos >= 0:
+            lines.append(line[pos + len(prefix):].rstrip())
+    return lines
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generate a relocation cache for an OSv image')
+    parser.add_argument('-e', '--execute', required=True, metavar='CMD',
+                        help='application command line to boot the image with')
+    parser.add_argument('-o', '--output', default='reloc.cache',
+                        help='file to write the cache to (default: %(default)s)')
+    parser.add_argument('-t', '--timeout', type=int, default=60,
+                        help='seconds after which the guest is stopped (default: %(default)s)')
+    parser.add_argument('run_args', nargs=argparse.REMAINDER,
+                        help='extra arguments to pass to run.py, after --')
+    args = parser.parse_args()
+
+    run_args = args.run_args
+    if run_args and run_args[0] == '--':
+        run_args = run_args[1:]
+
+    lines = collect(args.execute, run_args, args.timeout)
+    objects = sum(1 for l in lines if l.startswith('object '))
+    if not objects:
+        print('No relocation cache entries were printed by the guest', file=sys.stderr)
+        sys.exit(1)
+
+    with open(args.output, 'w') as f:
+        f.write('# OSv relocation cache, generated by gen-reloc-cache.py for:\n')
+        f.write('# %s\n' % args.execute)
+        for l in lines:
+            f.write(l + '\n')
+
+    print('Wrote %d objects to %s. Add it to the image and boot with --reloc-cache=<path>'
+          % (objects, args.output))
@@ -457,3 +457,70 @@ def print_flame_profile(samples, symbol_resolver, min_hits_count=None, time_rang
     for symbol_list, hits in iter(hits_by_symbol_list.items()):
         if not min_hits_count or hits >= min_hits_count:
             print(symbol_list + ' ' + str(hits))
+
+class OffcpuProfile:
+    """
+    Off-cpu profile as aggregated by the kernel (see include/osv/offcpu.hh):
+    per backtrace at the point threads blocked, the number of waits and the
+    time spent blocked and then runnable in the runqueue, plus a histogram
+    of runqueue waits.
+
+    """
+    def __init__(self, text):
+        self.stacks = []
+        self.runq_histogram = []
+        for line in text.splitlines():
+            if line.startswith('# runq '):
+                from_us, count = line.split()[2:]
+                self.runq_histogram.append((int(from_us), int(count)))
+            elif line and not line.startswith('#'):
+                frames, count, blocked, runq = line.rsplit(' ', 3)
+                addrs = [int(addr, 16) for addr in frames.split(';')]
+                self.stacks.append((addrs, int(count), int(blocked), int(runq)))
+
+offcpu_metrics = {
+    'total': lambda count, blocked, runq: blocked + runq,
+    'blocked': lambda count, blocked, runq: blocked,
+    'runq': lambda count, blocked, runq: runq,
+    'count': lambda count, blocked, runq: count,
+}
+
+def print_offcpu_flame_profile(profile, symbol_resolver, metric='total', min_value=None):
+    """
+    Prints the profile as folded stacks, one 'frame;frame;... value' line per
+    distinct backtrace, outermost frame first, ready to be fed to
+    flamegraph.pl. Times are in microseconds.
+
+    """
+    value_of = offcpu_metrics[metric]
+    values_by_symbol_list = defaultdict(int)
+
+    def symbol_name(src_addr):
+        if src_addr.name:
+            return src_addr.name
+        else:
+            return '0x%x' % src_addr.addr
+
+    for addrs, count, blocked, runq in profile.stacks:
+        # The kernel lists frames outermost first, strip_garbage() wants
+        # them innermost first
+        frames = list(debug.resolve_all(symbol_resolver, (addr - 1 for addr in reversed(addrs))))
+        frames = strip_garbage(frames)
+        if not frames:
+            continue
+        frames.reverse()
+        value = value_of(count, blocked, runq)
+        if metric != 'count':
+            value //= 1000
+        values_by_symbol_list[';'.join(symbol_name(src_addr) for src_addr in frames)] += value
+
+    for symbol_list, value in sorted(values_by_symbol_list.items()):
+        if value and (not min_value or value >= min_value):
+            print(symbol_list + ' ' + str(value))
+
+def print_runq_histogram(profile):
+    total = sum(count for _, count in profile.runq_histogram)
+    print('%12s %10s %7s' % ('RUNQ WAIT', 'COUNT', '%'))
+    for from_us, count in profile.runq_histogram:
+        label = '< 2 us' if from_us == 0 else '>= %d us' % from_us
+        print('%12s %10d %6.2f%%' % (label, count, 100.0 * count / total))
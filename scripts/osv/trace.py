@@ -2,6 +2,9 @@ import mmap
 import struct
 import heapq
 import bisect
+import os
+import time
+from collections import defaultdict
 
 from osv import debug
 
@@ -306,25 +309,36 @@ class WritingPacker:
 class NotATraceDumpFile(Exception):
     pass
 
+# Trace streams (see core/trace.cc) with another major version are not
+# readable by this script
+_stream_version_major = 1
+
 class TraceDumpReaderBase :
     def __init__(self, filename):
         self.endian = '<'
         self.file = open(filename, 'rb')
         try:
-            tag = self.file.read(4).decode()
-            if tag == "OSVT":
-                endian = '>'
-            elif tag != "TVSO":
-                raise NotATraceDumpFile("Not a trace dump file")
-            self.read('Q') # size. ignore, do not support embedded yet.
-            if self.read('I') != 1: #endian check. verify tag check
-                raise SyntaxError
-            self.read('I') # version. should check
+            self.readHeader()
             while self.readStruct0():
                 pass
         finally:
             self.file.close()
 
+    def readHeader(self):
+        tag = self.file.read(4).decode(errors='replace')
+        if tag == "OSVT":
+            endian = '>'
+        elif tag == "SVSO":
+            self.stream = True
+        elif tag != "TVSO":
+            raise NotATraceDumpFile("Not a trace dump file")
+        self.read('Q') # size. ignore, do not support embedded yet.
+        if self.read('I') != 1: #endian check. verify tag check
+            raise SyntaxError
+        version = self.read('I')
+        if getattr(self, 'stream', False) and (version >> 16) != _stream_version_major:
+            raise Exception('Unsupported trace stream version %d.%d' % (version >> 16, version & 0xffff))
+
     def align(self, a):
         while (self.file.tell() & (a - 1)) != 0:
             self.file.seek(1, 1)
@@ -351,9 +365,9 @@ class TraceDumpReaderBase :
         self.align(8)
         try:
             tag = self.read('I')
+            size = self.read('Q')
         except EOFError:
             return False
-        size = self.read('Q')
         if not self.readStruct(tag, size):
             self.file.seek(size, 1)
         return True
@@ -366,6 +380,8 @@ class TraceDumpReader(TraceDumpReaderBase) :
     def __init__(self, filename):
         self.tracepoints = {}
         self.trace_buffers = []
+        # Records lost by a trace stream, per cpu
+        self.lost = defaultdict(int)
         TraceDumpReaderBase.__init__(self, filename)
 
     def readStruct(self, tag, size):
@@ -373,11 +389,21 @@ class TraceDumpReader(TraceDumpReaderBase) :
             return self.readTraceDict(size)
         elif tag == 0x54524353: #'TRCS'
             data = self.file.read(size)
-            self.trace_buffers.append(data)
+            # The last chunk of a stream may still be being written
+            if len(data) == size:
+                self.trace_buffers.append(data)
+            return True
+        elif tag == 0x4C4F5354: #'LOST'
+            cpu = self.read('I')
+            count = self.read('Q')
+            self.readLost(cpu, count)
             return True
         else:
             return False
 
+    def readLost(self, cpu, count):
+        self.lost[cpu] += count
+
     def readTraceDict(self, size):
         self.backtrace_len = self.read('I')
         n_types = self.read('I')
@@ -431,6 +457,70 @@ class TraceDumpReader(TraceDumpReaderBase) :
         return heapq.merge(*iters)
 
 
+class TraceStreamReader(TraceDumpReader):
+    """Reads a trace stream incrementally, possibly while it is being written.
+
+    traces() yields the records of the chunks found in the file so far,
+    and with follow=True, then waits for more to be appended. Records are
+    ordered by time within each such batch of chunks only.
+    on_lost(cpu, count) is called for each report of lost records.
+    """
+    def __init__(self, filename, follow=False, on_lost=None, poll_interval=0.2):
+        self.endian = '<'
+        self.tracepoints = {}
+        self.trace_buffers = []
+        self.lost = defaultdict(int)
+        self.filename = filename
+        self.follow = follow
+        self.on_lost = on_lost
+        self.poll_interval = poll_interval
+
+    def readLost(self, cpu, count):
+        TraceDumpReader.readLost(self, cpu, count)
+        if self.on_lost:
+            self.on_lost(cpu, count)
+
+    def available(self):
+        return os.fstat(self.file.fileno()).st_size - self.file.tell()
+
+    def wait(self):
+        if not self.follow:
+            return False
+        time.sleep(self.poll_interval)
+        return True
+
+    # Reads the next chunk if it was written completely
+    def readChunk(self):
+        self.align(8)
+        start = self.file.tell()
+        if self.available() < 16:
+            return False
+        tag = self.read('I')
+        size = self.read('Q')
+        if self.available() < size:
+            self.file.seek(start)
+            return False
+        if not self.readStruct(tag, size):
+            self.file.seek(size, 1)
+        return True
+
+    def traces(self):
+        with open(self.filename, 'rb') as self.file:
+            while self.available() < 24:
+                if not self.wait():
+                    return
+            self.readHeader()
+            if not getattr(self, 'stream', False):
+                raise NotATraceDumpFile("Not a trace stream file")
+            while True:
+                while self.readChunk():
+                    pass
+                buffers, self.trace_buffers = self.trace_buffers, []
+                for t in heapq.merge(*[self.oneTrace(data) for data in buffers]):
+                    yield t
+                if not self.wait():
+                    return
+
 class Symbol:
     def __init__(self, addr, size, name=None, filename=None, line=None):
         self.addr = addr
@@ -6,6 +6,7 @@ import re
 import os
 import math
 import subprocess
+import time
 import requests
 
 from collections import defaultdict
@@ -79,6 +80,14 @@ class BeautifyingResolver(object):
                     src_addr.name = "do_wait_until"
         return resolution
 
+def loader_elf_path(args):
+    if args.exe:
+        return args.exe
+    elif args.debug:
+        return 'build/debug/loader.elf'
+    else:
+        return 'build/release/loader.elf'
+
 def symbol_resolver(args):
     if args.no_resolve:
         return debug.DummyResolver()
@@ -87,12 +96,7 @@ def symbol_resolver(args):
         symbols_file = "%s.symbols" % args.tracefile
         return BeautifyingResolver(debug.SymbolsFileResolver(symbols_file))
 
-    if args.exe:
-        elf_path = args.exe
-    elif args.debug:
-        elf_path = 'build/debug/loader.elf'
-    else:
-        elf_path = 'build/release/loader.elf'
+    elf_path = loader_elf_path(args)
 
     base = debug.DummyResolver()
     try:
@@ -124,8 +128,19 @@ def list_trace(args):
         else:
             return True
 
+    def report_lost(cpu, count):
+        print('%d records lost on cpu %d' % (count, cpu))
+
     backtrace_formatter = get_backtrace_formatter(args)
     time_range = get_time_range(args)
+    if args.follow:
+        reader = trace.TraceStreamReader(args.tracefile, follow=True, on_lost=report_lost)
+        for t in reader.traces():
+            if t.time in time_range and name_filter(t):
+                print(t.format(backtrace_formatter, data_formatter=data_formatter))
+                sys.stdout.flush()
+        return
+
     with get_trace_reader(args) as reader:
         for t in reader.get_traces():
             if t.time in time_range and name_filter(t):
@@ -320,6 +335,42 @@ def prof_flame(args):
             min_hits_count=int(args.min_hits) if args.min_hits else None,
             time_range=time_range)
 
+def prof_offcpu(args):
+    client = Client(args)
+    url = client.get_url() + "/trace/offcpu"
+
+    if args.start or args.stop:
+        requests.post(url, params={'enabled': 'true' if args.start else 'false'},
+            **client.get_request_kwargs()).raise_for_status()
+        return
+    if args.reset:
+        requests.delete(url, **client.get_request_kwargs()).raise_for_status()
+        return
+
+    if args.profile and not args.save:
+        with open(args.profile) as f:
+            text = f.read()
+    else:
+        r = requests.get(url, **client.get_request_kwargs())
+        r.raise_for_status()
+        text = r.json()
+        if args.save:
+            with open(args.profile, 'w') as f:
+                f.write(text)
+
+    profile = prof.OffcpuProfile(text)
+    if args.histogram:
+        prof.print_runq_histogram(profile)
+        return
+
+    if args.no_resolve:
+        resolver = debug.DummyResolver()
+    else:
+        resolver = BeautifyingResolver(debug.SymbolResolver(loader_elf_path(args),
+            show_inline=not args.no_inlined_by))
+    prof.print_offcpu_flame_profile(profile, resolver, metric=args.metric,
+        min_value=int(args.min_value) if args.min_value else None)
+
 def needs_dpkt():
     global dpkt
     try:
@@ -711,6 +762,33 @@ def download_dump(args):
                 sys.stdout.write("\n")
             sys.stdout.flush()
 
+def stream_trace(args):
+    client = Client(args)
+    url = client.get_url() + "/trace/stream"
+    kwargs = client.get_request_kwargs()
+
+    requests.post(url, **kwargs).raise_for_status()
+    print("Streaming %s -> %s, interrupt to stop" % (url, args.tracefile))
+
+    deadline = time.time() + args.duration if args.duration else None
+    with open(args.tracefile, 'wb') as out_file:
+        def read():
+            r = requests.get(url, **kwargs)
+            r.raise_for_status()
+            out_file.write(r.content)
+            out_file.flush()
+
+        try:
+            while not deadline or time.time() < deadline:
+                read()
+        except KeyboardInterrupt:
+            pass
+        finally:
+            status = requests.get(url + "/status", **kwargs).json()
+            read()
+            requests.delete(url, **kwargs).raise_for_status()
+
+    print("%d records streamed, %d lost" % (status['records'], status['lost']))
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="trace file processing")
@@ -721,6 +799,8 @@ if __name__ == "__main__":
     cmd_list.add_argument("--tcpdump", action="store_true")
     cmd_list.add_argument("-t", "--tracepoint", action="store",
         help="prefix of name of the tracepoint to show; shows all by default")
+    cmd_list.add_argument("-f", "--follow", action="store_true",
+        help="keep reading records appended to a trace stream file")
     cmd_list.set_defaults(func=list_trace, paginate=True)
 
     cmd_wakeup_latency = subparsers.add_parser("wakeup-latency")
@@ -854,6 +934,25 @@ if __name__ == "__main__":
                                   default="buffers")
     cmd_convert_dump.set_defaults(func=convert_dump, paginate=False)
 
+    cmd_prof_offcpu = subparsers.add_parser("prof-offcpu", help="show off-cpu profile (REST)", description="""
+        Prints the kernel's off-cpu profile in the flame format: where threads
+        blocked, and how long they stayed blocked and then runnable but waiting
+        for a cpu, in microseconds. The profiler is started and stopped with
+        --start and --stop.
+        """)
+    add_symbol_resolution_options(cmd_prof_offcpu)
+    Client.add_arguments(cmd_prof_offcpu, use_full_url=True)
+    cmd_prof_offcpu.add_argument("profile", nargs='?', help="read the profile from this file instead of downloading it")
+    cmd_prof_offcpu.add_argument("--save", action="store_true", help="download the profile and save it to the given file")
+    cmd_prof_offcpu.add_argument("--metric", choices=sorted(prof.offcpu_metrics.keys()), default="total",
+        help="blocked time, runqueue wait time, both (total), or number of waits")
+    cmd_prof_offcpu.add_argument("--min-value", action="store", help="omit stacks with lower values")
+    cmd_prof_offcpu.add_argument("--histogram", action="store_true", help="show histogram of runqueue wait times")
+    cmd_prof_offcpu.add_argument("--start", action="store_true", help="start the off-cpu profiler")
+    cmd_prof_offcpu.add_argument("--stop", action="store_true", help="stop the off-cpu profiler")
+    cmd_prof_offcpu.add_argument("--reset", action="store_true", help="reset the off-cpu profile")
+    cmd_prof_offcpu.set_defaults(func=prof_offcpu, paginate=False)
+
     cmd_download_dump = subparsers.add_parser("download", help="download trace dump file (REST)"
                                              , description="""
                                              Downloads a trace dump via REST Api
@@ -862,10 +961,21 @@ if __name__ == "__main__":
     Client.add_arguments(cmd_download_dump, use_full_url=True)
     cmd_download_dump.set_defaults(func=download_dump, paginate=False)
 
+    cmd_stream = subparsers.add_parser("stream", help="stream trace records to a file (REST)"
+                                       , description="""
+                                       Streams trace records, as they are written, to a file
+                                       which the other commands can read, also while it grows
+                                       (see list --follow). Streaming stops when interrupted.
+                                       """)
+    add_trace_source_options(cmd_stream)
+    Client.add_arguments(cmd_stream, use_full_url=True)
+    cmd_stream.add_argument("--duration", type=float, help="stop after this many seconds")
+    cmd_stream.set_defaults(func=stream_trace, paginate=False)
+
 
     args = parser.parse_args()
 
-    if getattr(args, 'paginate', False):
+    if getattr(args, 'paginate', False) and not getattr(args, 'follow', False):
         less_process = subprocess.Popen(['less', '-FX'], stdin=subprocess.PIPE, text=True)
         sys.stdout = less_process.stdin
     else:
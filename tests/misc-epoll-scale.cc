@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// epoll scalability benchmark.
+//
+// The first test registers a large number of eventfds with one epoll
+// instance, shared by a number of worker threads, and has a producer make
+// random batches of them ready. It reports delivered events per second,
+// which should stay flat as the number of registered fds grows.
+//
+// The second test is the thundering herd: every worker has its own epoll
+// instance watching one shared eventfd, and each event should ideally wake
+// a single worker. It reports wakeups per event with and without
+// EPOLLEXCLUSIVE.
+//
+// Usage: misc-epoll-scale.so [fds [threads [seconds]]]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1U << 28)
+#endif
+
+using _clock = std::chrono::steady_clock;
+
+static void signal_fd(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+        perror("write");
+        abort();
+    }
+}
+
+static void drain_fd(int fd)
+{
+    uint64_t v;
+    // Nonblocking, another worker may have drained it already
+    (void)!read(fd, &v, sizeof(v));
+}
+
+static double ready_scan(const std::vector<int>& fds, unsigned nthreads,
+                         std::chrono::seconds duration)
+{
+    int ep = epoll_create1(0);
+    for (unsigned i = 0; i < fds.size(); i++) {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u32 = i;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+            perror("epoll_ctl");
+            abort();
+        }
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> delivered(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers.emplace_back([&] {
+            epoll_event events[64];
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                int r = epoll_wait(ep, events, 64, 10);
+                for (int i = 0; i < r; i++) {
+                    drain_fd(fds[events[i].data.u32]);
+                }
+                n += r > 0 ? r : 0;
+            }
+            delivered += n;
+        });
+    }
+
+    std::mt19937 rand(1);
+    std::uniform_int_distribution<unsigned> pick(0, fds.size() - 1);
+    auto start = _clock::now();
+    while (_clock::now() - start < duration) {
+        for (int i = 0; i < 64; i++) {
+            signal_fd(fds[pick(rand)]);
+        }
+    }
+    std::chrono::duration<double> sec = _clock::now() - start;
+    stop = true;
+    for (auto& t : workers) {
+        t.join();
+    }
+    close(ep);
+    for (auto fd : fds) {
+        drain_fd(fd);
+    }
+    return delivered / sec.count();
+}
+
+static double herd(unsigned nthreads, bool exclusive, unsigned nevents)
+{
+    int fd = eventfd(0, EFD_NONBLOCK);
+    std::vector<int> eps;
+    for (unsigned t = 0; t < nthreads; t++) {
+        int ep = epoll_create1(0);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET | (exclusive ? EPOLLEXCLUSIVE : 0);
+        ev.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        eps.push_back(ep);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> wakeups(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers.emplace_back([&, t] {
+            epoll_event ev;
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (epoll_wait(eps[t], &ev, 1, 10) == 1) {
+                    n++;
+                }
+            }
+            wakeups += n;
+        });
+    }
+    for (unsigned i = 0; i < nevents; i++) {
+        signal_fd(fd);
+        // Let the woken workers settle before the next event. Workers do
+        // not read the eventfd, so each one woken gets to see the event.
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        drain_fd(fd);
+    }
+    stop = true;
+    for (auto& t : workers) {
+        t.join();
+    }
+    for (auto ep : eps) {
+        close(ep);
+    }
+    close(fd);
+    return double(wakeups) / nevents;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_fds = argc > 1 ? atoi(argv[1]) : 50000;
+    unsigned nthreads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+    std::chrono::seconds duration(argc > 3 ? atoi(argv[3]) : 2);
+
+    rlimit rl = { max_fds + 100, max_fds + 100 };
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    std::vector<int> fds;
+    for (unsigned n = std::min(100u, max_fds); ; n = std::min(n * 10, max_fds)) {
+        while (fds.size() < n) {
+            int fd = eventfd(0, EFD_NONBLOCK);
+            if (fd < 0) {
+                perror("eventfd");
+                return 1;
+            }
+            fds.push_back(fd);
+        }
+        printf("%6u fds, %2u threads: %10.0f events/s\n",
+               n, nthreads, ready_scan(fds, nthreads, duration));
+        if (n == max_fds) {
+            break;
+        }
+    }
+    for (auto fd : fds) {
+        close(fd);
+    }
+
+    for (unsigned n = 2; n <= std::max(nthreads, 2u); n *= 2) {
+        printf("herd, %2u epolls: %5.2f wakeups/event, %5.2f with EPOLLEXCLUSIVE\n",
+               n, herd(n, false, 1000), herd(n, true, 1000));
+    }
+    return 0;
+}
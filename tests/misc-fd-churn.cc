@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// File descriptor churn benchmark.
+//
+// Measures how fast concurrent threads can allocate and release file
+// descriptors, first with bare socket()/close() pairs and then with
+// loopback accept()/close() churn, the pattern of a busy server. Both
+// runs keep a number of long-lived descriptors open so that allocation
+// has to skip over a populated table, and repeat with 1..N threads to
+// show how the descriptor table scales.
+//
+// Usage: misc-fd-churn.so [threads [seconds [open-fds]]]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using _clock = std::chrono::steady_clock;
+
+static double socket_churn(unsigned nthreads, std::chrono::seconds duration)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<long> ops(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nthreads; i++) {
+        threads.emplace_back([&] {
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                int fd = socket(AF_INET, SOCK_DGRAM, 0);
+                if (fd < 0) {
+                    perror("socket");
+                    abort();
+                }
+                close(fd);
+                n++;
+            }
+            ops += n;
+        });
+    }
+    auto start = _clock::now();
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    std::chrono::duration<double> sec = _clock::now() - start;
+    return ops / sec.count();
+}
+
+static double accept_churn(unsigned nthreads, std::chrono::seconds duration)
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(lfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 1024) < 0) {
+        perror("bind/listen");
+        abort();
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(lfd, (sockaddr*)&addr, &len);
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> accepts(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nthreads; i++) {
+        threads.emplace_back([&] {
+            long n = 0;
+            while (true) {
+                int fd = accept(lfd, nullptr, nullptr);
+                if (fd < 0 || stop.load(std::memory_order_relaxed)) {
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    break;
+                }
+                close(fd);
+                n++;
+            }
+            accepts += n;
+        });
+        threads.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                // Reset instead of going through TIME_WAIT, we are after
+                // fd allocation, not port exhaustion
+                linger l = {1, 0};
+                setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+                if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+                    perror("connect");
+                    abort();
+                }
+                close(fd);
+            }
+        });
+    }
+    auto start = _clock::now();
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    std::chrono::duration<double> sec = _clock::now() - start;
+    // Wake up acceptors still blocked in accept()
+    for (unsigned i = 0; i < nthreads; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(fd, (sockaddr*)&addr, sizeof(addr));
+        close(fd);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    close(lfd);
+    return accepts / sec.count();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_threads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+    std::chrono::seconds duration(argc > 2 ? atoi(argv[2]) : 2);
+    unsigned open_fds = argc > 3 ? atoi(argv[3]) : 1000;
+
+    // Long-lived descriptors, with every other one closed so that the
+    // table has holes to find
+    std::vector<int> held;
+    for (unsigned i = 0; i < open_fds; i++) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            perror("socket");
+            return 1;
+        }
+        held.push_back(fd);
+    }
+    for (unsigned i = 0; i < held.size(); i += 2) {
+        close(held[i]);
+    }
+    printf("%u long-lived fds, %u of them open\n", open_fds, open_fds / 2);
+
+    for (unsigned n = 1; n <= max_threads; n *= 2) {
+        printf("%2u threads: socket/close %10.0f ops/s, accept/close %9.0f conn/s\n",
+               n, socket_churn(n, duration), accept_churn(n, duration));
+    }
+
+    for (unsigned i = 1; i < held.size(); i += 2) {
+        close(held[i]);
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -10,6 +11,35 @@ unsigned long to_usec(struct timeval tv)
     return tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+unsigned long to_nsec(struct timespec ts)
+{
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+// Times RUNS reads of the given clock, and checks on the way that the
+// monotonic clock never goes backwards
+void run_clock_gettime(clockid_t clk, const char *name)
+{
+    struct timespec ts_start, ts, prev;
+    double diff;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    clock_gettime(clk, &prev);
+    for (i = 0; i < RUNS; ++i) {
+        clock_gettime(clk, &ts);
+        if (clk == CLOCK_MONOTONIC && to_nsec(ts) < to_nsec(prev)) {
+            printf("%s went backwards by %lu ns\n", name, to_nsec(prev) - to_nsec(ts));
+            exit(1);
+        }
+        prev = ts;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    diff = (double)(to_nsec(ts) - to_nsec(ts_start)) / RUNS;
+    printf("1 %s run: %.2f ns\n", name, diff);
+}
+
 int main(int argc, char **argv)
 {
     struct timeval tv_start;
@@ -23,6 +53,9 @@ int main(int argc, char **argv)
     }
     gettimeofday(&tv, NULL);
 
-    diff = (1000 * (to_usec(tv) - to_usec(tv_start))) / RUNS;
+    diff = (1000.0 * (to_usec(tv) - to_usec(tv_start))) / RUNS;
     printf("1 GTOD run: %.2f ns\n", diff);
+
+    run_clock_gettime(CLOCK_MONOTONIC, "clock_gettime(CLOCK_MONOTONIC)");
+    run_clock_gettime(CLOCK_REALTIME, "clock_gettime(CLOCK_REALTIME)");
 }
@@ -8,6 +8,7 @@
 #include <osv/preempt-lock.hh>
 #include <osv/migration-lock.hh>
 #include <future>
+#include <pthread.h>
 #include <chrono>
 #include <osv/elf.hh>
 OSV_ELF_MLOCK_OBJECT();
@@ -20,6 +21,13 @@ struct dummy_lock
     void unlock() {}
 };
 
+struct pthread_lock
+{
+    pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+    void lock() { pthread_mutex_lock(&m); }
+    void unlock() { pthread_mutex_unlock(&m); }
+};
+
 template<typename Lock>
 double time(Lock& lock)
 {
@@ -53,5 +61,6 @@ int main(int argc, char const *argv[])
     test("preempt", preempt_lock);
     test("migrate", migration_lock);
     test("mutex", *new mutex);
+    test("pthread", *new pthread_lock);
     return 0;
 }
@@ -1,6 +1,10 @@
 #include <sys/mman.h>
 #include <cstdio>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 std::chrono::duration<double> mmap_and_write(size_t mb, int flags)
 {
@@ -23,8 +27,60 @@ void mmap_bench(size_t mb)
     printf("%4lu %-6.3f %-6.3f\n", mb, demand.count(), populate.count());
 }
 
+// Small unmaps and protection changes, the pattern of garbage collectors and
+// allocators returning memory, done concurrently by several threads. Each
+// operation needs a TLB shootdown on every cpu running one of the threads,
+// so this shows both the cost of a single shootdown and how well concurrent
+// ones scale.
+void small_unmap_bench(unsigned nthreads, size_t pages)
+{
+    const auto duration = std::chrono::seconds(1);
+    std::atomic<bool> stop(false);
+    std::atomic<long> unmaps(0), mprotects(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nthreads; t++) {
+        threads.emplace_back([&] {
+            size_t size = pages * 4096;
+            long n = 0, m = 0;
+            char *q = reinterpret_cast<char*>(mmap(nullptr, 4096, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0));
+            q[0] = 1;
+            while (!stop.load(std::memory_order_relaxed)) {
+                char *p = reinterpret_cast<char*>(mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0));
+                for (size_t i = 0; i < size; i += 4096) {
+                    p[i] = 1;
+                }
+                munmap(p, size);
+                n++;
+                mprotect(q, 4096, PROT_READ);
+                mprotect(q, 4096, PROT_READ|PROT_WRITE);
+                m += 2;
+            }
+            munmap(q, 4096);
+            unmaps += n;
+            mprotects += m;
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    std::chrono::duration<double> sec = duration;
+    printf("%7u %5lu %10.0f %10.0f\n", nthreads, pages,
+           unmaps / sec.count(), mprotects / sec.count());
+}
+
 int main()
 {
+    printf("threads pages  munmaps/s mprotects/s\n");
+    auto ncpus = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t pages : { 1, 16, 64 }) {
+        for (unsigned n = 1; n <= ncpus; n *= 2) {
+            small_unmap_bench(n, pages);
+        }
+    }
+    printf("\n");
+
     for (auto i = 1; i <= 5; i++) {
         printf("Iteration %d\n\n", i);
         printf("     time (seconds)\n");
@@ -11,6 +11,7 @@
 #include <osv/clock.hh>
 #include <osv/rwlock.h>
 #include <iostream>
+#include <atomic>
 
 #include <string.h>
 
@@ -158,6 +159,41 @@ static void test(int N, long len, bool pinned, threadfunc<T> f)
     }
 }
 
+// Like test<mutex>(..., increment_thread), with the lock held for a short
+// time, but also reports how many context switches each lock() cost. This
+// shows what adaptive spinning saves: with spinning, a thread finding the
+// lock held by a running thread usually gets it without sleeping.
+static void test_spinning(int N, long len, unsigned spin_limit)
+{
+    auto saved_limit = mutex::spin_limit;
+    mutex::spin_limit = spin_limit;
+    long shared = 0;
+    mutex m;
+    std::atomic<u64> switches(0);
+    sched::thread *threads[N];
+    for (int i = 0; i < N; i++) {
+        threads[i] = sched::thread::make([&, i] {
+            auto t = sched::thread::current();
+            auto before = t->stat_switches.get();
+            increment_thread(i, &m, len, &shared);
+            switches += t->stat_switches.get() - before;
+        }, sched::thread::attr().pin(sched::cpus[i]));
+    }
+    auto t1 = clock::get()->time();
+    for (int i = 0; i < N; i++) {
+        threads[i]->start();
+    }
+    for (int i = 0; i < N; i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    auto t2 = clock::get()->time();
+    printf("\n%d pinned threads, spin limit %u: %d ns, %.3f context switches per lock\n",
+            N, spin_limit, (t2-t1)/len/N, double(switches) / (len * N));
+    assert(shared == len*N);
+    mutex::spin_limit = saved_limit;
+}
+
 template <typename T>
 static void measure_uncontended(long len)
 {
@@ -278,6 +314,14 @@ int main(int argc, char **argv)
         test<rwlock_read_lock>(20, n, false, rwf);
     }
 
+    if ((run_contended || run_all) && sched::cpus.size() > 1) {
+        printf("\n==== BENCHMARK 3 ====\nContended mutex with and without adaptive spinning:\n");
+        for (unsigned spin_limit : { mutex::spin_limit, 0u }) {
+            test_spinning(2, n, spin_limit);
+            test_spinning((int)sched::cpus.size(), n, spin_limit);
+        }
+    }
+
     if (run_misc || run_all) {
         printf("\n==== MISC TESTS ====\n");
         printf("\n\nTrylock tests using spinning_increment_thread:\n");
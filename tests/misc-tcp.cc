@@ -18,10 +18,22 @@
 #include <utility>
 #include <random>
 #include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 // To run this test you need netcat running in another terminal
 // to echo the data back to this program like so:
 //   ncat -l -k -p 9999 -e /bin/cat
+//
+// With --loopback, it instead benchmarks TCP over 127.0.0.1 against an
+// echo server of its own: the round trip latency of small messages, then
+// the throughput of a one way bulk transfer.
 
 using namespace std;
 
@@ -41,6 +53,8 @@ struct params {
     unsigned lifetime;
     uint64_t transfer;
     string remote;
+    unsigned rounds;
+    unsigned msg_size;
 };
 
 class tcp_test_client {
@@ -214,6 +228,130 @@ tcp_test_client::tcp_test_client(params p)
 {
 }
 
+static constexpr in_port_t loopback_port = 9999;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        throw runtime_error(string(what) + ": " + strerror(errno));
+    }
+}
+
+static void read_full(int fd, char* buf, size_t len)
+{
+    while (len) {
+        auto r = read(fd, buf, len);
+        check(r > 0, "read");
+        buf += r;
+        len -= r;
+    }
+}
+
+static void write_full(int fd, const char* buf, size_t len)
+{
+    while (len) {
+        auto r = write(fd, buf, len);
+        check(r > 0, "write");
+        buf += r;
+        len -= r;
+    }
+}
+
+// Echoes the first connection back until it is closed, then counts what the
+// second one sends and replies with the byte count once it is closed for
+// writing
+static void loopback_server(int listener)
+{
+    std::vector<char> buf(65536);
+    int fd = accept(listener, nullptr, nullptr);
+    check(fd >= 0, "accept");
+    ssize_t r;
+    while ((r = read(fd, buf.data(), buf.size())) > 0) {
+        write_full(fd, buf.data(), r);
+    }
+    close(fd);
+
+    fd = accept(listener, nullptr, nullptr);
+    check(fd >= 0, "accept");
+    uint64_t total = 0;
+    while ((r = read(fd, buf.data(), buf.size())) > 0) {
+        total += r;
+    }
+    write_full(fd, reinterpret_cast<char*>(&total), sizeof(total));
+    close(fd);
+}
+
+static int loopback_connect()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    check(fd >= 0, "socket");
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(loopback_port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    check(connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0, "connect");
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static void loopback_bench(const params& p)
+{
+    using clock = std::chrono::steady_clock;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    check(listener >= 0, "socket");
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(loopback_port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    check(bind(listener, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0, "bind");
+    check(listen(listener, 2) == 0, "listen");
+    thread server([=] { loopback_server(listener); });
+
+    int fd = loopback_connect();
+    std::vector<char> msg(p.msg_size, 'x');
+    std::vector<uint64_t> rtt(p.rounds);
+    for (unsigned i = 0; i < p.rounds; i++) {
+        auto t0 = clock::now();
+        write_full(fd, msg.data(), msg.size());
+        read_full(fd, msg.data(), msg.size());
+        rtt[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+    }
+    close(fd);
+    std::sort(rtt.begin(), rtt.end());
+    uint64_t sum = 0;
+    for (auto t : rtt) {
+        sum += t;
+    }
+    cout << "round trip of " << p.msg_size << " bytes, " << p.rounds << " rounds: avg "
+         << sum / p.rounds / 1000.0 << " us, p50 " << rtt[p.rounds / 2] / 1000.0
+         << " us, p99 " << rtt[p.rounds * 99 / 100] / 1000.0 << " us\n";
+
+    fd = loopback_connect();
+    std::vector<char> buf(65536, 'y');
+    uint64_t sent = 0;
+    auto t0 = clock::now();
+    while (sent < p.transfer) {
+        auto len = std::min<uint64_t>(buf.size(), p.transfer - sent);
+        write_full(fd, buf.data(), len);
+        sent += len;
+    }
+    shutdown(fd, SHUT_WR);
+    uint64_t received;
+    read_full(fd, reinterpret_cast<char*>(&received), sizeof(received));
+    double secs = std::chrono::duration<double>(clock::now() - t0).count();
+    close(fd);
+    server.join();
+    close(listener);
+    if (received != sent) {
+        throw runtime_error("bulk transfer lost data");
+    }
+    cout << "bulk transfer of " << sent << " bytes: " << sent / secs / 1e6 << " MB/s\n";
+}
+
 int main(int ac, char** av)
 {
     namespace bpo = boost::program_options;
@@ -230,7 +368,12 @@ int main(int ac, char** av)
         ("lifetime,l", bpo::value(&p.lifetime)->default_value(40),
                 "average thread lifetime (in connections)")
         ("transfer,t", bpo::value(&p.transfer)->default_value(10000000),
-                "average transfer (per connection)")
+                "average transfer (per connection), or bulk transfer with --loopback")
+        ("loopback", "benchmark against an echo server on 127.0.0.1 instead")
+        ("rounds,r", bpo::value(&p.rounds)->default_value(100000),
+                "round trips to time with --loopback")
+        ("size,s", bpo::value(&p.msg_size)->default_value(64),
+                "round trip message size with --loopback")
     ;
     bpo::variables_map vars;
     bpo::store(bpo::parse_command_line(ac, av, desc), vars);
@@ -242,6 +385,10 @@ int main(int ac, char** av)
     }
 
     try {
+        if (vars.count("loopback")) {
+            loopback_bench(p);
+            return 0;
+        }
         tcp_test_client client{p};
         client.run();
     } catch (exception& e) {
@@ -9,6 +9,9 @@
 // get when competing against each other, on OSv and on Linux, so we can
 // callibrate OSv's behavior in this case to be similar to Linux's.
 //
+// It first measures how late short sleeps wake up, which is dominated by
+// the cost and precision of rearming the timer.
+//
 // Please run this benchmark on a single CPU.
 // To run this benchmark on Linux:
 //    g++ -g -pthread -std=c++11 tests/misc-timeslice.cc
@@ -22,11 +25,39 @@
 #include <iostream>
 #include <vector>
 #include <atomic>
+#include <algorithm>
 
 #include <sys/resource.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <cmath>
+
 
+void timer_latency_test(std::chrono::microseconds period)
+{
+    using clock = std::chrono::steady_clock;
+    const int runs = 2000;
+    std::vector<double> late;
+    for (int i = 0; i < runs; i++) {
+        auto start = clock::now();
+        std::this_thread::sleep_for(period);
+        std::chrono::duration<double, std::micro> d = clock::now() - start - period;
+        late.push_back(d.count());
+    }
+    std::sort(late.begin(), late.end());
+    double sum = 0;
+    for (auto l : late) {
+        sum += l;
+    }
+    double avg = sum / runs;
+    double var = 0;
+    for (auto l : late) {
+        var += (l - avg) * (l - avg);
+    }
+    printf("%5ldus sleep: late by min %.1fus avg %.1fus p99 %.1fus max %.1fus, jitter %.1fus\n",
+           (long)period.count(), late.front(), avg, late[runs * 99 / 100],
+           late.back(), std::sqrt(var / runs));
+}
 
 void timeslice_test()
 {
@@ -52,5 +83,8 @@ void timeslice_test()
 }
 int main()
 {
+    for (auto us : {10, 100, 1000}) {
+        timer_latency_test(std::chrono::microseconds(us));
+    }
     timeslice_test();
 }
@@ -35,20 +35,25 @@ uint64_t nstime()
     return tv.tv_sec * mul + tv.tv_usec * mul2;
 }
 
+#define MEASURE(desc, call) do { \
+        long loop = count; \
+        uint64_t start = nstime(); \
+        while (loop--) { \
+            call; \
+        } \
+        uint64_t end = nstime(); \
+        printf("%lu ns (elapsed %.2f sec) : average %s duration\n", \
+               (end - start) / count, (end - start) / 1000000000.0, desc); \
+    } while (0)
+
 int main(int argc, char **argv)
 {
     long count = 50000000;
-    long loop = count;
-    uint64_t start = nstime();
-
     struct timespec ts1;
-    while (loop--) {
-        assert(0 == clock_gettime(CLOCK_MONOTONIC, &ts1));
-    }
-
-    uint64_t end = nstime();
+    struct timeval tv;
 
-    long average_syscall_duration = (end - start) / count;
-    printf("%lu ns (elapsed %.2f sec) %s\n", average_syscall_duration, (end - start) / 1000000000.0, ": average clock_gettime duration");
+    MEASURE("clock_gettime(CLOCK_MONOTONIC)", assert(0 == clock_gettime(CLOCK_MONOTONIC, &ts1)));
+    MEASURE("clock_gettime(CLOCK_REALTIME)", assert(0 == clock_gettime(CLOCK_REALTIME, &ts1)));
+    MEASURE("gettimeofday", assert(0 == gettimeofday(&tv, NULL)));
+    MEASURE("time", assert(0 != time(NULL)));
 }
-
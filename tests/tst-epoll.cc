@@ -16,7 +16,10 @@
 #include <osv/latch.hh>
 #endif
 
+#include <array>
+#include <atomic>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <chrono>
 #include <thread>
@@ -84,6 +87,103 @@ static void test_epolloneshot()
     report(r == 0, "epoll_ctl DEL");
 }
 
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1U << 28)
+#endif
+
+// With EPOLLEXCLUSIVE, an event on a file registered with several epoll
+// instances wakes one of their waiters rather than all of them.
+static void test_epollexclusive()
+{
+    constexpr int NEPOLL = 4;
+    int s[2];
+    int r = pipe(s);
+    report(r == 0, "create pipe");
+
+    int eps[NEPOLL];
+    struct epoll_event event;
+    for (int i = 0; i < NEPOLL; i++) {
+        eps[i] = epoll_create1(0);
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.u32 = i;
+        r = epoll_ctl(eps[i], EPOLL_CTL_ADD, s[0], &event);
+        report(r == 0, "epoll_ctl ADD EPOLLEXCLUSIVE");
+    }
+    event.events = EPOLLIN;
+    r = epoll_ctl(eps[0], EPOLL_CTL_MOD, s[0], &event);
+    report(r == -1 && errno == EINVAL, "EPOLL_CTL_MOD of exclusive fd is EINVAL");
+    int ep = epoll_create1(0);
+    event.events = EPOLLIN | EPOLLEXCLUSIVE | EPOLLONESHOT;
+    r = epoll_ctl(ep, EPOLL_CTL_ADD, s[0], &event);
+    report(r == -1 && errno == EINVAL, "EPOLLEXCLUSIVE with EPOLLONESHOT is EINVAL");
+    close(ep);
+
+    std::atomic<int> woken(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NEPOLL; i++) {
+        threads.emplace_back([&, i] {
+            struct epoll_event ev;
+            if (epoll_wait(eps[i], &ev, 1, 1000) == 1) {
+                woken++;
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    write_one(s[1]);
+    for (auto& t : threads) {
+        t.join();
+    }
+    report(woken >= 1 && woken < NEPOLL, "exclusive wakeup did not wake every epoll");
+
+    for (int i = 0; i < NEPOLL; i++) {
+        close(eps[i]);
+    }
+    close(s[0]);
+    close(s[1]);
+}
+
+// Level triggered readiness of many files, returned a few at a time, must
+// come back round-robin rather than starving files behind the first batch.
+static void test_epoll_many_level_triggered()
+{
+    constexpr int NFDS = 256;
+    constexpr int MAXEVENTS = 16;
+    struct epoll_event events[MAXEVENTS];
+
+    int ep = epoll_create1(0);
+    std::vector<std::array<int, 2>> pipes(NFDS);
+    for (int i = 0; i < NFDS; i++) {
+        if (pipe(pipes[i].data()) != 0) {
+            report(false, "create pipe");
+            return;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, pipes[i][0], &event);
+        char c = 0;
+        write(pipes[i][1], &c, 1);
+    }
+    std::vector<bool> seen(NFDS);
+    int nseen = 0;
+    for (int round = 0; round < NFDS / MAXEVENTS; round++) {
+        int r = epoll_wait(ep, events, MAXEVENTS, 0);
+        for (int i = 0; i < r; i++) {
+            if (!seen[events[i].data.u32]) {
+                seen[events[i].data.u32] = true;
+                nseen++;
+            }
+        }
+    }
+    report(nseen == NFDS, "every level triggered fd returned once");
+    // Closing the epoll instance with items still on its ready list
+    close(ep);
+    for (auto& p : pipes) {
+        close(p[0]);
+        close(p[1]);
+    }
+}
+
 // Test epoll on a VFS file. It's not a very interesting case, and Linux
 // doesn't even support epoll on disk filesystems (like ext4), but it
 // turns out that on the /proc filesystem, it does work on Linux. In OSv,
@@ -393,6 +493,8 @@ int main(int ac, char** av)
     test_epoll_file();
     test_socket_epollrdhup();
     test_af_local_epollrdhup();
+    test_epollexclusive();
+    test_epoll_many_level_triggered();
 
     std::cout << "SUMMARY: " << tests << ", " << fails << " failures\n";
     return !!fails;
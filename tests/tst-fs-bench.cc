@@ -13,11 +13,16 @@
  *
  * Usage (as OSv execute argument):
  *   tests/tst-fs-bench.so [--dir /path] [--size-mb N] [--nfiles N] [--prebuilt]
+ *                         [--ramfs]
  *
  * --dir PATH    working directory (default: /bench)
  * --size-mb N   file size in MB for seq/random tests (default: 32)
  * --nfiles N    number of files for metadata test (default: 200)
  * --prebuilt    files already exist in --dir; skip creation, only read tests
+ * --ramfs       also run the scratch-space workloads ramfs is tuned for:
+ *               lookups in a large directory, sparse files and appends.
+ *               Run the same command on two builds to compare ramfs data
+ *               layouts; the BENCH lines are named ramfs_* for that.
  *
  * Pre-built layout expected by --prebuilt:
  *   PATH/seq_4096.bin          seq_size_mb MB of data (4K alignment)
@@ -53,6 +58,7 @@ static std::string g_dir      = "/bench";
 static size_t      g_size_mb  = 32;
 static int         g_nfiles   = 200;
 static bool        g_prebuilt = false;
+static bool        g_ramfs    = false;
 
 static void report(const char *name, double val, const char *unit)
 {
@@ -226,6 +232,116 @@ static double mmap_read(const char *dir, size_t file_sz)
     return (double)file_sz / (1024.0 * 1024.0) / s;
 }
 
+/* --------------------------------------------------------------------------
+ * ramfs scratch-space workloads
+ * -------------------------------------------------------------------------- */
+static double ramfs_bigdir_lookup(const char *dir, int n)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bigdir", dir);
+    mkdir(path, 0755);
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/bigdir/f%06d", dir, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd < 0) return -1;
+        close(fd);
+    }
+    struct stat st;
+    srand(42);
+    auto t0 = hrc::now();
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/bigdir/f%06d", dir, rand() % n);
+        stat(path, &st);
+    }
+    double s = fsec(hrc::now() - t0).count();
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/bigdir/f%06d", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/bigdir", dir);
+    rmdir(path);
+    return n / s;
+}
+
+/* Touch one 4K block per MB of a file truncated to file_sz, then read the
+ * whole file back, holes included. */
+static double ramfs_sparse(const char *dir, size_t file_sz)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sparse.bin", dir);
+    int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    std::vector<char> buf(131072, (char)0x5A);
+    auto t0 = hrc::now();
+    if (ftruncate(fd, file_sz) < 0) {
+        close(fd);
+        return -1;
+    }
+    for (size_t off = 0; off < file_sz; off += 1024 * 1024) {
+        pwrite(fd, buf.data(), 4096, off);
+    }
+    for (size_t off = 0; off < file_sz; off += buf.size()) {
+        if (pread(fd, buf.data(), buf.size(), off) <= 0) break;
+    }
+    double s = fsec(hrc::now() - t0).count();
+    close(fd);
+    unlink(path);
+    return (double)file_sz / (1024.0 * 1024.0) / s;
+}
+
+/* Append in small writes, the way logs and temp files grow. */
+static double ramfs_append(const char *dir, size_t file_sz, size_t io_sz)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/append.bin", dir);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return -1;
+    std::vector<char> buf(io_sz, (char)0x3C);
+    auto t0 = hrc::now();
+    for (size_t done = 0; done < file_sz;) {
+        ssize_t n = write(fd, buf.data(), buf.size());
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    double s = fsec(hrc::now() - t0).count();
+    close(fd);
+    unlink(path);
+    return (double)file_sz / (1024.0 * 1024.0) / s;
+}
+
+/* Random 4K reads through a shared read-only mapping of a fresh file. */
+static double ramfs_mmap_rand(const char *dir, size_t file_sz, int nops)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/mmap.bin", dir);
+    int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    std::vector<char> buf(65536, (char)0x7E);
+    for (size_t done = 0; done < file_sz;) {
+        ssize_t n = write(fd, buf.data(), buf.size());
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    void *p = mmap(nullptr, file_sz, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    unlink(path);
+    if (p == MAP_FAILED) return -1;
+    const size_t n_pages = file_sz / 4096;
+    volatile uint64_t sum = 0;
+    srand(42);
+    auto t0 = hrc::now();
+    for (int i = 0; i < nops; i++) {
+        const uint64_t *q = (const uint64_t *)((char *)p +
+            (size_t)(rand() % (int)n_pages) * 4096);
+        for (size_t j = 0; j < 4096 / sizeof(uint64_t); j++)
+            sum += q[j];
+    }
+    double s = fsec(hrc::now() - t0).count();
+    munmap(p, file_sz);
+    (void)sum;
+    return nops / s;
+}
+
 /* --------------------------------------------------------------------------
  * Utilities
  * -------------------------------------------------------------------------- */
@@ -290,6 +406,8 @@ int main(int argc, char *argv[])
             g_nfiles = atoi(argv[++i]);
         else if (!strcmp(argv[i], "--prebuilt"))
             g_prebuilt = true;
+        else if (!strcmp(argv[i], "--ramfs"))
+            g_ramfs = true;
         else {
             fprintf(stderr, "unknown arg: %s\n", argv[i]);
             return 1;
@@ -306,6 +424,7 @@ int main(int argc, char *argv[])
     printf("  file:     %zu MB\n", g_size_mb);
     printf("  nfiles:   %d\n", g_nfiles);
     printf("  prebuilt: %s\n", g_prebuilt ? "yes" : "no");
+    printf("  ramfs:    %s\n", g_ramfs ? "yes" : "no");
     print_statvfs(dir);
     printf("\n");
 
@@ -400,6 +519,25 @@ int main(int argc, char *argv[])
     if (v > 0) report("mmap_seq_read", v, "MB/s");
     else        skip("mmap_seq_read");
 
+    if (g_ramfs) {
+        printf("--- ramfs scratch workloads ---\n");
+        if (writable) {
+            v = ramfs_bigdir_lookup(dir, g_nfiles * 100);
+            report("ramfs_bigdir_stat", v, "ops/s");
+            v = ramfs_sparse(dir, fsz * 32);
+            report("ramfs_sparse_rw", v, "MB/s");
+            v = ramfs_append(dir, fsz, 512);
+            report("ramfs_append_512", v, "MB/s");
+            v = ramfs_mmap_rand(dir, fsz, nrand * 20);
+            report("ramfs_mmap_rand_4k", v, "IOPS");
+        } else {
+            skip("ramfs_bigdir_stat");
+            skip("ramfs_sparse_rw");
+            skip("ramfs_append_512");
+            skip("ramfs_mmap_rand_4k");
+        }
+    }
+
     /* ------------------------------------------------------------------ */
     printf("\n=== Done ===\n");
 
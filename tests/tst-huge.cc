@@ -98,6 +98,34 @@ int main(int argc, char **argv)
         munmap(p, mmu::huge_page_size);
     }
 
+    // Test MAP_HUGE_1GB: refused unless the cpu has 1GB pages, and then
+    // mapped with naturally aligned 1GB pages, which can still be unmapped
+    // piecemeal.
+    {
+        constexpr size_t gb = size_t(1) << 30;
+        void *p = mmap(NULL, gb, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(30 << MAP_HUGE_SHIFT), -1, 0);
+        if (mmu::get_nr_page_sizes() < 3) {
+            assert(p == MAP_FAILED && errno == EINVAL);
+        } else if (memory::stats::free() < 2 * gb) {
+            std::cerr << "not enough memory to test MAP_HUGE_1GB\n";
+            if (p != MAP_FAILED) {
+                munmap(p, gb);
+            }
+        } else {
+            assert(p != MAP_FAILED && "MAP_HUGE_1GB should succeed with free memory");
+            assert((reinterpret_cast<uintptr_t>(p) & (gb - 1)) == 0);
+            auto up = static_cast<volatile unsigned char *>(p);
+            up[0] = 1;
+            up[gb / 2] = 2;
+            up[gb - 1] = 3;
+            // Punch a hole in the middle, splitting the page
+            assert(munmap((void*)(up + gb / 2), mmu::huge_page_size) == 0);
+            assert(up[0] == 1 && up[gb - 1] == 3);
+            munmap(p, gb);
+        }
+    }
+
     // Test MADV_NOHUGEPAGE / MADV_HUGEPAGE round-trip on a small mapping.
     {
         void *ps = mmap(NULL, mmu::page_size, PROT_READ|PROT_WRITE,
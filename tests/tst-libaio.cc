@@ -6,11 +6,17 @@
  */
 
 // Exercises the Linux libaio interface (io_setup/io_submit/io_getevents/
-// io_destroy/io_cancel) implemented in core/libaio.cc.  This test targets
-// OSv's <libaio.h> ABI (flat struct iocb with aio_* fields); it is built and
-// run as part of the OSv test image.
+// io_destroy/io_cancel) implemented in core/libaio.cc, and the POSIX aio_*()
+// functions which share its engine.  This test targets OSv's <libaio.h> ABI
+// (flat struct iocb with aio_* fields); it is built and run as part of the
+// OSv test image.
+//
+// It ends with a benchmark of random 4K reads at increasing queue depths,
+// on a file in /tmp or, when TST_LIBAIO_DEV names one (e.g. /dev/vblk1), on
+// a block device, which is only ever read.
 
 #include <libaio.h>
+#include <aio.h>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -19,8 +25,11 @@
 #include <errno.h>
 
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
+#include <random>
+#include <vector>
 
 // Helpers matching the fields libaio's io_prep_* would set.
 static void prep_pwrite(struct iocb *cb, int fd, void *buf, size_t n, long long off)
@@ -177,6 +186,169 @@ static void test_getevents_timeout()
     assert(io_destroy(ctx) == 0);
 }
 
+// POSIX aio: write with aio_write(), wait with aio_suspend(), read back
+// with lio_listio(LIO_WAIT).
+static void test_posix_aio()
+{
+    char path[] = "/tmp/tst-posix-aio-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+
+    const size_t N = 4096;
+    std::vector<char> wbuf(N), rbuf1(N / 2), rbuf2(N / 2);
+    for (size_t i = 0; i < N; i++) {
+        wbuf[i] = static_cast<char>((i * 7 + 3) & 0xff);
+    }
+
+    struct aiocb cb;
+    memset(&cb, 0, sizeof(cb));
+    cb.aio_fildes = fd;
+    cb.aio_buf = wbuf.data();
+    cb.aio_nbytes = N;
+    cb.aio_offset = 0;
+    cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+    assert(aio_write(&cb) == 0);
+    const struct aiocb *list[] = { &cb };
+    while (aio_error(&cb) == EINPROGRESS) {
+        assert(aio_suspend(list, 1, nullptr) == 0);
+    }
+    assert(aio_error(&cb) == 0);
+    assert(aio_return(&cb) == (ssize_t)N);
+
+    struct aiocb r1, r2;
+    memset(&r1, 0, sizeof(r1));
+    r1.aio_fildes = fd;
+    r1.aio_lio_opcode = LIO_READ;
+    r1.aio_buf = rbuf1.data();
+    r1.aio_nbytes = N / 2;
+    r1.aio_offset = 0;
+    r2 = r1;
+    r2.aio_buf = rbuf2.data();
+    r2.aio_offset = N / 2;
+    struct aiocb *lio[] = { &r1, nullptr, &r2 };
+    assert(lio_listio(LIO_WAIT, lio, 3, nullptr) == 0);
+    assert(aio_return(&r1) == (ssize_t)(N / 2));
+    assert(aio_return(&r2) == (ssize_t)(N / 2));
+    assert(memcmp(wbuf.data(), rbuf1.data(), N / 2) == 0);
+    assert(memcmp(wbuf.data() + N / 2, rbuf2.data(), N / 2) == 0);
+
+    // A bad fd is reported through aio_error()
+    struct aiocb bad = r1;
+    bad.aio_fildes = 987654;
+    assert(aio_read(&bad) == 0);
+    const struct aiocb *blist[] = { &bad };
+    while (aio_error(&bad) == EINPROGRESS) {
+        assert(aio_suspend(blist, 1, nullptr) == 0);
+    }
+    assert(aio_error(&bad) == EBADF);
+    assert(aio_return(&bad) == -1);
+
+    // An fsync covers the writes queued before it, so they are done by the
+    // time it is
+    std::vector<struct aiocb> writes(8);
+    for (size_t i = 0; i < writes.size(); i++) {
+        memset(&writes[i], 0, sizeof(writes[i]));
+        writes[i].aio_fildes = fd;
+        writes[i].aio_buf = wbuf.data();
+        writes[i].aio_nbytes = N;
+        writes[i].aio_offset = N * i;
+        assert(aio_write(&writes[i]) == 0);
+    }
+    struct aiocb sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.aio_fildes = fd;
+    assert(aio_fsync(O_SYNC, &sync) == 0);
+    const struct aiocb *slist[] = { &sync };
+    while (aio_error(&sync) == EINPROGRESS) {
+        assert(aio_suspend(slist, 1, nullptr) == 0);
+    }
+    assert(aio_error(&sync) == 0);
+    for (auto& w : writes) {
+        assert(aio_error(&w) == 0);
+        assert(aio_return(&w) == (ssize_t)N);
+    }
+
+    close(fd);
+    unlink(path);
+}
+
+// Random 4K reads keeping qd of them in flight, returns the IOPS
+static double run_qd(int fd, off_t size, int qd, int ops, char *bufs)
+{
+    const size_t bs = 4096;
+    std::mt19937_64 rnd(qd);
+    std::uniform_int_distribution<off_t> block(0, size / bs - 1);
+
+    io_context_t ctx = nullptr;
+    assert(io_setup(qd, &ctx) == 0);
+    std::vector<struct iocb> cbs(qd);
+    std::vector<struct io_event> evs(qd);
+
+    auto start = std::chrono::steady_clock::now();
+    int submitted = 0, completed = 0;
+    for (int i = 0; i < qd && submitted < ops; i++, submitted++) {
+        prep_pread(&cbs[i], fd, bufs + i * bs, bs, block(rnd) * bs);
+        struct iocb *p = &cbs[i];
+        assert(io_submit(ctx, 1, &p) == 1);
+    }
+    while (completed < ops) {
+        int n = io_getevents(ctx, 1, qd, evs.data(), nullptr);
+        assert(n > 0);
+        for (int i = 0; i < n; i++) {
+            assert(evs[i].res == (long)bs);
+            completed++;
+            if (submitted < ops) {
+                auto cb = reinterpret_cast<struct iocb *>(evs[i].obj);
+                auto buf = reinterpret_cast<void *>(cb->aio_buf);
+                prep_pread(cb, fd, buf, bs, block(rnd) * bs);
+                assert(io_submit(ctx, 1, &cb) == 1);
+                submitted++;
+            }
+        }
+    }
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    assert(io_destroy(ctx) == 0);
+    return ops / secs;
+}
+
+static void bench_qd_scaling()
+{
+    const int max_qd = 64;
+    const int ops = 4096;
+    const char *dev = getenv("TST_LIBAIO_DEV");
+    char path[] = "/tmp/tst-libaio-bench-XXXXXX";
+    int fd;
+    off_t size;
+
+    if (dev) {
+        fd = open(dev, O_RDONLY | O_DIRECT);
+        assert(fd >= 0);
+        size = lseek(fd, 0, SEEK_END);
+        assert(size >= 4096);
+    } else {
+        fd = mkstemp(path);
+        assert(fd >= 0);
+        size = 16 << 20;
+        std::vector<char> chunk(1 << 20, 'x');
+        for (off_t off = 0; off < size; off += chunk.size()) {
+            assert(pwrite(fd, chunk.data(), chunk.size(), off) == (ssize_t)chunk.size());
+        }
+    }
+
+    char *bufs;
+    assert(posix_memalign(reinterpret_cast<void **>(&bufs), 4096, max_qd * 4096) == 0);
+    std::cerr << "Random 4K reads from " << (dev ? dev : "a file in /tmp") << ":\n";
+    for (int qd = 1; qd <= max_qd; qd *= 2) {
+        std::cerr << "  QD " << qd << ": " << (long)run_qd(fd, size, qd, ops, bufs) << " IOPS\n";
+    }
+    free(bufs);
+
+    close(fd);
+    if (!dev) {
+        unlink(path);
+    }
+}
+
 int main()
 {
     std::cerr << "Running libaio tests\n";
@@ -185,6 +357,8 @@ int main()
     test_batch();
     test_bad_fd();
     test_getevents_timeout();
+    test_posix_aio();
+    bench_qd_scaling();
 
     std::cerr << "libaio tests PASSED\n";
     return 0;
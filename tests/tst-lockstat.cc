@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// Checks that lockstat accounts waits on a contended mutex, and only
+// while it is enabled.
+
+#include <osv/lockstat.hh>
+#include <osv/mutex.h>
+#include <osv/sched.hh>
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+static mutex test_mutex;
+
+static const lockstat::lock_stat* find(const std::vector<lockstat::lock_stat>& stats,
+                                       const void* lock)
+{
+    for (auto& s : stats) {
+        if (s.lock == lock) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+// Holds test_mutex for a while, and has another thread wait for it
+static void contend()
+{
+    std::atomic<bool> locked(false);
+    std::thread holder([&] {
+        WITH_LOCK(test_mutex) {
+            locked = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    });
+    while (!locked) {
+        sched::thread::yield();
+    }
+    WITH_LOCK(test_mutex) {
+    }
+    holder.join();
+}
+
+int main()
+{
+    std::cerr << "Running lockstat tests\n";
+
+    lockstat::reset();
+    lockstat::enable(false);
+    contend();
+    assert(!find(lockstat::get_stats(), &test_mutex));
+
+    lockstat::enable(true);
+    contend();
+    lockstat::enable(false);
+    auto stats = lockstat::get_stats();
+    auto s = find(stats, &test_mutex);
+    assert(s);
+    assert(s->type == lockstat::lock_type::mutex);
+    assert(s->contended >= 1);
+    assert(s->max_wait_ns >= 10000000);
+    assert(s->wait_ns >= s->max_wait_ns);
+    assert(s->holder_site);
+    assert(lockstat::name(&test_mutex).find("test_mutex") != std::string::npos);
+
+    std::ifstream f("/proc/lockstat");
+    std::stringstream contents;
+    contents << f.rdbuf();
+    assert(contents.str().find("test_mutex") != std::string::npos);
+
+    lockstat::reset();
+    assert(!find(lockstat::get_stats(), &test_mutex));
+
+    std::cerr << "lockstat tests PASSED\n";
+    return 0;
+}
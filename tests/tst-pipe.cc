@@ -14,6 +14,7 @@
 #include <string.h>
 #include <signal.h>
 
+#include <chrono>
 #include <string>
 #include <thread>
 #include <iostream>
@@ -101,14 +102,8 @@ int main(int ac, char** av)
 
 
     // test atomic writes.
-#ifdef __OSV__
-    // Assumes our af_local_buffer size is 8192 bytes -
-    // if this changes we need to change this test!
-#define PIPE_BUFFER_SIZE 8192
-#else
-    // The pipe buffer size since Linux 2.6.11 was dramatically increased to 64K.
+    // The default pipe buffer size, 64K both on OSv and on Linux (since 2.6.11)
 #define PIPE_BUFFER_SIZE 65536
-#endif
 #define TSTBUFSIZE PIPE_BUFFER_SIZE*3
     char *buf1 = (char *)calloc(1,TSTBUFSIZE);
     char *buf2 = (char *)calloc(1,TSTBUFSIZE);
@@ -255,9 +250,88 @@ int main(int ac, char** av)
     r = close(s[1]);
     report(r == 0, "close write side");
 
+    // test F_GETPIPE_SZ and F_SETPIPE_SZ
+    r = pipe(s);
+    report(r == 0, "pipe call");
+    r = fcntl(s[0], F_GETPIPE_SZ);
+    report(r == PIPE_BUFFER_SIZE, "F_GETPIPE_SZ gives the default size");
+    r = fcntl(s[1], F_SETPIPE_SZ, 1 << 20);
+    report(r == 1 << 20, "F_SETPIPE_SZ to 1MB");
+    r = fcntl(s[0], F_GETPIPE_SZ);
+    report(r == 1 << 20, "F_GETPIPE_SZ on the other end sees the new size");
+    r = fcntl(s[1], F_SETPIPE_SZ, 1000);
+    report(r >= 1000 && r < PIPE_BUFFER_SIZE, "F_SETPIPE_SZ rounds up small sizes");
+#ifdef __OSV__
+    // On Linux, root may go over /proc/sys/fs/pipe-max-size
+    r = fcntl(s[1], F_SETPIPE_SZ, 1 << 21);
+    report(r == -1 && errno == EPERM, "F_SETPIPE_SZ above the maximum");
+#endif
+    r = fcntl(s[1], F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+    report(r == PIPE_BUFFER_SIZE, "F_SETPIPE_SZ back to the default");
+    buf1 = (char*) calloc(1, PIPE_BUFFER_SIZE);
+    r = write(s[1], buf1, PIPE_BUFFER_SIZE / 2);
+    report(r == PIPE_BUFFER_SIZE / 2, "write half the pipe");
+    r = fcntl(s[1], F_SETPIPE_SZ, 4096);
+    report(r == -1 && errno == EBUSY, "F_SETPIPE_SZ below the buffered data");
+    r = fcntl(s[1], F_SETPIPE_SZ, 1 << 20);
+    report(r == 1 << 20, "F_SETPIPE_SZ grows a non-empty pipe");
+    r = read(s[0], buf1, PIPE_BUFFER_SIZE);
+    report(r == PIPE_BUFFER_SIZE / 2, "data survives resizing");
+    free(buf1);
+    close(s[0]);
+    close(s[1]);
+    int sp[2];
+    r = socketpair(AF_UNIX, SOCK_STREAM, 0, sp);
+    report(r == 0, "socketpair");
+    r = fcntl(sp[0], F_GETPIPE_SZ);
+    report(r == -1 && errno == EBADF, "F_GETPIPE_SZ on a socket");
+    close(sp[0]);
+    close(sp[1]);
+    int rf = open("/tmp/tst-pipe-file", O_CREAT | O_TRUNC | O_RDWR, 0644);
+    report(rf >= 0, "open a regular file");
+    r = fcntl(rf, F_GETPIPE_SZ);
+    report(r == -1 && errno == EBADF, "F_GETPIPE_SZ on a regular file");
+    r = fcntl(rf, F_SETPIPE_SZ, 1 << 20);
+    report(r == -1 && errno == EBADF, "F_SETPIPE_SZ on a regular file");
+    close(rf);
+    unlink("/tmp/tst-pipe-file");
+
+    // Throughput, for information only. A reader thread drains the pipe
+    // while we write with different write and pipe sizes.
+    for (int pipe_size : { PIPE_BUFFER_SIZE, 1 << 20 }) {
+        for (int chunk : { 4096, 65536 }) {
+            const long total = 256 << 20;
+            r = pipe(s);
+            fcntl(s[1], F_SETPIPE_SZ, pipe_size);
+            buf1 = (char*) calloc(1, chunk);
+            buf2 = (char*) calloc(1, chunk);
+            std::thread reader([&] {
+                while (read(s[0], buf2, chunk) > 0) {
+                }
+            });
+            auto start = std::chrono::steady_clock::now();
+            for (long done = 0; done < total; done += chunk) {
+                if (write(s[1], buf1, chunk) != chunk) {
+                    report(false, "throughput write");
+                    break;
+                }
+            }
+            close(s[1]);
+            reader.join();
+            std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+            std::cout << "pipe size " << pipe_size << ", " << chunk
+                      << " byte writes: " << int(total / sec.count() / (1 << 20))
+                      << " MB/s\n";
+            close(s[0]);
+            free(buf1);
+            free(buf2);
+        }
+    }
+
 
     std::vector<int> fds;
-    while (pipe(s) == 0) {
+    // The descriptor table grows on demand, so bound the loop ourselves
+    while (fds.size() < 20000 && pipe(s) == 0) {
         fds.push_back(s[0]);
         fds.push_back(s[1]);
     }
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// Checks the per-thread scheduler statistics under /proc/self/task, the
+// pressure stall files under /proc/pressure and /proc/meminfo.
+
+#include <cassert>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream f(path);
+    std::stringstream contents;
+    contents << f.rdbuf();
+    return contents.str();
+}
+
+struct schedstat {
+    unsigned long run_ns, runq_ns, switches, sleep_ns;
+};
+
+static schedstat read_schedstat(const std::string& path)
+{
+    schedstat s;
+    std::istringstream in(read_file(path));
+    in >> s.run_ns >> s.runq_ns >> s.switches >> s.sleep_ns;
+    assert(in);
+    return s;
+}
+
+static bool has_task(const std::string& tid)
+{
+    auto dir = opendir("/proc/self/task");
+    assert(dir);
+    bool found = false;
+    while (auto e = readdir(dir)) {
+        if (tid == e->d_name) {
+            found = true;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+int main()
+{
+    std::cerr << "Running procfs scheduler statistics tests\n";
+
+    auto tid = std::to_string(syscall(SYS_gettid));
+    assert(has_task(tid));
+    auto task = "/proc/self/task/" + tid;
+
+    auto stat = read_file(task + "/stat");
+    assert(stat.compare(0, tid.size() + 2, tid + " (") == 0);
+    assert(stat.find(") R ") != std::string::npos);
+
+    auto before = read_schedstat(task + "/schedstat");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto after = read_schedstat(task + "/schedstat");
+    assert(after.switches > before.switches);
+    assert(after.sleep_ns - before.sleep_ns >= 50000000);
+    assert(after.run_ns >= before.run_ns);
+
+    // A thread which is gone is no longer listed, once it has been reaped
+    std::string other_tid;
+    std::thread t([&] { other_tid = std::to_string(syscall(SYS_gettid)); });
+    t.join();
+    assert(!other_tid.empty());
+    for (int i = 0; i < 100 && has_task(other_tid); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert(!has_task(other_tid));
+    assert(access(("/proc/self/task/" + other_tid).c_str(), F_OK) != 0);
+
+    for (auto r : {"cpu", "memory", "io"}) {
+        auto p = read_file(std::string("/proc/pressure/") + r);
+        assert(p.compare(0, 11, "some avg10=") == 0);
+        assert(p.find(" total=") != std::string::npos);
+        assert(p.find("\nfull avg10=") != std::string::npos);
+    }
+
+    auto meminfo = read_file("/proc/meminfo");
+    for (auto field : {"MemTotal:", "MemFree:", "MemAvailable:", "Hugepagesize:"}) {
+        assert(meminfo.find(field) != std::string::npos);
+    }
+
+    std::cerr << "procfs scheduler statistics tests PASSED\n";
+    return 0;
+}
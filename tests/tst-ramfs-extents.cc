@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// Checks the contents of files whose data ramfs keeps in 4K and 2MB
+// extents: holes, truncation into and across a huge page, and reads and
+// writes that straddle a 2MB boundary. /tmp is ramfs on the test images.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static constexpr off_t MB = 1 << 20;
+static constexpr off_t huge = 2 * MB;
+
+static char pattern(off_t off, int gen)
+{
+    return static_cast<char>((off * 7 + off / 4096 + gen) & 0xff);
+}
+
+static void fill(std::vector<char>& buf, off_t off, int gen)
+{
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = pattern(off + i, gen);
+    }
+}
+
+static void write_at(int fd, off_t off, size_t len, int gen)
+{
+    std::vector<char> buf(len);
+    fill(buf, off, gen);
+    assert(pwrite(fd, buf.data(), len, off) == (ssize_t)len);
+}
+
+// gen < 0 expects zeroes
+static void check(int fd, off_t off, size_t len, int gen)
+{
+    std::vector<char> buf(len), expect(len, 0);
+    if (gen >= 0) {
+        fill(expect, off, gen);
+    }
+    assert(pread(fd, buf.data(), len, off) == (ssize_t)len);
+    assert(memcmp(buf.data(), expect.data(), len) == 0);
+}
+
+static off_t size(int fd)
+{
+    struct stat st;
+    assert(fstat(fd, &st) == 0);
+    return st.st_size;
+}
+
+static void test_holes(const char* path)
+{
+    std::cerr << "holes\n";
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    assert(fd >= 0);
+
+    // Sparse writes past EOF, one of them at a 2MB aligned offset
+    write_at(fd, 5 * MB + 100, 300, 1);
+    write_at(fd, 8 * MB, 4096, 1);
+    assert(size(fd) == 8 * MB + 4096);
+    check(fd, 0, 5 * MB + 100, -1);
+    check(fd, 5 * MB + 100, 300, 1);
+    check(fd, 5 * MB + 400, 3 * MB - 400, -1);
+    check(fd, 8 * MB, 4096, 1);
+
+    // Growing with ftruncate() leaves a hole too
+    assert(ftruncate(fd, 12 * MB) == 0);
+    check(fd, 8 * MB + 4096, 4 * MB - 4096, -1);
+
+    // Fill a hole in the middle, across a 2MB boundary
+    write_at(fd, huge - 1000, 3000, 2);
+    check(fd, huge - 2000, 1000, -1);
+    check(fd, huge - 1000, 3000, 2);
+    check(fd, huge + 2000, 1000, -1);
+
+    close(fd);
+    assert(unlink(path) == 0);
+}
+
+// Grows a file by appending, so its regions past the first 2MB may be
+// backed by huge pages.
+static int create_appended(const char* path, off_t len, int gen)
+{
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    assert(fd >= 0);
+    const size_t chunk = 64 * 1024;
+    std::vector<char> buf(chunk);
+    for (off_t off = 0; off < len; off += chunk) {
+        fill(buf, off, gen);
+        assert(write(fd, buf.data(), chunk) == (ssize_t)chunk);
+    }
+    assert(size(fd) == len);
+    return fd;
+}
+
+static void test_truncate(const char* path)
+{
+    std::cerr << "truncate into a huge page\n";
+    int fd = create_appended(path, 8 * MB, 3);
+    check(fd, 0, 8 * MB, 3);
+
+    // Cut in the middle of the 2MB region at 2MB, then grow back: what was
+    // cut must read back as zeroes, not as the old data
+    off_t cut = 3 * MB + 123;
+    assert(ftruncate(fd, cut) == 0);
+    assert(size(fd) == cut);
+    check(fd, 0, cut, 3);
+    char c;
+    assert(pread(fd, &c, 1, cut) == 0);
+    assert(ftruncate(fd, 8 * MB) == 0);
+    check(fd, cut, 8 * MB - cut, -1);
+    check(fd, 0, cut, 3);
+    close(fd);
+
+    std::cerr << "truncate across huge pages\n";
+    fd = create_appended(path, 8 * MB, 4);
+    assert(ftruncate(fd, MB + 5) == 0);
+    assert(size(fd) == MB + 5);
+    check(fd, 0, MB + 5, 4);
+    assert(ftruncate(fd, 6 * MB) == 0);
+    check(fd, MB + 5, 5 * MB - 5, -1);
+
+    // Appending after the shrink starts new extents
+    assert(lseek(fd, 0, SEEK_END) == 6 * MB);
+    std::vector<char> buf(huge);
+    fill(buf, 6 * MB, 5);
+    assert(write(fd, buf.data(), buf.size()) == (ssize_t)buf.size());
+    check(fd, 6 * MB, huge, 5);
+    check(fd, MB + 5, 5 * MB - 5, -1);
+
+    close(fd);
+    assert(unlink(path) == 0);
+}
+
+static void test_boundary(const char* path)
+{
+    std::cerr << "read after write across a 2MB boundary\n";
+    int fd = create_appended(path, 6 * MB, 6);
+
+    for (off_t b = huge; b < 6 * MB; b += huge) {
+        // Reads straddling the boundary
+        check(fd, b - 1, 2, 6);
+        check(fd, b - 4096, 8192, 6);
+        // Overwrites straddling it, each read back right away
+        write_at(fd, b - 10, 20, 7);
+        check(fd, b - 10, 20, 7);
+        check(fd, b - 4096, 4086, 6);
+        check(fd, b + 10, 4086, 6);
+        write_at(fd, b - 100000, 200000, 8);
+        check(fd, b - 100000, 200000, 8);
+    }
+
+    // The same data through mmap(), which is served by the page cache
+    auto p = static_cast<char*>(mmap(nullptr, 6 * MB, PROT_READ, MAP_PRIVATE, fd, 0));
+    assert(p != MAP_FAILED);
+    std::vector<char> buf(6 * MB);
+    assert(pread(fd, buf.data(), buf.size(), 0) == (ssize_t)buf.size());
+    assert(memcmp(p, buf.data(), buf.size()) == 0);
+    munmap(p, 6 * MB);
+
+    close(fd);
+    assert(unlink(path) == 0);
+}
+
+int main()
+{
+    std::cerr << "Running ramfs extent tests\n";
+    const char* path = "/tmp/tst-ramfs-extents";
+    test_holes(path);
+    test_truncate(path);
+    test_boundary(path);
+    std::cerr << "ramfs extent tests passed\n";
+    return 0;
+}
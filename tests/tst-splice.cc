@@ -109,10 +109,44 @@ int main()
     read_all(pfd[0], vbuf, strlen(msg));
     assert(memcmp(vbuf, msg, strlen(msg)) == 0);
 
-    // tee is not supported (needs non-consuming pipe peek) -> ENOSYS, honestly.
+    // splice pipe -> pipe moves the data, including whole pages.
+    int qfd[2];
+    assert(pipe(qfd) == 0);
+    write_all(pfd[1], data.data(), 3 * 4096 + 100);
+    size_t spliced = 0;
+    while (spliced < 3 * 4096 + 100) {
+        ssize_t s = splice(pfd[0], nullptr, qfd[1], nullptr, 3 * 4096 + 100 - spliced, 0);
+        assert(s > 0);
+        spliced += s;
+    }
+    std::string pbuf(3 * 4096 + 100, 0);
+    read_all(qfd[0], &pbuf[0], pbuf.size());
+    assert(memcmp(pbuf.data(), data.data(), pbuf.size()) == 0);
+
+    // tee copies between pipes without consuming the source.
+    write_all(pfd[1], msg, strlen(msg));
+    ssize_t t = tee(pfd[0], qfd[1], strlen(msg), 0);
+    assert(t == (ssize_t)strlen(msg));
+    memset(vbuf, 0, sizeof(vbuf));
+    read_all(qfd[0], vbuf, strlen(msg));
+    assert(memcmp(vbuf, msg, strlen(msg)) == 0);
+    memset(vbuf, 0, sizeof(vbuf));
+    read_all(pfd[0], vbuf, strlen(msg));
+    assert(memcmp(vbuf, msg, strlen(msg)) == 0);
+
+    // tee on an empty pipe with SPLICE_F_NONBLOCK -> EAGAIN.
+    errno = 0;
+    assert(tee(pfd[0], qfd[1], 10, SPLICE_F_NONBLOCK) == -1 && errno == EAGAIN);
+
+    // tee from a pipe to itself -> EINVAL.
+    errno = 0;
+    assert(tee(pfd[0], pfd[1], 10, 0) == -1 && errno == EINVAL);
+
+    // tee needs pipes at both ends -> EINVAL.
     errno = 0;
-    assert(tee(pfd[0], pfd[1], 10, 0) == -1 && errno == ENOSYS);
+    assert(tee(sfd, qfd[1], 10, 0) == -1 && errno == EINVAL);
 
+    close(qfd[0]); close(qfd[1]);
     close(pfd[0]); close(pfd[1]); close(sfd); close(dfd);
     unlink(src); unlink(dst);
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// Checks TCP pacing over loopback. SO_MAX_PACING_RATE stands in for a
+// bottleneck link: a bulk transfer capped by it must take about as long as
+// the link would, with both the default congestion control and BBR.
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+static constexpr unsigned short port = 7799;
+
+using clk = std::chrono::steady_clock;
+
+static sockaddr_in loopback()
+{
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sa;
+}
+
+static int listener()
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(s >= 0);
+    int one = 1;
+    assert(setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0);
+    auto sa = loopback();
+    assert(bind(s, (sockaddr*)&sa, sizeof(sa)) == 0);
+    assert(listen(s, 1) == 0);
+    return s;
+}
+
+static void test_sockopt()
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(s >= 0);
+    uint64_t rate64 = 0;
+    socklen_t len = sizeof(rate64);
+    assert(getsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate64, &len) == 0);
+    assert(len == sizeof(rate64) && rate64 == ~0ull);
+
+    uint32_t rate32 = 123456;
+    assert(setsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate32, sizeof(rate32)) == 0);
+    rate32 = 0;
+    len = sizeof(rate32);
+    assert(getsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate32, &len) == 0);
+    assert(rate32 == 123456);
+
+    rate64 = 10ull << 32;
+    assert(setsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate64, sizeof(rate64)) == 0);
+    len = sizeof(rate32);
+    assert(getsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate32, &len) == 0);
+    assert(rate32 == ~0u);
+    close(s);
+}
+
+// Sends size bytes from a socket paced at rate (0 for none) using the
+// congestion control cc, and returns the throughput seen by the receiver,
+// in bytes per second
+static double transfer(int ls, const char* cc, uint64_t rate, size_t size)
+{
+    std::vector<char> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = i % 251;
+    }
+    double secs = 0;
+    std::thread receiver([&] {
+        int s = accept(ls, nullptr, nullptr);
+        assert(s >= 0);
+        std::vector<char> buf(65536);
+        size_t got = 0;
+        auto start = clk::now();
+        for (;;) {
+            auto r = read(s, buf.data(), buf.size());
+            assert(r >= 0);
+            if (r == 0) {
+                break;
+            }
+            for (ssize_t i = 0; i < r; i++) {
+                assert(buf[i] == data[got + i]);
+            }
+            got += r;
+        }
+        secs = std::chrono::duration<double>(clk::now() - start).count();
+        assert(got == size);
+        close(s);
+    });
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(s >= 0);
+    if (cc) {
+        assert(setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, cc, strlen(cc)) == 0);
+        char name[16] = {};
+        socklen_t len = sizeof(name);
+        assert(getsockopt(s, IPPROTO_TCP, TCP_CONGESTION, name, &len) == 0);
+        assert(strcmp(name, cc) == 0);
+    }
+    if (rate) {
+        assert(setsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0);
+    }
+    auto sa = loopback();
+    assert(connect(s, (sockaddr*)&sa, sizeof(sa)) == 0);
+    size_t off = 0;
+    while (off < size) {
+        auto w = write(s, data.data() + off, size - off);
+        assert(w > 0);
+        off += w;
+    }
+    close(s);
+    receiver.join();
+    return size / secs;
+}
+
+static void test_paced(int ls, const char* cc)
+{
+    constexpr uint64_t rate = 4 << 20;
+    constexpr size_t size = 2 << 20;
+    auto bw = transfer(ls, cc, rate, size);
+    std::cerr << (cc ? cc : "default") << " capped at " << rate
+              << " B/s: " << (uint64_t)bw << " B/s\n";
+    // Slack for the pacing timer and the headers counted against the rate
+    assert(bw <= rate * 1.2);
+    assert(bw >= rate * 0.5);
+}
+
+int main()
+{
+    std::cerr << "Running TCP pacing tests\n";
+
+    test_sockopt();
+
+    int ls = listener();
+    test_paced(ls, nullptr);
+    test_paced(ls, "bbr");
+
+    // Unpaced BBR has to get data across intact, and quickly
+    auto bw = transfer(ls, "bbr", 0, 32 << 20);
+    std::cerr << "bbr unpaced: " << (uint64_t)bw << " B/s\n";
+    assert(bw > (16 << 20));
+
+    close(ls);
+    std::cerr << "TCP pacing tests PASSED\n";
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2026 OSv Authors
+ *
+ * This work is open source software, licensed under the terms of the
+ * BSD license as described in the LICENSE file in the top-level directory.
+ */
+
+// Checks batched UDP I/O over loopback: sendmmsg()/recvmmsg(), sending a
+// run of datagrams with UDP_SEGMENT and receiving them coalesced with UDP_GRO.
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+static constexpr unsigned short port = 7788;
+
+static sockaddr_in loopback(unsigned short p)
+{
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(p);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sa;
+}
+
+static std::vector<char> pattern(size_t len, char seed)
+{
+    std::vector<char> v(len);
+    for (size_t i = 0; i < len; i++) {
+        v[i] = seed + i % 61;
+    }
+    return v;
+}
+
+// Loopback hands datagrams over asynchronously, so give them time to be
+// queued on the receiving socket
+static void settle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+static void test_mmsg(int snd, int rcv)
+{
+    constexpr unsigned n = 4;
+    std::vector<char> bufs[n];
+    iovec iov[n];
+    mmsghdr msgs[n] = {};
+    for (unsigned i = 0; i < n; i++) {
+        bufs[i] = pattern(100 * (i + 1), 'a' + i);
+        iov[i] = { bufs[i].data(), bufs[i].size() };
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    assert(sendmmsg(snd, msgs, n, 0) == n);
+    for (unsigned i = 0; i < n; i++) {
+        assert(msgs[i].msg_len == bufs[i].size());
+    }
+
+    char rbufs[n + 2][1000];
+    iovec riov[n + 2];
+    sockaddr_in from[n + 2];
+    mmsghdr rmsgs[n + 2] = {};
+    for (unsigned i = 0; i < n + 2; i++) {
+        riov[i] = { rbufs[i], sizeof(rbufs[i]) };
+        rmsgs[i].msg_hdr.msg_iov = &riov[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1;
+        rmsgs[i].msg_hdr.msg_name = &from[i];
+        rmsgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+    unsigned got = 0;
+    while (got < n) {
+        int r = recvmmsg(rcv, rmsgs + got, n + 2 - got, MSG_WAITFORONE, nullptr);
+        assert(r > 0);
+        got += r;
+    }
+    assert(got == n);
+    for (unsigned i = 0; i < n; i++) {
+        assert(rmsgs[i].msg_len == bufs[i].size());
+        assert(memcmp(rbufs[i], bufs[i].data(), bufs[i].size()) == 0);
+        assert(rmsgs[i].msg_hdr.msg_namelen == sizeof(sockaddr_in));
+        assert(from[i].sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    }
+
+    // Nothing left, and with nothing received there is no count to return
+    assert(recvmmsg(rcv, rmsgs, 1, MSG_DONTWAIT, nullptr) == -1);
+    assert(errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void expect_datagram(int rcv, const char* data, size_t len)
+{
+    char buf[2000];
+    assert(recv(rcv, buf, sizeof(buf), 0) == (ssize_t)len);
+    assert(memcmp(buf, data, len) == 0);
+}
+
+static void test_segment(int snd, int rcv)
+{
+    constexpr int segsz = 1000;
+    auto data = pattern(4500, 'A');
+
+    int v = segsz;
+    assert(setsockopt(snd, IPPROTO_UDP, UDP_SEGMENT, &v, sizeof(v)) == 0);
+    socklen_t vlen = sizeof(v);
+    v = 0;
+    assert(getsockopt(snd, IPPROTO_UDP, UDP_SEGMENT, &v, &vlen) == 0);
+    assert(v == segsz);
+
+    assert(send(snd, data.data(), data.size(), 0) == (ssize_t)data.size());
+    for (size_t off = 0; off < data.size(); off += segsz) {
+        expect_datagram(rcv, data.data() + off,
+                        std::min<size_t>(segsz, data.size() - off));
+    }
+
+    // A size given with the send overrides the socket's
+    v = 0;
+    assert(setsockopt(snd, IPPROTO_UDP, UDP_SEGMENT, &v, sizeof(v)) == 0);
+    char cbuf[CMSG_SPACE(sizeof(uint16_t))] = {};
+    iovec iov = { data.data(), 1200 };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    auto cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = IPPROTO_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *(uint16_t*)CMSG_DATA(cm) = 500;
+    assert(sendmsg(snd, &msg, 0) == 1200);
+    expect_datagram(rcv, data.data(), 500);
+    expect_datagram(rcv, data.data() + 500, 500);
+    expect_datagram(rcv, data.data() + 1000, 200);
+
+    // Too many segments for one send
+    *(uint16_t*)CMSG_DATA(cm) = 10;
+    assert(sendmsg(snd, &msg, 0) == -1 && errno == EINVAL);
+}
+
+static void test_gro(int snd, int rcv)
+{
+    constexpr int segsz = 1000;
+    auto data = pattern(4300, '0');
+
+    int v = 1;
+    assert(setsockopt(rcv, IPPROTO_UDP, UDP_GRO, &v, sizeof(v)) == 0);
+    v = segsz;
+    assert(setsockopt(snd, IPPROTO_UDP, UDP_SEGMENT, &v, sizeof(v)) == 0);
+    assert(send(snd, data.data(), data.size(), 0) == (ssize_t)data.size());
+    settle();
+
+    std::vector<char> buf(65536);
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    iovec iov = { buf.data(), buf.size() };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    assert(recvmsg(rcv, &msg, 0) == (ssize_t)data.size());
+    assert(memcmp(buf.data(), data.data(), data.size()) == 0);
+    auto cm = CMSG_FIRSTHDR(&msg);
+    assert(cm);
+    assert(cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO);
+    assert(*(int*)CMSG_DATA(cm) == segsz);
+
+    // A short buffer stops the coalescing at a datagram boundary
+    assert(send(snd, data.data(), data.size(), 0) == (ssize_t)data.size());
+    settle();
+    iov.iov_len = 2500;
+    msg.msg_controllen = sizeof(cbuf);
+    assert(recvmsg(rcv, &msg, 0) == 2000);
+    iov.iov_len = buf.size();
+    msg.msg_controllen = sizeof(cbuf);
+    assert(recvmsg(rcv, &msg, 0) == 2300);
+
+    v = 0;
+    assert(setsockopt(rcv, IPPROTO_UDP, UDP_GRO, &v, sizeof(v)) == 0);
+    assert(setsockopt(snd, IPPROTO_UDP, UDP_SEGMENT, &v, sizeof(v)) == 0);
+}
+
+int main()
+{
+    std::cerr << "Running UDP batching tests\n";
+
+    int rcv = socket(AF_INET, SOCK_DGRAM, 0);
+    int snd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(rcv >= 0 && snd >= 0);
+    auto sa = loopback(port);
+    assert(bind(rcv, (sockaddr*)&sa, sizeof(sa)) == 0);
+    assert(connect(snd, (sockaddr*)&sa, sizeof(sa)) == 0);
+    int bufsz = 256 * 1024;
+    assert(setsockopt(snd, SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz)) == 0);
+    assert(setsockopt(rcv, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz)) == 0);
+
+    test_mmsg(snd, rcv);
+    test_segment(snd, rcv);
+    test_gro(snd, rcv);
+
+    close(snd);
+    close(rcv);
+    std::cerr << "UDP batching tests PASSED\n";
+    return 0;
+}